@@ -6,7 +6,6 @@
 #include <sstream>
 
 #include "readers.hpp"
-#include "dump_reader_lammps_bin.hpp"
 #include "my_timer.hpp"
 #include "util.hpp"
 #include "writers.hpp"
@@ -36,6 +35,17 @@ void print_dump_info(std::string dump_file, int file_format,
 	                                                 file_format,
 	                                                 DUMP_FORMAT_LAMMPS));
 	dr->set_column_headers(headers);
+	if (const frame_index *index = dr->get_frame_index()) {
+		std::cout << "Dump file:         " << dump_file << "\n";
+		std::cout << "Number of frames:  " << index->size() << "\n";
+		if (index->size() > 0) {
+			std::cout << "Time steps:        "
+			          << (*index)[0].tstep << " to "
+			          << index->frames.back().tstep << "\n";
+		}
+		return;
+	}
+
 	int n_frames = 0;
 	block_data b;
 	my_timer timer;
@@ -184,32 +194,25 @@ int main(int argc, char **argv)
 	                                                 DUMP_FORMAT_LAMMPS));
 	dr->set_column_headers(headers);
 
-	if (file_format == FILE_FORMAT_BIN) {
-		int cur_frame = 0;
-		int j = 0;
-		block_data b;
-
-		dump_reader_lammps_bin *d =
-			dynamic_cast<dump_reader_lammps_bin*>(dr.get());
-
+	block_data b;
+	if (dr->get_frame_index()) {
 		for (int next_frame : frames) {
-			std::cerr << "Skipping to frame " << next_frame << " from "
-				  << cur_frame << "\n";
-			d->skip_to_block(next_frame, cur_frame);
-			if (d->next_block(b)) {
+			std::cerr << "Seeking to frame " << next_frame << "\n";
+			if (next_frame < 0 || dr->seek_to_frame(next_frame)) {
+				std::cerr << "Cannot seek to frame "
+				          << next_frame << "!\n";
+				return -1;
+			}
+			if (dr->next_block(b)) {
 				std::cerr << "Error reading block "
 				          << next_frame << "!\n";
 				return -1;
 			}
 			std::cerr << "Read block at t=" << b.tstep << "\n";
 			block_to_lammps_dump(std::cout, b, file_format);
-			cur_frame = next_frame;
 		}
-
-		
 	} else {
 		int n_frames = 0;
-		block_data b;
 		while (dr->next_block(b) == 0) {
 			if (util::contains(frames, n_frames)) {
 				block_to_lammps_dump(std::cout, b, file_format);
@@ -217,7 +220,6 @@ int main(int argc, char **argv)
 			++n_frames;
 		}
 	}
-		
-	
+
 	return 0;
 }
@@ -13,6 +13,7 @@
 #include "block_data_access.hpp"
 #include "cluster_finder.hpp"
 #include "dump_reader.hpp"
+#include "frame_parallel.hpp"
 #include "neighborize.hpp"
 
 #include <iomanip>
@@ -109,17 +110,90 @@ block_data filter_block( const block_data &b )
 
 
 
-void analyze_dump( readers::dump_reader *d, std::vector<int> sizes,
-                   double dt, double rc, std::ostream &out,
-                   uint64_t start_frame, int output_format )
+/// Cluster size counts of a single block.
+struct block_population
 {
-	block_data b, b2;
+	bigint tstep;
+	std::vector<int> counts;
+	int max_size;
+};
 
-	int bc = 0;
+
+block_population block_to_population( const block_data &b2,
+                                      const std::map<int, int> &size2count,
+                                      double rc )
+{
+	block_data b;
+	if (do_filter) {
+		b = filter_block(b2);
+	} else {
+		b = b2;
+	}
+	b.dom.periodic = 7;
 
 	std::vector<int> type_i = { 3 , 5, 7 };
 	std::vector<int> type_j = { 4 , 6, 8 };
 
+	/*
+	  Analysis scheme:
+
+	  1. Construct molecular network.
+	  2. Count clusters.
+	  3. Make distribution of clusters sizes.
+	*/
+	const std::vector<int> &types = get_type( b );
+	std::vector<int> ilist, jlist;
+
+	for( std::size_t idx = 0; idx < b.N; ++idx ){
+		int ttype = types[idx];
+
+		if( ttype == type_i[0] ||
+		    ttype == type_i[1] ||
+		    ttype == type_i[2] ){
+			ilist.push_back(idx);
+		}
+		if( ttype == type_j[0] ||
+		    ttype == type_j[1] ||
+		    ttype == type_j[2] ){
+			jlist.push_back(idx);
+		}
+	}
+
+	neigh_list nl;
+	make_list_dist_indexed( nl, b, ilist, jlist, DIST_BIN, 3, rc );
+
+	// Step 1:  Construct a list of molecular clusters
+	auto mol_nlist = get_molecular_connections( b, nl, false );
+
+	// Step 2:  Now we need to convert the molecular connections
+	//          to actual clusters.
+	auto mol_clusters = neigh_list_to_clusters( mol_nlist );
+
+	// Step 3: Make distribution:
+	block_population pop;
+	pop.tstep = b.tstep;
+	pop.counts.resize( size2count.size(), 0 );
+	pop.max_size = 0;
+	for( const auto &mneighs : mol_clusters ){
+		int size = mneighs.size();
+		if( size > pop.max_size ) pop.max_size = size;
+
+		auto it = size2count.find( size );
+		if( it != size2count.end() ){
+			++pop.counts[ it->second ];
+		}
+	}
+	return pop;
+}
+
+
+int analyze_dump( const readers::dump_reader_factory &open,
+                  std::vector<int> sizes, double dt, double rc,
+                  std::ostream &out, uint64_t start_frame,
+                  int output_format, int n_threads )
+{
+	int bc = 0;
+
 	std::map< int, int > size2count;
 	int idx = 0;
 	for( int s : sizes ){
@@ -138,90 +212,33 @@ void analyze_dump( readers::dump_reader *d, std::vector<int> sizes,
 			dump_header_gnuplot( out );
 	}
 
-
-	while( d->next_block( b2 ) == 0 ){
-		if (do_filter) {
-			b = filter_block(b2);
-		} else {
-			b = b2;
-		}
-		b.dom.periodic = 7;
-		double time = b.tstep * dt;
+	// The populations are computed on all threads, but only
+	// written here, in order.
+	auto count = [&size2count, rc]( const block_data &b ){
+		return block_to_population( b, size2count, rc );
+	};
+	auto write = [&]( const block_population &pop ){
+		double time = pop.tstep * dt;
 		// std::cerr << "time = " << time << ", old_time = " << old_t << "\n";
 		if( (bc != 0) && (time <= old_t) ){
 			// This means there was two trajectories
 			// in the dump file.
 			std::cerr << "Got block with mismatched time! "
 			          << "Ignoring frame " << bc << " (t = "
-			          << b.tstep << ")!\n";
+			          << pop.tstep << ")!\n";
 			++bc;
-			continue;
-		}
-
-		const std::vector<int> &mols = get_mol( b );
-		const std::vector<int> &types = get_type( b );
-
-		int nmols = *std::max_element( mols.begin(), mols.end() );
-		int atoms_per_mol = b.N / nmols;
-		int target_atom = 25180;
-		int target_mol = target_atom / atoms_per_mol;
-
-		/*
-		  Analysis scheme:
-
-		  1. Construct molecular network.
-		  2. Count clusters.
-		  3. Make distribution of clusters sizes.
-		*/
-		std::vector<int> ilist, jlist;
-
-		for( std::size_t idx = 0; idx < b.N; ++idx ){
-			int ttype = types[idx];
-
-			if( ttype == type_i[0] ||
-			    ttype == type_i[1] ||
-			    ttype == type_i[2] ){
-				ilist.push_back(idx);
-			}
-			if( ttype == type_j[0] ||
-			    ttype == type_j[1] ||
-			    ttype == type_j[2] ){
-				jlist.push_back(idx);
-			}
-		}
-
-		double scale_factor = static_cast<double>(b.N) / nmols;
-		neigh_list nl;
-		double avg_neighs = make_list_dist_indexed( nl, b, ilist, jlist,
-		                                            DIST_BIN, 3, rc );
-
-		// Step 1:  Construct a list of molecular clusters
-		auto mol_nlist = get_molecular_connections( b, nl, false );
-
-		// Step 2:  Now we need to convert the molecular connections
-		//          to actual clusters.
-		auto mol_clusters = neigh_list_to_clusters( mol_nlist );
-
-		// Step 3: Make distribution:
-		std::vector<int> counts( sizes.size(), 0 );
-		int max_size = 0;
-		for( const auto &mneighs : mol_clusters ){
-			int size = mneighs.size();
-			if( size > max_size ) max_size = size;
-
-			if( size2count.count( size ) ){
-				++counts[ size2count[ size ] ];
-			}
+			return;
 		}
 
 		switch( output_format ){
 			default:
 			case GNUPLOT:
 				dump_population_gnuplot( out, time,
-				                         sizes, counts );
+				                         sizes, pop.counts );
 				break;
 			case OLD:
-				dump_population( out, time, counts, max_size );
+				dump_population( out, time, pop.counts,
+				                 pop.max_size );
 				break;
 		}
 
@@ -231,9 +248,17 @@ void analyze_dump( readers::dump_reader *d, std::vector<int> sizes,
 		if( bc % 50 == 0 ){
 			std::cerr << "  At block " << bc << "...\n";
 		}
-
+	};
+
+	int status = readers::map_frames( open, count, write, n_threads,
+	                                  start_frame );
+	if( status < 0 ){
+		std::cerr << "Failed to read dump file after " << bc
+		          << " blocks!\n";
+		return status;
 	}
 	std::cerr << "Done with analysis on " << bc << " blocks!\n";
+	return 0;
 }
 
 
@@ -257,6 +282,7 @@ int main( int argc, char **argv )
 	bool dump_all_sizes = false;
 	int max_capsid_size = 80;
 	int output_format = OLD;
+	int n_threads = 0;
 
 
 	if( argc < 2 ){
@@ -282,6 +308,8 @@ int main( int argc, char **argv )
 		["--output-format"]( "Output format." )
 		| clara::Opt( max_capsid_size, "max_capsid_size" )
 		["-m"]["--max-capsid-size"]( "Largest capsid size to dump" )
+		| clara::Opt( n_threads, "n_threads" )
+		["-n"]["--n-threads"]( "Threads to analyse on (0 for all cores)" )
 		| clara::Opt( out_fname, "output" )
 		["-o"]["--output"]( "Output file name (\"-\" for stdout)" );
 
@@ -314,7 +342,8 @@ int main( int argc, char **argv )
 	          << "    Cut-off:       " << rc << "\n"
 	          << "    Output file:   " << out_fname << "\n"
 	          << "    Output format: " << dump_format_str << "\n"
-	          << "    Start-frame:   " << start_frame << "\n\n";
+	          << "    Start-frame:   " << start_frame << "\n"
+	          << "    Threads:       " << n_threads << "\n\n";
 
 	int fformat = FILE_FORMAT_PLAIN;
 	int dformat = DUMP_FORMAT_LAMMPS;
@@ -351,8 +380,9 @@ int main( int argc, char **argv )
 
 	double dt = 0.0025;
 
-	std::unique_ptr<readers::dump_reader> d(
-		readers::make_dump_reader( dump_name, fformat, dformat ) );
+	auto open = [&dump_name, fformat, dformat](){
+		return readers::make_dump_reader( dump_name, fformat, dformat );
+	};
 
 	// Interesting sizes:
 	std::vector<int> sizes = { 1, 2, 3, 5, 20, 60, 80, 8, 10, 12, 15, 18, 19 };
@@ -363,9 +393,11 @@ int main( int argc, char **argv )
 		}
 	}
 
-	analyze_dump( d.get(), sizes, dt, rc, *out, start_frame, output_format );
-
-
+	int status = analyze_dump( open, sizes, dt, rc, *out, start_frame,
+	                           output_format, n_threads );
+	if( status < 0 ){
+		return -1;
+	}
 
 	return 0;
 }
@@ -4,6 +4,7 @@
 #include <list>
 #include <memory>
 #include <string>
+#include <utility>
 
 #include "cluster_finder.hpp"
 #include "dump_reader_lammps.hpp"
@@ -65,11 +66,9 @@ void skeletonize_blocks( readers::dump_reader_lammps *d,
 		int dims = 3;
 
 		// Remove some fields:
-		data_field *df;
 		for( const std::string &n : remove_these ){
 			int special_field = block_data::UNKNOWN;
-			df = b.remove_field( n, special_field );
-			delete df;
+			b.take_field( n, special_field );
 		}
 
 		// Construct the Euclidian distance transform:
@@ -108,7 +107,7 @@ void skeletonize_blocks( readers::dump_reader_lammps *d,
 		diams.push_back( diameter );
 
 		// Write to dump file:
-		b.add_field( edt );
+		b.add_field( std::move( edt ) );
 		writers::block_to_lammps_dump( out, b, fformat );
 
 		if( block_count > 0 && (block_count % 25 == 0) ){
@@ -234,27 +234,23 @@ void lt_block_data_print_stats( lt_block_data_handle *bdh )
 void lt_block_data_remove_field( lt_block_data_handle *bdh, const char *name )
 {
 	int spec_type = lammps_tools::block_data::UNKNOWN;
-	lammps_tools::data_field *df = bdh->bd->remove_field( name, spec_type );
-	if( !df ){
+	if( !bdh->bd->take_field( name, spec_type ) ){
 		std::cerr << "Warning: Data field named " << name
 		          << " could not be found!\n";
-		return;
 	}
-	delete df;
 }
 
 void lt_block_data_swap_fields( lt_block_data_handle *bdh, const char *name,
                                 const lt_data_field_handle *new_df )
 {
 	int spec_type = lammps_tools::block_data::special_fields::UNKNOWN;
-	lammps_tools::data_field *df = bdh->bd->remove_field( name, spec_type );
+	bdh->bd->take_field( name, spec_type );
 
 	if( spec_type != lammps_tools::block_data::special_fields::UNKNOWN ){
 		lt_block_data_add_special_field( bdh, new_df, spec_type );
 	}else{
 		lt_block_data_add_data_field( bdh, new_df );
 	}
-	delete df;
 }
 
 const std::vector<double>
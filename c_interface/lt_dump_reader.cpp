@@ -141,6 +141,45 @@ int lt_number_of_blocks( lt_dump_reader_handle drh )
 }
 
 
+int lt_number_of_frames( lt_dump_reader_handle drh )
+{
+	try{
+		const lammps_tools::readers::frame_index *index =
+			drh.dr->get_frame_index();
+		return index ? index->size() : -1;
+	}catch( std::runtime_error &e ){
+		std::cerr << "Error occured in lt_number_of_frames! "
+		          << e.what() << "\n";
+		return -1;
+	}
+}
+
+
+int lt_seek_to_frame( lt_dump_reader_handle drh, int k )
+{
+	if( k < 0 ) return 1;
+	try{
+		return drh.dr->seek_to_frame( k );
+	}catch( std::runtime_error &e ){
+		std::cerr << "Error occured in lt_seek_to_frame! "
+		          << e.what() << "\n";
+		return -1;
+	}
+}
+
+
+int lt_seek_to_timestep( lt_dump_reader_handle drh, lammps_tools::bigint tstep )
+{
+	try{
+		return drh.dr->seek_to_timestep( tstep );
+	}catch( std::runtime_error &e ){
+		std::cerr << "Error occured in lt_seek_to_timestep! "
+		          << e.what() << "\n";
+		return -1;
+	}
+}
+
+
 int lt_set_col_header( lt_dump_reader_handle drh, int n, const char *header )
 {
 	using lammps_tools::readers::dump_reader_lammps;
@@ -115,6 +115,44 @@ int lt_get_next_block( lt_dump_reader_handle drh, lt_block_data_handle *bdh );
 int lt_number_of_blocks( lt_dump_reader_handle drh );
 
 
+/**
+   \brief Counts the number of frames in the dump file, without reading them.
+
+   Uses the frame index, so unlike lt_number_of_blocks this leaves the
+   dump reader where it was.
+
+   \param[in] drh The lt_dump_reader_handle to check.
+
+   \returns the number of frames, or -1 if this dump reader cannot seek.
+*/
+int lt_number_of_frames( lt_dump_reader_handle drh );
+
+
+/**
+   \brief Moves the dump reader so that the next block read is frame k.
+
+   \param drh  The lt_dump_reader_handle to move.
+   \param k    Index of the frame to read next, counting from 0.
+
+   \returns 0 on success, positive if there is no frame k, negative
+            if the dump reader cannot seek.
+*/
+int lt_seek_to_frame( lt_dump_reader_handle drh, int k );
+
+
+/**
+   \brief Moves the dump reader so that the next block read is the
+   first one with given time step.
+
+   \param drh    The lt_dump_reader_handle to move.
+   \param tstep  The time step to read next.
+
+   \returns 0 on success, positive if there is no such frame, negative
+            if the dump reader cannot seek.
+*/
+int lt_seek_to_timestep( lt_dump_reader_handle drh, lammps_tools::bigint tstep );
+
+
 /**
    \brief Sets the column headers that some dump formats expect for dump reader.
 
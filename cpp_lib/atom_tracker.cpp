@@ -0,0 +1,119 @@
+#include "atom_tracker.hpp"
+#include "block_data_access.hpp"
+#include "id_map.hpp"
+#include "my_assert.hpp"
+
+#include <algorithm>
+#include <string>
+
+
+namespace lammps_tools {
+
+atom_tracker::atom_tracker( int dims, const std::vector<int> &ids )
+	: dims( dims ), frames( 0 ), t0( 0 ), dt( 0 ), had_images( false ),
+	  slot_ids( ids ), last_ids(), index_of(), current(), wrapped(),
+	  offset()
+{
+	my_assert( __FILE__, __LINE__, dims == 2 || dims == 3,
+	           "Dimensions have to be 2 or 3!" );
+}
+
+
+void atom_tracker::add_frame( const block_data &b )
+{
+	if( frames == 0 ){
+		t0 = b.tstep;
+		if( slot_ids.empty() ) slot_ids = get_id( b );
+	}else if( frames == 1 ){
+		dt = b.tstep - t0;
+		my_assert( __FILE__, __LINE__, dt > 0,
+		           "Time steps of frames have to increase!" );
+	}else{
+		my_assert( __FILE__, __LINE__, b.tstep - t0 == frames * dt,
+		           "Frames are not evenly spaced in time!" );
+	}
+
+	const std::vector<int> &id = get_id( b );
+	std::size_t N = slot_ids.size();
+	if( id != last_ids ){
+		id_map im( id );
+		index_of.resize( N );
+		for( std::size_t s = 0; s < N; ++s ){
+			std::size_t atom_id = slot_ids[s];
+			int i = atom_id < im.size() ? im[atom_id] : -1;
+			if( i < 0 || id[i] != slot_ids[s] ){
+				my_runtime_error( __FILE__, __LINE__,
+				                  "Atom with id " + std::to_string( atom_id )
+				                  + " is missing from frame!" );
+			}
+			index_of[s] = i;
+		}
+		last_ids = id;
+	}
+
+	const std::vector<double> &x = get_x( b );
+	const std::vector<double> &y = get_y( b );
+	const std::vector<double> &z = get_z( b );
+	bool images = b.get_special_field( block_data::IX )
+		&& b.get_special_field( block_data::IY )
+		&& ( dims == 2 || b.get_special_field( block_data::IZ ) );
+	const std::vector<int> *ix = images ? &get_ix( b ) : nullptr;
+	const std::vector<int> *iy = images ? &get_iy( b ) : nullptr;
+	const std::vector<int> *iz = images && dims == 3 ? &get_iz( b ) : nullptr;
+	bool first = frames == 0;
+	// On the first frame with flags after frames without them, the
+	// atoms are followed as before, and the difference with the
+	// positions from the flags is kept for the frames after it.
+	bool switched = images && !first && !had_images;
+	if( switched ) offset.assign( N * dims, 0.0 );
+	had_images = images;
+	current.resize( N * dims );
+	++frames;
+
+	// Without image flags, add the displacement since the last frame.
+	// The wrapped positions are kept either way, in case later frames
+	// do not have the flags.
+	wrapped.resize( N * dims );
+	for( std::size_t s = 0; s < N; ++s ){
+		int i = index_of[s];
+		double xi[3] = { x[i], y[i], dims == 3 ? z[i] : 0.0 };
+		double *u = current.data() + s*dims;
+		double *w = wrapped.data() + s*dims;
+		if( !images || switched ){
+			if( first ){
+				std::copy( xi, xi + dims, u );
+			}else{
+				double x0[3] = { w[0], w[1], dims == 3 ? w[2] : 0.0 };
+				double r[3];
+				b.dom.dist_2( xi, x0, r );
+				for( int d = 0; d < dims; ++d ) u[d] += r[d];
+			}
+		}
+		if( images ){
+			double xu[3] = { xi[0], xi[1], xi[2] };
+			int flags[3] = { (*ix)[i], (*iy)[i], iz ? (*iz)[i] : 0 };
+			b.dom.unwrap_image( xu, flags );
+			double *o = offset.empty() ? nullptr : offset.data() + s*dims;
+			for( int d = 0; d < dims; ++d ){
+				if( switched ){
+					o[d] = u[d] - xu[d];
+				}else{
+					u[d] = xu[d] + ( o ? o[d] : 0.0 );
+				}
+			}
+		}
+		std::copy( xi, xi + dims, w );
+	}
+}
+
+
+std::size_t atom_tracker::memory() const
+{
+	return ( current.capacity() + wrapped.capacity() + offset.capacity() )
+		* sizeof(double)
+		+ ( slot_ids.capacity() + last_ids.capacity() + index_of.capacity() )
+		* sizeof(int);
+}
+
+
+} // namespace lammps_tools
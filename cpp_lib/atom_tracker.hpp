@@ -0,0 +1,93 @@
+#ifndef ATOM_TRACKER_HPP
+#define ATOM_TRACKER_HPP
+
+/**
+   \file atom_tracker.hpp
+
+   Follows atoms through the frames of a trajectory.
+*/
+
+#include <vector>
+
+#include "block_data.hpp"
+#include "types.hpp"
+
+
+namespace lammps_tools {
+
+/**
+   \brief Follows a fixed set of atoms over frames, unwrapping their
+          positions.
+
+   Each atom gets a slot, in the order of the ids given or of the
+   first frame. Atoms are matched by id, and the id map is only
+   rebuilt when the order of the atoms in a frame changes.
+
+   Positions are unwrapped with the image flags if the frames have
+   them. Otherwise the atoms are followed from frame to frame with the
+   minimum image convention, which needs frames close enough together
+   that no atom moves more than half a box length in between.
+
+   Frames with and without flags can be mixed. If a frame with flags
+   comes after one without, the atoms are followed to it with the
+   minimum image convention, and the difference with the positions from
+   its flags is added to the positions of all later frames with flags.
+   The unwrapped positions therefore always continue from the first
+   frame, whichever image the atoms started in.
+
+   Frames have to be evenly spaced in time.
+*/
+class atom_tracker
+{
+public:
+	/**
+	   \param dims  Dimensions of the system (2 or 3).
+	   \param ids   Ids of the atoms to follow, empty for all atoms in
+	                the first frame.
+	*/
+	explicit atom_tracker( int dims = 3,
+	                       const std::vector<int> &ids = std::vector<int>() );
+
+	/// Finds the atoms in the next frame and unwraps their positions.
+	void add_frame( const block_data &b );
+
+	/// Returns the number of frames added.
+	bigint n_frames() const { return frames; }
+
+	/// Returns the number of atoms followed.
+	int size() const { return slot_ids.size(); }
+
+	/// Returns the id of the atom in each slot.
+	const std::vector<int> &ids() const { return slot_ids; }
+
+	/// Returns the index in the last frame of the atom in each slot.
+	const std::vector<int> &index() const { return index_of; }
+
+	/// Returns the unwrapped positions, dims per slot.
+	const std::vector<double> &unwrapped() const { return current; }
+
+	/// Returns the number of time steps between frames.
+	bigint time_step() const { return dt; }
+
+	/// Returns the number of bytes used.
+	std::size_t memory() const;
+
+private:
+	int dims;
+	bigint frames;
+	bigint t0, dt;  ///< Time step of the first frame, and between frames.
+	bool had_images; ///< Whether the last frame had image flags.
+
+	std::vector<int> slot_ids;   ///< Id of the atom in each slot.
+	std::vector<int> last_ids;   ///< Ids of the last frame, in its order.
+	std::vector<int> index_of;   ///< Index in the last frame of each slot.
+
+	std::vector<double> current; ///< Unwrapped positions, per slot.
+	std::vector<double> wrapped; ///< Positions of the last frame, per slot.
+	std::vector<double> offset;  ///< Added to positions from image flags.
+};
+
+
+} // namespace lammps_tools
+
+#endif // ATOM_TRACKER_HPP
@@ -4,12 +4,56 @@
 #include "id_map.hpp"
 #include "my_assert.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <utility>
 
 using namespace lammps_tools;
 
 namespace lammps_tools {
 
+namespace {
+
+// Spreads the lowest 21 bits of v out to every third bit.
+std::uint64_t spread_bits_3( std::uint64_t v )
+{
+	v &= 0x1fffff;
+	v = ( v | v << 32 ) & 0x1f00000000ffffull;
+	v = ( v | v << 16 ) & 0x1f0000ff0000ffull;
+	v = ( v | v <<  8 ) & 0x100f00f00f00f00full;
+	v = ( v | v <<  4 ) & 0x10c30c30c30c30c3ull;
+	v = ( v | v <<  2 ) & 0x1249249249249249ull;
+	return v;
+}
+
+// Spreads the lowest 32 bits of v out to every other bit.
+std::uint64_t spread_bits_2( std::uint64_t v )
+{
+	v &= 0xffffffffull;
+	v = ( v | v << 16 ) & 0x0000ffff0000ffffull;
+	v = ( v | v <<  8 ) & 0x00ff00ff00ff00ffull;
+	v = ( v | v <<  4 ) & 0x0f0f0f0f0f0f0f0full;
+	v = ( v | v <<  2 ) & 0x3333333333333333ull;
+	v = ( v | v <<  1 ) & 0x5555555555555555ull;
+	return v;
+}
+
+template <typename T>
+void gather( data_field *df, const std::vector<std::size_t> &p,
+             std::vector<T> &tmp )
+{
+	std::vector<T> &vec = data_as_rw<T>( df );
+	tmp.resize( p.size() );
+	for( std::size_t k = 0; k < p.size(); ++k ){
+		tmp[k] = vec[ p[k] ];
+	}
+	vec.swap( tmp );
+}
+
+} // namespace
+
 block_data::block_data()
 	: tstep( 0 ), N( 0 ), N_ghost(0), N_true(0),
 	  N_types( 1 ), atom_style( ATOM_STYLE_ATOMIC ),
@@ -47,7 +91,7 @@ block_data::block_data( const block_data &o )
 	           "Data size mismatch after copy!" );
 
 	for( std::size_t i = 0; i < o.n_data_fields(); ++i ){
-		data[i] = copy( o.get_data( o[i].name) );
+		data[i] = copy( o.data[i] );
 		field_to_special_field_type[i] = UNKNOWN;
 	}
 
@@ -67,6 +111,27 @@ block_data::block_data( const block_data &o )
 	}
 }
 
+block_data::block_data( block_data &&o )
+	: block_data()
+{
+	swap( *this, o );
+}
+
+
+void block_data::copy_meta( const block_data &o )
+{
+	tstep = o.tstep;
+	N = o.N;
+	N_ghost = o.N_ghost;
+	N_true = o.N_true;
+	N_types = o.N_types;
+	atom_style = o.atom_style;
+	dom = o.dom;
+	top = o.top;
+	ati = o.ati;
+}
+
+
 block_data::~block_data()
 {
 	for( data_field *df : data ){
@@ -101,19 +166,35 @@ const data_field *block_data::get_data( const std::string &name ) const
 
 
 void block_data::add_field( const data_field &data_f, int special_field )
+{
+	check_new_field( data_f.name, data_f.size() );
+	// Now you need to copy the data.
+	add_field_ptr( copy( &data_f ), special_field );
+}
+
+void block_data::add_field( data_field &&data_f, int special_field )
+{
+	check_new_field( data_f.name, data_f.size() );
+	add_field_ptr( move_field( std::move( data_f ) ), special_field );
+}
+
+void block_data::check_new_field( const std::string &name,
+                                  std::size_t size ) const
 {
 	my_assert( __FILE__, __LINE__,
-	           data_f.size() == static_cast<std::size_t>(N),
+	           size == static_cast<std::size_t>(N),
 	           "Atom number mismatch on add_field! Call set_natoms first!");
 	// Check if this name is already in block or not.
-	if( get_data( data_f.name ) != nullptr ){
+	if( get_data( name ) != nullptr ){
 		my_runtime_error( __FILE__, __LINE__,
 		                  "Named data already in block_data" );
 	}
-	// Now you need to copy the data.
-	data_field *cp = copy( &data_f );
+}
+
+void block_data::add_field_ptr( data_field *df, int special_field )
+{
 	int index = data.size();
-	data.push_back( cp );
+	data.push_back( df );
 
 	field_to_special_field_type.push_back( UNKNOWN );
 
@@ -127,7 +208,7 @@ void block_data::add_field( const data_field &data_f, int special_field )
 	           special_fields_by_index[special_field] == -1,
 	           "Special field already set!" );
 
-	special_fields_by_name[special_field]  = data_f.name;
+	special_fields_by_name[special_field]  = df->name;
 	special_fields_by_index[special_field] = index;
 	field_to_special_field_type[index] = special_field;
 
@@ -165,11 +246,8 @@ void block_data::print_internal_state()
 
 block_data &block_data::operator=( block_data o )
 {
-	if( this != &o ){
-		using std::swap;
-		block_data n(o);
-		swap( *this, n );
-	}
+	// o already is a copy, so it can be swapped in as is.
+	swap( *this, o );
 	return *this;
 }
 
@@ -208,8 +286,20 @@ void block_data::set_special_field( const std::string &name, int field )
 		++index;
 	}
 	if( index < data.size() ){
+		// The field can only be one kind of special at a time.
+		int old_index = special_fields_by_index[field];
+		if( old_index >= 0 ){
+			field_to_special_field_type[old_index] = UNKNOWN;
+		}
+		int old_field = field_to_special_field_type[index];
+		if( old_field != UNKNOWN ){
+			special_fields_by_name[old_field]  = "";
+			special_fields_by_index[old_field] = -1;
+		}
+
 		special_fields_by_name[field]  = name;
 		special_fields_by_index[field] = index;
+		field_to_special_field_type[index] = field;
 	}
 }
 
@@ -263,25 +353,19 @@ data_field *block_data::remove_field( const std::string &name,
 	}
 	if( !df ) return nullptr;
 	data.erase( data.begin() + index );
-	//field_to_special_field_type.erase(
-	//	field_to_special_field_type.begin() + index );
-
-	bool found = false;
-	for( std::size_t i = 0; i < special_fields_by_name.size(); ++i ){
-		if( special_fields_by_name[i] == name ){
-			special_field = i;
-			found = true;
-			break;
-		}
-	}
-	if( found ){
+
+	special_field = field_to_special_field_type[index];
+	field_to_special_field_type.erase(
+		field_to_special_field_type.begin() + index );
+	if( special_field != UNKNOWN ){
 		special_fields_by_name[ special_field ] = "";
 		special_fields_by_index[ special_field ] = -1;
+	}
 
-		for( int &i : special_fields_by_index ){
-			if( i > index ){
-				--i;
-			}
+	// All fields after the removed one moved one place forward.
+	for( int &i : special_fields_by_index ){
+		if( i > index ){
+			--i;
 		}
 	}
 
@@ -291,6 +375,14 @@ data_field *block_data::remove_field( const std::string &name,
 }
 
 
+std::unique_ptr<data_field> block_data::take_field( const std::string &name,
+                                                   int &special_field )
+{
+	special_field = UNKNOWN;
+	return std::unique_ptr<data_field>( remove_field( name, special_field ) );
+}
+
+
 /// Get read/write pointer to special data field of given kind.
 data_field *block_data::get_special_field_rw( int field )
 {
@@ -344,14 +436,14 @@ data_field *block_data::get_data_rw( int index )
 // ******************   Non-member functions:    ************************
 void swap( block_data &f, block_data &s )
 {
-	// using std::swap;
+	using std::swap;
 
-	f.tstep = s.tstep;
-	f.N = s.N;
-	f.N_ghost = s.N_ghost;
-	f.N_true = s.N_true;
-	f.N_types = s.N_types;
-	f.atom_style = s.atom_style;
+	swap( f.tstep, s.tstep );
+	swap( f.N, s.N );
+	swap( f.N_ghost, s.N_ghost );
+	swap( f.N_true, s.N_true );
+	swap( f.N_types, s.N_types );
+	swap( f.atom_style, s.atom_style );
 	swap( f.dom, s.dom );
 	swap( f.top, s.top );
 	swap( f.data, s.data );
@@ -433,69 +525,47 @@ bool is_legal_special_field( int special_field )
 
 block_data filter_by_id( const block_data &b, const std::vector<int> &ids )
 {
-	block_data new_block( b );
+	// Only the meta data is needed, the fields are filtered one by one.
+	block_data new_block;
+	new_block.copy_meta( b );
 	bigint new_size = ids.size();
-	new_block.set_natoms( new_size );
+	new_block.N = new_size;
 	std::size_t nfields = b.n_data_fields();
 
 	// Loop over all data fields and extract new ones from them,
-	// then replace the one in new_block with those.
+	// straight into new_block.
 	int field_id = block_data::special_fields::ID;
 	const data_field_int *df_ids = static_cast<const data_field_int*>(
 		b.get_special_field( field_id ) );
 
 	id_map im( df_ids->get_data() );
-	new_block.clear();
 
 	for( std::size_t i = 0; i < nfields; ++i ){
 		const data_field *df_i = &b[i];
 		const std::string &field_name = df_i->name;
-		int type = df_i->type();
-
-		data_field_int *dfi;
-		data_field_double *dfd;
-
-		const data_field_int *dfi_old = nullptr;
-		const data_field_double *dfd_old = nullptr;
-
-		data_field *df_new;
-
-		if( type == data_field::INT ){
-			dfi = new data_field_int( field_name, new_size );
-			dfi_old = static_cast<const data_field_int*>( df_i );
-			dfd = nullptr;
-			df_new = dfi;
-		}else{
-			dfd = new data_field_double( field_name, new_size );
-			dfd_old = static_cast<const data_field_double*>( df_i );
-			dfi = nullptr;
-			df_new = dfd;
-		}
-		df_new->name = df_i->name;
 		int special_field_type = b.get_special_field_type( i );
 
-		std::size_t k = 0;
-		for( std::size_t j : ids ){
-			std::size_t idx = im[j];
-			if( dfi ){
-				(*dfi)[k] = (*dfi_old)[idx];
+		if( df_i->type() == data_field::INT ){
+			const std::vector<int> &old_data = data_as<int>( df_i );
+			data_field_int &dfi = new_block.emplace_field<int>(
+				field_name, special_field_type );
+			std::size_t k = 0;
+			for( int j : ids ){
+				dfi[k] = old_data[ im[j] ];
 				++k;
-				continue;
-			}else if( dfd ){
-				(*dfd)[k] = (*dfd_old)[idx];
+			}
+		}else if( df_i->type() == data_field::DOUBLE ){
+			const std::vector<double> &old_data = data_as<double>( df_i );
+			data_field_double &dfd = new_block.emplace_field<double>(
+				field_name, special_field_type );
+			std::size_t k = 0;
+			for( int j : ids ){
+				dfd[k] = old_data[ im[j] ];
 				++k;
-				continue;
 			}
-
+		}else{
 			my_runtime_error( __FILE__, __LINE__,
-			                  "data_field ptr assignment failed!" );
-		}
-		if( dfi ){
-			new_block.add_field( *dfi, special_field_type );
-			delete dfi;
-		}else if( dfd ){
-			new_block.add_field( *dfd, special_field_type );
-			delete dfd;
+			                  "Unknown data field type in filter_by_id!" );
 		}
 	}
 
@@ -554,90 +624,77 @@ void block_data::add_ghost_atoms( double rc, int dims )
 
 	bigint old_N = N;
 
+	// In a triclinic box the distance to a face follows from the
+	// fractional coordinates and the distance between the faces.
+	bool triclinic = dom.is_triclinic();
+	double width[3];
+	dom.face_widths( width, dims );
+
+	// The copies go in the order x, y, z, xy, xz, yz, xyz, as bits:
+	static const int copies[7] = { 1, 2, 4, 3, 5, 6, 7 };
+
 	for( bigint i = 0; i < old_N; ++i ){
 		double x = (*xx)[i];
 		double y = (*yy)[i];
 		double z = (*zz)[i];
 
-		int flip_x = 0; // 1 means "add to the right" with right being
-		int flip_y = 0; // at xhi, -1 means "add to the left" with left
-		int flip_z = 0; // being at xlo, 0 means nothing needed.
+		// Distances to the lower and upper face along each box vector.
+		double gap_lo[3], gap_hi[3];
+		if( triclinic ){
+			double pos[3] = { x, y, z };
+			double s[3];
+			dom.to_fractional( pos, s );
+			for( int d = 0; d < 3; ++d ){
+				gap_lo[d] = s[d]*width[d];
+				gap_hi[d] = ( 1.0 - s[d] )*width[d];
+			}
+		}else{
+			gap_lo[0] = x - dom.xlo[0];
+			gap_lo[1] = y - dom.xlo[1];
+			gap_lo[2] = z - dom.xlo[2];
+			gap_hi[0] = dom.xhi[0] - x;
+			gap_hi[1] = dom.xhi[1] - y;
+			gap_hi[2] = dom.xhi[2] - z;
+		}
 
-		if (periodic_x) {
+		// 1 means "add to the right" with right being at xhi, -1 means
+		// "add to the left" with left being at xlo, 0 means nothing
+		// needed.
+		int flip[3] = { 0, 0, 0 };
+		bool periodic_d[3] = { periodic_x, periodic_y, periodic_z };
+		for( int d = 0; d < 3; ++d ){
+			if( !periodic_d[d] ) continue;
 			// Suppose xlo = 0, xhi = 10, rc = 1.
 			// Then any position [0,1] and [9,10] needs
 			// mirroring. That means [.2 - 0 ] < rc
 			// or [10 - 9.8 ] < rc:
-			if     (x - dom.xlo[0] <= rc) flip_x =  1;
-			else if(dom.xhi[0] - x <  rc) flip_x = -1;
-		}
-		if (periodic_y) {
-			if     (y - dom.xlo[1] <= rc) flip_y =  1;
-			else if(dom.xhi[1] - y <  rc) flip_y = -1;
-		}
-		if (periodic_z) {
-			if     (z - dom.xlo[2] <= rc) flip_z =  1;
-			else if(dom.xhi[2] - z <  rc) flip_z = -1;
-		}
-
-		if (!flip_x && !flip_y && !flip_z) continue;
-
-		// Handle all the cases:
-		double Lx = dom.xhi[0] - dom.xlo[0];
-		double Ly = dom.xhi[1] - dom.xlo[1];
-		double Lz = dom.xhi[2] - dom.xlo[2];
-
-		double dx = x + flip_x*Lx;
-		double dy = y + flip_y*Ly;
-		double dz = z + flip_z*Lz;
-
-
-		if (flip_x) {
-			bigint new_idx = clone_particle(i);
-			(*xx)[new_idx] = dx;
-			++ghost_added;
-		}
-		if (flip_y) {
-			bigint new_idx = clone_particle(i);
-			(*yy)[new_idx] = dy;
-			++ghost_added;
-		}
-		if (flip_z) {
-			bigint new_idx = clone_particle(i);
-			(*zz)[new_idx] = dz;
-			++ghost_added;
-		}
-
-		if (flip_x && flip_y) {
-			bigint new_idx = clone_particle(i);
-
-			(*xx)[new_idx] = dx;
-			(*yy)[new_idx] = dy;
-			++ghost_added;
+			if     ( gap_lo[d] <= rc ) flip[d] =  1;
+			else if( gap_hi[d] <  rc ) flip[d] = -1;
 		}
 
-		if (flip_x && flip_z) {
-			bigint new_idx = clone_particle(i);
-			(*xx)[new_idx] = dx;
-			(*zz)[new_idx] = dz;
-			++ghost_added;
-		}
+		if (!flip[0] && !flip[1] && !flip[2]) continue;
+
+		// Add a copy for every combination of the flipped directions,
+		// shifted by whole box vectors.
+		for( int copy : copies ){
+			int img[3];
+			bool needed = true;
+			for( int d = 0; d < 3; ++d ){
+				bool along = copy & ( 1 << d );
+				if( along && !flip[d] ) needed = false;
+				img[d] = along ? flip[d] : 0;
+			}
+			if( !needed ) continue;
 
-		if (flip_y && flip_z) {
-			bigint new_idx = clone_particle(i);
-			(*yy)[new_idx] = dy;
-			(*zz)[new_idx] = dz;
-			++ghost_added;
-		}
+			double pos[3] = { x, y, z };
+			dom.unwrap_image( pos, img );
 
-		if (flip_x && flip_y && flip_z) {
 			bigint new_idx = clone_particle(i);
-			(*xx)[new_idx] = dx;
-			(*yy)[new_idx] = dy;
-			(*zz)[new_idx] = dz;
+			(*xx)[new_idx] = pos[0];
+			(*yy)[new_idx] = pos[1];
+			(*zz)[new_idx] = pos[2];
 			++ghost_added;
 		}
-
 	}
 
 	std::cerr << "Added " << ghost_added << " ghost atoms.\n";
@@ -650,6 +707,25 @@ void block_data::add_ghost_atoms( double rc, int dims )
 	          "Mismatch in number of ghosts/true!");
 
 	// Extend the domain:
+	if( triclinic ){
+		// Move every face out by rc. The box vectors grow by rc on
+		// both sides, in units of the distance between their faces.
+		double m[3] = { rc / width[0], rc / width[1],
+		                dims == 3 ? rc / width[2] : 0.0 };
+		double L[3];
+		for( int d = 0; d < 3; ++d ) L[d] = dom.xhi[d] - dom.xlo[d];
+
+		dom.xlo[0] -= m[0]*L[0] + m[1]*dom.xy + m[2]*dom.xz;
+		dom.xlo[1] -= m[1]*L[1] + m[2]*dom.yz;
+		dom.xlo[2] -= m[2]*L[2];
+		for( int d = 0; d < 3; ++d ){
+			dom.xhi[d] = dom.xlo[d] + ( 1.0 + 2.0*m[d] )*L[d];
+		}
+		dom.xy *= 1.0 + 2.0*m[1];
+		dom.xz *= 1.0 + 2.0*m[2];
+		dom.yz *= 1.0 + 2.0*m[2];
+		return;
+	}
 	dom.xlo[0] -= rc;
 	dom.xhi[0] += rc;
 	dom.xlo[1] -= rc;
@@ -662,6 +738,76 @@ void block_data::add_ghost_atoms( double rc, int dims )
 
 
 
+void block_data::permute( const std::vector<std::size_t> &p )
+{
+	my_assert( __FILE__, __LINE__, p.size() == static_cast<std::size_t>( N ),
+	           "Permutation does not match number of atoms!" );
+
+	// The old entries are gathered into a buffer that is swapped in, so
+	// every field is read and written once.
+	std::vector<double> dtmp;
+	std::vector<int> itmp;
+	for( data_field *df : data ){
+		if( df->type() == data_field::DOUBLE ){
+			gather( df, p, dtmp );
+		}else if( df->type() == data_field::INT ){
+			gather( df, p, itmp );
+		}
+	}
+}
+
+
+std::vector<std::size_t> block_data::sort_spatially( int dims )
+{
+	my_assert( __FILE__, __LINE__, !have_ghost_atoms(),
+	           "Cannot reorder atoms with ghost atoms!" );
+
+	// Flat directions get unit length, so to_fractional is defined.
+	domain box( dom );
+	for( int d = 0; d < 3; ++d ){
+		if( box.xhi[d] <= box.xlo[d] ) box.xhi[d] = box.xlo[d] + 1.0;
+	}
+	if( dims == 2 ) box.xz = box.yz = 0.0;
+
+	const std::vector<double> &x = data_as<double>( get_special_field( X ) );
+	const std::vector<double> &y = data_as<double>( get_special_field( Y ) );
+	const std::vector<double> &z = data_as<double>( get_special_field( Z ) );
+
+	// Grid coordinates along the box vectors, as many bits per
+	// direction as fit in the key.
+	const int bits = dims == 2 ? 32 : 21;
+	const double scale = static_cast<double>( ( 1ull << bits ) - 1 );
+	std::vector<std::pair<std::uint64_t, std::size_t> > keys( N );
+	for( bigint i = 0; i < N; ++i ){
+		double xi[3] = { x[i], y[i], dims == 2 ? box.xlo[2] : z[i] };
+		double s[3];
+		box.to_fractional( xi, s );
+
+		std::uint64_t c[3] = { 0, 0, 0 };
+		for( int d = 0; d < dims; ++d ){
+			// Wrap periodic directions, clamp the others.
+			if( dom.periodic & ( 1 << d ) ) s[d] -= std::floor( s[d] );
+			s[d] = std::min( std::max( s[d], 0.0 ), 1.0 );
+			c[d] = static_cast<std::uint64_t>( s[d] * scale );
+		}
+		std::uint64_t key;
+		if( dims == 2 ){
+			key = spread_bits_2( c[0] ) | spread_bits_2( c[1] ) << 1;
+		}else{
+			key = spread_bits_3( c[0] ) | spread_bits_3( c[1] ) << 1
+				| spread_bits_3( c[2] ) << 2;
+		}
+		keys[i] = std::make_pair( key, static_cast<std::size_t>( i ) );
+	}
+	std::sort( keys.begin(), keys.end() );
+
+	std::vector<std::size_t> p( N );
+	for( bigint k = 0; k < N; ++k ) p[k] = keys[k].second;
+	permute( p );
+	return p;
+}
+
+
 bigint block_data::clone_particle( bigint idx )
 {
 	my_assert(__FILE__, __LINE__, idx >= 0 && idx < N, "Index out of range!");
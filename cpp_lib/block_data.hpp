@@ -16,7 +16,9 @@
 #include "types.hpp"
 
 #include <map>
+#include <memory>
 #include <string>
+#include <utility>
 
 
 
@@ -91,6 +93,11 @@ public:
 	*/
 	block_data( const block_data &o );
 
+	/**
+	   Move constructor, leaves o as an empty block_data.
+	*/
+	block_data( block_data &&o );
+
 	/**
 	   Clears all data in the block_data.
 	*/
@@ -104,6 +111,10 @@ public:
 	/**
 	   Assignment operator performs deep copy.
 
+	   \note o is taken by value, so assigning a temporary does not
+	         copy anything. To hand over the contents of a block that
+	         is not needed anymore, swap it in instead.
+
 	   \param o The block_data whose contents to copy.
 
 	   \returns Ref to this.
@@ -121,9 +132,12 @@ public:
 	/**
 	   Copies only the meta-data from block_data o.
 
+	   This copies everything except the data fields, leaving the
+	   data fields of this block_data untouched.
+
 	   \param o the block_data to copy from.
 	*/
-	// void copy_meta( const block_data &o );
+	void copy_meta( const block_data &o );
 
 
 	/**
@@ -170,18 +184,77 @@ public:
 	void add_field( const data_field &data,
 	                int special_field_type = block_data::UNKNOWN );
 
+	/**
+	   Moves a data field into the data fields.
+
+	   \note Unlike add_field( const data_field & ), the data is not
+	         copied. data is left empty, without a name.
+
+	   \param data The data field to add.
+	   \param special_field_type the type of specialty of data.
+	*/
+	void add_field( data_field &&data,
+	                int special_field_type = block_data::UNKNOWN );
+
+	/**
+	   \brief Adds a new data field with N values of type T.
+
+	   This saves constructing a data field only to move it in. The
+	   values can be filled in through the returned reference.
+
+	   \param name               The name of the new data field.
+	   \param special_field_type the type of specialty of data.
+
+	   \returns a reference to the new data field.
+	*/
+	template <typename T>
+	data_field_der<T, data_field_type_id<T>::TYPE> &
+	emplace_field( const std::string &name,
+	               int special_field_type = block_data::UNKNOWN );
+
+	/**
+	   \brief Adds a new data field that takes over the values in vec.
+
+	   \param name               The name of the new data field.
+	   \param vec                The N values of the data field.
+	   \param special_field_type the type of specialty of data.
+
+	   \returns a reference to the new data field.
+	*/
+	template <typename T>
+	data_field_der<T, data_field_type_id<T>::TYPE> &
+	emplace_field( const std::string &name, std::vector<T> &&vec,
+	               int special_field_type = block_data::UNKNOWN );
+
 	/**
 	   \brief Removes the named data field from the block_data.
 
 	   This returns a pointer to the field so that it can be cleaned up.
 
 	   \param[in]  name           the name of the data field to remove
-	   \param[out] special_field  the special_field type of data
+	   \param[out] special_field  the special_field type of data, or
+	                              UNKNOWN if it was not special
 
 	   \returns a pointer to the data field, or nullptr if not found
 	*/
 	data_field *remove_field( const std::string &name, int &special_field );
 
+	/**
+	   \brief Removes the named data field and hands it over.
+
+	   Like remove_field, but the field is cleaned up automatically.
+	   To move it to another block_data without copying it, pass
+	   std::move( *field ) to add_field.
+
+	   \param[in]  name           the name of the data field to remove
+	   \param[out] special_field  the special_field type of data, or
+	                              UNKNOWN if it was not special
+
+	   \returns the data field, or an empty pointer if not found
+	*/
+	std::unique_ptr<data_field> take_field( const std::string &name,
+	                                        int &special_field );
+
 	/**
 	   Resizes all data_fields.
 
@@ -246,6 +319,30 @@ public:
 	/// Sorts the data along given header with standard '<' comparator.
 	void sort_along( const std::string &header );
 
+	/**
+	   \brief Reorders the entries of all fields, in one pass per field.
+
+	   \param p  The permutation, entry k becomes what entry p[k] was.
+	*/
+	void permute( const std::vector<std::size_t> &p );
+
+	/**
+	   \brief Reorders the atoms along a Morton (Z-order) curve through
+	          the box.
+
+	   Dumps are in a more or less random order after atoms migrate
+	   between processors. After this atoms that are close in space are
+	   mostly close in memory as well, so cell lists and neighbour loops
+	   access memory nearly in sequence.
+
+	   \param dims  Dimensionality, in 2D the z-coordinate is ignored.
+
+	   \returns the permutation p: atom k is atom p[k] of before. Use
+	            util::undo_permutation to put per-atom results back in
+	            the original order.
+	*/
+	std::vector<std::size_t> sort_spatially( int dims = 3 );
+
 	/// Grab fields by index:
 	const data_field &operator[]( int i ) const;
 
@@ -288,6 +385,12 @@ private:
 	/// Contains a mapping from data field index to special field type.
 	std::vector<int> field_to_special_field_type;
 
+	/// Checks if a data field of given name and size can be added.
+	void check_new_field( const std::string &name, std::size_t size ) const;
+
+	/// Takes ownership of df and registers it as given special field.
+	void add_field_ptr( data_field *df, int special_field_type );
+
 	/// Prints internal state of block_data
 	void print_internal_state();
 };
@@ -331,6 +434,27 @@ block_data filter_by_index( const block_data &b, const std::vector<int> &idxs );
 
 
 
+template <typename T> inline
+data_field_der<T, data_field_type_id<T>::TYPE> &
+block_data::emplace_field( const std::string &name, int special_field_type )
+{
+	return emplace_field( name, std::vector<T>( N ), special_field_type );
+}
+
+template <typename T> inline
+data_field_der<T, data_field_type_id<T>::TYPE> &
+block_data::emplace_field( const std::string &name, std::vector<T> &&vec,
+                           int special_field_type )
+{
+	typedef data_field_der<T, data_field_type_id<T>::TYPE> field_type;
+
+	check_new_field( name, vec.size() );
+	field_type *df = new field_type( name, std::move( vec ) );
+	add_field_ptr( df, special_field_type );
+	return *df;
+}
+
+
 /**
    \brief Sorts given block along given header.
 */
@@ -362,13 +486,7 @@ void block_data::sort_along( const std::string &header, const comparator &comp )
 		                "Unkown data type in block_data::sort_along!" );
 	}
 
-	for( data_field *df : data ){
-		if( df->type() == data_field::DOUBLE ){
-			sort_data_with_permutation<double>( df, p );
-		}else if( df->type() == data_field::INT ){
-			sort_data_with_permutation<int>( df, p );
-		}
-	}
+	permute( p );
 }
 
 
@@ -98,6 +98,21 @@ inline const std::vector<double> &get_z( const block_data &b )
 	return data_as<double>( b.get_special_field( block_data::Z ) );
 }
 
+inline const std::vector<double> &get_vx( const block_data &b )
+{
+	return data_as<double>( b.get_special_field( block_data::VX ) );
+}
+
+inline const std::vector<double> &get_vy( const block_data &b )
+{
+	return data_as<double>( b.get_special_field( block_data::VY ) );
+}
+
+inline const std::vector<double> &get_vz( const block_data &b )
+{
+	return data_as<double>( b.get_special_field( block_data::VZ ) );
+}
+
 inline const std::vector<int> &get_id( const block_data &b )
 {
 	return data_as<int>( b.get_special_field( block_data::ID ) );
@@ -3,6 +3,7 @@
 #include "constants.hpp"
 #include "fast_math.hpp"
 #include "neighborize.hpp"
+#include "neighborize_csr.hpp"
 
 namespace lammps_tools {
 
@@ -41,23 +42,25 @@ double angle_2pi( const point &v1, const point &v2 )
 	}
 }
 
-double compute_psi_n( const block_data &b,
-                      const neighborize::neigh_list &neighs,
-                      int n, const point &axis,
-                      std::vector<double> &psi_n_real,
-                      std::vector<double> &psi_n_imag )
+namespace {
+
+void bond_angles( const block_data &b, point axis,
+                  const std::vector<bond> &bonds,
+                  std::vector<double> &angles );
+
+double psi_n_of_bonds( const block_data &b, const std::vector<bond> &bonds,
+                       int n, const point &axis,
+                       std::vector<double> &psi_n_real,
+                       std::vector<double> &psi_n_imag )
 {
-	// 1. Calculate all bonds and bond angles.
+	// 1. Calculate all bond angles.
 	// 2. For each bond, determine psi_n and add to psi_n of atoms involved.
 	// 3. Average for each atom.
 
 	std::vector<double> angles;
-	std::vector<bond> bonds_from = neighborize::neigh_list_to_bonds( b, neighs );
-	const std::vector<bond> &bonds = bonds_from;
-	const std::vector<int> &id = get_id(b);
 
 	// 1
-	relative_bond_angles( b, neighs, axis, bonds, angles );
+	bond_angles( b, axis, bonds, angles );
 	std::size_t N = b.N;
 	if( psi_n_real.size() != N ) psi_n_real.resize( N );
 	if( psi_n_imag.size() != N ) psi_n_imag.resize( N );
@@ -110,11 +113,9 @@ double compute_psi_n( const block_data &b,
 	return std::sqrt( abs_psi );
 }
 
-void relative_bond_angles( const block_data &b,
-                           const neighborize::neigh_list &neighs,
-                           point axis,
-                           const std::vector<bond> &bonds,
-                           std::vector<double> &angles )
+void bond_angles( const block_data &b, point axis,
+                  const std::vector<bond> &bonds,
+                  std::vector<double> &angles )
 {
 	// Loop over all bonds:
 	const std::vector<double> &x = get_x(b);
@@ -157,6 +158,41 @@ void relative_bond_angles( const block_data &b,
 }
 
 
+} // namespace
+
+
+double compute_psi_n( const block_data &b,
+                      const neighborize::neigh_list &neighs,
+                      int n, const point &axis,
+                      std::vector<double> &psi_n_real,
+                      std::vector<double> &psi_n_imag )
+{
+	std::vector<bond> bonds = neighborize::neigh_list_to_bonds( b, neighs );
+	return psi_n_of_bonds( b, bonds, n, axis, psi_n_real, psi_n_imag );
+}
+
+
+double compute_psi_n( const block_data &b,
+                      const neighborize::csr_neigh_list &neighs,
+                      int n, const point &axis,
+                      std::vector<double> &psi_n_real,
+                      std::vector<double> &psi_n_imag )
+{
+	std::vector<bond> bonds = neighborize::neigh_list_to_bonds( b, neighs );
+	return psi_n_of_bonds( b, bonds, n, axis, psi_n_real, psi_n_imag );
+}
+
+
+void relative_bond_angles( const block_data &b,
+                           const neighborize::neigh_list &neighs,
+                           point axis,
+                           const std::vector<bond> &bonds,
+                           std::vector<double> &angles )
+{
+	bond_angles( b, axis, bonds, angles );
+}
+
+
 void relative_bond_angles_( const block_data &b,
                             const neighborize::neigh_list &neighs,
                             const std::vector<double> &axis,
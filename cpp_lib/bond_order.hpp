@@ -12,6 +12,7 @@
 #include "domain.hpp"
 #include "geometry.hpp"
 #include "neighborize.hpp"
+#include "neighborize_csr.hpp"
 //#include "topology.hpp"
 
 namespace lammps_tools {
@@ -35,6 +36,17 @@ double compute_psi_n( const block_data &b,
                       std::vector<double> &psi_n_real,
 	              std::vector<double> &psi_n_imag );
 
+/**
+   Calculates psi_n from a CSR neighbour list, which can be half.
+
+   \overload compute_psi_n
+*/
+double compute_psi_n( const block_data &b,
+                      const neighborize::csr_neigh_list &neighs,
+                      int n, const point &axis,
+                      std::vector<double> &psi_n_real,
+	              std::vector<double> &psi_n_imag );
+
 /**
    Calculates all bond angles for all neighbour pairs relative to some axis.
 
@@ -0,0 +1,127 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+/**
+   \file bounded_queue.hpp
+
+   A blocking, bounded single-producer single-consumer queue.
+*/
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+namespace lammps_tools {
+
+namespace util {
+
+/**
+   \brief A fixed-capacity FIFO queue that blocks the producer when full
+   and the consumer when empty.
+
+   Items are swapped in and out of preallocated slots rather than
+   copied, so T only needs to be default-constructible and swappable.
+   Because the slots are reused, storage held by the items (like the
+   data fields of a block_data) is recycled between pushes.
+
+   \tparam T  Type of the items in the queue.
+*/
+template <typename T>
+class bounded_queue
+{
+public:
+	/**
+	   \param capacity  Number of items the queue holds before push blocks.
+	*/
+	explicit bounded_queue( std::size_t capacity )
+		: slots( capacity + 1 ), capacity( capacity ), head( 0 ),
+		  count( 0 ), closed( false )
+	{ }
+
+	/**
+	   \brief Swaps item into the back of the queue.
+
+	   Blocks while the queue is full. After close() this no longer
+	   blocks, and the queue accepts one item past its capacity so a
+	   producer does not lose the item it was holding.
+
+	   \param item  The item to push. Will contain a recycled item after.
+	*/
+	void push( T &item )
+	{
+		std::unique_lock<std::mutex> lock( mut );
+		not_full.wait( lock, [this]{
+				return count < capacity ||
+					( closed && count < slots.size() ); } );
+
+		using std::swap;
+		swap( slots[ (head + count) % slots.size() ], item );
+		++count;
+		not_empty.notify_one();
+	}
+
+	/**
+	   \brief Swaps the front of the queue into item.
+
+	   Blocks until there is an item, or until the queue is closed.
+
+	   \param item Will contain the popped item.
+
+	   \returns false if the queue is closed and empty, true otherwise.
+	*/
+	bool pop( T &item )
+	{
+		std::unique_lock<std::mutex> lock( mut );
+		not_empty.wait( lock, [this]{ return count > 0 || closed; } );
+		if( count == 0 ) return false;
+
+		using std::swap;
+		swap( slots[head], item );
+		head = ( head + 1 ) % slots.size();
+		--count;
+		not_full.notify_one();
+		return true;
+	}
+
+	/// Wakes up all waiting threads and makes push and pop non-blocking.
+	void close()
+	{
+		std::lock_guard<std::mutex> lock( mut );
+		closed = true;
+		not_full.notify_all();
+		not_empty.notify_all();
+	}
+
+	/// Makes the queue blocking again, keeping the queued items.
+	void reopen()
+	{
+		std::lock_guard<std::mutex> lock( mut );
+		closed = false;
+	}
+
+	/// Returns the number of items in the queue.
+	std::size_t size() const
+	{
+		std::lock_guard<std::mutex> lock( mut );
+		return count;
+	}
+
+private:
+	bounded_queue( const bounded_queue & ) = delete;
+	bounded_queue &operator=( const bounded_queue & ) = delete;
+
+	std::vector<T> slots;
+	const std::size_t capacity;
+	std::size_t head, count;
+	bool closed;
+
+	mutable std::mutex mut;
+	std::condition_variable not_full, not_empty;
+};
+
+} // namespace util
+
+} // namespace lammps_tools
+
+#endif // BOUNDED_QUEUE_HPP
@@ -41,9 +41,11 @@ neigh_list neigh_list_to_clusters( const neigh_list &conns )
 
 
 
-neigh_list get_molecular_connections( const block_data &b,
-                                      const neigh_list &atom_neighs,
-                                      bool debug )
+namespace {
+
+template <typename list_type>
+neigh_list molecular_connections( const block_data &b,
+                                  const list_type &atom_neighs, bool debug )
 {
 	const std::vector<int> &mol = data_as<int>(
 		b.get_special_field( block_data::MOL ) );
@@ -51,11 +53,7 @@ neigh_list get_molecular_connections( const block_data &b,
 	int max_mol = *std::max_element( mol.begin(), mol.end() );
 	neigh_list conns( max_mol + 1 );
 
-	const std::vector<int> &type = data_as<int>(
-		b.get_special_field( block_data::TYPE ) );
-
-	for( std::size_t i = 0; i < atom_neighs.size(); ++i ){
-		int type_i = type[i];
+	for( int i = 0; i < static_cast<int>( atom_neighs.size() ); ++i ){
 		int mol_i = mol[i];
 
 		for( int j : atom_neighs[i] ){
@@ -79,6 +77,24 @@ neigh_list get_molecular_connections( const block_data &b,
 	return conns;
 }
 
+} // namespace
+
+
+neigh_list get_molecular_connections( const block_data &b,
+                                      const neigh_list &atom_neighs,
+                                      bool debug )
+{
+	return molecular_connections( b, atom_neighs, debug );
+}
+
+
+neigh_list get_molecular_connections( const block_data &b,
+                                      const csr_neigh_list &atom_neighs,
+                                      bool debug )
+{
+	return molecular_connections( b, atom_neighs, debug );
+}
+
 
 
 } // namespace neighborize
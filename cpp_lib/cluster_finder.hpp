@@ -6,6 +6,7 @@
 */
 
 #include "neighborize.hpp"
+#include "neighborize_csr.hpp"
 
 #include <vector>
 
@@ -40,6 +41,17 @@ neigh_list get_molecular_connections( const block_data &b,
                                       const neigh_list &atom_neighs,
                                       bool debug = false );
 
+/**
+   \brief Constructs a list of molecular connections from a CSR list.
+
+   Works with both full and half lists.
+
+   \overload get_molecular_connections
+*/
+neigh_list get_molecular_connections( const block_data &b,
+                                      const csr_neigh_list &atom_neighs,
+                                      bool debug = false );
+
 
 
 } // namespace neighborize
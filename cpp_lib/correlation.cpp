@@ -1,11 +1,15 @@
 #include "block_data_access.hpp"
 #include "constants.hpp"
 #include "correlation.hpp"
+#include "fft.hpp"
 #include "my_timer.hpp"
 #include "neighborize.hpp"
 #include "neighborize_bin.hpp"
+#include "neighborize_cell.hpp"
+#include "util.hpp"
 
 
+#include <algorithm>
 #include <cmath>
 
 using namespace lammps_tools;
@@ -15,86 +19,371 @@ namespace lammps_tools {
 
 namespace correlate {
 
+namespace {
 
-template <typename T>
-void correlate_impl( const lammps_tools::block_data &b,
-                     const std::vector<T> &data,
-                     std::vector<double> &Cr,
-                     double x0, double x1, double dx, int dims )
+using fourier::cx_double;
+
+// Grids with more points are made coarser. This many take 256 MB.
+const double max_grid_points = 16777216.0;
+
+
+// A grid over the box, in fractional coordinates.
+struct grid_shape
 {
-	// x1 is the max, so you can bin the atoms
-	std::cerr << "Correlating data between " << x0 << " and "
-	          << x1 << "...\n";
-	double Lgrid = x1 - x0;
-	int n_bins = Lgrid / dx;
+	int n[3];  // Points along each axis, padded for non-periodic axes.
+	int m[3];  // Points that span the box along each axis.
+
+	std::size_t size() const
+	{ return static_cast<std::size_t>( n[0] ) * n[1] * n[2]; }
+};
+
+
+grid_shape make_grid( const block_data &b, int dims, double h )
+{
+	grid_shape g;
+	while( true ){
+		double points = 1.0;
+		for( int d = 0; d < 3; ++d ){
+			if( d >= dims ){
+				g.n[d] = g.m[d] = 1;
+				continue;
+			}
+			double L = b.dom.xhi[d] - b.dom.xlo[d];
+			double cells = std::min( std::max( 1.0, std::ceil( L / h ) ),
+			                         max_grid_points );
+			if( b.dom.periodic & ( 1 << d ) ){
+				g.m[d] = fourier::fft_size( cells );
+				g.n[d] = g.m[d];
+			}else{
+				// Pad with zeros so that the correlation does not wrap.
+				g.m[d] = cells;
+				g.n[d] = fourier::fft_size( 2*g.m[d] + 1 );
+			}
+			points *= g.n[d];
+		}
+		if( points <= max_grid_points ) return g;
+		h *= 2.0;
+	}
+}
+
+
+// Returns the part of all pairs that the pair loop looks at.
+double pair_fraction( const block_data &b, double x1, int dims )
+{
+	double looked_at = 1.0, V = 1.0;
+	for( int d = 0; d < dims; ++d ){
+		double L = b.dom.xhi[d] - b.dom.xlo[d];
+		looked_at *= std::min( 3.0*x1, L );
+		V *= L;
+	}
+	return looked_at / V;
+}
 
-	Cr.resize( n_bins, 0.0 );
-	std::vector<double> counts( n_bins );
 
+template <typename T>
+void correlate_pairs( const block_data &b, const std::vector<T> &data,
+                      std::vector<double> &Cr,
+                      double x0, double x1, double dx, int dims,
+                      int n_threads )
+{
+	int n_bins = Cr.size();
 	const std::vector<double> &x = get_x(b);
 	const std::vector<double> &y = get_y(b);
 	const std::vector<double> &z = get_z(b);
 
-	const double pi = constants::pi;
-
 	my_timer timer( std::cerr );
 	std::vector<int> a = neighborize::all(b);
-	neighborize::neighborizer_bin nb( b, a, a, 2, x1 );
+	neighborize::neighborizer_bin nb( b, a, a, dims, x1 );
 	nb.setup_bins();
 	nb.bin_atoms();
 	timer.toc("Binning atoms");
 
-
 	timer.tic();
 	std::cerr << "Correlating " << nb.n_bins() << " bins...\n";
 
-	// Loop over the bins rather than the atoms.
-	for( int bin_i = 0; bin_i < nb.n_bins(); ++bin_i ){
-		std::vector<int> loop_idx = nb.get_nearby_bins<2>(bin_i);
-		for( int bin_j : loop_idx ){
-			if (bin_j < bin_i) continue;
-
-			// Loop over all particles in bin_i:
-			for( int i : nb.get_bin(bin_i) ){
-				double xi[3] = { x[i], y[i], z[i] };
-				T di = data[i];
-				// You also need to take into account the
-				// self-correlation in this case.
-
-				for( int j : nb.get_bin(bin_j) ){
-					T dj = data[j];
-					double xj[3] = { x[j], y[j], z[j] };
-					double rij[3];
-					double r2 = b.dom.dist_2( xi, xj, rij );
-					double r  = std::sqrt(r2);
-
-					int bin = ( r - x0 ) / dx;
-					if( bin >= n_bins || bin < 0 ) continue;
+	// Sums of d_i d_j and counts per distance bin, for each thread.
+	int n_run = std::min<bigint>( n_threads,
+	                              1 + b.N / neighborize::cell_list::min_thread_atoms );
+	std::vector<std::vector<double> > sums( n_run,
+	                                        std::vector<double>( 2*n_bins ) );
+	double x02 = x0 > 0 ? x0*x0 : 0.0;
+	double x12 = x1*x1;
+
+	util::run_on_threads( n_run, [&]( int t ){
+		std::vector<double> &s = sums[t];
+		// Loop over the bins rather than the atoms.
+		for( int bin_i = t; bin_i < nb.n_bins(); bin_i += n_run ){
+			std::vector<int> loop_idx = nb.get_nearby_bins( bin_i, dims );
+			std::sort( loop_idx.begin(), loop_idx.end() );
+			loop_idx.erase( std::unique( loop_idx.begin(), loop_idx.end() ),
+			                loop_idx.end() );
+			for( int bin_j : loop_idx ){
+				if( bin_j < bin_i || bin_j >= nb.n_bins() ) continue;
+
+				// Loop over all particles in bin_i:
+				for( int i : nb.get_bin(bin_i) ){
+					double xi[3] = { x[i], y[i], z[i] };
+					double di = data[i];
 
-					// You will encounter i == j twice.
-					double didj = di*dj * ( ( i == j ) ? 0.5 : 1.0 );
-					Cr[bin] += didj;
+					for( int j : nb.get_bin(bin_j) ){
+						// Count each pair once, and skip i == j.
+						if( bin_j == bin_i && j <= i ) continue;
+						double xj[3] = { x[j], y[j], z[j] };
+						double rij[3];
+						double r2 = b.dom.dist_2( xi, xj, rij );
+						if( r2 < x02 || r2 >= x12 ) continue;
 
-					counts[bin] += 1.0;
+						int bin = ( std::sqrt(r2) - x0 ) / dx;
+						if( bin >= n_bins || bin < 0 ) continue;
+
+						s[2*bin]     += di*data[j];
+						s[2*bin + 1] += 1.0;
+					}
 				}
 			}
 		}
-	}
+	} );
 	timer.toc( "Correlating data" );
 
-	// Normalize:
 	for( int bin = 0; bin < n_bins; ++bin ){
-		double r = x0 + dx * bin;
-		double bin_r = r + 0.5*dx;
-		double bin_V = 2*pi*bin_r*bin_r;
-		if( dims == 3 ) bin_V *= 2.0*bin_r/3.0;
-		if( counts[bin] > 0 ){
-			// double factor = 1.0 / (counts[bin]*bin_V);
-			double factor = 1.0 / counts[bin];
-			Cr[bin] *= factor;
+		double sum = 0.0, count = 0.0;
+		for( const std::vector<double> &s : sums ){
+			sum   += s[2*bin];
+			count += s[2*bin + 1];
 		}
+		if( count > 0 ) Cr[bin] = sum / count;
 	}
+}
+
+
+template <typename T>
+void correlate_grid( const block_data &b, const std::vector<T> &data,
+                     std::vector<double> &Cr,
+                     double x0, double x1, double dx, int dims,
+                     int n_threads, double h )
+{
+	int n_bins = Cr.size();
+	const std::vector<double> &x = get_x(b);
+	const std::vector<double> &y = get_y(b);
+	const std::vector<double> &z = get_z(b);
+
+	my_timer timer( std::cerr );
+	grid_shape g = make_grid( b, dims, h );
+	const int nx = g.n[0], ny = g.n[1], nz = g.n[2];
+	std::cerr << "Correlating on a " << nx << " x " << ny << " x " << nz
+	          << " grid...\n";
 
+	// Spread the data into the real part and the atom density into the
+	// imaginary part, so both are transformed at once. The parts of the
+	// correlation that come from an atom with itself are summed for the
+	// lags -1, 0 and 1 along each axis, where cloud-in-cell puts them.
+	std::vector<cx_double> grid( g.size() );
+	double self_data[27] = {}, self_density[27] = {};
+	for( bigint i = 0; i < b.N; ++i ){
+		double xi[3] = { x[i], y[i], dims == 3 ? z[i] : b.dom.xlo[2] };
+		double s[3];
+		b.dom.to_fractional( xi, s );
+
+		int i0[3];
+		double w[3][2], w_self[3][3];
+		for( int d = 0; d < 3; ++d ){
+			if( d >= dims ){
+				i0[d] = 0;
+				w[d][0] = 1.0;
+				w[d][1] = 0.0;
+				w_self[d][0] = w_self[d][2] = 0.0;
+				w_self[d][1] = 1.0;
+				continue;
+			}
+			double sd = s[d];
+			if( b.dom.periodic & ( 1 << d ) ){
+				sd -= std::floor( sd );
+			}else{
+				sd = std::min( std::max( sd, 0.0 ), 1.0 );
+			}
+			double u = sd * g.m[d];
+			i0[d] = std::floor( u );
+			double f = u - i0[d];
+			w[d][0] = 1.0 - f;
+			w[d][1] = f;
+			w_self[d][0] = w_self[d][2] = f*( 1.0 - f );
+			w_self[d][1] = ( 1.0 - f )*( 1.0 - f ) + f*f;
+		}
+
+		double di = data[i];
+		for( int a = 0; a < 2; ++a ){
+			int ix = ( i0[0] + a ) & ( nx - 1 );
+			for( int c = 0; c < 2; ++c ){
+				int iy = ( i0[1] + c ) & ( ny - 1 );
+				double wxy = w[0][a] * w[1][c];
+				for( int e = 0; e < 2; ++e ){
+					int iz = ( i0[2] + e ) & ( nz - 1 );
+					double wt = wxy * w[2][e];
+					grid[ ( static_cast<std::size_t>( ix )*ny + iy )*nz + iz ]
+						+= cx_double( di*wt, wt );
+				}
+			}
+		}
+		for( int k = 0; k < 27; ++k ){
+			double wt = w_self[0][k / 9] * w_self[1][( k / 3 ) % 3]
+				* w_self[2][k % 3];
+			self_density[k] += wt;
+			self_data[k] += di*di*wt;
+		}
+	}
+	timer.toc( "Spreading data on grid" );
+
+	timer.tic();
+	fourier::fft_3d( grid.data(), nx, ny, nz, false, n_threads );
+
+	// With Z = A + iB for real A and B, A(k) = ( Z(k) + Z*(-k) )/2 and
+	// B(k) = ( Z(k) - Z*(-k) )/2i. Their power spectra are even in k,
+	// so k and -k get the same value and are done together.
+	int n_slices = nx / 2 + 1;
+	int n_run = std::max( 1, std::min( n_threads, n_slices ) );
+	util::run_on_threads( n_run, [&]( int t ){
+		for( int kx = t; kx < n_slices; kx += n_run ){
+			int mx = ( nx - kx ) & ( nx - 1 );
+			for( int ky = 0; ky < ny; ++ky ){
+				int my = ( ny - ky ) & ( ny - 1 );
+				for( int kz = 0; kz < nz; ++kz ){
+					int mz = ( nz - kz ) & ( nz - 1 );
+					std::size_t k  = ( static_cast<std::size_t>( kx )*ny + ky )*nz + kz;
+					std::size_t mk = ( static_cast<std::size_t>( mx )*ny + my )*nz + mz;
+					if( mk < k ) continue;
+
+					cx_double zk = grid[k];
+					cx_double zm = std::conj( grid[mk] );
+					cx_double p( 0.25*std::norm( zk + zm ),
+					             0.25*std::norm( zk - zm ) );
+					grid[k]  = p;
+					grid[mk] = p;
+				}
+			}
+		}
+	} );
+	fourier::fft_3d( grid.data(), nx, ny, nz, true, n_threads );
+
+	double M = g.size();
+	for( int k = 0; k < 27; ++k ){
+		int ix = ( k / 9 - 1 ) & ( nx - 1 );
+		int iy = ( ( k / 3 ) % 3 - 1 ) & ( ny - 1 );
+		int iz = ( k % 3 - 1 ) & ( nz - 1 );
+		grid[ ( static_cast<std::size_t>( ix )*ny + iy )*nz + iz ]
+			-= M * cx_double( self_data[k], self_density[k] );
+	}
+	timer.toc( "Correlating grid" );
+
+	// Average over shells. Lags are taken to the nearest image and
+	// turned into distances with the (possibly tilted) box vectors.
+	timer.tic();
+	const domain &dom = b.dom;
+	double L[3];
+	for( int d = 0; d < 3; ++d ) L[d] = dom.xhi[d] - dom.xlo[d];
+	double x02 = x0 > 0 ? x0*x0 : 0.0;
+	double x12 = x1*x1;
+
+	n_run = std::max( 1, std::min( n_threads, nx ) );
+	std::vector<std::vector<double> > sums( n_run,
+	                                        std::vector<double>( 2*n_bins ) );
+	util::run_on_threads( n_run, [&]( int t ){
+		std::vector<double> &s = sums[t];
+		for( int ix = t; ix < nx; ix += n_run ){
+			double sx = ( ix <= nx / 2 ? ix : ix - nx ) / double( g.m[0] );
+			for( int iy = 0; iy < ny; ++iy ){
+				double sy = ( iy <= ny / 2 ? iy : iy - ny ) / double( g.m[1] );
+				for( int iz = 0; iz < nz; ++iz ){
+					double sz = dims == 3
+						? ( iz <= nz / 2 ? iz : iz - nz ) / double( g.m[2] )
+						: 0.0;
+					double r[3] = { sx*L[0] + sy*dom.xy + sz*dom.xz,
+					                sy*L[1] + sz*dom.yz,
+					                sz*L[2] };
+					double r2 = r[0]*r[0] + r[1]*r[1] + r[2]*r[2];
+					if( r2 < x02 || r2 >= x12 ) continue;
+
+					int bin = ( std::sqrt(r2) - x0 ) / dx;
+					if( bin >= n_bins || bin < 0 ) continue;
+
+					const cx_double &c =
+						grid[ ( static_cast<std::size_t>( ix )*ny + iy )*nz + iz ];
+					s[2*bin]     += c.real();
+					s[2*bin + 1] += c.imag();
+				}
+			}
+		}
+	} );
+
+	// Bins that no pairs reach only get round-off from the transforms.
+	double tiny = 1e-12 * M * b.N * b.N;
+	for( int bin = 0; bin < n_bins; ++bin ){
+		double sum = 0.0, weight = 0.0;
+		for( const std::vector<double> &s : sums ){
+			sum    += s[2*bin];
+			weight += s[2*bin + 1];
+		}
+		if( weight > tiny ) Cr[bin] = sum / weight;
+	}
+	timer.toc( "Averaging over shells" );
+}
+
+} // namespace
+
+
+int choose_method( const lammps_tools::block_data &b, double x1,
+                   double grid_spacing, int dims )
+{
+	double N = b.N;
+	double pair_cost = 0.5 * N * N * pair_fraction( b, x1, dims );
+
+	// Rough operation counts: two transforms and one pass over the grid
+	// to average, and per atom 2^dims points to spread it on and the 27
+	// lags of its self-correlation.
+	double M = make_grid( b, dims, grid_spacing ).size();
+	double grid_cost = M * ( 4.0*std::log2( std::max( M, 2.0 ) ) + 2.0 )
+		+ N * ( ( 1 << dims ) + 27 );
+
+	return grid_cost < pair_cost ? GRID_FFT : PAIR_LOOP;
+}
+
+
+template <typename T>
+void correlate_impl( const lammps_tools::block_data &b,
+                     const std::vector<T> &data,
+                     std::vector<double> &Cr,
+                     double x0, double x1, double dx, int dims,
+                     int method, int n_threads, double grid_spacing )
+{
+	my_assert( __FILE__, __LINE__, dims == 2 || dims == 3,
+	           "Dimensions have to be 2 or 3!" );
+	my_assert( __FILE__, __LINE__, dx > 0 && x1 > x0,
+	           "Need a positive bin size and range!" );
+	my_assert( __FILE__, __LINE__, data.size() == static_cast<std::size_t>( b.N ),
+	           "Need one value per atom!" );
+
+	// x1 is the max, so you can bin the atoms
+	std::cerr << "Correlating data between " << x0 << " and "
+	          << x1 << "...\n";
+	double Lgrid = x1 - x0;
+	int n_bins = Lgrid / dx;
+
+	Cr.assign( n_bins, 0.0 );
+
+	n_threads = neighborize::resolve_threads( n_threads );
+	double h = grid_spacing > 0 ? grid_spacing : dx;
+	if( method == AUTO ) method = choose_method( b, x1, h, dims );
+
+	switch( method ){
+		case PAIR_LOOP:
+			correlate_pairs( b, data, Cr, x0, x1, dx, dims, n_threads );
+			break;
+		case GRID_FFT:
+			correlate_grid( b, data, Cr, x0, x1, dx, dims, n_threads, h );
+			break;
+		default:
+			my_runtime_error( __FILE__, __LINE__,
+			                  "Unknown correlation method!" );
+	}
 }
 
 
@@ -102,17 +391,21 @@ void correlate_impl( const lammps_tools::block_data &b,
 void correlate_int( const lammps_tools::block_data &b,
                     const std::vector<int> &data,
                     std::vector<double> &Cr,
-                    double x0, double x1, double dx, int dims )
+                    double x0, double x1, double dx, int dims,
+                    int method, int n_threads, double grid_spacing )
 {
-	correlate_impl<int>( b, data, Cr, x0, x1, dx, dims );
+	correlate_impl<int>( b, data, Cr, x0, x1, dx, dims,
+	                     method, n_threads, grid_spacing );
 }
 
 void correlate_double( const lammps_tools::block_data &b,
                        const std::vector<double> &data,
                        std::vector<double> &Cr,
-                       double x0, double x1, double dx, int dims )
+                       double x0, double x1, double dx, int dims,
+                       int method, int n_threads, double grid_spacing )
 {
-	correlate_impl<double>( b, data, Cr, x0, x1, dx, dims );
+	correlate_impl<double>( b, data, Cr, x0, x1, dx, dims,
+	                        method, n_threads, grid_spacing );
 }
 
 
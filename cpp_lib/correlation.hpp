@@ -14,6 +14,13 @@ namespace lammps_tools {
 
 namespace correlate {
 
+/// Ways to compute the spatial correlation.
+enum methods {
+	AUTO      = 0,  ///< Pick whichever of the two below is cheaper.
+	PAIR_LOOP = 1,  ///< Loop over pairs of atoms in neighbouring bins.
+	GRID_FFT  = 2   ///< Correlate a field on a grid with FFTs.
+};
+
 
 /**
    \brief Correlate a value over distance.
@@ -22,28 +29,56 @@ namespace correlate {
    <f(r)*f(r+R)> - <f(r)>*<f(r+R)>, where the <> indicates averaging
    over all atoms.
 
-   \param b    The block data to calculate the correlation for
-   \param data The data field to average
-   \param x0   Lower point on distance over which to correlate
-   \param x1   Higher point on distance over which to correlate
-   \param dx   Bin size.
-   \param dims Dimensions of the simulation box
+   The pair loop is exact, but its cost grows with the number of atoms
+   within x1 of each other, so it becomes O(N^2) if x1 is a large part
+   of the box. GRID_FFT spreads the data and the atom density over a
+   grid with cloud-in-cell weights, gets their autocorrelations with
+   FFTs and averages them over shells. Its cost only depends on the
+   grid, but the distances are smeared out over about one grid spacing.
+   In both, an atom is not correlated with itself. The exact pair loop
+   is the default; GRID_FFT and AUTO have to be asked for.
+
+   \param b            The block data to calculate the correlation for
+   \param data         The data field to average
+   \param x0           Lower point on distance over which to correlate
+   \param x1           Higher point on distance over which to correlate
+   \param dx           Bin size.
+   \param dims         Dimensions of the simulation box
+   \param method       The way to compute it, see methods.
+   \param n_threads    Number of threads to use, 0 for all cores.
+   \param grid_spacing Spacing of the grid for GRID_FFT, 0 for dx. It is
+                       made coarser if the grid would get too large.
 
    \returns the correlation of given data.
 */
 void correlate_int( const lammps_tools::block_data &b,
                     const std::vector<int> &data,
                     std::vector<double> &Cr,
-                    double x0, double x1, double dx, int dims );
+                    double x0, double x1, double dx, int dims,
+                    int method = PAIR_LOOP, int n_threads = 1,
+                    double grid_spacing = 0.0 );
 
 
 void correlate_double( const lammps_tools::block_data &b,
                        const std::vector<double> &data,
                        std::vector<double> &Cr,
-                       double x0, double x1, double dx, int dims );
+                       double x0, double x1, double dx, int dims,
+                       int method = PAIR_LOOP, int n_threads = 1,
+                       double grid_spacing = 0.0 );
+
 
+/**
+   \brief Estimates which method is cheaper for a correlation.
 
+   \param b            The block data to correlate.
+   \param x1           Largest distance to correlate over.
+   \param grid_spacing Spacing of the grid for GRID_FFT.
+   \param dims         Dimensions of the simulation box.
 
+   \returns PAIR_LOOP or GRID_FFT.
+*/
+int choose_method( const lammps_tools::block_data &b, double x1,
+                   double grid_spacing, int dims );
 
 
 
@@ -21,11 +21,13 @@ void swap( data_field &f, data_field &s )
 			data_field_int &d_f = dynamic_cast<data_field_int&>(f);
 			data_field_int &d_s = dynamic_cast<data_field_int&>(s);
 			swap( d_f, d_s );
+			break;
 		}
 		case data_field::DOUBLE: {
 			data_field_double &d_f = dynamic_cast<data_field_double&>(f);
 			data_field_double &d_s = dynamic_cast<data_field_double&>(s);
 			swap( d_f, d_s );
+			break;
 		}
 	}
 }
@@ -9,6 +9,7 @@
 
 #include <string>
 #include <typeinfo>
+#include <utility>
 #include <vector>
 
 #include "my_assert.hpp"
@@ -105,10 +106,8 @@ struct data_field_der : public data_field
 	   Sets up name and complete data.
 	*/
 	explicit data_field_der( const data_field_der<T, TYPE> *other )
-		: data_field( other->name ), data( other->size() )
-	{
-		construct_from_other( *other );
-	}
+		: data_field( other->name ), data( other->data )
+	{ }
 
 	/**
 	   Copy constructor from reference.
@@ -116,10 +115,19 @@ struct data_field_der : public data_field
 	   Sets up name and complete data.
 	*/
 	explicit data_field_der( const data_field_der<T, TYPE> &other )
-		: data_field( other.name ), data( other.size() )
+		: data_field( other.name ), data( other.data )
+	{ }
+
+	/**
+	   Move constructor.
+
+	   Takes over name and data, other is left empty.
+	*/
+	data_field_der( data_field_der<T, TYPE> &&other )
+		: data_field( "" ), data( std::move( other.data ) )
 	{
-		std::cerr << "Attempting to construct through ref.\n";
-		construct_from_other( other );
+		name.swap( other.name );
+		other.data.clear();
 	}
 
 	/**
@@ -137,7 +145,7 @@ struct data_field_der : public data_field
 	*/
 	explicit data_field_der( const std::string &n,
 	                         std::vector<T> &&vec )
-		: data_field(n), data(vec)
+		: data_field(n), data( std::move( vec ) )
 	{
 		// std::cerr << "Called move-from-vector constructor.\n";
 	}
@@ -161,7 +169,8 @@ struct data_field_der : public data_field
 	}
 
 	/**
-	   Assingment operator
+	   Assignment operator, copies or moves depending on what other
+	   was constructed from.
 	*/
 	data_field_der &operator=( data_field_der<T, TYPE> other )
 	{
@@ -292,6 +301,33 @@ inline data_field *copy( const data_field *d )
 
 
 
+/**
+   Moves the contents of d into a new data field of the same type.
+
+   \param d The data to move. Is left empty, without name.
+
+   \returns A pointer to a heap-allocated data_field.
+*/
+inline data_field *move_field( data_field &&d )
+{
+	data_field *df = nullptr;
+	switch( d.type() ){
+		default:
+			my_logic_error( __FILE__, __LINE__,
+			                "Unkown data field type encountered!" );
+			return nullptr;
+		case data_field::INT:
+			df = new data_field_int( "" );
+			break;
+		case data_field::DOUBLE:
+			df = new data_field_double( "" );
+			break;
+	}
+	swap( *df, d );
+	return df;
+}
+
+
 template <typename T> inline
 const std::vector<T> &data_as( const data_field *df );
 
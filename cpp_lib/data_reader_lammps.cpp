@@ -5,6 +5,7 @@
 
 #include <string>
 #include <sstream>
+#include <utility>
 
 
 namespace lammps_tools {
@@ -56,6 +57,14 @@ int get_header_info( std::istream &in, block_data &b,
 				b.dom.xhi[2] = std::stof( words[1] );
 			}
 		}
+		if( words.size() >= 6 && words[3] == "xy" && words[4] == "xz"
+		    && words[5] == "yz" ){
+			// Data files have xlo and xhi of the box itself, not of
+			// the bounding box like dump files.
+			b.dom.xy = std::stod( words[0] );
+			b.dom.xz = std::stod( words[1] );
+			b.dom.yz = std::stod( words[2] );
+		}
 
 		if( std::find( body_headers.begin(), body_headers.end(),
 		               words[0] ) != body_headers.end() ){
@@ -136,19 +145,19 @@ int read_data_atoms( std::istream &in, block_data &b, bool quiet )
 	}
 	if( !quiet ) std::cerr << "    ....Adding fields.\n";
 
-	b.add_field(   id, block_data::ID );
+	b.add_field( std::move( id ), block_data::ID );
 	if( b.atom_style == ATOM_STYLE_MOLECULAR ){
-		b.add_field( mol, block_data::MOL );
+		b.add_field( std::move( mol ), block_data::MOL );
 	}
-	b.add_field( type, block_data::TYPE );
-	b.add_field(    x, block_data::X );
-	b.add_field(    y, block_data::Y );
-	b.add_field(    z, block_data::Z );
+	b.add_field( std::move( type ), block_data::TYPE );
+	b.add_field( std::move( x ), block_data::X );
+	b.add_field( std::move( y ), block_data::Y );
+	b.add_field( std::move( z ), block_data::Z );
 
 	if( has_image_flags ){
-		b.add_field( ix, block_data::IX );
-		b.add_field( iy, block_data::IY );
-		b.add_field( iz, block_data::IZ );
+		b.add_field( std::move( ix ), block_data::IX );
+		b.add_field( std::move( iy ), block_data::IY );
+		b.add_field( std::move( iz ), block_data::IZ );
 	}
 
 	return 0;
@@ -184,9 +193,9 @@ int read_data_atoms_velocities( std::istream &in, block_data &b, bool quiet )
 		std::getline(in,line);
 	}
 
-	b.add_field( vx, block_data::VX );
-	b.add_field( vy, block_data::VY );
-	b.add_field( vz, block_data::VZ );
+	b.add_field( std::move( vx ), block_data::VX );
+	b.add_field( std::move( vy ), block_data::VY );
+	b.add_field( std::move( vz ), block_data::VZ );
 
 	return 0;
 }
@@ -4,6 +4,7 @@
 #include "data_field.hpp"
 
 #include <algorithm>
+#include <cmath>
 
 using namespace lammps_tools;
 
@@ -48,11 +49,15 @@ void swap( domain &f, domain &s )
 	swap( f.xhi, s.xhi );
 
 	swap( f.periodic, s.periodic );
+
+	swap( f.xy, s.xy );
+	swap( f.xz, s.xz );
+	swap( f.yz, s.yz );
 }
 
 
 domain::domain( const domain &o )
-	: periodic( o.periodic )
+	: periodic( o.periodic ), xy( o.xy ), xz( o.xz ), yz( o.yz )
 {
 	std::copy( o.xlo, o.xlo + 3, xlo );
 	std::copy( o.xhi, o.xhi + 3, xhi );
@@ -60,6 +65,62 @@ domain::domain( const domain &o )
 }
 
 
+void domain::face_widths( double w[3], int dims ) const
+{
+	double Lx = xhi[0] - xlo[0];
+	double Ly = xhi[1] - xlo[1];
+	double Lz = xhi[2] - xlo[2];
+	w[0] = Lx;
+	w[1] = Ly;
+	w[2] = Lz;
+	if( !is_triclinic() ) return;
+
+	if( dims == 2 ){
+		// The area divided by the length of b.
+		w[0] = Lx*Ly / std::sqrt( Ly*Ly + xy*xy );
+		return;
+	}
+
+	// The volume divided by the area of the face spanned by the other
+	// two box vectors. The face of a and b has area Lx*Ly.
+	double bc_x = Ly*Lz, bc_y = xy*Lz, bc_z = xy*yz - Ly*xz;
+	w[0] = Lx*Ly*Lz / std::sqrt( bc_x*bc_x + bc_y*bc_y + bc_z*bc_z );
+	w[1] = Ly*Lz / std::sqrt( Lz*Lz + yz*yz );
+}
+
+
+void domain::set_from_bounding_box( const double lo_bound[3],
+                                    const double hi_bound[3],
+                                    double txy, double txz, double tyz )
+{
+	xy = txy;
+	xz = txz;
+	yz = tyz;
+
+	xlo[0] = lo_bound[0] - std::min( std::min( 0.0, xy ),
+	                                 std::min( xz, xy + xz ) );
+	xhi[0] = hi_bound[0] - std::max( std::max( 0.0, xy ),
+	                                 std::max( xz, xy + xz ) );
+	xlo[1] = lo_bound[1] - std::min( 0.0, yz );
+	xhi[1] = hi_bound[1] - std::max( 0.0, yz );
+	xlo[2] = lo_bound[2];
+	xhi[2] = hi_bound[2];
+}
+
+
+void domain::bounding_box( double lo_bound[3], double hi_bound[3] ) const
+{
+	lo_bound[0] = xlo[0] + std::min( std::min( 0.0, xy ),
+	                                 std::min( xz, xy + xz ) );
+	hi_bound[0] = xhi[0] + std::max( std::max( 0.0, xy ),
+	                                 std::max( xz, xy + xz ) );
+	lo_bound[1] = xlo[1] + std::min( 0.0, yz );
+	hi_bound[1] = xhi[1] + std::max( 0.0, yz );
+	lo_bound[2] = xlo[2];
+	hi_bound[2] = xhi[2];
+}
+
+
 void domain::reconstruct_image_flags(const block_data &b,
                                      std::vector<int> &image_x,
                                      std::vector<int> &image_y,
@@ -185,9 +246,9 @@ void domain::reconstruct_image_flags(const block_data &b,
 				xdum3[1] = xx[1];
 				xdum3[2] = xx[2];
 
-				xdum3[0] += Lx*ximgs[flag_i];
-				xdum3[1] += Ly*yimgs[flag_i];
-				xdum3[2] += Lz*zimgs[flag_i];
+				int img[3] = { ximgs[flag_i], yimgs[flag_i],
+				               zimgs[flag_i] };
+				b.dom.unwrap_image( xdum3, img );
 
 				double r2 = b.dom.dist_2(xp, xdum3, r, false);
 				if (r2 < r2_min) {
@@ -198,15 +259,15 @@ void domain::reconstruct_image_flags(const block_data &b,
 				}
 			}
 
-			double xdum3[3] = { Lx*imx_m + xx[0],
-			                    Ly*imy_m + xx[1],
-			                    Lz*imz_m + xx[2] };
+			double xdum3[3] = { xx[0], xx[1], xx[2] };
+			int img[3] = { imx_m, imy_m, imz_m };
+			b.dom.unwrap_image( xdum3, img );
 
 			double r2 = b.dom.dist_2(xp, xdum3, r, false);
 
-			xp[0] = Lx*imx_m + xx[0];
-			xp[1] = Ly*imy_m + xx[1];
-			xp[2] = Lz*imz_m + xx[2];
+			xp[0] = xdum3[0];
+			xp[1] = xdum3[1];
+			xp[2] = xdum3[2];
 
 			image_x[i] = imx_m;
 		        image_y[i] = imy_m;
@@ -1,6 +1,7 @@
 #ifndef DOMAIN_HPP
 #define DOMAIN_HPP
 
+#include <cmath>
 #include <iostream>
 #include <vector>
 
@@ -34,14 +35,70 @@ struct domain {
 	double xhi[3]; ///< Upper bounds of box.
 	int periodic;  ///< This int set periodicity, see periodic_bits
 
+	/**
+	   Tilt factors of a triclinic box, as in LAMMPS. The box is spanned
+	   by a = (Lx,0,0), b = (xy,Ly,0) and c = (xz,yz,Lz) from xlo, with
+	   L = xhi - xlo. For orthogonal boxes they are all 0.
+	*/
+	double xy, xz, yz;
+
 	/// Empty constructor
-	domain() : xlo{0,0,0}, xhi{0,0,0}, periodic(0) {}
+	domain() : xlo{0,0,0}, xhi{0,0,0}, periodic(0), xy(0), xz(0), yz(0) {}
 	/// Empty destructor
 	~domain(){}
 
 	/// Copy constructor
 	domain( const domain &o );
 
+	/// Returns true if the box is tilted.
+	bool is_triclinic() const
+	{ return xy != 0 || xz != 0 || yz != 0; }
+
+	/**
+	   \brief Converts a position to fractional coordinates.
+
+	   \param[in]  x  Position vector.
+	   \param[out] s  Coordinates along the box vectors, in [0,1) inside
+	                  the box. Along a direction in which the box is
+	                  flat this is 0.
+	*/
+	void to_fractional( const double x[3], double s[3] ) const;
+
+	/// Converts fractional coordinates back to a position.
+	void from_fractional( const double s[3], double x[3] ) const;
+
+	/**
+	   \brief Gets the distances between opposite faces of the box.
+
+	   For orthogonal boxes these are the box lengths. A tilted box is
+	   thinner than that, which matters for anything that has to fit
+	   a cut-off in the box.
+
+	   \param[out] w     Distance between the faces spanned by the other
+	                     two box vectors, per box vector.
+	   \param[in]  dims  Dimensionality, in 2D xz and yz are ignored.
+	*/
+	void face_widths( double w[3], int dims = 3 ) const;
+
+	/**
+	   \brief Sets the box from the bounds in a LAMMPS dump file.
+
+	   For triclinic boxes dump files have the bounding box of the box
+	   and the tilt factors, rather than xlo and xhi.
+
+	   \param lo_bound  Lower bounds of the bounding box.
+	   \param hi_bound  Upper bounds of the bounding box.
+	   \param txy       Tilt factor xy.
+	   \param txz       Tilt factor xz.
+	   \param tyz       Tilt factor yz.
+	*/
+	void set_from_bounding_box( const double lo_bound[3],
+	                            const double hi_bound[3],
+	                            double txy, double txz, double tyz );
+
+	/// Gets the bounding box, as LAMMPS dump files have it.
+	void bounding_box( double lo_bound[3], double hi_bound[3] ) const;
+
 	/**
 	   \brief Calculates distance vector and distance^2 between two points.
 
@@ -141,9 +198,49 @@ void domain::rewrap_position( double x[3] ) const
 	rewrap_position( x, ix );
 }
 
+inline
+void domain::to_fractional( const double x[3], double s[3] ) const
+{
+	double dz = x[2] - xlo[2];
+	double dy = x[1] - xlo[1];
+	double dx = x[0] - xlo[0];
+	double L[3] = { xhi[0] - xlo[0], xhi[1] - xlo[1], xhi[2] - xlo[2] };
+	// A flat box (such as z in 2D) has nothing to divide by.
+	s[2] = L[2] > 0 ? dz / L[2] : 0.0;
+	s[1] = L[1] > 0 ? ( dy - s[2]*yz ) / L[1] : 0.0;
+	s[0] = L[0] > 0 ? ( dx - s[1]*xy - s[2]*xz ) / L[0] : 0.0;
+}
+
+inline
+void domain::from_fractional( const double s[3], double x[3] ) const
+{
+	x[0] = xlo[0] + s[0]*( xhi[0] - xlo[0] ) + s[1]*xy + s[2]*xz;
+	x[1] = xlo[1] + s[1]*( xhi[1] - xlo[1] ) + s[2]*yz;
+	x[2] = xlo[2] + s[2]*( xhi[2] - xlo[2] );
+}
+
 inline
 void domain::rewrap_position( double x[3], int ix[3] ) const
 {
+	if( is_triclinic() ){
+		// Shift by whole box vectors until inside the parallelepiped.
+		double s[3];
+		to_fractional( x, s );
+		int n[3] = { 0, 0, 0 };
+		for( int d = 0; d < 3; ++d ){
+			if( periodic & ( 1 << d ) ) n[d] = std::floor( s[d] );
+		}
+		if( n[0] || n[1] || n[2] ){
+			x[0] -= n[0]*( xhi[0] - xlo[0] ) + n[1]*xy + n[2]*xz;
+			x[1] -= n[1]*( xhi[1] - xlo[1] ) + n[2]*yz;
+			x[2] -= n[2]*( xhi[2] - xlo[2] );
+			ix[0] += n[0];
+			ix[1] += n[1];
+			ix[2] += n[2];
+		}
+		return;
+	}
+
 	// Periodicity:
 	if( periodic & BIT_X ){
 		int d_ix = rewrap_position_component<0>(x);
@@ -163,6 +260,29 @@ void domain::rewrap_position( double x[3], int ix[3] ) const
 inline
 void domain::rewrap_vector( double x[3] ) const
 {
+	if( is_triclinic() ){
+		// The box vectors are lower triangular, so going from c down
+		// to a every shift leaves the components done before alone.
+		if( periodic & BIT_Z ){
+			double Lz = xhi[2] - xlo[2];
+			double n = std::round( x[2] / Lz );
+			x[2] -= n*Lz;
+			x[1] -= n*yz;
+			x[0] -= n*xz;
+		}
+		if( periodic & BIT_Y ){
+			double Ly = xhi[1] - xlo[1];
+			double n = std::round( x[1] / Ly );
+			x[1] -= n*Ly;
+			x[0] -= n*xy;
+		}
+		if( periodic & BIT_X ){
+			double Lx = xhi[0] - xlo[0];
+			x[0] -= std::round( x[0] / Lx )*Lx;
+		}
+		return;
+	}
+
 	// Periodicity:
 	if( periodic & BIT_X ){
 		rewrap_vector_component<0>(x);
@@ -228,6 +348,10 @@ inline void domain::unwrap_image(double x[3], int flags[3]) const
 	unwrap_image_component<0>(x,flags);
 	unwrap_image_component<1>(x,flags);
 	unwrap_image_component<2>(x,flags);
+
+	// Images along b and c are also shifted in x (and y).
+	x[0] += flags[1]*xy + flags[2]*xz;
+	x[1] += flags[2]*yz;
 }
 
 
@@ -7,48 +7,174 @@
 #include "dump_reader_lammps_plain.hpp"
 #include "dump_reader_xyz.hpp"
 
+#include "bounded_queue.hpp"
+
+#include <atomic>
+#include <exception>
+#include <limits>
+#include <memory> // Smart pointers.
+#include <thread>
+
 #ifdef THREADED_READ_BLOCKS
-#include "../dependencies/readerwriterqueue/readerwriterqueue.h"
-constexpr const bool threaded_read_blocks = true;
+constexpr const std::size_t default_prefetch_depth = 2;
 #else
-constexpr const bool threaded_read_blocks = false;
+constexpr const std::size_t default_prefetch_depth = 0;
+#endif // THREADED_READ_BLOCKS
+
+namespace lammps_tools {
 
-// Dummy class:
-namespace moodycamel {
+namespace readers {
 
-template <typename T, size_t MAX_BLOCK_SIZE>
-class ReaderWriterQueue
+/// A block read ahead by the prefetch thread, and how reading it went.
+struct prefetched_block
 {
-public:
-	ReaderWriterQueue(){};
+	prefetched_block() : block(), status( 0 ), error() {}
 
-	T t;
+	block_data block;
+	int status;
+	std::exception_ptr error;
 };
 
-}// namespace moodycamel
-#endif // THREADED_READ_BLOCKS
+void swap( prefetched_block &f, prefetched_block &s )
+{
+	using std::swap;
+	swap( f.block, s.block );
+	swap( f.status, s.status );
+	swap( f.error, s.error );
+}
 
-#include <memory> // Smart pointers.
 
-namespace lammps_tools {
+/// State shared between the reader and its prefetch thread.
+struct prefetch_state
+{
+	explicit prefetch_state( std::size_t depth )
+		: queue( depth ), out(), thread(), stop( false )
+	{ }
+
+	util::bounded_queue<prefetched_block> queue;
+	prefetched_block out; ///< Last block popped by the reader.
+	std::thread thread;
+	std::atomic<bool> stop;
+};
 
-namespace readers {
 
 dump_reader::dump_reader()
-	: quiet(true), read_blocks(nullptr), read_started(false)
+	: quiet(true), read_blocks(nullptr),
+	  prefetch_depth( default_prefetch_depth ), read_started(false)
+{ }
+
+dump_reader::~dump_reader()
 {
-	if( threaded_read_blocks ){
-		read_blocks = new moodycamel::ReaderWriterQueue<block_data>;
+	// Derived readers should have done this already, as the
+	// thread calls into them.
+	stop_prefetch();
+	if( read_blocks ){
+		delete read_blocks;
 	}
 }
 
-dump_reader::~dump_reader()
+
+void dump_reader::set_prefetch( std::size_t n_blocks )
 {
+	if( n_blocks == prefetch_depth ) return;
+
+	stop_prefetch();
 	if( read_blocks ){
+		if( read_blocks->queue.size() > 0 ){
+			my_runtime_error( __FILE__, __LINE__,
+			                  "Cannot change prefetch depth while "
+			                  "blocks are queued!" );
+		}
 		delete read_blocks;
+		read_blocks = nullptr;
 	}
+	prefetch_depth = n_blocks;
+}
+
+
+void dump_reader::stop_prefetch()
+{
+	if( !read_started ) return;
+
+	read_blocks->stop = true;
+	read_blocks->queue.close();
+	read_blocks->thread.join();
+	read_blocks->queue.reopen();
+	read_blocks->stop = false;
+	read_started = false;
 }
 
+
+std::size_t dump_reader::drop_prefetched( std::size_t n )
+{
+	stop_prefetch();
+	if( !read_blocks ) return 0;
+
+	std::size_t dropped = 0;
+	while( dropped < n && read_blocks->queue.size() > 0 ){
+		read_blocks->queue.pop( read_blocks->out );
+		// Only count real blocks, not queued EOF or errors.
+		if( read_blocks->out.status == 0 ) ++dropped;
+	}
+	read_blocks->out.error = nullptr;
+	return dropped;
+}
+
+
+void dump_reader::reread_prefetched()
+{
+	// Readers also change their settings while reading a block.
+	if( read_started &&
+	    std::this_thread::get_id() == read_blocks->thread.get_id() ){
+		return;
+	}
+	stop_prefetch();
+	if( !read_blocks || read_blocks->queue.size() == 0 ) return;
+
+	const frame_index *index = index_frames();
+	if( !index ){
+		std::cerr << "Cannot read the blocks that were read ahead "
+		          << "again, they keep the old settings!\n";
+		return;
+	}
+
+	// The first queued block is the next one to hand out. EOF or an
+	// error come up again by themselves once reading resumes.
+	prefetched_block &first = read_blocks->out;
+	read_blocks->queue.pop( first );
+	int status = first.status;
+	bigint tstep = first.block.tstep;
+	drop_prefetched( std::numeric_limits<std::size_t>::max() );
+	if( status != 0 ) return;
+
+	std::size_t k = index->find_timestep( tstep );
+	if( k == index->size() || seek_frame( k ) != 0 ){
+		my_runtime_error( __FILE__, __LINE__, "Failed to go back to "
+		                  "the blocks that were read ahead!" );
+	}
+}
+
+
+void dump_reader::prefetch_loop( bool warn_if_no_special )
+{
+	prefetched_block pb;
+	while( !read_blocks->stop ){
+		pb.error = nullptr;
+		try {
+			pb.status = next_block_impl( pb.block, warn_if_no_special );
+		}catch( ... ){
+			pb.status = -1;
+			pb.error = std::current_exception();
+		}
+		bool done = pb.status != 0;
+
+		// Blocks while the queue is full.
+		read_blocks->queue.push( pb );
+		if( done ) break;
+	}
+}
+
+
 // The dumb way is to just read n blocks.
 int dump_reader::skip_n_blocks( uint n )
 {
@@ -82,6 +208,50 @@ int dump_reader::skip_to_block(uint n, uint curr)
 	skip_n_blocks(diff-1);
 	return 0;
 }
+
+
+const frame_index *dump_reader::get_frame_index()
+{
+	// Building the index moves through the file too.
+	stop_prefetch();
+	return index_frames();
+}
+
+
+int dump_reader::seek_to_frame( std::size_t k )
+{
+	const frame_index *index = get_frame_index();
+	if( !index ){
+		std::cerr << "This dump reader cannot seek!\n";
+		return -1;
+	}
+	if( k >= index->size() ){
+		std::cerr << "Cannot seek to frame " << k << ", dump file has "
+		          << index->size() << " frames!\n";
+		return 1;
+	}
+
+	// Whatever was read ahead is no longer next.
+	drop_prefetched( std::numeric_limits<std::size_t>::max() );
+	return seek_frame( k );
+}
+
+
+int dump_reader::seek_to_timestep( bigint tstep )
+{
+	const frame_index *index = get_frame_index();
+	if( !index ){
+		std::cerr << "This dump reader cannot seek!\n";
+		return -1;
+	}
+	std::size_t k = index->find_timestep( tstep );
+	if( k == index->size() ){
+		std::cerr << "Dump file has no frame at time step "
+		          << tstep << "!\n";
+		return 1;
+	}
+	return seek_to_frame( k );
+}
 	
 
 /**
@@ -101,7 +271,7 @@ void set_type_names_to_type( block_data &block )
 
 int dump_reader::next_block( block_data &block, bool warn_if_no_special )
 {
-	if( threaded_read_blocks ){
+	if( prefetch_depth > 0 ){
 		return next_block_thr_impl( block, warn_if_no_special );
 	}else{
 		return next_block_impl( block, warn_if_no_special );
@@ -112,7 +282,38 @@ int dump_reader::next_block( block_data &block, bool warn_if_no_special )
 int dump_reader::next_block_thr_impl( block_data &block,
 				      bool warn_if_no_special )
 {
-	return next_block_impl( block, warn_if_no_special );
+	if( !read_blocks ){
+		read_blocks = new prefetch_state( prefetch_depth );
+	}
+	// Hand out blocks that were read before the thread was stopped
+	// first, so that the thread picks up reading where it left off.
+	if( !read_started && read_blocks->queue.size() == 0 ){
+		read_blocks->thread = std::thread( &dump_reader::prefetch_loop,
+		                                   this, warn_if_no_special );
+		read_started = true;
+	}
+
+	prefetched_block &out = read_blocks->out;
+	if( !read_blocks->queue.pop( out ) ){
+		return -1;
+	}
+
+	if( out.status != 0 ){
+		// The thread stops after EOF or an error, so clean it up.
+		// The next call starts a new one if needed.
+		stop_prefetch();
+	}
+	if( out.error ){
+		std::exception_ptr error = out.error;
+		out.error = nullptr;
+		std::rethrow_exception( error );
+	}
+
+	if( out.status == 0 ){
+		using std::swap;
+		swap( block, out.block );
+	}
+	return out.status;
 }
 
 
@@ -9,35 +9,27 @@
 
 #include "block_data.hpp"
 #include "enums.hpp"
+#include "frame_index.hpp"
 
 #include <iosfwd>
 #include <memory>
 
-#ifdef THREADED_READ_BLOCKS
-namespace moodycamel {
-template <typename T, size_t MAX_BLOCK_SIZE> class ReaderWriterQueue;
-}
-#else
-namespace moodycamel {
-template <typename T, size_t MAX_BLOCK_SIZE = 512> class ReaderWriterQueue;
-}
-#endif
-
-
 namespace lammps_tools {
 
 /// Contains functions and classes that are related to reading dump files.
 namespace readers {
 
+struct prefetch_state;
+
 
 /// A generic class for reading in dump files.
 class dump_reader
 {
 public:
-	/// Allocates the queue.
+	/// Sets up a reader without prefetch queue.
 	dump_reader();
 
-	/// Empty destructor:
+	/// Stops the prefetch thread and cleans up the queue.
 	virtual ~dump_reader();
 
 	/**
@@ -66,28 +58,135 @@ public:
 	/// Skips n blocks, might not actually be fast.
 	virtual int skip_n_blocks( uint n );
 
-
 	/// Skips to specific block from current block.
 	virtual int skip_to_block( uint n, uint current );
-	
+
+	/**
+	   \brief Returns the index of all frames in the dump file.
+
+	   Readers that can seek build the index on first use. Text dumps
+	   are scanned once, without parsing the atom lines, and the index
+	   is cached in a sidecar file (see frame_index) for next time.
+
+	   \returns a pointer to the index, or nullptr if this reader
+	            cannot seek.
+	*/
+	const frame_index *get_frame_index();
+
+	/**
+	   \brief Moves the reader so that the next block read is frame k.
+
+	   Frames are counted from the start of the file, regardless of
+	   what was read before, so this can also go back.
+
+	   \param k  Index of the frame to read next.
+
+	   \returns 0 on success, positive if there is no frame k,
+	            negative if this reader cannot seek or seeking failed.
+	*/
+	int seek_to_frame( std::size_t k );
+
+	/**
+	   \brief Moves the reader so that the next block read is the first
+	   frame with time step tstep.
+
+	   \param tstep  Time step of the frame to read next.
+
+	   \returns 0 on success, positive if there is no such frame,
+	            negative if this reader cannot seek or seeking failed.
+	*/
+	int seek_to_timestep( bigint tstep );
+
+	/**
+	   \brief Sets how many blocks a background thread may read ahead.
+
+	   If n_blocks > 0, the first call to next_block starts a thread
+	   that keeps reading blocks into a queue of at most n_blocks,
+	   so that reading overlaps with whatever is done with the blocks.
+	   Errors and EOF are reported by next_block in the same order as
+	   without the thread. The default is 0 (no thread), unless the
+	   library is compiled with THREADED_READ_BLOCKS.
+
+	   \warning Settings that affect reading, like column headers and
+	            types, should be set before the first next_block. If
+	            they change later, the blocks that the thread already
+	            read are read again, which needs a frame index.
+
+	   \param n_blocks  Number of blocks to read ahead, 0 to disable.
+	*/
+	void set_prefetch( std::size_t n_blocks );
+
+	/// Returns the number of blocks read ahead, see set_prefetch.
+	std::size_t get_prefetch() const { return prefetch_depth; }
+
+protected:
+	/**
+	   \brief Stops the prefetch thread, if running.
+
+	   Blocks that were already read ahead stay queued and are
+	   returned by next_block first. Because the thread calls
+	   get_next_block, every reader has to call this first thing
+	   in its destructor.
+	*/
+	void stop_prefetch();
+
+	/**
+	   \brief Stops the prefetch thread and drops up to n queued blocks.
+
+	   Readers that move through the file by themselves need this
+	   to account for the blocks that were already read ahead.
+
+	   \param n  Maximum number of blocks to drop.
+
+	   \returns the number of blocks that were dropped.
+	*/
+	std::size_t drop_prefetched( std::size_t n );
+
+	/**
+	   \brief Makes the blocks that were read ahead get read again.
+
+	   Readers call this before they change a setting that affects
+	   how blocks are read, so that next_block does not hand out
+	   blocks read with the old setting. It stops the prefetch thread
+	   and seeks back to the first queued block. If the reader cannot
+	   seek, the queued blocks keep the old setting.
+
+	   Calls from the prefetch thread itself are ignored.
+	*/
+	void reread_prefetched();
 
 private:
 	virtual int  get_next_block( block_data &block ) = 0;
 	virtual bool check_eof()  const = 0;
 	virtual bool check_good() const = 0;
 
+	/// Builds or loads the frame index, default is no index.
+	virtual const frame_index *index_frames() { return nullptr; }
+
+	/// Moves to indexed frame k, which is known to exist.
+	virtual int seek_frame( std::size_t k ) { return -1; }
+
 	/// Implementation of serial next_block
 	int next_block_impl( block_data &block, bool warn_if_no_special );
 
 	/// Implementation of threaded next_block
 	int next_block_thr_impl( block_data &block, bool warn_if_no_special );
 
+	/// Body of the prefetch thread.
+	void prefetch_loop( bool warn_if_no_special );
 
 	/// Contains a buffer to store the blocks in.
-	moodycamel::ReaderWriterQueue<block_data,512> *read_blocks;
+	prefetch_state *read_blocks;
+
+	/// Maximum number of blocks in read_blocks, 0 means no thread.
+	std::size_t prefetch_depth;
+
 	/// If true, the first read was called and a thread will start
 	/// filling read_blocks.
 	bool read_started;
+
+	dump_reader( const dump_reader & ) = delete;
+	dump_reader &operator=( const dump_reader & ) = delete;
 };
 
 
@@ -6,6 +6,7 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <utility>
 #include <unistd.h> // For fdopen
 
 #include "writers_hoomd.hpp"
@@ -71,6 +72,7 @@ dump_reader_hoomd_gsd::dump_reader_hoomd_gsd( const std::string &fname )
 
 dump_reader_hoomd_gsd::~dump_reader_hoomd_gsd()
 {
+	stop_prefetch();
 	// prevents compiler complaint about deleting forward-declared struct:
 #ifdef HAVE_GSD
 	if( gh ){
@@ -432,12 +434,11 @@ int dump_reader_hoomd_gsd::add_optional_data( block_data &b, T &data, uint n_fie
 		// might contain more than one per-atom data, and those
 		// need to be split to different data fields.
 		for( std::size_t nf = 0; nf < n_fields; ++nf ){
-			data_field_double d( names[nf], b.N );
+			data_field_double &d = b.emplace_field<double>( names[nf] );
 			for( bigint i = 0; i < b.N; ++i ){
 				std::size_t index = stride*i + nf;
 				d[i] = data[index];
 			}
-			b.add_field( d );
 
 			if( !quiet ){
 				std::cerr << "Added field " << names[nf]
@@ -447,12 +448,11 @@ int dump_reader_hoomd_gsd::add_optional_data( block_data &b, T &data, uint n_fie
 		}
 	}else if( data_type == data_field::INT ){
 		for( std::size_t nf = 0; nf < n_fields; ++nf ){
-			data_field_int d( names[nf], b.N );
+			data_field_int &d = b.emplace_field<int>( names[nf] );
 			for( bigint i = 0; i < b.N; ++i ){
 				std::size_t index = stride*i + nf;
 				d[i] = data[index];
 			}
-			b.add_field( d );
 
 			if( !quiet ){
 				std::cerr << "Added field " << names[nf]
@@ -514,12 +514,17 @@ int dump_reader_hoomd_gsd::get_next_block( block_data &block )
 
 
 	tmp.tstep = tstep;
-	tmp.dom.xlo[0] = -0.5*box[0];
-	tmp.dom.xlo[1] = -0.5*box[1];
+	// HOOMD tilt factors are relative to the box lengths, and the box
+	// is centred on the origin.
+	tmp.dom.xy = box[3]*box[1];
+	tmp.dom.xz = box[4]*box[2];
+	tmp.dom.yz = box[5]*box[2];
+	tmp.dom.xlo[0] = -0.5*( box[0] + tmp.dom.xy + tmp.dom.xz );
+	tmp.dom.xlo[1] = -0.5*( box[1] + tmp.dom.yz );
 	tmp.dom.xlo[2] = -0.5*box[2];
-	tmp.dom.xhi[0] =  0.5*box[0];
-	tmp.dom.xhi[1] =  0.5*box[1];
-	tmp.dom.xhi[2] =  0.5*box[2];
+	tmp.dom.xhi[0] = tmp.dom.xlo[0] + box[0];
+	tmp.dom.xhi[1] = tmp.dom.xlo[1] + box[1];
+	tmp.dom.xhi[2] = tmp.dom.xlo[2] + box[2];
 
 	tmp.set_natoms(N);
 
@@ -593,15 +598,15 @@ int dump_reader_hoomd_gsd::get_next_block( block_data &block )
 	tmp.ati.type_names = type_names;
 	tmp.atom_style = lammps_tools::ATOM_STYLE_ATOMIC;
 
-	tmp.add_field( id, block_data::special_fields::ID );
+	tmp.add_field( std::move( id ), block_data::special_fields::ID );
 	if( optional_data_found[BODY] ){
 		tmp.atom_style = lammps_tools::ATOM_STYLE_MOLECULAR;
-		tmp.add_field( mol, block_data::special_fields::MOL );
+		tmp.add_field( std::move( mol ), block_data::special_fields::MOL );
 	}
-	tmp.add_field( type, block_data::special_fields::TYPE );
-	tmp.add_field( x, block_data::special_fields::X );
-	tmp.add_field( y, block_data::special_fields::Y );
-	tmp.add_field( z, block_data::special_fields::Z );
+	tmp.add_field( std::move( type ), block_data::special_fields::TYPE );
+	tmp.add_field( std::move( x ), block_data::special_fields::X );
+	tmp.add_field( std::move( y ), block_data::special_fields::Y );
+	tmp.add_field( std::move( z ), block_data::special_fields::Z );
 
 
 	// ****    Check for additional fields that might be present:    ****
@@ -658,7 +663,7 @@ int dump_reader_hoomd_gsd::get_next_block( block_data &block )
 		                                  "mom_inertia.z" } );
 	}
 
-	block = tmp;
+	swap( block, tmp );
 
 	return 0;
 
@@ -4,6 +4,9 @@
 #include "dump_reader_lammps_gzip.hpp"
 #include "dump_reader_lammps_bin.hpp"
 
+#include <thread>
+#include <utility>
+
 
 using namespace lammps_tools;
 // using namespace readers;
@@ -23,6 +26,7 @@ bool is_int_data_field( const std::string &header )
 void dump_reader_lammps::set_column_headers(
 	const std::vector<std::string> &headers )
 {
+	reread_prefetched();
 	column_headers = headers;
 	column_header_types.resize( headers.size(), default_col_type );
 
@@ -41,6 +45,7 @@ void dump_reader_lammps::set_column_header( std::size_t idx,
                                             const std::string &header,
                                             int special_field_type )
 {
+	reread_prefetched();
 	if( idx >= column_headers.size() ){
 		column_headers.resize(idx+1);
 		column_header_types.resize(idx+1);
@@ -71,6 +76,7 @@ const std::vector<std::string> &dump_reader_lammps::get_column_headers() const
 bool dump_reader_lammps::set_column_header_as_special( const std::string &header,
                                                        int special_field_type )
 {
+	reread_prefetched();
 	my_assert( __FILE__, __LINE__,
 	           is_legal_special_field( special_field_type ),
 	           "Invalid special_field_type!" );
@@ -103,15 +109,109 @@ void dump_reader_lammps::add_custom_data_fields( std::vector<data_field*> &dfs,
 			if( special_field_type == block_data::MOL ){
 				b.atom_style = ATOM_STYLE_MOLECULAR;
 			}
-			b.add_field( *df, special_field_type );
+			b.add_field( std::move( *df ), special_field_type );
 		}else{
-			b.add_field( *df );
+			b.add_field( std::move( *df ) );
 		}
 		delete df;
 	}
 }
 
 
+block_data &dump_reader_lammps::recycled_block()
+{
+	block_data &b = spare;
+	b.tstep = 0;
+	b.N = b.N_ghost = b.N_true = 0;
+	b.N_types = 1;
+	b.atom_style = ATOM_STYLE_ATOMIC;
+	b.dom = domain();
+	b.top = topology();
+
+	// Same as atom_type_info( 1 ), but keeps the storage.
+	b.ati.mass.assign( 2, 1.0 );
+	b.ati.type_names.clear();
+	return b;
+}
+
+
+void dump_reader_lammps::prepare_data_fields(
+	block_data &b, const std::vector<std::string> &headers, std::size_t N )
+{
+	field_types.resize( headers.size() );
+	field_specials.assign( headers.size(), block_data::UNKNOWN );
+	for( std::size_t i = 0; i < headers.size(); ++i ){
+		field_types[i] = get_column_type( headers[i] );
+		auto it = header_to_special_field.find( headers[i] );
+		if( it != header_to_special_field.end() ){
+			field_specials[i] = it->second;
+		}
+	}
+	prepare_data_fields( b, headers, field_types, field_specials, N );
+}
+
+
+void dump_reader_lammps::prepare_data_fields(
+	block_data &b, const std::vector<std::string> &headers,
+	const std::vector<int> &types, const std::vector<int> &special_fields,
+	std::size_t N )
+{
+	bool reuse = b.n_data_fields() == headers.size();
+	for( std::size_t i = 0; reuse && i < headers.size(); ++i ){
+		const data_field &df = b[ static_cast<int>(i) ];
+		// Fields that are not legal specials are not stored as such.
+		int special = special_fields[i];
+		if( !is_legal_special_field( special ) ){
+			special = block_data::UNKNOWN;
+		}
+		reuse = df.name == headers[i] && df.type() == types[i] &&
+			b.get_special_field_type( static_cast<int>(i) ) == special;
+	}
+
+	if( !reuse ){
+		b.clear();
+		b.N = N;
+		for( std::size_t i = 0; i < headers.size(); ++i ){
+			if( types[i] == data_field::INT ){
+				b.emplace_field<int>( headers[i], special_fields[i] );
+			}else{
+				b.emplace_field<double>( headers[i], special_fields[i] );
+			}
+		}
+		column_allocations += headers.size();
+		return;
+	}
+
+	for( std::size_t i = 0; i < headers.size(); ++i ){
+		data_field *df = b.get_data_rw( static_cast<int>(i) );
+		std::size_t capacity = df->type() == data_field::INT ?
+			data_as_rw<int>( df ).capacity() :
+			data_as_rw<double>( df ).capacity();
+		if( capacity < N ) ++column_allocations;
+	}
+	b.set_natoms( N );
+	if( b.get_special_field( block_data::MOL ) ){
+		b.atom_style = ATOM_STYLE_MOLECULAR;
+	}
+}
+
+
+void dump_reader_lammps::get_column_sinks( block_data &b,
+                                           std::vector<column_sink> &cols )
+{
+	cols.resize( b.n_data_fields() );
+	for( std::size_t k = 0; k < cols.size(); ++k ){
+		data_field *df = b.get_data_rw( static_cast<int>(k) );
+		if( df->type() == data_field::INT ){
+			cols[k].i_dest = data_as_rw<int>( df ).data();
+			cols[k].d_dest = nullptr;
+		}else{
+			cols[k].i_dest = nullptr;
+			cols[k].d_dest = data_as_rw<double>( df ).data();
+		}
+	}
+}
+
 
 dump_reader_lammps *make_dump_reader_lammps( const std::string &fname,
                                              int fformat,
@@ -157,6 +257,7 @@ dump_reader_lammps *make_dump_reader_lammps( const std::string &fname, int fform
 
 void dump_reader_lammps::set_column_type( const std::string &header, int type )
 {
+	reread_prefetched();
 	my_assert( __FILE__, __LINE__,
 	           (type == data_field::INT || type == data_field::DOUBLE),
 	           "Incorrect data type passed to set_column_type!");
@@ -197,10 +298,31 @@ void dump_reader_lammps::set_default_column_type( int type )
 	}
 	std::cerr << "Putting default column type to "
 	          << pretty_type(type) << ".\n";
+	reread_prefetched();
 	default_col_type = type;
 }
 
 
+void dump_reader_lammps::set_parse_threads( int n )
+{
+	if( n <= 0 ){
+		n = std::thread::hardware_concurrency();
+		if( n <= 0 ) n = 1;
+	}
+	parse_threads = n;
+}
+
+int dump_reader_lammps::get_parse_threads() const
+{
+	return parse_threads;
+}
+
+std::size_t dump_reader_lammps::get_column_allocations() const
+{
+	return column_allocations;
+}
+
+
 } // namespace readers
 
 } // namespace lammps_tools
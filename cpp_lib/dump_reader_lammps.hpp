@@ -4,6 +4,7 @@
 // LAMMPS dump readers come in three flavours: Plain, gzip and bin.
 // They all share this general interface.
 
+#include <atomic>
 #include <iosfwd>
 
 #include "dump_reader.hpp"
@@ -31,8 +32,9 @@ public:
 	/// Empty constructor
 	dump_reader_lammps( int dump_style )
 		: dump_style(dump_style), default_col_type(data_field::DOUBLE),
-		  header_to_special_field(), column_headers(),
-		  column_header_types()
+		  header_to_special_field(), parse_threads(1), column_headers(),
+		  column_header_types(), field_types(), field_specials(), spare(),
+		  column_allocations(0)
 	{ }
 
 	const int dump_style;
@@ -92,8 +94,90 @@ public:
 
 	int default_col_type; ///< Stores the default value assumed for columns.
 
+	/**
+	   \brief Sets the number of threads used to parse a single block.
+
+	   Text dumps with many atoms per block are split at line boundaries
+	   and the pieces are parsed concurrently. Blocks with few atoms are
+	   always parsed serially. The gzip reader also uses this many
+	   threads for decompression, once the file is indexed.
+	   Set this before reading blocks.
+
+	   \param n  Number of threads to use, 0 picks one per core.
+	*/
+	void set_parse_threads( int n );
+
+	/// Returns the number of threads used to parse a single block.
+	int get_parse_threads() const;
+
+	/**
+	   \brief Returns how often reading a block had to allocate storage
+	   for a data field, summed over all blocks read so far.
+
+	   Blocks are read into the data fields of the block that was
+	   passed to next_block before, so once the column layout of the
+	   dump is known, reading the next block allocates nothing and
+	   this stays the same. The difference before and after a call
+	   to next_block is the number of allocations for that block.
+	*/
+	std::size_t get_column_allocations() const;
+
 protected:
+	/// Points at the storage of one column, typed so no dispatch is needed.
+	struct column_sink
+	{
+		int    *i_dest; ///< Storage if the column holds ints, or nullptr.
+		double *d_dest; ///< Storage if the column holds doubles, or nullptr.
+	};
+
+	/**
+	   \brief Returns the block to read the next block into.
+
+	   Readers read into this block and swap it with the block passed
+	   to next_block once reading succeeded, so that block is left
+	   unchanged on failure. The data fields of the block that comes
+	   back are kept, everything else is reset to how a new block_data
+	   has it.
+	*/
+	block_data &recycled_block();
+
+	/**
+	   \brief Makes the data fields of b hold N values for each of
+	   given headers.
+
+	   If b already has exactly these fields, in this order and of
+	   the right types, they are resized and their old values are
+	   left in them. Otherwise they are replaced by new fields. The
+	   types and special fields are looked up from the column headers.
+
+	   \param[out] b        The block data to set up the fields of.
+	   \param[in]  headers  The headers of the fields, in order.
+	   \param[in]  N        Number of rows the fields should hold.
+	*/
+	void prepare_data_fields( block_data &b,
+	                          const std::vector<std::string> &headers,
+	                          std::size_t N );
+
+	/**
+	   \brief Sets up data fields with given types and special fields.
+	   \overloads prepare_data_fields
+	*/
+	void prepare_data_fields( block_data &b,
+	                          const std::vector<std::string> &headers,
+	                          const std::vector<int> &types,
+	                          const std::vector<int> &special_fields,
+	                          std::size_t N );
+
+	/**
+	   \brief Resolves the storage of each data field of b, in order.
+
+	   \param[in]  b     The block data whose fields to resolve.
+	   \param[out] cols  Will contain a column_sink per data field.
+	*/
+	void get_column_sinks( block_data &b, std::vector<column_sink> &cols );
+
 	std::map<std::string, int> header_to_special_field;
+	int parse_threads; ///< Number of threads to parse a block with.
 private:
 	virtual int  get_next_block( lammps_tools::block_data &block ) = 0;
 	virtual bool check_eof()  const = 0;
@@ -102,6 +186,13 @@ private:
 	std::vector<std::string> column_headers;
 	std::vector<int> column_header_types;
 
+	// Scratch space for prepare_data_fields.
+	std::vector<int> field_types, field_specials;
+
+	block_data spare; ///< Block the next block is read into.
+
+	/// Number of data fields allocated while reading blocks.
+	std::atomic<std::size_t> column_allocations;
 };
 
 
@@ -1,6 +1,6 @@
 #include "dump_reader_lammps_bin.hpp"
 
-#include <cstdio>
+#include <algorithm>
 #include <cstring>
 
 
@@ -25,140 +25,275 @@ typedef int64_t bigint;
 using namespace lammps_tools;
 using namespace readers;
 
+
+namespace {
+
+/// Layout of the header that precedes each frame in a binary dump.
+struct frame_header
+{
+	bigint ntimestep, natoms;
+	int triclinic;
+	int boundary[3][2];
+	double xlo[3], xhi[3];
+	double xy, xz, yz;
+	int size_one, nchunk;
+};
+
+
+/**
+   Reads a T from the mapping at offset and advances offset.
+
+   The file makes no alignment guarantees, hence the memcpy.
+
+   \returns false if the file ends before the value does.
+*/
+template <typename T> inline
+bool read_value( const char *data, std::size_t size,
+                 std::size_t &offset, T &val )
+{
+	if( offset > size || size - offset < sizeof(T) ) return false;
+	std::memcpy( &val, data + offset, sizeof(T) );
+	offset += sizeof(T);
+	return true;
+}
+
+
+/**
+   Parses the frame header at offset.
+
+   \returns offset of the first chunk, or 0 if the header is truncated.
+*/
+std::size_t read_frame_header( const char *data, std::size_t size,
+                               std::size_t offset, frame_header &h )
+{
+	bool ok = read_value( data, size, offset, h.ntimestep );
+	ok = ok && read_value( data, size, offset, h.natoms );
+	ok = ok && read_value( data, size, offset, h.triclinic );
+	for( int d = 0; d < 3; ++d ){
+		ok = ok && read_value( data, size, offset, h.boundary[d][0] );
+		ok = ok && read_value( data, size, offset, h.boundary[d][1] );
+	}
+	for( int d = 0; d < 3; ++d ){
+		ok = ok && read_value( data, size, offset, h.xlo[d] );
+		ok = ok && read_value( data, size, offset, h.xhi[d] );
+	}
+	h.xy = h.xz = h.yz = 0.0;
+	if( ok && h.triclinic ){
+		ok = ok && read_value( data, size, offset, h.xy );
+		ok = ok && read_value( data, size, offset, h.xz );
+		ok = ok && read_value( data, size, offset, h.yz );
+	}
+	ok = ok && read_value( data, size, offset, h.size_one );
+	ok = ok && read_value( data, size, offset, h.nchunk );
+
+	if( !ok ) return 0;
+	return offset;
+}
+
+
+/**
+   Walks over the chunks of a frame body starting at offset.
+
+   \returns offset just past the frame, or 0 if the body is truncated
+            or its row count does not match the header.
+*/
+std::size_t skip_frame_body( const char *data, std::size_t size,
+                             std::size_t offset, const frame_header &h )
+{
+	if( h.size_one <= 0 || h.nchunk < 0 ) return 0;
+
+	bigint rows = 0;
+	for( int i = 0; i < h.nchunk; ++i ){
+		int n = 0;
+		if( !read_value( data, size, offset, n ) ) return 0;
+		if( n < 0 || n % h.size_one ) return 0;
+
+		std::size_t n_bytes = static_cast<std::size_t>(n) * sizeof(double);
+		if( size - offset < n_bytes ) return 0;
+		offset += n_bytes;
+		rows += n / h.size_one;
+	}
+	if( rows != h.natoms ) return 0;
+	return offset;
+}
+
+
+/**
+   Converts rows doubles spaced stride bytes apart to T.
+
+   Keeping this a tight loop per column per tile of rows means there
+   is no per-value type dispatch and the compiler can unroll it.
+*/
+template <typename T> inline
+void decode_column( const char *src, std::size_t stride,
+                    std::size_t rows, T *dest )
+{
+	for( std::size_t j = 0; j < rows; ++j ){
+		double val;
+		std::memcpy( &val, src + j*stride, sizeof(double) );
+		dest[j] = static_cast<T>( val );
+	}
+}
+
+} // namespace
+
+
 namespace lammps_tools {
 
 namespace readers {
 
 dump_reader_lammps_bin::dump_reader_lammps_bin( const std::string &fname,
                                                 int dump_style )
-	: dump_reader_lammps( dump_style ), in( nullptr )
+	: dump_reader_lammps( dump_style ), in( nullptr ),
+	  index(), current_frame( 0 ), cols()
 {
 	my_assert( __FILE__, __LINE__, util::file_exists( fname ),
 	           "Dump file does not exist!" );
 
-	in = fopen( fname.c_str(), "rb" );
-	my_assert( __FILE__, __LINE__, in != nullptr,
-	           "Failed to open dump file!" );
+	in.reset( new util::mapped_file( fname ) );
+	my_assert( __FILE__, __LINE__, in->good(),
+	           "Failed to map dump file!" );
+	build_frame_index();
 }
 
 dump_reader_lammps_bin::dump_reader_lammps_bin( const std::string &fname,
                                                 std::vector<std::string> h,
                                                 int dump_style )
-	: dump_reader_lammps( dump_style ), in( nullptr )
+	: dump_reader_lammps( dump_style ), in( nullptr ),
+	  index(), current_frame( 0 ), cols()
 {
-	in = fopen( fname.c_str(), "rb" );
+	in.reset( new util::mapped_file( fname ) );
 	set_column_headers( h );
-	my_assert( __FILE__, __LINE__, in != nullptr,
-	           "Failed to open dump file!" );
+	my_assert( __FILE__, __LINE__, in->good(),
+	           "Failed to map dump file!" );
+	build_frame_index();
 }
 
 dump_reader_lammps_bin::~dump_reader_lammps_bin()
 {
-	if( in ) fclose( in );
+	stop_prefetch();
+}
+
+
+void dump_reader_lammps_bin::build_frame_index()
+{
+	const char *data = in->data();
+	std::size_t size = in->size();
+	std::size_t offset = 0;
+
+	index.frames.clear();
+	index.end = 0;
+	while( offset < size ){
+		frame_header h;
+		std::size_t body = read_frame_header( data, size, offset, h );
+		std::size_t next = body ? skip_frame_body( data, size, body, h ) : 0;
+		if( !next ){
+			// Can happen if LAMMPS is still writing to the file.
+			my_warning( __FILE__, __LINE__,
+			            "Binary dump ends in an incomplete frame, "
+			            "ignoring it!" );
+			break;
+		}
+		index.frames.push_back( { offset, h.ntimestep, h.natoms } );
+		index.end = offset = next;
+	}
+}
+
+
+std::size_t dump_reader_lammps_bin::n_frames() const
+{
+	return index.size();
 }
 
 
+const frame_index *dump_reader_lammps_bin::index_frames()
+{
+	return &index;
+}
+
+
+int dump_reader_lammps_bin::seek_frame( std::size_t k )
+{
+	current_frame = k;
+	return 0;
+}
+
 
 int dump_reader_lammps_bin::get_next_block( block_data &block )
 {
-	if( !in ) return -1;
+	if( !in->good() ) return -1;
 
-	if( std::feof(in) ){
+	if( current_frame >= n_frames() ){
+		if( !quiet ) std::cerr << "EOF reached.\n";
 		return 1;
 	}
+	std::size_t offset = index[current_frame].offset;
 	int size_one, nchunk;
-	block_data tmp;
-	int status = next_block_meta( tmp, size_one, nchunk );
-	if( status > 0 ){
-		if( status == 1 && !quiet ) std::cerr << "EOF reached.\n";
-		return status;
-	}else if( status < 0 ){
+	block_data &tmp = recycled_block();
+	int status = next_block_meta( tmp, offset, size_one, nchunk );
+	if( status ){
 		std::cerr << "Failed to get meta!\n";
 		return -1;
 	}
-	// status was 0, so meta was gotten properly.
-	status = next_block_body( tmp, size_one, nchunk );
+	// Pull in the next frame while this one is being decoded.
+	if( current_frame + 1 < n_frames() ){
+		std::size_t next = index[current_frame+1].offset;
+		std::size_t next_end = current_frame + 2 < n_frames() ?
+			index[current_frame+2].offset : index.end;
+		in->will_need( next, next_end - next );
+	}
+
+	status = next_block_body( tmp, offset, size_one, nchunk );
 	if( status ){
 		std::cerr << "Failed to get body!\n";
 		return status;
 	}
-	block = std::move( tmp );
+
+	// Hand over the decoded fields without copying them. The
+	// fields of block are decoded into next time.
+	swap( block, tmp );
+	++current_frame;
 	return 0;
 }
 
 
 int dump_reader_lammps_bin::next_block_meta( block_data &block,
+                                             std::size_t &offset,
                                              int &size_one, int &nchunk )
 {
-	bigint ntimestep, natoms;
-	double xlo[3], xhi[3];
-	int boundary[3][2];
-
-	int triclinic;
-	int xy,xz,yz;
-
-	std::fread( &ntimestep, sizeof(bigint), 1, in );
-	if( !in ){
-		std::cerr << "Error opening binary file!\n";
+	frame_header h;
+	offset = read_frame_header( in->data(), in->size(), offset, h );
+	if( !offset ){
+		std::cerr << "Truncated frame header in binary file!\n";
 		return -1;
 	}
-	
-	if( feof(in) ){
-		std::cerr << "EOF encountered in binary file!\n";
-		return 1;
-	}
-	
-	std::fread(&natoms,sizeof(bigint),1,in);
-	std::fread(&triclinic,sizeof(int),1,in);
-	std::fread(&boundary[0][0],6*sizeof(int),1,in);
-	std::fread(xlo  ,sizeof(double),1,in);
-	std::fread(xhi  ,sizeof(double),1,in);
-	std::fread(xlo+1,sizeof(double),1,in);
-	std::fread(xhi+1,sizeof(double),1,in);
-	std::fread(xlo+2,sizeof(double),1,in);
-	std::fread(xhi+2,sizeof(double),1,in);
-	if (triclinic) {
-		std::fread(&xy,sizeof(double),1,in);
-		std::fread(&xz,sizeof(double),1,in);
-		std::fread(&yz,sizeof(double),1,in);
-	}
-	std::fread(&size_one,sizeof(int),1,in);
-	std::fread(&nchunk,sizeof(int),1,in);
-	
-	/*
-	  my_warning_if( __FILE__, __LINE__, nchunk > 1,
-	  "You've got multiple processor "
-	  "chunks incoming!\n" );
-	*/
-	if( nchunk == 0 ){
-		my_warning( __FILE__, __LINE__,
-		            "nchunk was 0. That's not good.\n");
-		if( feof(in) ){
-			std::cerr << "The dump is at EOF, "
-			          << "assuming it's fine...\n";
-			return 2;
-		}else{
-			return -1;
-		}
+	size_one = h.size_one;
+	nchunk   = h.nchunk;
+
+	block.N = h.natoms;
+	block.tstep = h.ntimestep;
+	if( h.triclinic ){
+		block.dom.set_from_bounding_box( h.xlo, h.xhi, h.xy, h.xz, h.yz );
+	}else{
+		block.dom.xlo[0] = h.xlo[0];
+		block.dom.xlo[1] = h.xlo[1];
+		block.dom.xlo[2] = h.xlo[2];
+
+		block.dom.xhi[0] = h.xhi[0];
+		block.dom.xhi[1] = h.xhi[1];
+		block.dom.xhi[2] = h.xhi[2];
+
+		block.dom.xy = block.dom.xz = block.dom.yz = 0.0;
 	}
-	block.N = natoms;
-	block.tstep = ntimestep;
-	block.dom.xlo[0] = xlo[0];
-	block.dom.xlo[1] = xlo[1];
-	block.dom.xlo[2] = xlo[2];
-	
-	block.dom.xhi[0] = xhi[0];
-	block.dom.xhi[1] = xhi[1];
-	block.dom.xhi[2] = xhi[2];
-	
+
 	block.dom.periodic = 0;
-	if( (boundary[0][0] == 0) && (boundary[0][1] == 0) ){
+	if( (h.boundary[0][0] == 0) && (h.boundary[0][1] == 0) ){
 		block.dom.periodic += domain::BIT_X;
 	}
-	if( (boundary[1][0] == 0) && (boundary[1][1] == 0) ){
+	if( (h.boundary[1][0] == 0) && (h.boundary[1][1] == 0) ){
 		block.dom.periodic += domain::BIT_Y;
 	}
-	if( (boundary[2][0] == 0) && (boundary[2][1] == 0) ){
+	if( (h.boundary[2][0] == 0) && (h.boundary[2][1] == 0) ){
 		block.dom.periodic += domain::BIT_Z;
 	}
 	
@@ -166,82 +301,54 @@ int dump_reader_lammps_bin::next_block_meta( block_data &block,
 }
 
 int dump_reader_lammps_bin::next_block_body( block_data &block,
+                                             std::size_t &offset,
                                              int size_one, int nchunk )
 {
-	using dfi = data_field_int;
-	using dfd = data_field_double;
-
-	int maxbuf = 0;
-	double *buf = nullptr;
-	int n = 0;
-	block.set_natoms( block.N );
 	const std::vector<std::string> &headers = get_column_headers();
-	std::vector<data_field*> data_fields(size_one);
 	std::size_t ssize_one = size_one;
 
-	int idx = 0;
-	for( std::string h : headers ){
-		// Depending on the keyword, you want to take
-		// either an int or a double.
-		if( is_int_data_field( h ) ){
-			dfi *new_field = new dfi( h, block.N );
-			data_fields[idx] = new_field;
-		}else{
-			// Assume it's a double.
-			dfd *new_field = new dfd( h, block.N );
-			data_fields[idx] = new_field;
-		}
-		++idx;
-	}
-
 	my_assert( __FILE__, __LINE__, !headers.empty(),
 	           "Column headers required for binary LAMMPS dump files!" );
 
-
 	my_assert( __FILE__, __LINE__, headers.size() == ssize_one,
 	           "Column number does not match number of headers!" );
 
-	int line_count = 0;
-	for( int i = 0; i < nchunk; i++ ){
-		std::fread(&n,sizeof(int),1,in);
-
-		// extend buffer to fit chunk size
+	prepare_data_fields( block, headers, block.N );
+	get_column_sinks( block, cols );
 
-		if( n > maxbuf ){
-			if (buf) delete [] buf;
-			buf = new double[n];
-			maxbuf = n;
-		}
+	// Decode in tiles of rows so that the tile stays in cache while
+	// each column is pulled out of it.
+	const std::size_t tile = 256;
+	const std::size_t stride = ssize_one * sizeof(double);
+	const char *data = in->data();
+	std::size_t line_count = 0;
 
-		// read chunk and write as size_one values per line
-
-		std::fread(buf,sizeof(double),n,in);
-		n /= size_one;
-
-		int m = 0;
-		for( int j = 0; j < n; ++j ){
-			for( int k = 0; k < size_one; ++k ){
-				int type = data_fields[k]->type();
-				data_field *df = data_fields[k];
-				if( type == data_field::INT ){
-					dfi *field = static_cast<dfi*>( df );
-					(*field)[line_count] = buf[m++];
-				}else if( type == data_field::DOUBLE ){
-					dfd *field = static_cast<dfd*>( df );
-					(*field)[line_count] = buf[m++];
+	for( int i = 0; i < nchunk; i++ ){
+		int n = 0;
+		read_value( data, in->size(), offset, n );
+		std::size_t rows = n / size_one;
+		const char *chunk = data + offset;
+
+		for( std::size_t r0 = 0; r0 < rows; r0 += tile ){
+			std::size_t nr = std::min( tile, rows - r0 );
+			const char *src = chunk + r0 * stride;
+			std::size_t row = line_count + r0;
+
+			for( std::size_t k = 0; k < ssize_one; ++k ){
+				const char *col = src + k * sizeof(double);
+				if( cols[k].i_dest ){
+					decode_column( col, stride, nr,
+					               cols[k].i_dest + row );
 				}else{
-					// No clue.
+					decode_column( col, stride, nr,
+					               cols[k].d_dest + row );
 				}
 			}
-			++line_count;
 		}
+		offset += rows * stride;
+		line_count += rows;
 	}
 
-	// Copy all data fields into the block data.
-	add_custom_data_fields( data_fields, block );
-
-	if( buf ) delete [] buf;
-
 	return 0;
 }
 
@@ -249,11 +356,14 @@ int dump_reader_lammps_bin::next_block_body( block_data &block,
 
 int dump_reader_lammps_bin::skip_n_blocks( uint n )
 {
-	int status = 0;
-	for( int i = 0; i < n; ++i) {
-		status = skip_block();
-		if (status) return status;
+	// Blocks the prefetch thread read ahead count as skipped.
+	n -= drop_prefetched( n );
+	if( current_frame + n > n_frames() ){
+		std::cerr << "Hit EOF when skipping blocks?\n";
+		current_frame = n_frames();
+		return -1;
 	}
+	current_frame += n;
 	return 0;
 }
 
@@ -261,26 +371,7 @@ int dump_reader_lammps_bin::skip_n_blocks( uint n )
 
 int dump_reader_lammps_bin::skip_block()
 {
-	
-	block_data b;
-	int size_one, nchunk;
-	int result = next_block_meta(b, size_one, nchunk);
-	if (result == 1) {
-		// This means you hit EOF while trying to read meta!
-		std::cerr << "Hit EOF when reading meta?\n";
-		return -1;
-	}
-	int block_size = 0;
-	int n = 0;
-	// Each chunk has its own internal buffer:
-	for (int i = 0; i < nchunk; ++i) {
-		std::fread(&n,sizeof(int),1,in);
-		// At this point you would read in n doubles for each size_one.
-		int read_size = n*sizeof(double);
-		std::fseek(in, read_size, SEEK_CUR);
-	}
-
-	return 0;
+	return skip_n_blocks( 1 );
 }	
 
 
@@ -289,12 +380,12 @@ int dump_reader_lammps_bin::skip_block()
 
 bool dump_reader_lammps_bin::check_eof()  const
 {
-	return std::feof(in);
+	return current_frame >= n_frames();
 }
 
 bool dump_reader_lammps_bin::check_good() const
 {
-	return !std::ferror(in);
+	return in && in->good();
 }
 
 } // namespace readers
@@ -9,10 +9,11 @@
 */
 
 #include "dump_reader_lammps.hpp"
+#include "mapped_file.hpp"
 
-#include <cstdio>
-#include <string>
 #include <memory>
+#include <string>
+#include <vector>
 
 namespace lammps_tools {
 
@@ -20,6 +21,10 @@ namespace readers {
 
 /**
    A dump reader for binary LAMMPS dump files.
+
+   The file is memory-mapped and indexed once on construction, so
+   skipping frames is O(1) and frame data is decoded straight from the
+   mapping into the block_data columns without intermediate buffers.
 */
 class dump_reader_lammps_bin : public dump_reader_lammps
 {
@@ -44,14 +49,16 @@ public:
 	                        std::vector<std::string> h,
 	                        int dump_style = dump_reader_lammps::CUSTOM );
 
-	// Skips a single block more efficiently by ignoring
-	// the expected number of chars.
+	// Skips a single block by jumping to the next indexed frame.
 	int skip_block();
 	
 
-	// This reader knows the size of each block in chars, so can skip ahead.
+	// This reader knows where each block starts, so can skip ahead.
 	virtual int skip_n_blocks( uint n );
 
+	/// Returns the number of complete frames in the file.
+	std::size_t n_frames() const;
+
 	
 	/// Cleanup:
 	virtual ~dump_reader_lammps_bin();
@@ -61,13 +68,29 @@ private:
 	virtual bool check_eof()  const;
 	virtual bool check_good() const;
 
-	int next_block_meta( block_data &block, int &size_one, int &nchunk );
-	int next_block_body( block_data &block, int size_one, int nchunk );
+	int next_block_meta( block_data &block, std::size_t &offset,
+	                     int &size_one, int &nchunk );
+	int next_block_body( block_data &block, std::size_t &offset,
+	                     int size_one, int nchunk );
+
+	// Scans the frame headers to find the offset of each frame.
+	void build_frame_index();
+
+	// The index is built on construction already.
+	virtual const frame_index *index_frames();
+	virtual int seek_frame( std::size_t k );
 
 	dump_reader_lammps_bin( dump_reader_lammps_bin& ) = delete;
 	dump_reader_lammps_bin &operator=(dump_reader_lammps_bin&) = delete;
 
-	std::FILE *in;
+	std::unique_ptr<util::mapped_file> in;
+
+	/// Start of each frame, and the end of the last complete one.
+	frame_index index;
+	std::size_t current_frame;
+
+	/// Storage of each column, kept to reuse between blocks.
+	std::vector<column_sink> cols;
 };
 
 } // namespace dump_readers
@@ -5,6 +5,9 @@
 #  include <boost/iostreams/filtering_stream.hpp>
 #endif
 
+#include <algorithm>
+#include <vector>
+
 using namespace lammps_tools;
 using namespace readers;
 
@@ -12,7 +15,17 @@ namespace lammps_tools {
 
 namespace readers {
 
-#ifdef HAVE_BOOST_GZIP
+#if defined(HAVE_ZLIB)
+dump_reader_lammps_gzip::dump_reader_lammps_gzip( const std::string &fname, int dump_style )
+	: dump_reader_lammps_plain( fname, dump_style ),
+	  gz( new util::gzip_reader( fname ) )
+{
+	my_assert( __FILE__, __LINE__, util::file_exists( fname ),
+	           "Dump file does not exist!" );
+	my_assert( __FILE__, __LINE__, gz->good(),
+	           "Failed to open gzip file!" );
+}
+#elif defined(HAVE_BOOST_GZIP)
 dump_reader_lammps_gzip::dump_reader_lammps_gzip( const std::string &fname, int dump_style )
 	: dump_reader_lammps_plain( fname, dump_style ),
 	  infile( fname, std::ios_base::in |std::ios_base::binary ), in()
@@ -30,24 +43,72 @@ dump_reader_lammps_gzip::dump_reader_lammps_gzip( const std::string &fname, int
 	  infile( fname, std::ios_base::in |std::ios_base::binary ), in(fname)
 {
 	my_logic_error( __FILE__, __LINE__, "Gzipped files are not supported "
-	                "without boost support! Recompile with HAVE_BOOST_GZIP "
-	                "defined and boost installed or gunzip file!" );
+	                "without zlib or boost support! Recompile with "
+	                "HAVE_ZLIB or HAVE_BOOST_GZIP defined or gunzip file!" );
 }
 #endif
 
 
 dump_reader_lammps_gzip::~dump_reader_lammps_gzip()
-{}
+{
+	stop_prefetch();
+}
+
+
+#if defined(HAVE_ZLIB)
+std::size_t dump_reader_lammps_gzip::read_raw( char *dest, std::size_t n )
+{
+	gz->set_threads( get_parse_threads() );
+	std::size_t n_read = gz->read( dest, n );
+	if( n_read == 0 && !gz->good() ){
+		my_runtime_error( __FILE__, __LINE__, "Corrupt gzip data in "
+		                  + file_name + "!" );
+	}
+	return n_read;
+}
 
+bool dump_reader_lammps_gzip::seek_raw( std::uint64_t offset )
+{
+	// Restarts from the nearest access point of the gzip index.
+	return gz->seek( offset );
+}
 
-bool dump_reader_lammps_gzip::get_line( std::string &line )
+#else
+std::size_t dump_reader_lammps_gzip::read_raw( char *dest, std::size_t n )
 {
-	if( std::getline( in, line ) ){
-		return true;
-	}else{
-		return false;
+	in.read( dest, n );
+	return in.gcount();
+}
+
+#  ifdef HAVE_BOOST_GZIP
+bool dump_reader_lammps_gzip::seek_raw( std::uint64_t offset )
+{
+	// gzip streams cannot seek, so decompress from the start again.
+	in.reset();
+	infile.close();
+	infile.clear();
+	infile.open( file_name, std::ios_base::in | std::ios_base::binary );
+	if( !infile ) return false;
+	in.push( boost::iostreams::gzip_decompressor() );
+	in.push( infile );
+
+	std::vector<char> scratch( std::min<std::uint64_t>( offset, 1 << 20 ) );
+	while( offset > 0 ){
+		std::size_t n = read_raw( scratch.data(),
+		                          std::min<std::uint64_t>( offset,
+		                                                   scratch.size() ) );
+		if( n == 0 ) return false;
+		offset -= n;
 	}
+	return true;
+}
+#  else
+bool dump_reader_lammps_gzip::seek_raw( std::uint64_t offset )
+{
+	return false;
 }
+#  endif // HAVE_BOOST_GZIP
+#endif // HAVE_ZLIB
 
 } // namespace readers
 
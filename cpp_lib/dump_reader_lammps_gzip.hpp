@@ -8,18 +8,27 @@
 */
 
 #include "dump_reader_lammps_plain.hpp"
+#include "gzip_reader.hpp"
 
-#ifdef HAVE_BOOST_GZIP
+#if defined(HAVE_BOOST_GZIP) && !defined(HAVE_ZLIB)
 #  include <boost/iostreams/filter/gzip.hpp>
 #  include <boost/iostreams/filtering_stream.hpp>
 #endif
 
 #include <fstream>
+#include <memory>
 
 namespace lammps_tools {
 
 namespace readers {
 
+/**
+   A dump reader for gzipped LAMMPS text dump files.
+
+   With zlib, the file is decompressed through util::gzip_reader, which
+   makes seeking cheap and decompresses on get_parse_threads() threads
+   once the file is indexed. Otherwise boost is used, if available.
+*/
 class dump_reader_lammps_gzip : public dump_reader_lammps_plain
 {
 public:
@@ -31,11 +40,17 @@ public:
 	virtual ~dump_reader_lammps_gzip();
 
 private:
-	virtual bool get_line( std::string &line );
+	virtual std::size_t read_raw( char *dest, std::size_t n );
+
+	// Restarts decompression and skips to given uncompressed offset.
+	virtual bool seek_raw( std::uint64_t offset );
+#if defined(HAVE_ZLIB)
+	std::unique_ptr<util::gzip_reader> gz;
+#elif defined(HAVE_BOOST_GZIP)
 	std::ifstream infile;
-#ifdef HAVE_BOOST_GZIP
 	boost::iostreams::filtering_istream in;
 #else
+	std::ifstream infile;
 	// Just to trick the compiler. Using this class _will_ lead to a
 	// runtime error if GZIP is not compiled in.
 	std::ifstream in;
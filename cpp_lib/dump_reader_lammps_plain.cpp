@@ -2,7 +2,10 @@
 #include "types.hpp"
 #include "util.hpp"
 #include "my_assert.hpp"
+#include "text_parse.hpp"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 
 
@@ -19,13 +22,56 @@ namespace lammps_tools {
 
 namespace readers {
 
+// Bytes read from the input at once. Lines longer than this still
+// work, the buffer just grows to fit them.
+static const std::size_t slab_size = 4 << 20;
+
+// Blocks need at least this many rows per thread to be parsed in parallel.
+static const bigint min_rows_per_thread = 1 << 14;
+
+
+// Returns the domain::periodic_bits set by an ITEM: BOX BOUNDS line,
+// which has the boundary style of x, y and z as its last three words.
+// For triclinic boxes "xy xz yz" comes before those, and then
+// triclinic is set to true.
+static int periodic_bits( const std::string &boxline, bool &triclinic )
+{
+	static const int bits[3] = { domain::BIT_X, domain::BIT_Y,
+	                             domain::BIT_Z };
+	const char *p = boxline.data();
+	const char *end = p + boxline.size();
+	int periodic = 0;
+	int style = 0;
+	triclinic = false;
+	for( int word = 0; word < 9; ++word ){
+		p = util::skip_blanks( p, end );
+		const char *w = p;
+		while( p < end && !util::is_blank( *p ) ) ++p;
+		if( word < 3 || p == w ) continue;
+		if( p - w == 2 && w[0] == 'x' && w[1] == 'y' ){
+			triclinic = true;
+			continue;
+		}
+		if( p - w == 2 && ( w[0] == 'x' || w[0] == 'y' ) ) continue;
+		if( style < 3 && p - w == 2 && w[0] == 'p' && w[1] == 'p' ){
+			periodic += bits[style];
+		}
+		++style;
+	}
+	return periodic;
+}
+
 dump_reader_lammps_plain::dump_reader_lammps_plain( const std::string &fname,
                                                     int dump_style )
-	: dump_reader_lammps( dump_style ), in_file( nullptr ), in( nullptr )
+	: dump_reader_lammps( dump_style ), file_name( fname ),
+	  in_file( nullptr ), in( nullptr ), buffer( slab_size ), buf_pos( 0 ),
+	  buf_end( 0 ), input_done( false ), buf_offset( 0 ), index(),
+	  indexed( false ), line(), last_line(), header_line(), headers(),
+	  cols()
 {
 	my_assert( __FILE__, __LINE__, util::file_exists( fname ),
 	           "Dump file does not exist!" );
-	in_file = new std::ifstream( fname );
+	in_file = new std::ifstream( fname, std::ios_base::binary );
 	my_assert( __FILE__, __LINE__, in_file,
 	           "Failed to open input stream!" );
 	in = in_file;
@@ -33,11 +79,19 @@ dump_reader_lammps_plain::dump_reader_lammps_plain( const std::string &fname,
 
 dump_reader_lammps_plain::dump_reader_lammps_plain( std::istream &istream,
                                                     int dump_style )
-	: dump_reader_lammps( dump_style ), in_file( nullptr ), in( &istream )
-{ }
+	: dump_reader_lammps( dump_style ), file_name(), in_file( nullptr ),
+	  in( &istream ), buffer( slab_size ), buf_pos( 0 ), buf_end( 0 ),
+	  input_done( false ), buf_offset( 0 ), index(), indexed( false ),
+	  line(), last_line(), header_line(), headers(), cols()
+{
+	// Offsets are relative to the stream, not to where reading starts.
+	std::streampos pos = in->tellg();
+	if( pos > 0 ) buf_offset = pos;
+}
 
 dump_reader_lammps_plain::~dump_reader_lammps_plain()
 {
+	stop_prefetch();
 	if( in_file ) delete in_file;
 }
 
@@ -45,8 +99,7 @@ int dump_reader_lammps_plain::get_next_block( block_data &block )
 {
 	if( !quiet ) std::cerr << "Reading block from LAMMPS dump file....\n";
 
-	std::string last_line = "";
-	block_data tmp_block;
+	block_data &tmp_block = recycled_block();
 	if( !quiet ) std::cerr << "  ....Reading block meta....\n";
 	int status = next_block_meta( tmp_block, last_line );
 	if( status > 0 ){
@@ -60,30 +113,35 @@ int dump_reader_lammps_plain::get_next_block( block_data &block )
 	status = next_block_body( tmp_block, last_line );
 	if( status ) return status;
 
-	// At this point, tmp_block should be in a 100% correct state.
-	block = tmp_block;
+	// At this point, tmp_block should be in a 100% correct state,
+	// so hand over its fields without copying them. The fields of
+	// block are read into next time.
+	swap( block, tmp_block );
 
 	return 0;
 }
 
 bool dump_reader_lammps_plain::check_eof() const
 {
-	return in->eof();
+	return input_done && buf_pos == buf_end;
 }
 bool dump_reader_lammps_plain::check_good() const
 {
-	return in->good();
+	// Reading up to the end of the input sets failbit too, that is fine.
+	return in && !in->bad() && ( !in->fail() || in->eof() );
 }
 
 
 int dump_reader_lammps_plain::next_block_meta( block_data &block,
                                                std::string &last_line )
 {
-	std::string line;
+	// line is a member so that its storage is reused between blocks.
 	bigint tstep, N;
-	std::string boxline;
 	double xlo[3] = {0,0,0};
 	double xhi[3] = {0,0,0};
+	double tilt[3] = {0,0,0};
+	int periodic = 0;
+	bool triclinic = false;
 	tstep = N = 0;
 
 	bool setup_box_and_get_body = false;
@@ -106,20 +164,16 @@ int dump_reader_lammps_plain::next_block_meta( block_data &block,
 			N = std::stoul( line );
 			if( !quiet ) std::cerr << "    ....N = " << N << "\n";
 		}else if( starts_with( line, "ITEM: BOX BOUNDS " ) ){
-			boxline = line;
-			get_line( line );
-			std::stringstream dims( line );
-			dims >> xlo[0] >> xhi[0];
-
-			get_line( line );
-			dims.str(""); dims.clear();
-			dims.str( line );
-			dims >> xlo[1] >> xhi[1];
-
-			get_line( line );
-			dims.str(""); dims.clear();
-			dims.str( line );
-			dims >> xlo[2] >> xhi[2];
+			periodic = periodic_bits( line, triclinic );
+			for( int d = 0; d < 3; ++d ){
+				get_line( line );
+				const char *p = line.data();
+				const char *end = p + line.size();
+				p = util::parse_double( p, end, xlo[d] );
+				if( p ) p = util::parse_double( p, end, xhi[d] );
+				// The tilt factors xy, xz and yz follow the bounds.
+				if( p && triclinic ) util::parse_double( p, end, tilt[d] );
+			}
 			if( !quiet )
 				std::cerr << "    ....box = [ " << xlo[0]
 				          << ", " << xhi[0] << " ] x [ "
@@ -153,30 +207,22 @@ int dump_reader_lammps_plain::next_block_meta( block_data &block,
 
 				block.tstep = tstep;
 				block.N = N;
-				block.dom.xlo[0] = xlo[0];
-				block.dom.xlo[1] = xlo[1];
-				block.dom.xlo[2] = xlo[2];
-
-				block.dom.xhi[0] = xhi[0];
-				block.dom.xhi[1] = xhi[1];
-				block.dom.xhi[2] = xhi[2];
-
-				block.dom.periodic = 0;
-				std::stringstream bl( boxline );
-				std::string tmp;
-				bl >> tmp >> tmp >> tmp; // ITEM: BOX BOUNDS
-				bl >> tmp;
-				if( tmp == "pp" ){
-					block.dom.periodic += domain::BIT_X;
-				}
-				bl >> tmp;
-				if( tmp == "pp" ){
-					block.dom.periodic += domain::BIT_Y;
-				}
-				bl >> tmp;
-				if( tmp == "pp" ){
-					block.dom.periodic += domain::BIT_Z;
+				if( triclinic ){
+					block.dom.set_from_bounding_box( xlo, xhi, tilt[0],
+					                                 tilt[1], tilt[2] );
+				}else{
+					block.dom.xlo[0] = xlo[0];
+					block.dom.xlo[1] = xlo[1];
+					block.dom.xlo[2] = xlo[2];
+
+					block.dom.xhi[0] = xhi[0];
+					block.dom.xhi[1] = xhi[1];
+					block.dom.xhi[2] = xhi[2];
+
+					block.dom.xy = block.dom.xz = block.dom.yz = 0.0;
 				}
+
+				block.dom.periodic = periodic;
 				return 0;
 			}else{
 				std::cerr << "!! File no longer good after "
@@ -194,13 +240,8 @@ int dump_reader_lammps_plain::next_block_meta( block_data &block,
 }
 
 void dump_reader_lammps_plain::set_custom_data_fields(
-	block_data &block, const std::string &line,
-	std::vector<std::string> &headers,
-	std::vector<data_field*> &data_fields )
+	const std::string &line, std::vector<std::string> &headers )
 {
-	using dfi = data_field_int;
-	using dfd = data_field_double;
-
 	if( dump_style == CUSTOM ){
 		my_assert( __FILE__, __LINE__,
 		           util::starts_with( line, "ITEM: ATOMS" ),
@@ -241,47 +282,183 @@ void dump_reader_lammps_plain::set_custom_data_fields(
 		headers.push_back(w);
 		if( !quiet ) std::cerr << "      ....Current header is \""
 		                       << w << "\"....\n";
-		// Depending on the keyword, you want to take
-		// either an int or a double.
+	}
+}
+
+
+int dump_reader_lammps_plain::append_data_to_fields( block_data &block )
+{
+	get_column_sinks( block, cols );
 
+	bigint n_threads = std::min<bigint>( parse_threads,
+	                                     block.N / min_rows_per_thread );
+	if( n_threads > 1 ){
+		return parse_rows_parallel( block.N, cols, n_threads );
+	}else{
+		return parse_rows_serial( 0, block.N, cols );
+	}
+}
 
-		int type = get_column_type( w );
 
-		if( type == data_field::INT ){
-			dfi *new_field = new dfi( w, block.N );
-			data_fields.push_back( new_field );
+int dump_reader_lammps_plain::parse_line( const char *begin, const char *end,
+                                          bigint i,
+                                          const std::vector<column_sink> &cols )
+{
+	const char *p = begin;
+	for( std::size_t j = 0; j < cols.size(); ++j ){
+		if( cols[j].i_dest ){
+			p = util::parse_int( p, end, cols[j].i_dest[i] );
 		}else{
-			// Assume it's a double.
-			dfd *new_field = new dfd( w, block.N );
-			data_fields.push_back( new_field );
+			p = util::parse_double( p, end, cols[j].d_dest[i] );
+		}
+		if( !p || ( p < end && !util::is_blank( *p ) ) ){
+			return j;
+		}
+	}
+	return -1;
+}
+
+
+int dump_reader_lammps_plain::parse_rows_serial(
+	bigint first_row, bigint N, const std::vector<column_sink> &cols )
+{
+	const char *begin, *end;
+	for( bigint i = first_row; i < N; ++i ){
+		if( !next_line( begin, end ) ){
+			std::cerr << "!! Input ended after " << i << " of "
+			          << N << " lines !!\n";
+			return -1;
 		}
 
+		int bad_col = parse_line( begin, end, i, cols );
+		if( bad_col >= 0 ){
+			std::cerr << "!! Failed to parse column " << bad_col
+			          << " of line '" << std::string( begin, end )
+			          << "' !!\n";
+			return -1;
+		}
 	}
+	return 0;
 }
 
 
-void dump_reader_lammps_plain::append_data_to_fields(
-	block_data &block, std::vector<data_field*> &data_fields )
+namespace {
+
+// A range of complete lines in the read buffer and the rows they go to.
+struct text_slice
 {
-	std::size_t n_cols = data_fields.size();
-	std::string line;
-	for( int i = 0; i < block.N; ++i ){
-		get_line( line );
-
-		std::stringstream ss( line );
-		for( std::size_t j = 0; j < n_cols; ++j ){
-			int type = data_fields[j]->type();
-			if( type == data_field::INT ){
-				std::vector<int> &vec =
-					data_as_rw<int>( data_fields[j] );
-				ss >> vec[i];
-			}else if( type == data_field::DOUBLE ){
-				std::vector<double> &vec =
-					data_as_rw<double>( data_fields[j] );
-				ss >> vec[i];
+	const char *begin, *end;
+	bigint first_row, n_lines;
+
+	// Set if a line failed to parse.
+	const char *bad_begin, *bad_end;
+	int bad_col;
+};
+
+} // namespace
+
+
+int dump_reader_lammps_plain::parse_rows_parallel(
+	bigint N, const std::vector<column_sink> &cols, int n_threads )
+{
+	// Give each thread a slab worth of text per pass.
+	if( buffer.size() < n_threads * slab_size ){
+		buffer.resize( n_threads * slab_size );
+	}
+	std::vector<text_slice> slices( n_threads );
+
+	bigint row = 0;
+	while( row < N ){
+		if( !input_done && buf_end - buf_pos < buffer.size() / 2 ){
+			fill_buffer();
+		}
+
+		// Only complete lines can be parsed in parallel.
+		const char *b = buffer.data() + buf_pos;
+		const char *e = buffer.data() + buf_end;
+		while( e > b && *(e-1) != '\n' ) --e;
+		if( e == b ){
+			if( input_done ) break;
+			fill_buffer();
+			continue;
+		}
+
+		// Cut [b, e) into slices of about equal size, right after
+		// a newline.
+		std::size_t len = e - b;
+		const char *s_begin = b;
+		for( int t = 0; t < n_threads; ++t ){
+			const char *s_end = b + ( len * ( t + 1 ) ) / n_threads;
+			if( s_end <= s_begin ){
+				s_end = s_begin;
+			}else{
+				s_end = static_cast<const char*>(
+					std::memchr( s_end - 1, '\n', e - s_end + 1 ) ) + 1;
+			}
+			slices[t].begin = s_begin;
+			slices[t].end = s_end;
+			slices[t].bad_col = -1;
+			s_begin = s_end;
+		}
+
+		util::run_on_threads( n_threads, [&slices]( int t ){
+				slices[t].n_lines = std::count( slices[t].begin,
+				                                slices[t].end, '\n' ); } );
+
+		// Assign rows to the slices. The buffer can contain the start
+		// of the next block, so cut off any lines beyond row N.
+		bigint next_row = row;
+		for( text_slice &s : slices ){
+			s.first_row = next_row;
+			if( next_row + s.n_lines > N ){
+				s.n_lines = N - next_row;
+				const char *p = s.begin;
+				for( bigint k = 0; k < s.n_lines; ++k ){
+					p = static_cast<const char*>(
+						std::memchr( p, '\n', s.end - p ) ) + 1;
+				}
+				s.end = p;
 			}
+			next_row += s.n_lines;
 		}
+
+		util::run_on_threads( n_threads, [&slices, &cols]( int t ){
+				text_slice &s = slices[t];
+				const char *p = s.begin;
+				for( bigint i = 0; i < s.n_lines; ++i ){
+					const char *nl = static_cast<const char*>(
+						std::memchr( p, '\n', s.end - p ) );
+					const char *line_end = nl;
+					if( line_end > p && *(line_end-1) == '\r' ) --line_end;
+
+					s.bad_col = parse_line( p, line_end,
+					                        s.first_row + i, cols );
+					if( s.bad_col >= 0 ){
+						s.bad_begin = p;
+						s.bad_end = line_end;
+						return;
+					}
+					p = nl + 1;
+				}
+			} );
+
+		for( const text_slice &s : slices ){
+			if( s.bad_col >= 0 ){
+				std::cerr << "!! Failed to parse column " << s.bad_col
+				          << " of line '"
+				          << std::string( s.bad_begin, s.bad_end )
+				          << "' !!\n";
+				return -1;
+			}
+			if( s.n_lines ){
+				buf_pos = s.end - buffer.data();
+			}
+		}
+		row = next_row;
 	}
+
+	// A last line without newline, or a truncated block.
+	return parse_rows_serial( row, N, cols );
 }
 
 
@@ -289,12 +466,7 @@ void dump_reader_lammps_plain::append_data_to_fields(
 int dump_reader_lammps_plain::next_block_body(
 	block_data &block, const std::string &last_line )
 {
-	using dfi = data_field_int;
-	using dfd = data_field_double;
-
-	std::string line = last_line;
-
-	block.set_natoms( block.N );
+	const std::string &line = last_line;
 
 	if( starts_with( line, "ITEM: ATOMS" ) ||
 	    starts_with( line, "ITEM: ENTRIES" ) ){
@@ -302,85 +474,215 @@ int dump_reader_lammps_plain::next_block_body(
 
 		// Figure out which column maps which.
 		// Read out the next block.N lines.
-		std::vector<std::string> headers;
-		std::vector<data_field*> data_fields;
-
-
 		if( line == "ITEM: ATOMS" ){
 			if( !quiet ) std::cerr << "    ....Reading atoms....\n";
 			my_assert( __FILE__, __LINE__,
 			           dump_style == ATOMIC,
 			           "Inconsistent dump style for atomic dump!" );
 
-			headers.push_back("id");
-			headers.push_back("type");
-			headers.push_back("x");
-			headers.push_back("y");
-			headers.push_back("z");
-
-			dfi *id = new dfi( "id",   block.N );
-			dfi *type = new dfi( "type", block.N );
-			dfd *x = new dfd( "x", block.N );
-			dfd *y = new dfd( "y", block.N );
-			dfd *z = new dfd( "z", block.N );
-
-			data_fields.push_back( id );
-			data_fields.push_back( type );
-			data_fields.push_back( x );
-			data_fields.push_back( y );
-			data_fields.push_back( z );
-		}else if( util::starts_with( line, "ITEM: ATOMS " ) ){
-			my_assert( __FILE__, __LINE__,
-			           dump_style == CUSTOM,
-			           "Inconsistent dump style for custom dump!" );
-			if( !quiet ) std::cerr << "    ....Reading atoms....\n";
-			set_custom_data_fields( block, line, headers,
-			                        data_fields );
-		}else if( util::starts_with( line, "ITEM: ENTRIES" ) ){
+			static const std::vector<std::string> atomic_headers =
+				{ "id", "type", "x", "y", "z" };
+			static const std::vector<int> types = { data_field::INT,
+			                                        data_field::INT,
+			                                        data_field::DOUBLE,
+			                                        data_field::DOUBLE,
+			                                        data_field::DOUBLE };
+			static const std::vector<int> special_fields =
+				{ block_data::ID, block_data::TYPE, block_data::X,
+				  block_data::Y,  block_data::Z };
+			prepare_data_fields( block, atomic_headers, types,
+			                     special_fields, block.N );
+		}else{
+			if( util::starts_with( line, "ITEM: ATOMS " ) ){
+				my_assert( __FILE__, __LINE__,
+				           dump_style == CUSTOM,
+				           "Inconsistent dump style for custom dump!" );
+				if( !quiet ) std::cerr << "    ....Reading atoms....\n";
+			}else{
+				my_assert( __FILE__, __LINE__,
+				           dump_style == LOCAL,
+				           "Inconsistent dump style for local dump!" );
+				if( !quiet ) std::cerr << "    ....Reading entries....\n";
+			}
+			// The columns rarely change between blocks, so only
+			// split the header line again if it differs.
+			if( line != header_line ){
+				headers.clear();
+				header_line.clear();
+				set_custom_data_fields( line, headers );
+				header_line = line;
+			}
+			prepare_data_fields( block, headers, block.N );
+		}
 
-			my_assert( __FILE__, __LINE__,
-			           dump_style == LOCAL,
-			           "Inconsistent dump style for local dump!" );
+		return append_data_to_fields( block );
 
-			if( !quiet ) std::cerr << "    ....Reading entries....\n";
-			set_custom_data_fields( block, line, headers,
-			                        data_fields );
-		}
+	}else{
+		// std::cerr << "Encountered unknown header!\n";
+		// std::cerr << line << "\n";
+		return -1;
+	}
 
 
-		std::size_t n_cols = headers.size();
-		my_assert( __FILE__, __LINE__, n_cols == data_fields.size(),
-		           "# of data fields does not match # of columns!" );
-		append_data_to_fields( block, data_fields );
+}
 
 
-		if( dump_style == ATOMIC ){
-			block.add_field( *data_fields[0], block_data::ID );
-			block.add_field( *data_fields[1], block_data::TYPE );
-			block.add_field( *data_fields[2], block_data::X );
-			block.add_field( *data_fields[3], block_data::Y );
-			block.add_field( *data_fields[4], block_data::Z );
+std::size_t dump_reader_lammps_plain::read_raw( char *dest, std::size_t n )
+{
+	in->read( dest, n );
+	return in->gcount();
+}
 
-			for( data_field *df : data_fields ) delete df;
-		}else{
-			add_custom_data_fields( data_fields, block );
+
+bool dump_reader_lammps_plain::fill_buffer()
+{
+	if( input_done ) return false;
+
+	// Move the unread tail to the front. If it fills the entire
+	// buffer a single line is longer than the buffer, so grow it.
+	std::size_t left = buf_end - buf_pos;
+	if( left && buf_pos ){
+		std::memmove( buffer.data(), buffer.data() + buf_pos, left );
+	}
+	buf_offset += buf_pos;
+	buf_pos = 0;
+	buf_end = left;
+	if( buf_end == buffer.size() ){
+		buffer.resize( 2*buffer.size() );
+	}
+
+	std::size_t n = read_raw( buffer.data() + buf_end,
+	                          buffer.size() - buf_end );
+	buf_end += n;
+	if( n == 0 ) input_done = true;
+	return n > 0;
+}
+
+
+bool dump_reader_lammps_plain::next_line( const char *&begin, const char *&end )
+{
+	std::size_t scanned = buf_pos;
+	while( true ){
+		const char *b = buffer.data() + scanned;
+		const char *e = buffer.data() + buf_end;
+		const char *nl = static_cast<const char*>(
+			std::memchr( b, '\n', e - b ) );
+		if( nl ){
+			begin = buffer.data() + buf_pos;
+			end = nl;
+			buf_pos = nl - buffer.data() + 1;
+			break;
+		}
+
+		// No complete line left, read more. The part that was
+		// already scanned moves to the front of the buffer.
+		std::size_t scanned_len = buf_end - buf_pos;
+		if( !fill_buffer() ){
+			if( buf_pos == buf_end ) return false;
+
+			// Last line is missing its newline.
+			begin = buffer.data() + buf_pos;
+			end = buffer.data() + buf_end;
+			buf_pos = buf_end;
+			break;
 		}
+		scanned = buf_pos + scanned_len;
+	}
 
-		return 0;
+	// Files written on Windows:
+	if( end > begin && *(end-1) == '\r' ) --end;
+	return true;
+}
 
-	}else{
-		// std::cerr << "Encountered unknown header!\n";
-		// std::cerr << line << "\n";
-		return -1;
+
+bool dump_reader_lammps_plain::seek_raw( std::uint64_t offset )
+{
+	in->clear();
+	in->seekg( offset );
+	return !in->fail();
+}
+
+
+bool dump_reader_lammps_plain::seek_input( std::uint64_t offset )
+{
+	buf_pos = buf_end = 0;
+	buf_offset = offset;
+	input_done = false;
+	return seek_raw( offset );
+}
+
+
+const frame_index *dump_reader_lammps_plain::index_frames()
+{
+	if( indexed ) return &index;
+	if( !file_name.empty() && index.load( file_name ) ){
+		indexed = true;
+		return &index;
 	}
 
+	// Streams like stdin cannot go back.
+	if( file_name.empty() &&
+	    in->rdbuf()->pubseekoff( 0, std::ios_base::cur,
+	                             std::ios_base::in ) < 0 ){
+		std::cerr << "Cannot index frames of an input stream "
+		          << "that cannot seek!\n";
+		return nullptr;
+	}
 
+	// Scan from the start, then return to where reading was.
+	std::uint64_t resume = buf_offset + buf_pos;
+	if( !seek_input( 0 ) ){
+		std::cerr << "Failed to rewind input to index frames!\n";
+		seek_input( resume );
+		return nullptr;
+	}
+
+	index.frames.clear();
+	block_data b;
+	const char *begin, *end;
+	while( true ){
+		std::uint64_t offset = buf_offset + buf_pos;
+		if( next_block_meta( b, last_line ) != 0 ) break;
+
+		// Only the header is parsed, the atom lines are just counted.
+		bigint i = 0;
+		while( i < b.N && next_line( begin, end ) ) ++i;
+		if( i < b.N ) break;
+
+		index.frames.push_back( { offset, b.tstep, b.N } );
+		index.end = buf_offset + buf_pos;
+	}
+
+	if( !seek_input( resume ) ){
+		std::cerr << "Failed to return input to where it was "
+		          << "after indexing frames!\n";
+		return nullptr;
+	}
+
+	if( !file_name.empty() && !index.save( file_name ) && !quiet ){
+		std::cerr << "Could not write frame index for "
+		          << file_name << ".\n";
+	}
+	indexed = true;
+	return &index;
+}
+
+
+int dump_reader_lammps_plain::seek_frame( std::size_t k )
+{
+	if( !seek_input( index[k].offset ) ){
+		std::cerr << "Failed to seek to frame " << k << "!\n";
+		return -1;
+	}
+	return 0;
 }
 
 
 bool dump_reader_lammps_plain::get_line( std::string &line )
 {
-	if( std::getline( *in, line ) ){
+	const char *begin, *end;
+	if( next_line( begin, end ) ){
+		line.assign( begin, end );
 		return true;
 	}else{
 		return false;
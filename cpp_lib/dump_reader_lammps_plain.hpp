@@ -2,16 +2,18 @@
 #define DUMP_READER_LAMMPS_PLAIN_HPP
 
 /**
-   \file dump_reader_lammps_gzip.hpp
+   \file dump_reader_lammps_plain.hpp
 
    Declaration of dump reader for lammps plain text dump files.
 */
 
 #include "dump_reader_lammps.hpp"
 
+#include <cstdint>
+#include <iosfwd>
 #include <memory>
 #include <string>
-#include <iosfwd>
+#include <vector>
 
 namespace lammps_tools {
 
@@ -35,34 +37,77 @@ private:
 	virtual bool check_eof()  const;
 	virtual bool check_good() const;
 
-	virtual bool get_line( std::string &line );
+	// Reads up to n raw bytes from the input, returns the number read.
+	virtual std::size_t read_raw( char *dest, std::size_t n );
+
+	// Moves the raw input to given byte offset.
+	virtual bool seek_raw( std::uint64_t offset );
+
+	// Moves the input to given byte offset and drops the buffer.
+	bool seek_input( std::uint64_t offset );
+
+	// Scans the file for the start of each frame.
+	virtual const frame_index *index_frames();
+	virtual int seek_frame( std::size_t k );
+
+	// Reads the next slab of input into buffer, keeping unread bytes.
+	bool fill_buffer();
+
+	// Sets [begin, end) to the next line in buffer, without newline.
+	// The range is valid until the next call.
+	bool next_line( const char *&begin, const char *&end );
+
+	bool get_line( std::string &line );
 
 	int next_block_meta( block_data &block, std::string &last_line );
 	int next_block_body( block_data &block, const std::string &last_line );
 
 	// Extracts the custom names for each data field from given line.
-	void set_custom_data_fields( block_data &block,
-	                             const std::string &line,
-	                             std::vector<std::string> &headers,
-	                             std::vector<data_field*> &data_fields );
+	void set_custom_data_fields( const std::string &line,
+	                             std::vector<std::string> &headers );
 
-	// Set custom fields for dump local.
-	void set_local_data_fields( block_data &block,
-	                            const std::string &line,
-	                            std::vector<std::string> &headers,
-	                            std::vector<data_field*> &data_fields );
+	// Parses the next block.N lines straight into the columns of block.
+	int append_data_to_fields( block_data &block );
 
+	// Parses rows [first_row, N) one line at a time.
+	int parse_rows_serial( bigint first_row, bigint N,
+	                       const std::vector<column_sink> &cols );
 
+	// Parses rows [0, N) with n_threads threads working on disjoint
+	// slices of the buffer. Leftovers are handed to parse_rows_serial.
+	int parse_rows_parallel( bigint N, const std::vector<column_sink> &cols,
+	                         int n_threads );
 
-	// Reads the info of the current block into block_data from file.
-	void append_data_to_fields( block_data &block,
-	                            std::vector<data_field*> &data_fields );
+	// Parses one line into row i of cols. Returns the index of the
+	// column that could not be parsed, or -1 on success.
+	static int parse_line( const char *begin, const char *end, bigint i,
+	                       const std::vector<column_sink> &cols );
 
 	dump_reader_lammps_plain &operator=(dump_reader_lammps_plain&) = delete;
 	dump_reader_lammps_plain(dump_reader_lammps_plain&) = delete;
 
+protected:
+	const std::string file_name; ///< Name of the dump file, if known.
+
+private:
 	std::ifstream *in_file;
 	std::istream *in;
+
+	std::vector<char> buffer; ///< Slab of raw text read from in.
+	std::size_t buf_pos;      ///< Start of the unread part of buffer.
+	std::size_t buf_end;      ///< End of the valid part of buffer.
+	bool input_done;          ///< True once read_raw returned nothing.
+	std::uint64_t buf_offset; ///< Input offset of the start of buffer.
+
+	frame_index index;        ///< Start of each frame, if indexed.
+	bool indexed;             ///< True once index is built.
+
+	// These are kept between blocks so that their storage is reused.
+	std::string line;         ///< Line being read by next_block_meta.
+	std::string last_line;    ///< The ITEM: ATOMS line of the block.
+	std::string header_line;  ///< The line headers was split from.
+	std::vector<std::string> headers; ///< Column headers of the block.
+	std::vector<column_sink> cols;    ///< Storage of each column.
 };
 
 } // namespace readers
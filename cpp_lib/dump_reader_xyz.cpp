@@ -27,7 +27,9 @@ dump_reader_xyz::dump_reader_xyz( std::istream &istream )
 
 
 dump_reader_xyz::~dump_reader_xyz()
-{ }
+{
+	stop_prefetch();
+}
 
 
 int dump_reader_xyz::get_next_block( block_data &block )
@@ -61,11 +63,17 @@ int dump_reader_xyz::get_next_block( block_data &block )
 	}
 	ss.clear();
 
-	data_field_double x("x", natoms);
-	data_field_double y("y", natoms);
-	data_field_double z("z", natoms);
-	data_field_int id("id", natoms);
-	data_field_int type("type", natoms);
+	// Read straight into the fields of the block:
+	data_field_int &id = tmp.emplace_field<int>(
+		"id", block_data::special_fields::ID );
+	data_field_int &type = tmp.emplace_field<int>(
+		"type", block_data::special_fields::TYPE );
+	data_field_double &x = tmp.emplace_field<double>(
+		"x", block_data::special_fields::X );
+	data_field_double &y = tmp.emplace_field<double>(
+		"y", block_data::special_fields::Y );
+	data_field_double &z = tmp.emplace_field<double>(
+		"z", block_data::special_fields::Z );
 
 	int max_type = 1;
 	bigint i = 0;
@@ -88,16 +96,8 @@ int dump_reader_xyz::get_next_block( block_data &block )
 	if( !good() ) return -1;
 	if( eof() ) return 1;
 
-	// Copy all data to the block:
 	tmp.set_ntypes( max_type );
-
-	tmp.add_field( id, block_data::special_fields::ID );
-	tmp.add_field( type, block_data::special_fields::TYPE );
-	tmp.add_field( x, block_data::special_fields::X );
-	tmp.add_field( y, block_data::special_fields::Y );
-	tmp.add_field( z, block_data::special_fields::Z );
-
-	block = tmp;
+	swap( block, tmp );
 
 
 	return 0;
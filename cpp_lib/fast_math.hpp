@@ -1,6 +1,8 @@
 #ifndef FAST_MATH_HPP
 #define FAST_MATH_HPP
 
+#include <cmath>
+
 #include "sincos_lookup.hpp"
 
 namespace lammps_tools {
@@ -13,6 +15,89 @@ inline void sincos( double x, double &s, double &c )
 	table.sincos( x, s, c );
 }
 
+
+/**
+   \brief Sine and cosine from polynomials, without tables or branches.
+
+   The argument is reduced to [-pi/4, pi/4] around the nearest multiple
+   of pi/2. The error is then about 1e-16 |x|, or less without
+   -ffast-math, which is as well as x itself is known if it is a
+   rounded product like q*r. The number of quarter turns has to fit in
+   an int, so |x| < 3e9.
+   Because it has no branches or lookups, loops that call it can be
+   vectorised by the compiler.
+*/
+inline void sincos_poly( double x, double &s, double &c )
+{
+	// pi/2 in parts that are short enough for q*part to be exact.
+	const double pio2_1 = 1.57079632673412561417e+00;
+	const double pio2_2 = 6.07710050630396597660e-11;
+	const double pio2_3 = 2.02226624879595063154e-21;
+	const double two_over_pi = 6.36619772367581382433e-01;
+
+	// Round to the nearest quarter turn by truncating, which unlike
+	// std::floor vectorises without SSE4.1.
+	double t = x * two_over_pi;
+	int k = static_cast<int>( t + ( t >= 0.0 ? 0.5 : -0.5 ) );
+	double q = k;
+	double r = ( ( x - q*pio2_1 ) - q*pio2_2 ) - q*pio2_3;
+	double r2 = r*r;
+
+	// Taylor series, the first term left out is below 1e-16 here.
+	double sr = r + r*r2*( -1.0/6.0 + r2*( 1.0/120.0 + r2*( -1.0/5040.0
+		+ r2*( 1.0/362880.0 + r2*( -1.0/39916800.0
+		+ r2*( 1.0/6227020800.0 + r2*( -1.0/1307674368000.0 ) ) ) ) ) ) );
+	double cr = 1.0 + r2*( -0.5 + r2*( 1.0/24.0 + r2*( -1.0/720.0
+		+ r2*( 1.0/40320.0 + r2*( -1.0/3628800.0 + r2*( 1.0/479001600.0
+		+ r2*( -1.0/87178291200.0 + r2*( 1.0/20922789888000.0 ) ) ) ) ) ) ) );
+
+	// Rotate by the k quarter turns.
+	double ss = ( k & 1 ) ? cr : sr;
+	double cc = ( k & 1 ) ? sr : cr;
+	s = ( k & 2 ) ? -ss : ss;
+	c = ( ( k + 1 ) & 2 ) ? -cc : cc;
+}
+
+/**
+   \brief Bessel function of the first kind of order zero, J0(x).
+
+   std::cyl_bessel_j needs C++17 and j0 is not part of C++, so this
+   sums the power series for |x| < 13 and the asymptotic Hankel
+   expansion beyond. The absolute error is below about 1e-11.
+*/
+inline double bessel_j0( double x )
+{
+	x = std::fabs( x );
+	if( x < 13.0 ){
+		// sum_k ( -x^2/4 )^k / ( k! )^2
+		double y = -0.25*x*x;
+		double term = 1.0, sum = 1.0;
+		for( int k = 1; k < 60 && std::fabs( term ) > 1e-17; ++k ){
+			term *= y / ( double( k ) * k );
+			sum += term;
+		}
+		return sum;
+	}
+
+	// J0 = sqrt( 2 / pi x ) ( P cos( x - pi/4 ) - Q sin( x - pi/4 ) ).
+	// P and Q take the even and odd terms of ( 2k-1 )!!^2 / ( k! ( 8x )^k )
+	// with signs +, -, -, +, +, -, ... The series is cut off where the
+	// terms start to grow.
+	double P = 1.0, Q = 0.0, term = 1.0;
+	for( int k = 1; k < 30; ++k ){
+		double next = term * ( 2*k - 1 )*( 2*k - 1 ) / ( 8.0 * k * x );
+		if( next >= term ) break;
+		term = next;
+		double signed_term = ( ( k + 1 ) & 2 ) ? -term : term;
+		if( k & 1 ) Q += signed_term;
+		else        P += signed_term;
+	}
+	const double pi = 3.14159265358979323846;
+	double phase = x - 0.25*pi;
+	return std::sqrt( 2.0 / ( pi * x ) )
+		* ( P * std::cos( phase ) - Q * std::sin( phase ) );
+}
+
 } // fast_math
 
 } // lammps_tools
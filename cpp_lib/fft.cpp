@@ -0,0 +1,174 @@
+#include "fft.hpp"
+#include "constants.hpp"
+#include "my_assert.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+#include <vector>
+
+
+namespace lammps_tools {
+
+namespace fourier {
+
+std::size_t fft_size( std::size_t n )
+{
+	std::size_t s = 1;
+	while( s < n ) s *= 2;
+	return s;
+}
+
+
+fft_plan::fft_plan( std::size_t n )
+	: n( n ), rev( n ), w( n / 2 )
+{
+	my_assert( __FILE__, __LINE__, n > 0 && ( n & ( n - 1 ) ) == 0,
+	           "FFT length has to be a power of two!" );
+
+	int bits = 0;
+	while( ( std::size_t( 1 ) << bits ) < n ) ++bits;
+	for( std::size_t i = 0; i < n; ++i ){
+		std::size_t r = 0;
+		for( int b = 0; b < bits; ++b ){
+			if( i & ( std::size_t( 1 ) << b ) ){
+				r |= std::size_t( 1 ) << ( bits - 1 - b );
+			}
+		}
+		rev[i] = r;
+	}
+
+	for( std::size_t k = 0; k < n / 2; ++k ){
+		double phi = -constants::pi2 * k / n;
+		w[k] = cx_double( std::cos( phi ), std::sin( phi ) );
+	}
+}
+
+
+void fft_plan::forward( cx_double *data, std::size_t stride ) const
+{
+	transform( data, stride, false );
+}
+
+
+void fft_plan::inverse( cx_double *data, std::size_t stride ) const
+{
+	transform( data, stride, true );
+}
+
+
+void fft_plan::transform( cx_double *data, std::size_t stride, bool inv ) const
+{
+	for( std::size_t i = 0; i < n; ++i ){
+		if( i < rev[i] ) std::swap( data[i*stride], data[rev[i]*stride] );
+	}
+
+	// Iterative Cooley-Tukey, merging transforms of length half.
+	for( std::size_t len = 2; len <= n; len *= 2 ){
+		std::size_t half = len / 2;
+		std::size_t step = n / len;
+		for( std::size_t i = 0; i < n; i += len ){
+			cx_double *a = data + i*stride;
+			cx_double *b = a + half*stride;
+			for( std::size_t j = 0; j < half; ++j ){
+				cx_double wj = inv ? std::conj( w[j*step] ) : w[j*step];
+				cx_double u = a[j*stride];
+				cx_double v = b[j*stride] * wj;
+				a[j*stride] = u + v;
+				b[j*stride] = u - v;
+			}
+		}
+	}
+}
+
+
+namespace {
+
+// Lines that are gathered together, so that reading a strided axis
+// uses whole cache lines.
+const int batch = 8;
+
+// Transforms the lines along an axis of n points at the given stride.
+// The lines come in n_batches batches of lines that are adjacent in
+// memory. start( bt, w ) returns the first point of batch bt and sets w
+// to the number of lines in it, at most width. All batches share one
+// plan, and each thread takes a contiguous range of them.
+template <typename batch_start>
+void fft_lines( cx_double *data, int n, std::size_t stride, int n_batches,
+                int width, const batch_start &start, bool inverse,
+                int n_threads )
+{
+	if( n == 1 ) return;
+	fft_plan plan( n );
+	n_threads = std::max( 1, std::min( n_threads, n_batches ) );
+
+	util::run_on_threads( n_threads, [&]( int t ){
+		std::vector<cx_double> buf( static_cast<std::size_t>( n ) * width );
+		int bt0 = static_cast<bigint>( n_batches ) * t / n_threads;
+		int bt1 = static_cast<bigint>( n_batches ) * ( t + 1 ) / n_threads;
+		for( int bt = bt0; bt < bt1; ++bt ){
+			int w = 0;
+			cx_double *first = data + start( bt, w );
+			for( int k = 0; k < n; ++k ){
+				const cx_double *row = first + k*stride;
+				for( int j = 0; j < w; ++j ) buf[j*n + k] = row[j];
+			}
+			for( int j = 0; j < w; ++j ){
+				if( inverse ){
+					plan.inverse( buf.data() + j*n );
+				}else{
+					plan.forward( buf.data() + j*n );
+				}
+			}
+			for( int k = 0; k < n; ++k ){
+				cx_double *row = first + k*stride;
+				for( int j = 0; j < w; ++j ) row[j] = buf[j*n + k];
+			}
+		}
+	} );
+}
+
+} // namespace
+
+
+void fft_3d( cx_double *data, int nx, int ny, int nz, bool inverse,
+             int n_threads )
+{
+	std::size_t sy = nz;
+	std::size_t sx = static_cast<std::size_t>( ny ) * nz;
+
+	// Along z the lines are contiguous, one per ( ix, iy ).
+	auto z_lines = [nz]( int bt, int &w ){
+		w = 1;
+		return static_cast<std::size_t>( bt ) * nz;
+	};
+	fft_lines( data, nz, 1, nx*ny, 1, z_lines, inverse, n_threads );
+
+	// Along y, lines with consecutive iz are next to each other. Batches
+	// do not cross x-planes, so the threads split the planes between them.
+	int wy = std::min( batch, nz );
+	int blocks = ( nz + wy - 1 ) / wy;
+	auto y_lines = [=]( int bt, int &w ){
+		int ix = bt / blocks;
+		int z0 = ( bt % blocks ) * wy;
+		w = std::min( wy, nz - z0 );
+		return ix*sx + z0;
+	};
+	fft_lines( data, ny, sy, nx*blocks, wy, y_lines, inverse, n_threads );
+
+	// Along x, all ( iy, iz ) lines follow each other.
+	int n_yz = ny*nz;
+	auto x_lines = [n_yz]( int bt, int &w ){
+		int l0 = bt * batch;
+		w = std::min( batch, n_yz - l0 );
+		return static_cast<std::size_t>( l0 );
+	};
+	fft_lines( data, nx, sx, ( n_yz + batch - 1 ) / batch, batch, x_lines,
+	           inverse, n_threads );
+}
+
+
+} // namespace fourier
+
+} // namespace lammps_tools
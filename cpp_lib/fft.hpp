@@ -0,0 +1,92 @@
+#ifndef FFT_HPP
+#define FFT_HPP
+
+/**
+   \file fft.hpp
+
+   A plain radix-2 FFT, for the routines that need Fourier transforms
+   but should not depend on Armadillo.
+*/
+
+#include <complex>
+#include <cstddef>
+#include <vector>
+
+
+namespace lammps_tools {
+
+namespace fourier {
+
+typedef std::complex<double> cx_double;
+
+/// Returns the smallest power of two that is at least n.
+std::size_t fft_size( std::size_t n );
+
+
+/**
+   \brief Fast Fourier transforms of a fixed length.
+
+   The bit reversal and the twiddle factors are set up once, so a plan
+   pays off when many transforms of the same length are done. A plan
+   is not changed by transforms, so threads can share one.
+*/
+class fft_plan
+{
+public:
+	/**
+	   \param n  Length of the transforms, has to be a power of two.
+	*/
+	explicit fft_plan( std::size_t n );
+
+	/// Returns the length of the transforms.
+	std::size_t size() const { return n; }
+
+	/**
+	   \brief Transforms data in place, X_k = sum_j x_j exp(-2 pi i jk/n).
+
+	   \param data    The n entries to transform.
+	   \param stride  Distance between consecutive entries.
+	*/
+	void forward( cx_double *data, std::size_t stride = 1 ) const;
+
+	/**
+	   \brief Transforms data back in place, without dividing by n.
+
+	   \param data    The n entries to transform.
+	   \param stride  Distance between consecutive entries.
+	*/
+	void inverse( cx_double *data, std::size_t stride = 1 ) const;
+
+private:
+	void transform( cx_double *data, std::size_t stride, bool inv ) const;
+
+	std::size_t n;
+	std::vector<std::size_t> rev;  ///< Bit-reversed indices.
+	std::vector<cx_double> w;      ///< exp( -2 pi i k/n ) for k < n/2.
+};
+
+
+/**
+   \brief Transforms a grid in place along all of its axes.
+
+   The grid is stored with z varying fastest, as
+   data[ ( ix*ny + iy )*nz + iz ]. Axes of length 1 are skipped, so a
+   2D grid has nz = 1. Like fft_plan::inverse, the inverse transform
+   does not divide by the number of points.
+
+   \param data       The nx*ny*nz points of the grid.
+   \param nx         Points along x, a power of two.
+   \param ny         Points along y, a power of two.
+   \param nz         Points along z, a power of two.
+   \param inverse    If true, transform back.
+   \param n_threads  Number of threads to use.
+*/
+void fft_3d( cx_double *data, int nx, int ny, int nz, bool inverse,
+             int n_threads = 1 );
+
+
+} // namespace fourier
+
+} // namespace lammps_tools
+
+#endif // FFT_HPP
@@ -0,0 +1,101 @@
+#include "frame_index.hpp"
+#include "util.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+
+namespace lammps_tools {
+
+namespace readers {
+
+// First line of every sidecar, bump the number if the format changes.
+static const char *index_magic = "lammps-tools frame index 1";
+
+
+std::string frame_index_file_name( const std::string &dump_file )
+{
+	return dump_file + ".ltidx";
+}
+
+
+std::size_t frame_index::find_timestep( bigint tstep ) const
+{
+	for( std::size_t k = 0; k < frames.size(); ++k ){
+		if( frames[k].tstep == tstep ) return k;
+	}
+	return frames.size();
+}
+
+
+bool frame_index::load( const std::string &dump_file )
+{
+	frames.clear();
+	end = 0;
+
+	std::uint64_t size;
+	std::int64_t mtime;
+	if( !util::file_stamp( dump_file, size, mtime ) ) return false;
+
+	std::ifstream in( frame_index_file_name( dump_file ) );
+	std::string magic;
+	if( !std::getline( in, magic ) || magic != index_magic ) return false;
+
+	std::uint64_t idx_size;
+	std::int64_t idx_mtime;
+	std::size_t n_frames;
+	in >> idx_size >> idx_mtime >> n_frames >> end;
+	if( !in || idx_size != size || idx_mtime != mtime ){
+		end = 0;
+		return false;
+	}
+
+	frames.resize( n_frames );
+	for( frame_info &f : frames ){
+		in >> f.offset >> f.tstep >> f.N;
+	}
+	// A sidecar that was cut short is as good as none.
+	std::string tail;
+	in >> tail;
+	if( !in || tail != "end" ){
+		frames.clear();
+		end = 0;
+		return false;
+	}
+	return true;
+}
+
+
+bool frame_index::save( const std::string &dump_file ) const
+{
+	std::uint64_t size;
+	std::int64_t mtime;
+	if( !util::file_stamp( dump_file, size, mtime ) ) return false;
+
+	// Write to a temporary first so that readers never see half an index.
+	std::string idx_file = frame_index_file_name( dump_file );
+	std::string tmp_file = idx_file + ".tmp";
+	{
+		std::ofstream out( tmp_file );
+		if( !out ) return false;
+
+		out << index_magic << "\n";
+		out << size << " " << mtime << "\n";
+		out << frames.size() << " " << end << "\n";
+		for( const frame_info &f : frames ){
+			out << f.offset << " " << f.tstep << " " << f.N << "\n";
+		}
+		out << "end\n";
+		if( !out ){
+			std::remove( tmp_file.c_str() );
+			return false;
+		}
+	}
+	return std::rename( tmp_file.c_str(), idx_file.c_str() ) == 0;
+}
+
+
+} // namespace readers
+
+} // namespace lammps_tools
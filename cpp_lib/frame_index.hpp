@@ -0,0 +1,87 @@
+#ifndef FRAME_INDEX_HPP
+#define FRAME_INDEX_HPP
+
+/**
+   \file frame_index.hpp
+
+   An index of where each frame in a dump file starts, so that dump
+   readers can jump to any frame without parsing the ones before it.
+*/
+
+#include "types.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace lammps_tools {
+
+namespace readers {
+
+/// Location and size of a single frame in a dump file.
+struct frame_info
+{
+	std::uint64_t offset; ///< Byte offset of the start of the frame.
+	bigint tstep;         ///< Time step of the frame.
+	bigint N;             ///< Number of atoms or entries in the frame.
+};
+
+
+/**
+   \brief Lists the frames of a dump file in the order they appear.
+
+   Because scanning a large text dump still takes a while, the index
+   can be stored in a small sidecar file next to the dump. The sidecar
+   records the size and modification time of the dump, and is ignored
+   once the dump changes.
+*/
+struct frame_index
+{
+	frame_index() : frames(), end( 0 ) {}
+
+	std::vector<frame_info> frames; ///< All complete frames, in order.
+	std::uint64_t end; ///< Byte offset just past the last complete frame.
+
+	/// Returns the number of frames.
+	std::size_t size() const { return frames.size(); }
+
+	/// Returns the info of frame k.
+	const frame_info &operator[]( std::size_t k ) const { return frames[k]; }
+
+	/**
+	   \brief Finds the first frame with given time step.
+
+	   \returns the index of the frame, or size() if there is none.
+	*/
+	std::size_t find_timestep( bigint tstep ) const;
+
+	/**
+	   \brief Loads the index from the sidecar file of given dump file.
+
+	   \param dump_file  Name of the dump file the index is for.
+
+	   \returns true if the sidecar exists and matches the dump file,
+	            false otherwise, in which case the index is empty.
+	*/
+	bool load( const std::string &dump_file );
+
+	/**
+	   \brief Stores the index in the sidecar file of given dump file.
+
+	   \param dump_file  Name of the dump file the index is for.
+
+	   \returns true on success, false if the sidecar could not be written.
+	*/
+	bool save( const std::string &dump_file ) const;
+};
+
+
+/// Returns the name of the sidecar file the index of dump_file is stored in.
+std::string frame_index_file_name( const std::string &dump_file );
+
+
+} // namespace readers
+
+} // namespace lammps_tools
+
+#endif // FRAME_INDEX_HPP
@@ -0,0 +1,261 @@
+#ifndef FRAME_PARALLEL_HPP
+#define FRAME_PARALLEL_HPP
+
+/**
+   \file frame_parallel.hpp
+
+   Runs a per-frame analysis on several frames of a dump file at once.
+*/
+
+#include "dump_reader.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lammps_tools {
+
+namespace readers {
+
+/// Opens a new, fully set up reader for the dump file to analyse.
+typedef std::function<dump_reader*()> dump_reader_factory;
+
+
+/**
+   \brief Reads frames [first, last) one by one and emits the analysis
+   of each, on the calling thread only.
+
+   This is what map_frames falls back to if it cannot seek.
+
+   \returns 0 on success, negative if reading failed.
+*/
+template <typename Analyse, typename Emit>
+int map_frames_serial( dump_reader &d, Analyse &analyse, Emit &emit,
+                       std::size_t first, std::size_t last )
+{
+	std::size_t k = 0;
+	if( first > 0 && d.get_frame_index() ){
+		int status = d.seek_to_frame( first );
+		if( status > 0 ) return 0;
+		if( status < 0 ) return status;
+		k = first;
+	}
+
+	block_data b;
+	for( ; k < last; ++k ){
+		int status = d.next_block( b );
+		if( status > 0 ) return 0;
+		if( status < 0 ) return status;
+		if( k < first ) continue;
+		auto result = analyse( b );
+		emit( result );
+	}
+	return 0;
+}
+
+
+/**
+   \brief Maps an analysis over the frames of a dump file on several
+   threads and emits the results in the order of the frames.
+
+   Every thread opens its own reader through open, so the file has
+   to be indexed (see dump_reader::get_frame_index). The frames are
+   handed out in chunks of consecutive frames; a thread seeks to the
+   start of its chunk and calls analyse on each block in it. The
+   results are passed to emit on the calling thread, in frame order,
+   as soon as all frames before them have been emitted. Because
+   emit sees the results one at a time and in order, it can write
+   output, compare with the previous frame or reduce the results:
+   \code
+   std::vector<double> msd;
+   map_frames( open, compute_msd,
+               [&msd]( double m ){ msd.push_back( m ); } );
+   \endcode
+
+   Each thread works on its own copy of analyse, so scratch space in
+   a function object is not shared. Anything else analyse touches has
+   to be safe to use from several threads. At most a few chunks per
+   thread are kept waiting to be emitted.
+
+   If the reader cannot seek, or n_threads is 1, the frames are read
+   and analysed on the calling thread instead.
+
+   \param open       Opens a new reader on the dump file. Any settings,
+                     like column headers, have to be done in here.
+                     Frames are already spread over threads, so the
+                     reader itself should not use extra threads.
+   \param analyse    Called as analyse( block ) on each frame. Its
+                     return value is passed to emit.
+   \param emit       Called as emit( result ) for every frame, in order.
+   \param n_threads  Number of threads to analyse on, 0 means one per core.
+   \param first      Index of the first frame to analyse.
+   \param last       One past the index of the last frame to analyse.
+   \param chunk      Number of consecutive frames each thread takes at
+                     once, 0 to pick automatically.
+
+   \returns 0 on success, negative if a reader could not be opened or
+            a frame could not be read. Exceptions thrown by analyse or
+            emit stop all threads and are rethrown on the calling thread.
+*/
+template <typename Analyse, typename Emit>
+int map_frames( const dump_reader_factory &open, Analyse analyse, Emit emit,
+                int n_threads = 0, std::size_t first = 0,
+                std::size_t last = std::numeric_limits<std::size_t>::max(),
+                std::size_t chunk = 0 )
+{
+	typedef typename std::decay<
+		decltype( analyse( std::declval<block_data&>() ) ) >::type result_type;
+
+	if( n_threads <= 0 ){
+		n_threads = std::thread::hardware_concurrency();
+		if( n_threads <= 0 ) n_threads = 1;
+	}
+
+	std::unique_ptr<dump_reader> d( open() );
+	if( !d ) return -1;
+
+	const frame_index *index = nullptr;
+	if( n_threads > 1 ) index = d->get_frame_index();
+	if( !index ){
+		return map_frames_serial( *d, analyse, emit, first, last );
+	}
+
+	last = std::min( last, index->size() );
+	if( first >= last ) return 0;
+	std::size_t n_frames = last - first;
+	if( chunk == 0 ){
+		// Small chunks keep the threads balanced, and seeking to
+		// an indexed frame is cheap anyway.
+		chunk = n_frames / ( 4 * n_threads );
+		chunk = std::max<std::size_t>( 1, std::min<std::size_t>( chunk, 8 ) );
+	}
+	std::size_t n_chunks = ( n_frames + chunk - 1 ) / chunk;
+	if( static_cast<std::size_t>( n_threads ) > n_chunks ){
+		n_threads = n_chunks;
+	}
+	// Chunks beyond this many past the oldest unemitted one wait.
+	std::size_t window = 2 * n_threads;
+
+	std::mutex mut;
+	std::condition_variable cv;
+	std::vector<std::vector<result_type> > results( n_chunks );
+	std::vector<char> done( n_chunks, 0 );
+	std::size_t next_chunk = 0, emitted = 0;
+	int status = 0;
+	bool stop = false;
+	std::exception_ptr error;
+
+	auto fail = [&]( int s, std::exception_ptr e ){
+		std::lock_guard<std::mutex> lock( mut );
+		if( !error && status == 0 ){
+			status = s;
+			error = e;
+		}
+		stop = true;
+		cv.notify_all();
+	};
+
+	auto work = [&]( dump_reader *reader, Analyse task ){
+		std::unique_ptr<dump_reader> own;
+		try {
+			if( !reader ){
+				own.reset( open() );
+				reader = own.get();
+				if( !reader ){
+					fail( -1, nullptr );
+					return;
+				}
+			}
+
+			block_data b;
+			std::size_t at = last;
+			while( true ){
+				std::size_t c;
+				{
+					std::unique_lock<std::mutex> lock( mut );
+					cv.wait( lock, [&]{
+							return stop || next_chunk >= n_chunks ||
+								next_chunk < emitted + window; } );
+					if( stop || next_chunk >= n_chunks ) return;
+					c = next_chunk++;
+				}
+
+				std::size_t begin = first + c * chunk;
+				std::size_t end = std::min( begin + chunk, last );
+				if( at != begin && reader->seek_to_frame( begin ) != 0 ){
+					fail( -1, nullptr );
+					return;
+				}
+
+				std::vector<result_type> local;
+				local.reserve( end - begin );
+				for( at = begin; at < end; ++at ){
+					if( reader->next_block( b ) != 0 ){
+						fail( -1, nullptr );
+						return;
+					}
+					local.push_back( task( b ) );
+				}
+
+				std::lock_guard<std::mutex> lock( mut );
+				results[c].swap( local );
+				done[c] = 1;
+				cv.notify_all();
+			}
+		}catch( ... ){
+			fail( 0, std::current_exception() );
+		}
+	};
+
+	std::vector<std::thread> workers;
+	workers.reserve( n_threads );
+	workers.emplace_back( work, d.get(), analyse );
+	for( int t = 1; t < n_threads; ++t ){
+		workers.emplace_back( work, nullptr, analyse );
+	}
+
+	try {
+		for( std::size_t c = 0; c < n_chunks; ++c ){
+			std::vector<result_type> ready;
+			{
+				std::unique_lock<std::mutex> lock( mut );
+				cv.wait( lock, [&]{ return stop || done[c]; } );
+				if( !done[c] ) break;
+				ready.swap( results[c] );
+				++emitted;
+				cv.notify_all();
+			}
+			for( result_type &r : ready ){
+				emit( r );
+			}
+		}
+	}catch( ... ){
+		fail( 0, std::current_exception() );
+	}
+
+	{
+		std::lock_guard<std::mutex> lock( mut );
+		stop = true;
+		cv.notify_all();
+	}
+	for( std::thread &t : workers ) t.join();
+
+	if( error ) std::rethrow_exception( error );
+	return status;
+}
+
+
+} // namespace readers
+
+} // namespace lammps_tools
+
+#endif // FRAME_PARALLEL_HPP
@@ -0,0 +1,612 @@
+#include "gzip_reader.hpp"
+#include "mapped_file.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <future>
+#include <vector>
+
+#ifdef HAVE_ZLIB
+#  include <zlib.h>
+#endif
+
+
+namespace lammps_tools {
+
+namespace util {
+
+std::string gzip_index_file_name( const std::string &fname )
+{
+	return fname + ".ltgzidx";
+}
+
+
+#ifdef HAVE_ZLIB
+
+namespace {
+
+// Largest back-reference in a deflate stream.
+const std::size_t window_size = 32768;
+
+// Uncompressed bytes between access points, which is also the amount
+// of data each thread decompresses at a time.
+const std::uint64_t span = 8 << 20;
+
+// Uncompressed bytes decompressed at once when reading sequentially.
+const std::size_t out_chunk = 1 << 20;
+
+// Identifies the sidecar format, change it if the format changes.
+const char index_magic[8] = { 'L', 'T', 'G', 'Z', 'I', 'D', 'X', '1' };
+
+
+/// A place from where decompression can restart.
+struct access_point
+{
+	std::uint64_t out; ///< Offset in the uncompressed data.
+	std::uint64_t in;  ///< Offset of the first full compressed byte.
+	int bits;          ///< Bits of the byte before in that are still needed.
+	bool member_start; ///< If true, a gzip member starts at in.
+
+	/// The uncompressed data before out, empty at member starts.
+	std::vector<unsigned char> window;
+};
+
+
+// Checks for the gzip magic bytes.
+bool is_gzip_member( const unsigned char *p, std::size_t left )
+{
+	return left >= 2 && p[0] == 0x1f && p[1] == 0x8b;
+}
+
+
+// Hands strm the next part of the input if it ran out.
+// avail_in is only 32 bits, so files over 4 GB go in pieces.
+void feed( z_stream &strm, const unsigned char *data, std::size_t size )
+{
+	if( strm.avail_in > 0 ) return;
+	std::size_t pos = strm.next_in - data;
+	strm.avail_in = static_cast<uInt>(
+		std::min<std::size_t>( size - pos, 1u << 30 ) );
+}
+
+
+// Points strm at given access point. strm should be initialised.
+// raw is set to true if the data after it is raw deflate data.
+bool start_at( z_stream &strm, const access_point &p,
+               const unsigned char *data, std::size_t size, bool &raw )
+{
+	strm.next_in = const_cast<unsigned char*>( data + p.in );
+	strm.avail_in = 0;
+	feed( strm, data, size );
+	raw = !p.member_start;
+	if( p.member_start ){
+		// 32 + 15 makes zlib read the gzip header.
+		return inflateReset2( &strm, 47 ) == Z_OK;
+	}
+	if( inflateReset2( &strm, -15 ) != Z_OK ) return false;
+	if( p.bits && inflatePrime( &strm, p.bits,
+	                            data[p.in - 1] >> ( 8 - p.bits ) ) != Z_OK ){
+		return false;
+	}
+	return p.window.empty() ||
+		inflateSetDictionary( &strm, p.window.data(),
+		                      p.window.size() ) == Z_OK;
+}
+
+
+// Decompresses the len bytes following access point p.
+std::vector<unsigned char> inflate_piece( const access_point &p,
+                                          std::uint64_t len,
+                                          const unsigned char *data,
+                                          std::size_t size )
+{
+	std::vector<unsigned char> piece( len );
+	z_stream strm;
+	std::memset( &strm, 0, sizeof(strm) );
+	if( inflateInit2( &strm, 47 ) != Z_OK ){
+		piece.clear();
+		return piece;
+	}
+
+	bool raw;
+	std::size_t done = 0;
+	if( start_at( strm, p, data, size, raw ) ){
+		while( done < len ){
+			feed( strm, data, size );
+			strm.next_out = piece.data() + done;
+			strm.avail_out = static_cast<uInt>(
+				std::min<std::uint64_t>( len - done, 1u << 30 ) );
+			uInt before = strm.avail_out;
+			int ret = inflate( &strm, Z_NO_FLUSH );
+			done += before - strm.avail_out;
+			// Pieces end at member boundaries, so the stream can
+			// only end when the piece is full.
+			if( ret != Z_OK && !( ret == Z_STREAM_END && done == len ) ){
+				break;
+			}
+		}
+	}
+	inflateEnd( &strm );
+	piece.resize( done );
+	return piece;
+}
+
+} // namespace
+
+
+/// Everything gzip_reader needs, kept here to keep zlib out of the header.
+struct gzip_state
+{
+	explicit gzip_state( const std::string &fname );
+	~gzip_state();
+
+	bool load_index();
+	bool save_index() const;
+
+	// Index of the last access point at or before offset.
+	std::size_t point_before( std::uint64_t offset ) const;
+
+	// Sequential decompression:
+	bool seek_serial( std::uint64_t offset );
+	bool inflate_more();
+	std::size_t read_serial( char *dest, std::size_t n );
+
+	// Decompression of pieces between access points on threads:
+	bool seek_parallel( std::uint64_t offset );
+	bool next_piece();
+	std::size_t read_parallel( char *dest, std::size_t n );
+
+	std::string fname;
+	mapped_file file;
+	const unsigned char *data;
+	std::size_t size;
+
+	std::vector<access_point> points;
+	bool complete;           ///< True if points covers all data.
+	std::uint64_t total_out; ///< Uncompressed size, if complete.
+	bool failed;
+
+	std::uint64_t cursor;    ///< Uncompressed offset of the next read.
+	int threads;
+	bool parallel;           ///< True if reading through pieces.
+
+	z_stream strm;
+	bool raw;                ///< True if strm reads raw deflate data.
+	bool at_end;             ///< True if strm reached the end of data.
+	std::vector<unsigned char> out; ///< History, then unread output.
+	std::size_t out_pos, out_end;
+	std::uint64_t out_offset; ///< Uncompressed offset of out[out_end].
+
+	std::deque<std::future<std::vector<unsigned char> > > pending;
+	std::size_t next_launch;  ///< Access point of the next piece to start.
+	std::vector<unsigned char> piece;
+	std::size_t piece_pos;
+};
+
+
+gzip_state::gzip_state( const std::string &fname )
+	: fname( fname ), file( fname ), data( nullptr ), size( 0 ), points(),
+	  complete( false ), total_out( 0 ), failed( false ), cursor( 0 ),
+	  threads( 1 ), parallel( false ), strm(), raw( false ),
+	  at_end( false ), out( window_size + out_chunk ), out_pos( 0 ),
+	  out_end( 0 ), out_offset( 0 ), pending(), next_launch( 0 ),
+	  piece(), piece_pos( 0 )
+{
+	std::memset( &strm, 0, sizeof(strm) );
+	if( !file.good() || inflateInit2( &strm, 47 ) != Z_OK ){
+		failed = true;
+		return;
+	}
+	data = reinterpret_cast<const unsigned char*>( file.data() );
+	size = file.size();
+
+	if( !load_index() ){
+		access_point start = { 0, 0, 0, true, {} };
+		points.assign( 1, start );
+	}
+	failed = !seek_serial( 0 );
+}
+
+gzip_state::~gzip_state()
+{
+	// The futures wait for their threads when destroyed.
+	pending.clear();
+	inflateEnd( &strm );
+}
+
+
+std::size_t gzip_state::point_before( std::uint64_t offset ) const
+{
+	std::size_t k = 1;
+	while( k < points.size() && points[k].out <= offset ) ++k;
+	return k - 1;
+}
+
+
+bool gzip_state::seek_serial( std::uint64_t offset )
+{
+	pending.clear();
+
+	// out holds the data up to out_offset, so going forward from
+	// there can be cheaper than restarting at an access point.
+	std::size_t k = point_before( offset );
+	std::uint64_t buffered_from = out_offset - out_end;
+	bool restart = strm.next_in == nullptr || offset < buffered_from ||
+		points[k].out > out_offset;
+	if( restart ){
+		const access_point &p = points[k];
+		if( !start_at( strm, p, data, size, raw ) ) return false;
+		std::copy( p.window.begin(), p.window.end(), out.begin() );
+		out_pos = out_end = p.window.size();
+		out_offset = p.out;
+		at_end = false;
+	}else if( offset < out_offset ){
+		out_pos = offset - buffered_from;
+	}else{
+		out_pos = out_end;
+	}
+
+	std::uint64_t skip = offset - ( out_offset - ( out_end - out_pos ) );
+	while( skip > 0 ){
+		if( out_pos == out_end && !inflate_more() ) return false;
+		std::size_t n = std::min<std::uint64_t>( skip, out_end - out_pos );
+		out_pos += n;
+		skip -= n;
+	}
+	cursor = offset;
+	return true;
+}
+
+
+bool gzip_state::inflate_more()
+{
+	// Keep the last window_size bytes, access points need them.
+	std::size_t keep = std::min( out_end, window_size );
+	std::memmove( out.data(), out.data() + out_end - keep, keep );
+	out_pos = out_end = keep;
+
+	while( out_end < out.size() && !at_end ){
+		feed( strm, data, size );
+		strm.next_out = out.data() + out_end;
+		strm.avail_out = out.size() - out_end;
+		int ret = inflate( &strm, Z_BLOCK );
+		std::size_t produced = out.size() - out_end - strm.avail_out;
+		out_end += produced;
+		out_offset += produced;
+		std::size_t pos = strm.next_in - data;
+
+		if( ret == Z_STREAM_END ){
+			// Raw streams leave the gzip trailer unread.
+			if( raw ) pos += 8;
+			if( pos < size && is_gzip_member( data + pos, size - pos ) ){
+				if( !complete && out_offset > points.back().out ){
+					access_point p = { out_offset, pos, 0, true, {} };
+					points.push_back( p );
+				}
+				strm.next_in = const_cast<unsigned char*>( data + pos );
+				strm.avail_in = 0;
+				inflateReset2( &strm, 47 );
+				raw = false;
+				continue;
+			}
+
+			at_end = true;
+			if( !complete ){
+				complete = true;
+				total_out = out_offset;
+				save_index();
+			}
+		}else if( ret == Z_BUF_ERROR && pos >= size ){
+			// The file ends early, maybe it is still being written.
+			at_end = true;
+		}else if( ret != Z_OK ){
+			failed = true;
+			at_end = true;
+		}else if( !complete && ( strm.data_type & 128 ) &&
+		          !( strm.data_type & 64 ) &&
+		          out_offset >= points.back().out + span ){
+			// At the end of a deflate block that is not the last.
+			std::size_t w = std::min( out_end, window_size );
+			access_point p = { out_offset, pos, strm.data_type & 7,
+			                   false, {} };
+			p.window.assign( out.data() + out_end - w,
+			                 out.data() + out_end );
+			points.push_back( p );
+		}
+	}
+	return out_end > out_pos;
+}
+
+
+std::size_t gzip_state::read_serial( char *dest, std::size_t n )
+{
+	std::size_t done = 0;
+	while( done < n ){
+		if( out_pos == out_end && !inflate_more() ) break;
+		std::size_t m = std::min( n - done, out_end - out_pos );
+		std::memcpy( dest + done, out.data() + out_pos, m );
+		out_pos += m;
+		done += m;
+	}
+	cursor += done;
+	return done;
+}
+
+
+bool gzip_state::seek_parallel( std::uint64_t offset )
+{
+	if( offset > total_out ) return false;
+
+	pending.clear();
+	next_launch = point_before( offset );
+	piece.clear();
+	piece_pos = 0;
+	if( !next_piece() && offset < total_out ) return false;
+
+	piece_pos = offset - points[ point_before( offset ) ].out;
+	cursor = offset;
+	return piece_pos <= piece.size();
+}
+
+
+bool gzip_state::next_piece()
+{
+	// Keep every thread busy with a piece further ahead.
+	while( pending.size() < static_cast<std::size_t>( threads ) &&
+	       next_launch < points.size() ){
+		const access_point &p = points[next_launch];
+		std::uint64_t end = next_launch + 1 < points.size() ?
+			points[next_launch+1].out : total_out;
+		pending.push_back( std::async( std::launch::async, inflate_piece,
+		                               std::cref( p ), end - p.out,
+		                               data, size ) );
+		++next_launch;
+	}
+	if( pending.empty() ) return false;
+
+	std::size_t k = next_launch - pending.size();
+	std::uint64_t expected = ( k + 1 < points.size() ?
+	                           points[k+1].out : total_out ) - points[k].out;
+	piece = pending.front().get();
+	pending.pop_front();
+	piece_pos = 0;
+	if( piece.size() != expected ){
+		failed = true;
+		return false;
+	}
+	return true;
+}
+
+
+std::size_t gzip_state::read_parallel( char *dest, std::size_t n )
+{
+	std::size_t done = 0;
+	while( done < n ){
+		if( piece_pos == piece.size() && !next_piece() ) break;
+		std::size_t m = std::min( n - done, piece.size() - piece_pos );
+		std::memcpy( dest + done, piece.data() + piece_pos, m );
+		piece_pos += m;
+		done += m;
+	}
+	cursor += done;
+	return done;
+}
+
+
+bool gzip_state::load_index()
+{
+	std::uint64_t file_size;
+	std::int64_t mtime;
+	if( !file_stamp( fname, file_size, mtime ) ) return false;
+
+	std::ifstream in( gzip_index_file_name( fname ), std::ios_base::binary );
+	char magic[8];
+	std::uint64_t idx_size, idx_total_out, n_points;
+	std::int64_t idx_mtime;
+	in.read( magic, 8 );
+	in.read( reinterpret_cast<char*>( &idx_size ), sizeof(idx_size) );
+	in.read( reinterpret_cast<char*>( &idx_mtime ), sizeof(idx_mtime) );
+	in.read( reinterpret_cast<char*>( &idx_total_out ),
+	         sizeof(idx_total_out) );
+	in.read( reinterpret_cast<char*>( &n_points ), sizeof(n_points) );
+	if( !in || std::memcmp( magic, index_magic, 8 ) != 0 ||
+	    idx_size != file_size || idx_mtime != mtime || n_points == 0 ){
+		return false;
+	}
+
+	std::vector<access_point> loaded( n_points );
+	std::vector<unsigned char> packed;
+	for( access_point &p : loaded ){
+		std::int32_t bits, member_start;
+		std::uint32_t packed_size;
+		in.read( reinterpret_cast<char*>( &p.out ), sizeof(p.out) );
+		in.read( reinterpret_cast<char*>( &p.in ), sizeof(p.in) );
+		in.read( reinterpret_cast<char*>( &bits ), sizeof(bits) );
+		in.read( reinterpret_cast<char*>( &member_start ),
+		         sizeof(member_start) );
+		in.read( reinterpret_cast<char*>( &packed_size ),
+		         sizeof(packed_size) );
+		if( !in || p.in > size || bits < 0 || bits > 7 ) return false;
+		p.bits = bits;
+		p.member_start = member_start;
+
+		// Windows are stored compressed.
+		if( packed_size ){
+			packed.resize( packed_size );
+			in.read( reinterpret_cast<char*>( packed.data() ),
+			         packed_size );
+			p.window.resize( window_size );
+			uLongf w = p.window.size();
+			if( !in || uncompress( p.window.data(), &w, packed.data(),
+			                       packed_size ) != Z_OK ){
+				return false;
+			}
+			p.window.resize( w );
+		}
+	}
+	if( loaded[0].out != 0 ) return false;
+
+	points.swap( loaded );
+	total_out = idx_total_out;
+	complete = true;
+	return true;
+}
+
+
+bool gzip_state::save_index() const
+{
+	std::uint64_t file_size;
+	std::int64_t mtime;
+	if( !file_stamp( fname, file_size, mtime ) ) return false;
+
+	// Write to a temporary first so that readers never see half an index.
+	std::string idx_file = gzip_index_file_name( fname );
+	std::string tmp_file = idx_file + ".tmp";
+	{
+		std::ofstream o( tmp_file, std::ios_base::binary );
+		if( !o ) return false;
+
+		std::uint64_t n_points = points.size();
+		o.write( index_magic, 8 );
+		o.write( reinterpret_cast<const char*>( &file_size ),
+		         sizeof(file_size) );
+		o.write( reinterpret_cast<const char*>( &mtime ), sizeof(mtime) );
+		o.write( reinterpret_cast<const char*>( &total_out ),
+		         sizeof(total_out) );
+		o.write( reinterpret_cast<const char*>( &n_points ),
+		         sizeof(n_points) );
+
+		std::vector<unsigned char> packed( compressBound( window_size ) );
+		for( const access_point &p : points ){
+			std::int32_t bits = p.bits;
+			std::int32_t member_start = p.member_start;
+			uLongf packed_size = 0;
+			if( !p.window.empty() ){
+				packed_size = packed.size();
+				compress2( packed.data(), &packed_size, p.window.data(),
+				           p.window.size(), 1 );
+			}
+			std::uint32_t ps = packed_size;
+			o.write( reinterpret_cast<const char*>( &p.out ),
+			         sizeof(p.out) );
+			o.write( reinterpret_cast<const char*>( &p.in ),
+			         sizeof(p.in) );
+			o.write( reinterpret_cast<const char*>( &bits ), sizeof(bits) );
+			o.write( reinterpret_cast<const char*>( &member_start ),
+			         sizeof(member_start) );
+			o.write( reinterpret_cast<const char*>( &ps ), sizeof(ps) );
+			o.write( reinterpret_cast<const char*>( packed.data() ), ps );
+		}
+		if( !o ){
+			std::remove( tmp_file.c_str() );
+			return false;
+		}
+	}
+	return std::rename( tmp_file.c_str(), idx_file.c_str() ) == 0;
+}
+
+
+
+gzip_reader::gzip_reader( const std::string &fname )
+	: state( new gzip_state( fname ) )
+{ }
+
+gzip_reader::~gzip_reader()
+{ }
+
+bool gzip_reader::good() const
+{
+	return !state->failed;
+}
+
+std::size_t gzip_reader::read( char *dest, std::size_t n )
+{
+	if( state->failed ) return 0;
+
+	// Switch to decompressing in parallel once that is possible.
+	bool parallel = state->complete && state->threads > 1;
+	if( parallel != state->parallel ){
+		state->parallel = parallel;
+		if( !seek( state->cursor ) ) return 0;
+	}
+
+	if( state->parallel ){
+		return state->read_parallel( dest, n );
+	}else{
+		return state->read_serial( dest, n );
+	}
+}
+
+bool gzip_reader::seek( std::uint64_t offset )
+{
+	if( state->failed ) return false;
+	if( state->parallel ){
+		return state->seek_parallel( offset );
+	}else{
+		return state->seek_serial( offset );
+	}
+}
+
+std::uint64_t gzip_reader::tell() const
+{
+	return state->cursor;
+}
+
+void gzip_reader::set_threads( int n )
+{
+	state->threads = std::max( n, 1 );
+}
+
+bool gzip_reader::indexed() const
+{
+	return state->complete;
+}
+
+#else
+
+/// Without zlib there is nothing to keep track of.
+struct gzip_state {};
+
+gzip_reader::gzip_reader( const std::string &fname )
+	: state( nullptr )
+{ }
+
+gzip_reader::~gzip_reader()
+{ }
+
+bool gzip_reader::good() const
+{
+	return false;
+}
+
+std::size_t gzip_reader::read( char *dest, std::size_t n )
+{
+	return 0;
+}
+
+bool gzip_reader::seek( std::uint64_t offset )
+{
+	return false;
+}
+
+std::uint64_t gzip_reader::tell() const
+{
+	return 0;
+}
+
+void gzip_reader::set_threads( int n )
+{ }
+
+bool gzip_reader::indexed() const
+{
+	return false;
+}
+
+#endif // HAVE_ZLIB
+
+} // namespace util
+
+} // namespace lammps_tools
@@ -0,0 +1,95 @@
+#ifndef GZIP_READER_HPP
+#define GZIP_READER_HPP
+
+/**
+   \file gzip_reader.hpp
+
+   Decompresses gzip files with random access, based on zlib.
+*/
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace lammps_tools {
+
+namespace util {
+
+struct gzip_state;
+
+/**
+   \brief Reads the uncompressed contents of a gzip file.
+
+   While decompressing, the reader records access points: places in
+   the compressed data from where decompression can restart, together
+   with the 32 kB of output preceding them (like zlib's zran example).
+   Each gzip member start is an access point too, so concatenated
+   files work. Seeking then only decompresses from the nearest access
+   point instead of from the start.
+
+   Once the whole file was decompressed the access points cover all
+   of it. They are then stored in a sidecar file next to the gzip file
+   so that later readers start out indexed. With a complete index, the
+   pieces between access points are independent, so set_threads can
+   make read decompress the next pieces ahead in parallel.
+
+   Without zlib support good() is always false.
+*/
+class gzip_reader
+{
+public:
+	/// Opens the gzip file with given name.
+	explicit gzip_reader( const std::string &fname );
+
+	/// Waits for pending decompression and closes the file.
+	~gzip_reader();
+
+	/// Returns false if the file could not be opened or is corrupt.
+	bool good() const;
+
+	/**
+	   \brief Reads up to n uncompressed bytes into dest.
+
+	   \returns the number of bytes read, which is 0 at the end of the
+	            data or on failure.
+	*/
+	std::size_t read( char *dest, std::size_t n );
+
+	/**
+	   \brief Moves to given offset in the uncompressed data.
+
+	   \returns true on success, false if the offset is past the end.
+	*/
+	bool seek( std::uint64_t offset );
+
+	/// Returns the offset in the uncompressed data of the next read.
+	std::uint64_t tell() const;
+
+	/**
+	   \brief Sets how many threads decompress once the index is complete.
+
+	   \param n  Number of pieces to decompress at the same time.
+	*/
+	void set_threads( int n );
+
+	/// Returns true if the access points cover the entire file.
+	bool indexed() const;
+
+private:
+	gzip_reader( const gzip_reader & ) = delete;
+	gzip_reader &operator=( const gzip_reader & ) = delete;
+
+	std::unique_ptr<gzip_state> state;
+};
+
+
+/// Returns the name of the sidecar file the access points of fname go in.
+std::string gzip_index_file_name( const std::string &fname );
+
+
+} // namespace util
+
+} // namespace lammps_tools
+
+#endif // GZIP_READER_HPP
@@ -0,0 +1,99 @@
+#include "mapped_file.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+
+namespace lammps_tools {
+
+namespace util {
+
+#ifndef _WIN32
+
+mapped_file::mapped_file( const std::string &fname )
+	: begin( nullptr ), n_bytes( 0 ), mapped( false )
+{
+	int fd = open( fname.c_str(), O_RDONLY );
+	if( fd < 0 ) return;
+
+	struct stat st;
+	if( fstat( fd, &st ) != 0 ){
+		close( fd );
+		return;
+	}
+	n_bytes = st.st_size;
+	if( n_bytes == 0 ){
+		// Nothing to map, but an empty file is not an error.
+		close( fd );
+		mapped = true;
+		return;
+	}
+
+	void *addr = mmap( nullptr, n_bytes, PROT_READ, MAP_PRIVATE, fd, 0 );
+	// The mapping keeps its own reference to the file.
+	close( fd );
+	if( addr == MAP_FAILED ){
+		n_bytes = 0;
+		return;
+	}
+	begin = static_cast<const char*>( addr );
+	mapped = true;
+
+	madvise( const_cast<char*>( begin ), n_bytes, MADV_SEQUENTIAL );
+}
+
+mapped_file::~mapped_file()
+{
+	if( begin ) munmap( const_cast<char*>( begin ), n_bytes );
+}
+
+
+// madvise wants page-aligned addresses, so round the start down.
+static void advise_range( const char *begin, std::size_t n_bytes,
+                          std::size_t offset, std::size_t length,
+                          int advice )
+{
+	if( !begin || offset >= n_bytes ) return;
+	if( length > n_bytes - offset ) length = n_bytes - offset;
+
+	std::size_t page = sysconf( _SC_PAGESIZE );
+	std::size_t start = offset - offset % page;
+	madvise( const_cast<char*>( begin ) + start,
+	         length + offset - start, advice );
+}
+
+void mapped_file::will_need( std::size_t offset, std::size_t length ) const
+{
+	advise_range( begin, n_bytes, offset, length, MADV_WILLNEED );
+}
+
+void mapped_file::dont_need( std::size_t offset, std::size_t length ) const
+{
+	advise_range( begin, n_bytes, offset, length, MADV_DONTNEED );
+}
+
+#else
+
+// No mmap available, good() stays false so readers report failure.
+mapped_file::mapped_file( const std::string &fname )
+	: begin( nullptr ), n_bytes( 0 ), mapped( false )
+{ }
+
+mapped_file::~mapped_file()
+{ }
+
+void mapped_file::will_need( std::size_t, std::size_t ) const
+{ }
+
+void mapped_file::dont_need( std::size_t, std::size_t ) const
+{ }
+
+#endif // _WIN32
+
+} // namespace util
+
+} // namespace lammps_tools
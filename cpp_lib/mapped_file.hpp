@@ -0,0 +1,73 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+/**
+   \file mapped_file.hpp
+
+   A small RAII wrapper around a read-only memory-mapped file.
+*/
+
+#include <cstddef>
+#include <string>
+
+namespace lammps_tools {
+
+namespace util {
+
+/**
+   \brief Maps a complete file read-only into memory.
+
+   On POSIX systems this uses mmap, so the kernel pages data in on demand
+   and no user-space buffer or copy is needed. If the mapping cannot be
+   made, good() returns false.
+*/
+class mapped_file
+{
+public:
+	/// Maps the file with given name.
+	explicit mapped_file( const std::string &fname );
+
+	/// Unmaps the file.
+	~mapped_file();
+
+	/// Returns a pointer to the first byte of the file.
+	const char *data() const { return begin; }
+
+	/// Returns the size of the file in bytes.
+	std::size_t size() const { return n_bytes; }
+
+	/// Returns true if the file was mapped successfully.
+	bool good() const { return mapped; }
+
+	/**
+	   \brief Hints the kernel that the given byte range is needed soon.
+
+	   \param offset  Start of the range in bytes.
+	   \param length  Length of the range in bytes.
+	*/
+	void will_need( std::size_t offset, std::size_t length ) const;
+
+	/**
+	   \brief Hints the kernel that the given byte range is no longer needed.
+
+	   Useful when streaming through files much larger than memory.
+
+	   \param offset  Start of the range in bytes.
+	   \param length  Length of the range in bytes.
+	*/
+	void dont_need( std::size_t offset, std::size_t length ) const;
+
+private:
+	mapped_file( const mapped_file & ) = delete;
+	mapped_file &operator=( const mapped_file & ) = delete;
+
+	const char *begin;
+	std::size_t n_bytes;
+	bool mapped;
+};
+
+} // namespace util
+
+} // namespace lammps_tools
+
+#endif // MAPPED_FILE_HPP
@@ -5,6 +5,7 @@
 #include "markov_state_capsid.hpp"
 #include "my_assert.hpp"
 #include "neighborize.hpp"
+#include "neighborize_kd_tree.hpp"
 
 #include <cmath>
 #include <iostream>
@@ -82,18 +83,21 @@ double msm_id_capsid::shortest_cluster_dist(
 	const std::vector<double> &y = get_y( b );
 	const std::vector<double> &z = get_z( b );
 
+	// Instead of comparing all pairs, look up the nearest free molecule.
+	std::vector<int> free_coms;
+	free_coms.reserve( not_in_cluster.size() );
+	for( int jdx : not_in_cluster ){
+		free_coms.push_back( mol2com[jdx] );
+	}
+	neighborize::kd_tree free_tree( b, free_coms, 3 );
+
 	double min_r2 = dist*dist;
 	for( int idx : consider_these ){
 		int i = mol2com[idx];
 		double xi[3] = { x[i], y[i], z[i] };
-		for( int jdx : not_in_cluster ){
-			int j = mol2com[jdx];
-			double r[3];
-			double xj[3] = { x[j], y[j], z[j] };
-			double r2 = b.dom.dist_2( xi, xj, r );
-			if( r2 < min_r2 ){
-				min_r2 = r2;
-			}
+		double r2;
+		if( free_tree.nearest( xi, r2 ) >= 0 && r2 < min_r2 ){
+			min_r2 = r2;
 		}
 	}
 
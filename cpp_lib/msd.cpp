@@ -1,15 +1,235 @@
 #include "msd.hpp"
+#include "block_data_access.hpp"
+#include "fft.hpp"
+#include "my_assert.hpp"
+#include "neighborize_cell.hpp"
+#include "util.hpp"
+
+#include <algorithm>
 
 namespace lammps_tools {
 
 namespace fluctuations {
 
+namespace {
+
+// Pairs of values that are gathered from the frames together, so that
+// a pass over the frames reads whole cache lines.
+const int block_pairs = 8;
+
+} // namespace
+
+
+msd_accumulator::msd_accumulator( int dims, int mode,
+                                  const std::vector<int> &ids,
+                                  int n_threads, int p, int m )
+	: dims( dims ), mode( mode ),
+	  n_threads( neighborize::resolve_threads( n_threads ) ), p( p ), m( m ),
+	  atoms( dims, ids ), traj(), buffer( 0, p, m ), sums(), counts()
+{
+	my_assert( __FILE__, __LINE__, mode == FFT || mode == MULTI_TAU,
+	           "Unknown MSD mode!" );
+}
+
+
+void msd_accumulator::add_frame( const block_data &b )
+{
+	atoms.add_frame( b );
+	const std::vector<double> &current = atoms.unwrapped();
+	if( mode == FFT ){
+		traj.insert( traj.end(), current.begin(), current.end() );
+	}else{
+		if( atoms.n_frames() == 1 ){
+			buffer = correlate::multi_tau( current.size(), p, m );
+		}
+		add_multi_tau();
+	}
+}
+
+
+void msd_accumulator::add_multi_tau()
+{
+	const std::vector<double> &current = atoms.unwrapped();
+	const std::vector<correlate::multi_tau::partner> &partners =
+		buffer.add( current.data() );
+	std::size_t n_values = current.size();
+
+	int n_run = std::min<bigint>( n_threads,
+	                              1 + atoms.size()
+	                              / neighborize::cell_list::min_thread_atoms );
+	std::vector<std::vector<double> > partial(
+		n_run, std::vector<double>( partners.size(), 0.0 ) );
+	util::run_on_threads( n_run, [&]( int t ){
+		std::size_t begin = n_values * t / n_run;
+		std::size_t end = n_values * ( t + 1 ) / n_run;
+		const double *now = current.data();
+		for( std::size_t k = 0; k < partners.size(); ++k ){
+			const double *then = partners[k].frame;
+			double sum = 0.0;
+			for( std::size_t v = begin; v < end; ++v ){
+				double d = now[v] - then[v];
+				sum += d*d;
+			}
+			partial[t][k] = sum;
+		}
+	} );
+
+	for( std::size_t k = 0; k < partners.size(); ++k ){
+		std::size_t c = partners[k].channel;
+		if( c >= sums.size() ){
+			sums.resize( c + 1, 0.0 );
+			counts.resize( c + 1, 0 );
+		}
+		for( int t = 0; t < n_run; ++t ){
+			sums[c] += partial[t][k];
+		}
+		++counts[c];
+	}
+}
+
+
+std::vector<double> msd_accumulator::msd() const
+{
+	return mode == FFT ? msd_fft() : msd_multi_tau();
+}
+
+
+std::vector<double> msd_accumulator::msd_multi_tau() const
+{
+	std::vector<double> res( sums.size(), 0.0 );
+	for( std::size_t c = 0; c < sums.size(); ++c ){
+		if( counts[c] > 0 ){
+			res[c] = sums[c] / ( counts[c] * double( atoms.size() ) );
+		}
+	}
+	return res;
+}
+
+
+std::vector<double> msd_accumulator::msd_fft() const
+{
+	using fourier::cx_double;
+
+	const std::size_t T = atoms.n_frames();
+	const std::size_t S = atoms.size() * dims;
+	if( T == 0 || S == 0 ) return std::vector<double>( T, 0.0 );
+
+	// The MSD at lag m is S1( m ) - 2 S2( m ), with S1 the average of
+	// u( k )^2 + u( k + m )^2 and S2 the autocorrelation of u. The
+	// autocorrelation comes from the power spectrum of u padded to at
+	// least 2T. The real part of the autocorrelation of u + i v is the
+	// sum of those of u and v, and only the sum over all atoms and
+	// directions is needed, so each transform does two of them.
+	fourier::fft_plan plan( fourier::fft_size( 2*T ) );
+	const std::size_t n = plan.size();
+	const std::size_t n_pairs = ( S + 1 ) / 2;
+	const std::size_t n_blocks = ( n_pairs + block_pairs - 1 ) / block_pairs;
+	int n_run = std::min<std::size_t>( n_threads, n_blocks );
+
+	std::vector<std::vector<double> > power( n_run ), sq( n_run );
+	util::run_on_threads( n_run, [&]( int t ){
+		std::vector<double> &P = power[t];
+		std::vector<double> &D = sq[t];
+		P.assign( n, 0.0 );
+		D.assign( T, 0.0 );
+
+		std::vector<double> block( 2*block_pairs * T );
+		std::vector<cx_double> buf( n );
+		for( std::size_t bl = t; bl < n_blocks; bl += n_run ){
+			std::size_t s0 = 2 * block_pairs * bl;
+			std::size_t width = std::min<std::size_t>( 2*block_pairs, S - s0 );
+
+			// Displacements from the first frame, value after value.
+			for( std::size_t f = 0; f < T; ++f ){
+				const double *row = traj.data() + f*S + s0;
+				for( std::size_t v = 0; v < width; ++v ){
+					block[v*T + f] = row[v] - traj[s0 + v];
+				}
+			}
+
+			for( std::size_t v = 0; v < width; v += 2 ){
+				const double *u = block.data() + v*T;
+				const double *w = v + 1 < width ? u + T : nullptr;
+				for( std::size_t f = 0; f < T; ++f ){
+					double wf = w ? w[f] : 0.0;
+					buf[f] = cx_double( u[f], wf );
+					D[f] += u[f]*u[f] + wf*wf;
+				}
+				std::fill( buf.begin() + T, buf.end(), cx_double( 0.0, 0.0 ) );
+				plan.forward( buf.data() );
+				for( std::size_t k = 0; k < n; ++k ){
+					P[k] += std::norm( buf[k] );
+				}
+			}
+		}
+	} );
+
+	std::vector<cx_double> S2( n );
+	std::vector<double> D( T, 0.0 );
+	for( int t = 0; t < n_run; ++t ){
+		for( std::size_t k = 0; k < n; ++k ) S2[k] += power[t][k];
+		for( std::size_t f = 0; f < T; ++f ) D[f] += sq[t][f];
+	}
+	plan.inverse( S2.data() );
+
+	double Q = 0.0;
+	for( double Df : D ) Q += 2.0 * Df;
+	std::vector<double> res( T );
+	const double N = atoms.size();
+	for( std::size_t lag = 0; lag < T; ++lag ){
+		if( lag > 0 ) Q -= D[lag-1] + D[T-lag];
+		double pairs = T - lag;
+		double S1 = Q / pairs;
+		double auto_corr = std::real( S2[lag] ) / n / pairs;
+		res[lag] = ( S1 - 2.0 * auto_corr ) / N;
+	}
+	return res;
+}
+
+
+std::vector<bigint> msd_accumulator::lag_frames() const
+{
+	std::vector<bigint> lags;
+	if( mode == FFT ){
+		lags.resize( atoms.n_frames() );
+		for( bigint k = 0; k < atoms.n_frames(); ++k ) lags[k] = k;
+	}else{
+		lags.resize( sums.size() );
+		for( std::size_t c = 0; c < sums.size(); ++c ){
+			lags[c] = buffer.lag( c );
+		}
+	}
+	return lags;
+}
+
+
+std::vector<bigint> msd_accumulator::lag_times() const
+{
+	std::vector<bigint> lags = lag_frames();
+	for( bigint &l : lags ) l *= atoms.time_step();
+	return lags;
+}
+
+
+std::size_t msd_accumulator::memory() const
+{
+	return traj.capacity() * sizeof(double) + atoms.memory()
+		+ buffer.memory();
+}
+
 
-double compute_msd( readers::dump_reader *reader, std::vector<double> &msd,
-                    std::list<bigint> &time, const std::list<int> &ids,
-                    bool got_ids )
+bigint compute_msd( readers::dump_reader *reader, std::vector<double> &msd,
+                    std::vector<bigint> &lag_time, int dims, int mode,
+                    const std::vector<int> &ids, int n_threads )
 {
-	return 0.0;
+	msd_accumulator acc( dims, mode, ids, n_threads );
+	block_data b;
+	while( reader->next_block( b ) == 0 ){
+		acc.add_frame( b );
+	}
+	msd = acc.msd();
+	lag_time = acc.lag_times();
+	return acc.n_frames();
 }
 
 } // namespace fluctuations
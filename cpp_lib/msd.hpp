@@ -1,21 +1,123 @@
 #ifndef MSD_HPP
 #define MSD_HPP
 
+/**
+   \file msd.hpp
 
-#include "readers.hpp"
+   Mean-squared displacements over all lags of a trajectory.
+*/
+
+#include "atom_tracker.hpp"
+#include "block_data.hpp"
+#include "dump_reader.hpp"
+#include "multi_tau.hpp"
 #include "types.hpp"
 
-#include <list>
 #include <vector>
 
 namespace lammps_tools {
 
 namespace fluctuations {
 
+/**
+   \brief Accumulates the mean-squared displacement of atoms over frames.
+
+   The atoms are followed with an atom_tracker, which explains how
+   positions are unwrapped. Frames need not be sorted by id.
+
+   In FFT mode all frames are kept, and MSD( tau ) for every lag is
+   found with the Wiener-Khinchin theorem in O( N T log T ) for N atoms
+   and T frames. In MULTI_TAU mode only a logarithmic grid of past
+   frames is kept (see correlate::multi_tau), which bounds the memory
+   on very long trajectories at the cost of fewer lags.
+*/
+class msd_accumulator
+{
+public:
+	/// Ways of computing the MSD.
+	enum modes {
+		FFT = 0,       ///< Every lag, from all frames.
+		MULTI_TAU = 1  ///< Lags on a logarithmic grid, in bounded memory.
+	};
+
+	/**
+	   \param dims       Dimensions of the system (2 or 3).
+	   \param mode       FFT or MULTI_TAU.
+	   \param ids        Ids of the atoms to follow, empty for all atoms
+	                     in the first frame.
+	   \param n_threads  Number of threads to use, 0 for all cores.
+	   \param p          Frames per level in MULTI_TAU mode.
+	   \param m          Spacing between levels in MULTI_TAU mode.
+	*/
+	explicit msd_accumulator( int dims = 3, int mode = FFT,
+	                          const std::vector<int> &ids = std::vector<int>(),
+	                          int n_threads = 1, int p = 16, int m = 2 );
+
+	/// Adds the next frame of the trajectory.
+	void add_frame( const block_data &b );
+
+	/// Returns the number of frames added.
+	bigint n_frames() const { return atoms.n_frames(); }
+
+	/// Returns the number of atoms followed.
+	int n_atoms() const { return atoms.size(); }
+
+	/**
+	   \brief Gets the MSD at each lag, averaged over atoms and time
+	          origins.
+
+	   In FFT mode this does the transforms, so it is best called once
+	   at the end.
+	*/
+	std::vector<double> msd() const;
+
+	/// Returns the lags that msd() is for, in frames.
+	std::vector<bigint> lag_frames() const;
+
+	/// Returns the lags that msd() is for, in time steps.
+	std::vector<bigint> lag_times() const;
+
+	/// Returns the number of bytes used for positions.
+	std::size_t memory() const;
+
+private:
+	std::vector<double> msd_fft() const;
+	std::vector<double> msd_multi_tau() const;
+	void add_multi_tau();
+
+	int dims, mode, n_threads;
+	int p, m;
+
+	atom_tracker atoms;
+
+	/// FFT mode: all unwrapped positions, frame after frame.
+	std::vector<double> traj;
+
+	/// MULTI_TAU mode: past frames, and sums and counts per channel.
+	correlate::multi_tau buffer;
+	std::vector<double> sums;
+	std::vector<bigint> counts;
+};
+
+
+/**
+   \brief Calculates the mean-squared displacement of a whole trajectory.
+
+   \param[in,out] reader     The dump reader whose frames to read.
+   \param[out]    msd        Will contain the MSD per lag.
+   \param[out]    lag_time   Will contain the lags, in time steps.
+   \param[in]     dims       Dimensions of the system (2 or 3).
+   \param[in]     mode       msd_accumulator::FFT or MULTI_TAU.
+   \param[in]     ids        Only follow these atoms, empty for all.
+   \param[in]     n_threads  Number of threads to use, 0 for all cores.
 
-double compute_msd( readers::dump_reader *reader, std::vector<double> &msd,
-                    std::list<bigint> &time, const std::list<int> &ids,
-                    bool got_ids );
+   \returns the number of frames read.
+*/
+bigint compute_msd( readers::dump_reader *reader, std::vector<double> &msd,
+                    std::vector<bigint> &lag_time, int dims = 3,
+                    int mode = msd_accumulator::FFT,
+                    const std::vector<int> &ids = std::vector<int>(),
+                    int n_threads = 1 );
 
 } // namespace fluctuations
 
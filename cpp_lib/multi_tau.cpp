@@ -0,0 +1,120 @@
+#include "multi_tau.hpp"
+#include "my_assert.hpp"
+
+#include <algorithm>
+
+
+namespace lammps_tools {
+
+namespace correlate {
+
+multi_tau::multi_tau( std::size_t frame_size, int p, int m )
+	: size( frame_size ), p( p ), m( m ), frames( 0 ), levels(), partners()
+{
+	my_assert( __FILE__, __LINE__, m >= 2 && p % m == 0 && p >= 2*m,
+	           "p has to be a multiple of m, and at least 2m!" );
+}
+
+
+const std::vector<multi_tau::partner> &multi_tau::add( const double *frame )
+{
+	partners.clear();
+	push( 0, frame );
+	++frames;
+	return partners;
+}
+
+
+void multi_tau::clear()
+{
+	frames = 0;
+	levels.clear();
+	partners.clear();
+}
+
+
+int multi_tau::n_channels() const
+{
+	if( levels.empty() ) return 0;
+	int n = std::min<bigint>( p, levels[0].pushed );
+	for( std::size_t l = 1; l < levels.size(); ++l ){
+		bigint pairs = std::min<bigint>( p, levels[l].pushed ) - p / m;
+		if( pairs > 0 ) n += pairs;
+	}
+	return n;
+}
+
+
+bigint multi_tau::lag( int channel ) const
+{
+	if( channel < p ) return channel;
+
+	int per_level = p - p / m;
+	int l = 1 + ( channel - p ) / per_level;
+	int j = p / m + ( channel - p ) % per_level;
+	bigint spacing = 1;
+	for( int k = 0; k < l; ++k ) spacing *= m;
+	return j * spacing;
+}
+
+
+std::size_t multi_tau::memory() const
+{
+	std::size_t bytes = 0;
+	for( const level &lv : levels ){
+		bytes += lv.frames.capacity() * sizeof(double);
+	}
+	return bytes;
+}
+
+
+void multi_tau::push( std::size_t l, const double *frame )
+{
+	if( l == levels.size() ){
+		level lv;
+		lv.frames.resize( p * size );
+		lv.head = -1;
+		lv.pushed = 0;
+		levels.push_back( lv );
+	}
+
+	level &lv = levels[l];
+	lv.head = ( lv.head + 1 ) % p;
+	double *slot = lv.frames.data() + lv.head * size;
+	std::copy( frame, frame + size, slot );
+
+	// Lags below p/m at this level are done by the level below.
+	int j0 = l == 0 ? 0 : p / m;
+	int j1 = std::min<bigint>( p - 1, lv.pushed );
+	int offset = l == 0 ? 0 : p + ( l - 1 )*( p - p / m ) - p / m;
+	for( int j = j0; j <= j1; ++j ){
+		int old = ( lv.head - j + p ) % p;
+		partner pp;
+		pp.channel = offset + j;
+		pp.frame = lv.frames.data() + old * size;
+		partners.push_back( pp );
+	}
+
+	bigint k = lv.pushed++;
+	if( k % m != 0 ) return;
+	if( l + 1 < levels.size() ){
+		push( l + 1, slot );
+	}else if( k > 0 ){
+		// Start the next level with the first frame of this one, which
+		// is m frames back, so that its first lags have an origin.
+		level next;
+		next.frames.resize( p * size );
+		const double *first = lv.frames.data()
+			+ ( ( lv.head - m + p ) % p ) * size;
+		std::copy( first, first + size, next.frames.begin() );
+		next.head = 0;
+		next.pushed = 1;
+		levels.push_back( next );
+		push( l + 1, slot );
+	}
+}
+
+
+} // namespace correlate
+
+} // namespace lammps_tools
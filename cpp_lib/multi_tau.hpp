@@ -0,0 +1,104 @@
+#ifndef MULTI_TAU_HPP
+#define MULTI_TAU_HPP
+
+/**
+   \file multi_tau.hpp
+
+   Buffers of past frames for time correlations over many decades.
+*/
+
+#include <cstddef>
+#include <vector>
+
+#include "types.hpp"
+
+
+namespace lammps_tools {
+
+namespace correlate {
+
+/**
+   \brief Keeps past frames on a logarithmic grid of lags.
+
+   A frame is a fixed number of doubles, like the positions of all
+   atoms. Level 0 keeps the last p frames, level 1 every m-th frame of
+   level 0, and so on, so lags up to T frames need only about
+   p log_m( T/p ) frames in memory rather than T.
+
+   Every frame added is paired with the stored frames it is correlated
+   with, one for each channel. Channel j < p of level 0 has a lag of j
+   frames; the channels of level l > 0 have lags j m^l for p/m <= j < p,
+   which continue where the level below stops. Coarser levels keep the
+   frames themselves rather than averages, so a correlation of two
+   frames at a lag is exact, there are just fewer time origins for
+   larger lags.
+*/
+class multi_tau
+{
+public:
+	/// A stored frame that a new frame is to be correlated with.
+	struct partner
+	{
+		int channel;          ///< The channel, see lag().
+		const double *frame;  ///< The stored frame.
+	};
+
+	/**
+	   \param frame_size  Number of doubles per frame.
+	   \param p           Frames kept per level, a multiple of m.
+	   \param m           Factor between the spacing of levels.
+	*/
+	explicit multi_tau( std::size_t frame_size, int p = 16, int m = 2 );
+
+	/**
+	   \brief Stores a frame and finds what to correlate it with.
+
+	   \param frame  The frame_size values of the new frame.
+
+	   \returns the stored frames to pair frame with, including frame
+	            itself at lag 0. The pointers are valid until the next
+	            call.
+	*/
+	const std::vector<partner> &add( const double *frame );
+
+	/// Forgets all frames.
+	void clear();
+
+	/// Returns the number of frames added.
+	bigint n_frames() const { return frames; }
+
+	/// Returns the number of channels that have a partner by now.
+	int n_channels() const;
+
+	/// Returns the lag of given channel, in frames.
+	bigint lag( int channel ) const;
+
+	/// Returns the number of doubles per frame.
+	std::size_t frame_size() const { return size; }
+
+	/// Returns the number of bytes used for stored frames.
+	std::size_t memory() const;
+
+private:
+	struct level
+	{
+		std::vector<double> frames;  ///< Ring buffer of p frames.
+		int head;                    ///< Slot of the newest frame.
+		bigint pushed;               ///< Number of frames pushed.
+	};
+
+	void push( std::size_t l, const double *frame );
+
+	std::size_t size;
+	int p, m;
+	bigint frames;
+	std::vector<level> levels;
+	std::vector<partner> partners;
+};
+
+
+} // namespace correlate
+
+} // namespace lammps_tools
+
+#endif // MULTI_TAU_HPP
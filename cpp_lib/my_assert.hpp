@@ -116,6 +116,22 @@ inline void my_assert( const std::string &file, int line, bool test,
 }
 
 
+/**
+   \brief asserts that test is true, and if not, terminates.
+   \overloads my_assert
+
+   Only makes strings out of file and msg if test fails, so that
+   assertions in loops do not allocate.
+*/
+inline void my_assert( const char *file, int line, bool test,
+                       const char *msg )
+{
+	if( !test ){
+		my_assert( std::string( file ), line, test, std::string( msg ) );
+	}
+}
+
+
 /**
    \brief Prints useful error message and then terminates.
 
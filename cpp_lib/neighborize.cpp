@@ -11,6 +11,8 @@
 #include <cmath>
 #include <list>
 #include <stdexcept>
+#include <string>
+#include <thread>
 #include <vector>
 
 namespace lammps_tools {
@@ -22,7 +24,8 @@ neighborizer::neighborizer( const block_data &b, const std::vector<int> &s1,
 	: dims(dims), periodic(b.dom.periodic), b(b),
 	  xlo{b.dom.xlo[0], b.dom.xlo[1], b.dom.xlo[2]},
 	  xhi{b.dom.xhi[0], b.dom.xhi[1], b.dom.xhi[2]}, n_atoms(0),
-	  quiet(true), mol_policy(IGNORE), bond_policy(IGNORE), s1(s1), s2(s2)
+	  quiet(true), mol_policy(IGNORE), bond_policy(IGNORE), n_threads(1),
+	  s1(s1), s2(s2)
 { }
 
 
@@ -57,7 +60,7 @@ double neighborizer::build_list( neigh_list &neighs,
 			break;
 	}
 
-	remove_doubles( neighs );
+	remove_doubles( neighs, n_threads );
 
 	for( std::size_t i = 0; i < neighs.size(); ++i ){
 		avg_neighs += neighs[i].size();
@@ -186,7 +189,8 @@ double make_list_dist( neigh_list &neighs,
                        double rc,
                        int mol_policy,
                        int bond_policy,
-                       bool quiet )
+                       bool quiet,
+                       int n_threads )
 {
 
 	std::vector<int> s1, s2;
@@ -206,7 +210,8 @@ double make_list_dist( neigh_list &neighs,
 	}
 
 	return make_list_dist_indexed( neighs, b, s1, s2, method, dims, rc,
-	                               mol_policy, bond_policy, quiet );
+	                               mol_policy, bond_policy, quiet,
+	                               n_threads );
 }
 
 double make_list_dist_indexed( neigh_list &neighs,
@@ -217,7 +222,8 @@ double make_list_dist_indexed( neigh_list &neighs,
                                double rc,
                                int mol_policy,
                                int bond_policy,
-                               bool quiet )
+                               bool quiet,
+                               int n_threads )
 {
 	if( !quiet ) std::cerr << "  ....Calculating neighbours of "
 	                       << ilist.size() << " atoms from "
@@ -244,6 +250,7 @@ double make_list_dist_indexed( neigh_list &neighs,
 		n.quiet = quiet;
 		n.mol_policy = mol_policy;
 		n.bond_policy = bond_policy;
+		n.n_threads = n_threads;
 
 		return n.build_list( neighs, d );
 	}else{
@@ -266,6 +273,49 @@ double make_list_dist_indexed( neigh_list &neighs,
 }
 
 
+double make_list_dist_types( neigh_list &neighs,
+                             const block_data &b,
+                             const std::vector<std::vector<double> > &rc,
+                             int method, int dims,
+                             int mol_policy,
+                             int bond_policy,
+                             bool quiet,
+                             int n_threads )
+{
+	type_cutoff_criterion crit( rc, dims );
+	crit.check_types( b );
+
+	for( std::vector<int> &ni : neighs ){
+		ni.clear();
+	}
+	neighs.resize( b.N );
+	std::vector<int> all_atoms = all( b );
+
+	if( method == DIST_NSQ ){
+		neighborizer_nsq n( b, all_atoms, all_atoms, dims );
+
+		n.quiet = quiet;
+		n.mol_policy = mol_policy;
+		n.bond_policy = bond_policy;
+
+		return n.build_list( neighs, crit );
+	}else if( method == DIST_BIN ){
+		neighborizer_bin n( b, all_atoms, all_atoms, dims, crit.rc_max );
+
+		n.quiet = quiet;
+		n.mol_policy = mol_policy;
+		n.bond_policy = bond_policy;
+		n.n_threads = n_threads;
+
+		return n.build_list( neighs, crit );
+	}else{
+		my_logic_error( __FILE__, __LINE__,
+		                "Unknown dist neighbouring method!" );
+	}
+	return 0.0;
+}
+
+
 neigh_list nearest_neighs( const block_data &b,
                            int itype, int jtype, int method, int dims,
                            double rc,
@@ -332,11 +382,20 @@ void verify_neigh_list( const neigh_list &neighs )
 }
 
 
-void remove_doubles( neigh_list &neighs )
+void remove_doubles( neigh_list &neighs, int n_threads )
 {
-	for( std::size_t i = 0; i < neighs.size(); ++i ){
-		util::remove_doubles( neighs[i] );
+	if( n_threads <= 0 ){
+		n_threads = std::max( 1u, std::thread::hardware_concurrency() );
 	}
+	int n_lists = neighs.size();
+	n_threads = std::min( n_threads, 1 + n_lists / 2048 );
+
+	// Interleave the lists, so dense and sparse regions are spread out.
+	util::run_on_threads( n_threads, [&neighs, n_lists, n_threads]( int t ){
+		for( int i = t; i < n_lists; i += n_threads ){
+			util::remove_doubles( neighs[i] );
+		}
+	} );
 }
 
 
@@ -375,6 +434,57 @@ bool dist_criterion::operator()( const block_data &b, int i, int j ) const
 }
 
 
+type_cutoff_criterion::type_cutoff_criterion(
+	const std::vector<std::vector<double> > &rc, int dims )
+	: n_types( rc.size() ), stride( rc.size() + 1 ),
+	  rc2( stride*stride, -1.0 ), rc_max( 0.0 ), dims( dims )
+{
+	for( int a = 0; a < n_types; ++a ){
+		my_assert( __FILE__, __LINE__,
+		           static_cast<int>( rc[a].size() ) == n_types,
+		           "Cut-off matrix is not square!" );
+		for( int c = 0; c < n_types; ++c ){
+			my_assert( __FILE__, __LINE__, rc[a][c] == rc[c][a],
+			           "Cut-off matrix is not symmetric!" );
+			if( rc[a][c] <= 0 ) continue;
+			rc2[ (a+1)*stride + c + 1 ] = rc[a][c]*rc[a][c];
+			rc_max = std::max( rc_max, rc[a][c] );
+		}
+	}
+	my_assert( __FILE__, __LINE__, rc_max > 0,
+	           "No positive cut-offs given!" );
+}
+
+
+bool type_cutoff_criterion::operator()( const block_data &b,
+                                        int i, int j ) const
+{
+	const std::vector<int> &type = get_type( b );
+	double rc2_ij = cutoff_2( type[i], type[j] );
+	if( rc2_ij < 0 ) return false;
+
+	const std::vector<double> &x = get_x( b );
+	const std::vector<double> &y = get_y( b );
+	const std::vector<double> &z = get_z( b );
+	double xi[3] = { x[i], y[i], dims == 2 ? 0.0 : z[i] };
+	double xj[3] = { x[j], y[j], dims == 2 ? 0.0 : z[j] };
+	double r[3];
+	return b.dom.dist_2( xi, xj, r ) <= rc2_ij;
+}
+
+
+void type_cutoff_criterion::check_types( const block_data &b ) const
+{
+	for( int t : get_type( b ) ){
+		if( t < 1 || t > n_types ){
+			my_runtime_error( __FILE__, __LINE__,
+			                  "Atom type " + std::to_string( t ) +
+			                  " has no cut-off!" );
+		}
+	}
+}
+
+
 std::vector<bond> neigh_list_to_bonds( const block_data &b,
                                        const neighborize::neigh_list &neighs,
                                        int btype )
@@ -53,6 +53,40 @@ struct dist_criterion : public are_neighbours
 };
 
 
+/**
+   \brief Distance criterion with a cut-off per pair of atom types.
+
+   Atoms of types a and b are neighbours if they are within
+   rc[a-1][b-1]. Pairs with a cut-off of 0 or less are never
+   neighbours.
+*/
+struct type_cutoff_criterion : public are_neighbours
+{
+	/**
+	   \param rc    Symmetric matrix of cut-offs, N_types by N_types.
+	   \param dims  Dimensions of the system (2 or 3).
+	*/
+	type_cutoff_criterion( const std::vector<std::vector<double> > &rc,
+	                       int dims );
+	virtual bool operator()( const lammps_tools::block_data &b,
+	                         int i, int j ) const;
+	virtual ~type_cutoff_criterion(){}
+
+	/// Returns the squared cut-off for types ti and tj.
+	double cutoff_2( int ti, int tj ) const
+	{ return rc2[ ti*stride + tj ]; }
+
+	/// Raises a runtime error if b has types without cut-offs.
+	void check_types( const lammps_tools::block_data &b ) const;
+
+	int n_types;
+	int stride;              ///< Row length of rc2, as types start at 1.
+	std::vector<double> rc2; ///< Squared cut-offs, -1 for no neighbours.
+	double rc_max;           ///< The largest cut-off.
+	int dims;
+};
+
+
 /**
    A shared interface for all neighborizers
 */
@@ -105,6 +139,9 @@ public:
 	int mol_policy;
 	int bond_policy;
 
+	/// Number of threads build may use, 0 for all cores.
+	int n_threads;
+
 	const std::vector<int> &s1, &s2;
 
 private:
@@ -143,9 +180,12 @@ std::vector<int> all( const lammps_tools::block_data &b );
 /**
    \brief Removes double entries in neigh list.
 
-   \param neighs  neighbour list to clean.
+   This also sorts each list.
+
+   \param neighs     neighbour list to clean.
+   \param n_threads  Number of threads to use, 0 for all cores.
 */
-void remove_doubles( neigh_list &neighs );
+void remove_doubles( neigh_list &neighs, int n_threads = 1 );
 
 
 
@@ -166,6 +206,7 @@ void remove_doubles( neigh_list &neighs );
    \param bond_policy    Specifies how to take bond topology into account.
    \param filter         Add only particles with filter(particle_ID) == true
    \param neigh_est      A guess for the number of neighbours.
+   \param n_threads      Threads to use for DIST_BIN, 0 for all cores.
 
    \returns The average number of neighbours per particle.
 */
@@ -175,7 +216,8 @@ double make_list_dist( neigh_list &neighs,
                        double rc,
                        int mol_policy = neighborizer::IGNORE,
                        int bond_policy = neighborizer::IGNORE,
-                       bool quiet = true );
+                       bool quiet = true,
+                       int n_threads = 1 );
 
 /**
    \brief Calculates a neighbour list for the atoms in the block data.
@@ -193,6 +235,7 @@ double make_list_dist( neigh_list &neighs,
    \param mol_policy     Specifies how to take molecule ID into account.
    \param bond_policy    Specifies how to take bond topology into account.
    \param quiet          If true, don't output a lot of info.
+   \param n_threads      Threads to use for DIST_BIN, 0 for all cores.
 
    \returns The average number of neighbours per particle.
 */
@@ -204,7 +247,40 @@ double make_list_dist_indexed( neigh_list &neighs,
                                double rc,
                                int mol_policy = neighborizer::IGNORE,
                                int bond_policy = neighborizer::IGNORE,
-                               bool quiet = true );
+                               bool quiet = true,
+                               int n_threads = 1 );
+
+
+
+
+
+/**
+   \brief Calculates a neighbour list with a cut-off per pair of types.
+
+   All type pairs are found in one build, with cells as big as the
+   largest cut-off. See type_cutoff_criterion.
+
+   \param neighs[out]    The neighbour lists, indexed per particle ID
+   \param b              block_data to neighborize.
+   \param rc             Symmetric matrix of cut-offs, b.N_types by
+                         b.N_types, rc[a-1][b-1] for types a and b.
+   \param method         Distance method to use (see neighborize_methods)
+   \param dims           dimensions of the system (2 or 3)
+   \param mol_policy     Specifies how to take molecule ID into account.
+   \param bond_policy    Specifies how to take bond topology into account.
+   \param quiet          If true, don't output a lot of info.
+   \param n_threads      Threads to use for DIST_BIN, 0 for all cores.
+
+   \returns The average number of neighbours per particle.
+*/
+double make_list_dist_types( neigh_list &neighs,
+                             const lammps_tools::block_data &b,
+                             const std::vector<std::vector<double> > &rc,
+                             int method, int dims,
+                             int mol_policy = neighborizer::IGNORE,
+                             int bond_policy = neighborizer::IGNORE,
+                             bool quiet = true,
+                             int n_threads = 1 );
 
 
 
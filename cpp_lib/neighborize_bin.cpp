@@ -1,24 +1,32 @@
 #include "neighborize_bin.hpp"
+#include "neighborize_cell.hpp"
 
 #include <cmath>
+#include <typeinfo>
 #include "my_timer.hpp"
 
-#define USE_OPENMP 1
-
-#ifdef USE_OPENMP
-#include <omp.h>
-constexpr const bool use_openmp = true;
-#else
-constexpr const bool use_openmp = false;
-// Just to make stuff compile:
-int omp_get_thread_num(){ return 0; }
-#endif
-
 
 namespace lammps_tools {
 
 namespace neighborize {
 
+namespace {
+
+// Passes the pairs of the cell list on to a general criterion.
+struct criterion_policy
+{
+	criterion_policy( const block_data &b, const are_neighbours &criterion )
+		: b( &b ), criterion( &criterion ) {}
+
+	bool operator()( int i, int j, double r2 ) const
+	{ return ( *criterion )( *b, i, j ); }
+
+	const block_data *b;
+	const are_neighbours *criterion;
+};
+
+} // namespace
+
 
 int neighborizer_bin::xyz_index_to_bin_index( int ix, int iy, int iz ) const
 {
@@ -108,6 +116,17 @@ int neighborizer_bin::shift_bin_index( int bin, int xinc, int yinc, int zinc ) c
 	return xyz_index_to_bin_index( ix, iy, iz );
 }
 
+bool neighborizer_bin::too_many_bins() const
+{
+	// Same number of bins as setup_bins, but without overflowing.
+	double n_total = 1.0;
+	for( int d = 0; d < dims; ++d ){
+		n_total *= std::max( 3.0, std::floor( ( xhi[d] - xlo[d] ) / rc ) );
+	}
+	return n_total > std::max( 4.0*b.N, 1048576.0 );
+}
+
+
 void neighborizer_bin::setup_bins()
 {
 	if( atom_to_bin.size() > 0 ){
@@ -179,49 +198,23 @@ void neighborizer_bin::bin_atoms()
 	//    and automatically you only compare against atoms from the
 	//    second group. If they are both all, it reduces to the
 	//    standard approach anyway.
-	if( use_openmp ){
-		std::vector<int> s2_vec( s2.size() );
-		int c = 0;
-		for( int j : s2 ){
-			s2_vec[c++] = j;
-		}
-		for( std::size_t i = 0; i < s2_vec.size(); ++i ){
-			int j = s2_vec[i];
-			if( !quiet ){
-				std::cerr << "Binning atom " << j << " at ( "
-				          << x[j] << ", " << y[j] << ", "
-				          << z[j] << " ), ";
-			}
-			int bin = position_to_bin_index( x[j], y[j], z[j] );
-			if( !quiet ){
-				int ix, iy, iz;
-				bin_index_to_xyz_index( bin, ix, iy, iz );
-				std::cerr << "bin = " << ix << ", " << iy
-				          << ", " << iz << "\n";
-			}
+	for( int j : s2 ){
 
-			bins[bin].push_back( j );
-			atom_to_bin[j] = bin;
+		if( !quiet ){
+			std::cerr << "Binning atom " << j << " at ( "
+			          << x[j] << ", " << y[j] << ", "
+			          << z[j] << " ), ";
 		}
-	}else{
-		for( int j : s2 ){
-
-			if( !quiet ){
-				std::cerr << "Binning atom " << j << " at ( "
-				          << x[j] << ", " << y[j] << ", "
-				          << z[j] << " ), ";
-			}
-			int bin = position_to_bin_index( x[j], y[j], z[j] );
-			if( !quiet ){
-				int ix, iy, iz;
-				bin_index_to_xyz_index( bin, ix, iy, iz );
-				std::cerr << "bin = " << ix << ", " << iy
-				          << ", " << iz << "\n";
-			}
-
-			bins[bin].push_back( j );
-			atom_to_bin[j] = bin;
+		int bin = position_to_bin_index( x[j], y[j], z[j] );
+		if( !quiet ){
+			int ix, iy, iz;
+			bin_index_to_xyz_index( bin, ix, iy, iz );
+			std::cerr << "bin = " << ix << ", " << iy
+			          << ", " << iz << "\n";
 		}
+
+		bins[bin].push_back( j );
+		atom_to_bin[j] = bin;
 	}
 
 	atoms_binned_ = true;
@@ -361,6 +354,42 @@ int neighborizer_bin::build( neigh_list &neighs,
 	int n_neighs = 0;
 	if( !quiet ) m.toc("  Clearing neigh list");
 
+	// The distance criteria do not need a virtual call per pair,
+	// so hand them to the cell list.
+	if( typeid( criterion ) == typeid( dist_criterion ) ){
+		const dist_criterion &dist =
+			static_cast<const dist_criterion&>( criterion );
+		if( !quiet ) m.tic();
+		n_neighs = build_cell_list( neighs, b, s1, s2, dims, dist.rc,
+		                            within_cutoff(), n_threads );
+		if( !quiet ) m.toc("  Neighborizing with cell list");
+		return n_neighs;
+	}
+	if( typeid( criterion ) == typeid( type_cutoff_criterion ) ){
+		const type_cutoff_criterion &crit =
+			static_cast<const type_cutoff_criterion&>( criterion );
+		if( !quiet ) m.tic();
+		n_neighs = build_cell_list( neighs, b, s1, s2, dims, crit.rc_max,
+		                            type_pair_cutoff( get_type( b ), crit ),
+		                            n_threads );
+		if( !quiet ) m.toc("  Neighborizing with cell list");
+		return n_neighs;
+	}
+
+	// In a big box with few atoms most bins would be empty, if they
+	// fit in memory at all. The cell list then only stores occupied
+	// cells. The bins below are also axis-aligned, while the cells
+	// follow a tilted box. The criterion is only asked about pairs
+	// within rc.
+	if( too_many_bins() || b.dom.is_triclinic() ){
+		if( !quiet ) m.tic();
+		n_neighs = build_cell_list( neighs, b, s1, s2, dims, rc,
+		                            criterion_policy( b, criterion ),
+		                            n_threads );
+		if( !quiet ) m.toc("  Neighborizing with cell list");
+		return n_neighs;
+	}
+
 	// 0. Allocates bins and atom_to_bin containers,
 	//    sets number of bins and bin size
 	if( !quiet ) m.tic();
@@ -378,20 +407,8 @@ int neighborizer_bin::build( neigh_list &neighs,
 	if( !quiet ) std::cerr << "  ....Looping over "
 	                       << s1.size() << " atoms...\n";
 	if( !quiet ) m.tic();
-	if( use_openmp ){
-		std::vector<int> s1_vec( s1.size() );
-		int c = 0;
-		for( int j : s1 ){
-			s1_vec[c++] = j;
-		}
-		for( std::size_t j = 0; j < s1_vec.size(); ++j ){
-			int i = s1_vec[j];
-			neigh_bin_atom( i, neighs, n_neighs, criterion );
-		}
-	}else{
-		for( int i : s1 ){
-			neigh_bin_atom( i, neighs, n_neighs, criterion );
-		}
+	for( int i : s1 ){
+		neigh_bin_atom( i, neighs, n_neighs, criterion );
 	}
 	if( !quiet ) m.toc("  Neighborizing");
 
@@ -36,6 +36,9 @@ public:
 	void setup_bins();
 	void bin_atoms();
 
+	/// Returns true if setup_bins would make too many bins for the atoms.
+	bool too_many_bins() const;
+
 	int n_bins() const { return bins.size(); }
 
 	bool atoms_binned() const { return atoms_binned_; }
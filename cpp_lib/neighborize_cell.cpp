@@ -0,0 +1,370 @@
+#include "neighborize_cell.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace lammps_tools {
+
+namespace neighborize {
+
+cell_list::cell_list( const block_data &b, const std::vector<int> &atoms,
+                      int dims, double rc, int n_threads )
+	: cell_start(), index(), x(), y(), z(), dims( dims ),
+	  periodic( b.dom.periodic ), sparse( false ),
+	  tilt{ b.dom.xy, dims == 3 ? b.dom.xz : 0.0, dims == 3 ? b.dom.yz : 0.0 },
+	  n_stencil( 0 ), cell_grid(), cell_lookup()
+{
+	my_assert( __FILE__, __LINE__, rc > 0, "Cut-off must be positive!" );
+
+	for( int d = 0; d < 3; ++d ){
+		lo[d] = b.dom.xlo[d];
+		L[d]  = b.dom.xhi[d] - b.dom.xlo[d];
+	}
+	triclinic = tilt[0] != 0 || tilt[1] != 0 || tilt[2] != 0;
+
+	// The cells are regular in fractional coordinates. In a tilted box
+	// the distance between opposite faces is less than L, and that is
+	// what the cells have to be rc wide in.
+	double width[3];
+	b.dom.face_widths( width, dims );
+
+	double n_total = 1.0;
+	for( int d = 0; d < 3; ++d ){
+		n[d]  = 1;
+		if( d < dims && L[d] > 0 ){
+			n[d] = static_cast<int>( std::max( 1.0, std::min( width[d] / rc, 1e9 ) ) );
+		}
+		n_total *= n[d];
+	}
+
+	// Dilute systems in big boxes would mostly have empty cells, so
+	// then only store the occupied ones. This only depends on b, so
+	// lists of different atoms still share the grid.
+	sparse = n_total > 2.0*b.N + 27;
+	for( int d = 0; d < 3; ++d ){
+		inv_size[d] = L[d] > 0 ? n[d] / L[d] : 0.0;
+	}
+	if( dims == 2 ) periodic &= ~domain::BIT_Z;
+
+	// Cells are at least rc wide, so one cell to each side is enough.
+	int dz = dims == 3 ? 1 : 0;
+	for( int k = -dz; k <= dz; ++k ){
+		for( int j = -1; j <= 1; ++j ){
+			for( int i = -1; i <= 1; ++i ){
+				stencil[n_stencil][0] = i;
+				stencil[n_stencil][1] = j;
+				stencil[n_stencil][2] = k;
+				++n_stencil;
+			}
+		}
+	}
+
+	if( sparse ){
+		sort_atoms_sparse( b, atoms, std::max( n_threads, 1 ) );
+	}else{
+		sort_atoms( b, atoms, std::max( n_threads, 1 ) );
+	}
+}
+
+
+void cell_list::unskew( const double xi[3], double u[3] ) const
+{
+	u[0] = xi[0] - lo[0];
+	u[1] = xi[1] - lo[1];
+	u[2] = xi[2] - lo[2];
+	if( !triclinic ) return;
+
+	double s2 = L[2] > 0 ? u[2] / L[2] : 0.0;
+	u[1] -= s2*tilt[2];
+	double s1 = L[1] > 0 ? u[1] / L[1] : 0.0;
+	u[0] -= s1*tilt[0] + s2*tilt[1];
+}
+
+
+void cell_list::wrap( double xi[3] ) const
+{
+	static const int bits[3] = { domain::BIT_X, domain::BIT_Y,
+	                             domain::BIT_Z };
+	if( triclinic ){
+		double u[3];
+		unskew( xi, u );
+		for( int d = 2; d >= 0; --d ){
+			if( !( periodic & bits[d] ) || L[d] <= 0 ) continue;
+			if( u[d] < 0 || u[d] >= L[d] ){
+				add_image( xi, d, -std::floor( u[d] / L[d] ) );
+			}
+		}
+		return;
+	}
+
+	for( int d = 0; d < 3; ++d ){
+		if( !( periodic & bits[d] ) || L[d] <= 0 ) continue;
+		if( xi[d] < lo[d] || xi[d] >= lo[d] + L[d] ){
+			xi[d] -= L[d] * std::floor( ( xi[d] - lo[d] ) / L[d] );
+		}
+	}
+}
+
+
+void cell_list::grid_coords( const double xi[3], int ci[3] ) const
+{
+	static const int bits[3] = { domain::BIT_X, domain::BIT_Y,
+	                             domain::BIT_Z };
+	// Far enough from the limits of int to add the stencil to.
+	const double far = 1 << 30;
+	double u[3];
+	unskew( xi, u );
+	for( int d = 0; d < 3; ++d ){
+		double c = std::floor( u[d] * inv_size[d] );
+		if( sparse && !( periodic & bits[d] ) ){
+			ci[d] = static_cast<int>( std::min( std::max( c, -far ), far ) );
+		}else{
+			// Clamping also catches round-off of wrapped positions.
+			c = std::min( std::max( c, 0.0 ), n[d] - 1.0 );
+			ci[d] = static_cast<int>( c );
+		}
+	}
+}
+
+
+int cell_list::cell_of( const double xi[3] ) const
+{
+	int ci[3];
+	grid_coords( xi, ci );
+	return find_cell( ci );
+}
+
+
+void cell_list::cell_coords( int c, int ci[3] ) const
+{
+	if( sparse ){
+		ci[0] = cell_grid[c].c[0];
+		ci[1] = cell_grid[c].c[1];
+		ci[2] = cell_grid[c].c[2];
+	}else{
+		ci[0] = c % n[0];
+		ci[1] = ( c / n[0] ) % n[1];
+		ci[2] = c / ( n[0]*n[1] );
+	}
+}
+
+
+int cell_list::find_cell( const int ci[3] ) const
+{
+	if( !sparse ) return ci[0] + n[0]*( ci[1] + n[1]*ci[2] );
+
+	coords key = { { ci[0], ci[1], ci[2] } };
+	auto it = cell_lookup.find( key );
+	return it == cell_lookup.end() ? -1 : it->second;
+}
+
+
+void cell_list::sort_atoms( const block_data &b, const std::vector<int> &atoms,
+                            int n_threads )
+{
+	const std::vector<double> &bx = get_x( b );
+	const std::vector<double> &by = get_y( b );
+	const std::vector<double> &bz = get_z( b );
+	const int n_atoms = atoms.size();
+	const int n_cells = n[0]*n[1]*n[2];
+
+	// Each thread counts the atoms per cell in its own part of atoms.
+	// Keep that table of counts at a few entries per atom.
+	n_threads = std::min( n_threads, 1 + n_atoms / min_thread_atoms );
+	n_threads = std::min( n_threads, std::max( 1, 4*n_atoms / n_cells ) );
+	n_threads = std::max( n_threads, 1 );
+
+	auto atom_range = [n_atoms, n_threads]( int t, int &begin, int &end ){
+		begin = static_cast<long long>( n_atoms ) * t / n_threads;
+		end = static_cast<long long>( n_atoms ) * ( t + 1 ) / n_threads;
+	};
+	auto cell_range = [n_cells, n_threads]( int t, int &begin, int &end ){
+		begin = static_cast<long long>( n_cells ) * t / n_threads;
+		end = static_cast<long long>( n_cells ) * ( t + 1 ) / n_threads;
+	};
+
+	std::vector<int> atom_cell( n_atoms );
+	std::vector<int> counts( n_threads * n_cells, 0 );
+	util::run_on_threads( n_threads, [&]( int t ){
+		int begin, end;
+		atom_range( t, begin, end );
+		int *count = counts.data() + t*n_cells;
+		for( int k = begin; k < end; ++k ){
+			int i = atoms[k];
+			double xi[3] = { bx[i], by[i], dims == 3 ? bz[i] : 0.0 };
+			wrap( xi );
+			atom_cell[k] = cell_of( xi );
+			++count[ atom_cell[k] ];
+		}
+	} );
+
+	// Turn the counts into offsets of each thread within each cell,
+	// and the cell sizes into cell_start.
+	cell_start.assign( n_cells + 1, 0 );
+	util::run_on_threads( n_threads, [&]( int t ){
+		int begin, end;
+		cell_range( t, begin, end );
+		for( int c = begin; c < end; ++c ){
+			int sum = 0;
+			for( int s = 0; s < n_threads; ++s ){
+				int count = counts[s*n_cells + c];
+				counts[s*n_cells + c] = sum;
+				sum += count;
+			}
+			cell_start[c+1] = sum;
+		}
+	} );
+	for( int c = 0; c < n_cells; ++c ){
+		cell_start[c+1] += cell_start[c];
+	}
+
+	// Threads fill in their atoms in their original order, so the
+	// order in a cell does not depend on the number of threads.
+	index.resize( n_atoms );
+	x.resize( n_atoms );
+	y.resize( n_atoms );
+	z.resize( n_atoms );
+	util::run_on_threads( n_threads, [&]( int t ){
+		int begin, end;
+		atom_range( t, begin, end );
+		int *offset = counts.data() + t*n_cells;
+		for( int k = begin; k < end; ++k ){
+			int c = atom_cell[k];
+			int pos = cell_start[c] + offset[c]++;
+			int i = atoms[k];
+			double xi[3] = { bx[i], by[i], dims == 3 ? bz[i] : 0.0 };
+			wrap( xi );
+			index[pos] = i;
+			x[pos] = xi[0];
+			y[pos] = xi[1];
+			z[pos] = xi[2];
+		}
+	} );
+}
+
+
+void cell_list::sort_atoms_sparse( const block_data &b,
+                                   const std::vector<int> &atoms,
+                                   int n_threads )
+{
+	const std::vector<double> &bx = get_x( b );
+	const std::vector<double> &by = get_y( b );
+	const std::vector<double> &bz = get_z( b );
+	const int n_atoms = atoms.size();
+
+	n_threads = std::min( n_threads, 1 + n_atoms / min_thread_atoms );
+	std::vector<coords> atom_coords( n_atoms );
+	util::run_on_threads( n_threads, [&]( int t ){
+		int begin = static_cast<long long>( n_atoms ) * t / n_threads;
+		int end = static_cast<long long>( n_atoms ) * ( t + 1 ) / n_threads;
+		for( int k = begin; k < end; ++k ){
+			int i = atoms[k];
+			double xi[3] = { bx[i], by[i], dims == 3 ? bz[i] : 0.0 };
+			wrap( xi );
+			grid_coords( xi, atom_coords[k].c );
+		}
+	} );
+
+	// Number the occupied cells in grid order, so that cells close
+	// in space mostly are close in memory too.
+	cell_grid = atom_coords;
+	std::sort( cell_grid.begin(), cell_grid.end() );
+	cell_grid.erase( std::unique( cell_grid.begin(), cell_grid.end() ),
+	                 cell_grid.end() );
+	const int n_occupied = cell_grid.size();
+	cell_lookup.clear();
+	cell_lookup.reserve( n_occupied );
+	for( int c = 0; c < n_occupied; ++c ){
+		cell_lookup[ cell_grid[c] ] = c;
+	}
+
+	std::vector<int> atom_cell( n_atoms );
+	cell_start.assign( n_occupied + 1, 0 );
+	for( int k = 0; k < n_atoms; ++k ){
+		atom_cell[k] = cell_lookup[ atom_coords[k] ];
+		++cell_start[ atom_cell[k] + 1 ];
+	}
+	for( int c = 0; c < n_occupied; ++c ){
+		cell_start[c+1] += cell_start[c];
+	}
+
+	std::vector<int> fill( cell_start.begin(), cell_start.end() - 1 );
+	index.resize( n_atoms );
+	x.resize( n_atoms );
+	y.resize( n_atoms );
+	z.resize( n_atoms );
+	for( int k = 0; k < n_atoms; ++k ){
+		int pos = fill[ atom_cell[k] ]++;
+		int i = atoms[k];
+		double xi[3] = { bx[i], by[i], dims == 3 ? bz[i] : 0.0 };
+		wrap( xi );
+		index[pos] = i;
+		x[pos] = xi[0];
+		y[pos] = xi[1];
+		z[pos] = xi[2];
+	}
+}
+
+
+int cell_list::neighbour_cells( int c, near_cell *near ) const
+{
+	int ci[3];
+	cell_coords( c, ci );
+	return neighbour_cells( ci, near );
+}
+
+
+int cell_list::neighbour_cells( const int ci[3], near_cell *near ) const
+{
+	static const int bits[3] = { domain::BIT_X, domain::BIT_Y,
+	                             domain::BIT_Z };
+	int count = 0;
+	for( int s = 0; s < n_stencil; ++s ){
+		int cj[3];
+		double shift[3] = { 0.0, 0.0, 0.0 };
+		bool in_box = true;
+		for( int d = 0; d < 3; ++d ){
+			cj[d] = ci[d] + stencil[s][d];
+			if( cj[d] >= 0 && cj[d] < n[d] ) continue;
+
+			// Sparse grids go on past the box.
+			if( !( periodic & bits[d] ) ){
+				if( sparse ) continue;
+				in_box = false;
+				break;
+			}
+			if( cj[d] < 0 ){
+				cj[d] += n[d];
+				add_image( shift, d, -1.0 );
+			}else{
+				cj[d] -= n[d];
+				add_image( shift, d, 1.0 );
+			}
+		}
+		if( !in_box ) continue;
+
+		int cell = find_cell( cj );
+		if( cell < 0 ) continue;
+		near[count].cell = cell;
+		near[count].shift[0] = shift[0];
+		near[count].shift[1] = shift[1];
+		near[count].shift[2] = shift[2];
+		++count;
+	}
+	return count;
+}
+
+
+std::vector<unsigned char> group_flags( int N, const std::vector<int> &s1,
+                                        const std::vector<int> &s2 )
+{
+	std::vector<unsigned char> groups( N, 0 );
+	for( int i : s1 ) groups[i] |= 1;
+	for( int i : s2 ) groups[i] |= 2;
+	return groups;
+}
+
+
+} // namespace neighborize
+
+} // namespace lammps_tools
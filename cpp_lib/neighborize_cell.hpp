@@ -0,0 +1,494 @@
+#ifndef NEIGHBORIZE_CELL_HPP
+#define NEIGHBORIZE_CELL_HPP
+
+/**
+   \file neighborize_cell.hpp
+
+   Cell list neighbour search with the pair criterion fixed at compile time.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "block_data.hpp"
+#include "block_data_access.hpp"
+#include "neighborize.hpp"
+#include "util.hpp"
+
+
+namespace lammps_tools {
+
+namespace neighborize {
+
+/**
+   \brief Atoms sorted by the cell of a regular grid they are in.
+
+   The cells are at least rc wide, so all atoms within rc of a point
+   are in its own cell or in the cells next to it. The positions are
+   stored per coordinate, in the order of the cells, so the atoms of a
+   cell are contiguous and the distances to all of them are computed
+   in one loop the compiler can vectorise. Positions are wrapped into
+   the box along periodic directions. Along the others, atoms outside
+   of the box go in the outermost cells.
+
+   If a full grid would have many more cells than there are atoms, as
+   for a few atoms in a big box, only the cells that have atoms are
+   stored, and found by their grid coordinates in a hash table. Such a
+   sparse grid extends past the box along non-periodic directions, so
+   atoms far outside of it do not end up in one crowded outer cell.
+
+   Triclinic boxes are divided along the box vectors, so the cells are
+   parallelepipeds of the same shape as the box, and periodic images
+   are shifted by whole box vectors.
+*/
+class cell_list
+{
+public:
+	/// A cell in reach of another, and the periodic shift of its atoms.
+	struct near_cell
+	{
+		int cell;        ///< Index of the cell.
+		double shift[3]; ///< Add this to the positions in the cell.
+	};
+
+	/// The most cells neighbour_cells returns.
+	static const int max_near = 27;
+
+	/// Fewer atoms per thread than this are not worth a thread.
+	static const int min_thread_atoms = 2048;
+
+	/**
+	   \brief Sorts given atoms into cells of at least rc wide.
+
+	   The grid only depends on b, dims and rc, so lists of different
+	   atoms of the same block have the same cells.
+
+	   \param b          The block_data the atoms are in.
+	   \param atoms      Indices of the atoms to sort in.
+	   \param dims       Dimensionality, in 2D the z-coordinate is ignored.
+	   \param rc         Smallest allowed cell width.
+	   \param n_threads  Number of threads to sort with.
+	*/
+	cell_list( const block_data &b, const std::vector<int> &atoms,
+	           int dims, double rc, int n_threads = 1 );
+
+	/// Returns the number of cells, only the occupied ones if sparse.
+	int n_cells() const { return cell_start.size() - 1; }
+
+	/// Returns true if only the occupied cells are stored.
+	bool is_sparse() const { return sparse; }
+
+	/// Returns the number of atoms in the list.
+	int size() const { return index.size(); }
+
+	/// Wraps x into the box along the periodic directions.
+	void wrap( double x[3] ) const;
+
+	/// Returns the cell of wrapped position x, -1 if it has no atoms
+	/// in a sparse grid.
+	int cell_of( const double x[3] ) const;
+
+	/// Gets the grid coordinates of cell c.
+	void cell_coords( int c, int ci[3] ) const;
+
+	/// Returns the cell at grid coordinates ci, or -1 if there is none.
+	int find_cell( const int ci[3] ) const;
+
+	/**
+	   \brief Finds the cells in reach of the cell at grid coordinates ci.
+
+	   Along periodic directions that are only one or two cells wide
+	   the same cell can come up more than once, with different shifts.
+	   Cells of a sparse grid that have no atoms are left out.
+
+	   \param[in]  ci    Grid coordinates to find the neighbouring cells of.
+	   \param[out] near  Array of at least max_near cells.
+
+	   \returns the number of cells stored in near.
+	*/
+	int neighbour_cells( const int ci[3], near_cell *near ) const;
+
+	/// Finds the cells in reach of cell c. \overload
+	int neighbour_cells( int c, near_cell *near ) const;
+
+	std::vector<int> cell_start; ///< Atoms of cell c start at cell_start[c].
+	std::vector<int> index;      ///< Index in the block of each atom.
+	std::vector<double> x;       ///< Wrapped x-coordinate of each atom.
+	std::vector<double> y;       ///< Wrapped y-coordinate of each atom.
+	std::vector<double> z;       ///< Wrapped z-coordinate, 0 in 2D.
+
+private:
+	/// Grid coordinates of a cell, the key of a sparse grid.
+	struct coords
+	{
+		int c[3];
+
+		bool operator==( const coords &o ) const
+		{ return c[0] == o.c[0] && c[1] == o.c[1] && c[2] == o.c[2]; }
+
+		bool operator<( const coords &o ) const
+		{
+			if( c[2] != o.c[2] ) return c[2] < o.c[2];
+			if( c[1] != o.c[1] ) return c[1] < o.c[1];
+			return c[0] < o.c[0];
+		}
+	};
+
+	struct coords_hash
+	{
+		std::size_t operator()( const coords &k ) const
+		{
+			return static_cast<std::size_t>( k.c[0] ) * 73856093u
+				^ static_cast<std::size_t>( k.c[1] ) * 19349663u
+				^ static_cast<std::size_t>( k.c[2] ) * 83492791u;
+		}
+	};
+
+	void grid_coords( const double xi[3], int ci[3] ) const;
+	/// Gets the fractional coordinates of xi, times the box lengths.
+	void unskew( const double xi[3], double u[3] ) const;
+	/// Adds times box vector d to v.
+	void add_image( double v[3], int d, double times ) const;
+	void sort_atoms( const block_data &b, const std::vector<int> &atoms,
+	                 int n_threads );
+	void sort_atoms_sparse( const block_data &b,
+	                        const std::vector<int> &atoms, int n_threads );
+
+	int dims;
+	int periodic;
+	bool sparse;
+	bool triclinic;
+	double tilt[3];     ///< Tilt factors xy, xz and yz of the box.
+	int n[3];           ///< Number of cells along each direction.
+	double lo[3];       ///< Lower bounds of the box.
+	double L[3];        ///< Box lengths.
+	double inv_size[3]; ///< Inverse cell sizes.
+
+	int n_stencil;
+	int stencil[max_near][3]; ///< Offsets of the cells in reach.
+
+	std::vector<coords> cell_grid; ///< Coordinates of the occupied cells.
+	std::unordered_map<coords, int, coords_hash> cell_lookup;
+};
+
+
+inline
+void cell_list::add_image( double v[3], int d, double times ) const
+{
+	// Box vector d is column d of the lower triangular box matrix.
+	switch( d ){
+		case 0:
+			v[0] += times*L[0];
+			break;
+		case 1:
+			v[0] += times*tilt[0];
+			v[1] += times*L[1];
+			break;
+		case 2:
+			v[0] += times*tilt[1];
+			v[1] += times*tilt[2];
+			v[2] += times*L[2];
+			break;
+	}
+}
+
+
+/**
+   \brief Pair policy that accepts every pair within the cut-off.
+
+   Pair policies decide on the pairs within the cut-off that
+   build_cell_list finds. They are called as accept( i, j, r2 ), with
+   the indices of both atoms and their squared distance, and return
+   true if i and j are neighbours. As the policy is a template
+   parameter, the call is inlined into the neighbour loop. Policies
+   are called from several threads at once and should not depend on
+   the order of i and j.
+*/
+struct within_cutoff
+{
+	bool operator()( int i, int j, double r2 ) const
+	{ return true; }
+};
+
+
+/**
+   \brief Pair policy with a cut-off per pair of atom types.
+
+   Build with the largest cut-off, crit.rc_max, and this drops the
+   pairs that are further apart than the cut-off for their types.
+*/
+struct type_pair_cutoff
+{
+	type_pair_cutoff( const std::vector<int> &type,
+	                  const type_cutoff_criterion &crit )
+		: type( type.data() ), rc2( crit.rc2.data() ), stride( crit.stride )
+	{}
+
+	bool operator()( int i, int j, double r2 ) const
+	{ return r2 <= rc2[ type[i]*stride + type[j] ]; }
+
+	const int *type;
+	const double *rc2;
+	int stride;
+};
+
+
+/**
+   \brief Flags for the groups of atoms, bit 1 for s1 and bit 2 for s2.
+
+   visit_cell_pairs uses these to skip pairs that an earlier pass with
+   owners and targets swapped already found.
+*/
+std::vector<unsigned char> group_flags( int N, const std::vector<int> &s1,
+                                        const std::vector<int> &s2 );
+
+
+/**
+   \brief Visits all pairs of atoms in owners and targets within rc.
+
+   Each thread takes whole cells of owners and calls its own visitor
+   as visit( i, j, r2, dx, dy, dz ) for the atoms j near owner i, with
+   their squared distance and the displacement from i to j. All pairs
+   of an owner are visited in one go, by one thread, and in the same
+   order for any number of threads. Pairs of an atom with itself are
+   skipped.
+
+   \param owners    The atoms to find the neighbours of.
+   \param targets   The atoms that can be neighbours, on the same grid.
+   \param rc        Largest distance between neighbours.
+   \param groups    If not null, skip pairs of an owner in s1 and a
+                    target in s2, see group_flags.
+   \param visitors  One visitor per thread that can be used.
+*/
+template <typename pair_visitor>
+void visit_cell_pairs( const cell_list &owners, const cell_list &targets,
+                       double rc, const unsigned char *groups,
+                       std::vector<pair_visitor> &visitors )
+{
+	const double rc2 = rc*rc;
+	const double *cx = targets.x.data();
+	const double *cy = targets.y.data();
+	const double *cz = targets.z.data();
+	const int *cidx = targets.index.data();
+
+	const int n_cells = owners.n_cells();
+	int n_threads = std::min<int>( visitors.size(),
+	                               1 + owners.size() / cell_list::min_thread_atoms );
+	n_threads = std::max( n_threads, 1 );
+
+	// Cells are handed out in small chunks, as dense regions take
+	// longer than sparse ones.
+	const int chunk = 16;
+	std::atomic<int> next_cell( 0 );
+
+	auto work = [&]( int t ){
+		pair_visitor &visit = visitors[t];
+		std::vector<double> r2;
+		cell_list::near_cell near[cell_list::max_near];
+
+		for( int c0 = next_cell.fetch_add( chunk ); c0 < n_cells;
+		     c0 = next_cell.fetch_add( chunk ) ){
+			int c1 = std::min( c0 + chunk, n_cells );
+			for( int c = c0; c < c1; ++c ){
+				int ib = owners.cell_start[c];
+				int ie = owners.cell_start[c+1];
+				if( ib == ie ) continue;
+				// Owners and targets number their cells differently
+				// if the grid is sparse, so go through the coordinates.
+				int ci[3];
+				owners.cell_coords( c, ci );
+				int n_near = targets.neighbour_cells( ci, near );
+
+				for( int ii = ib; ii < ie; ++ii ){
+					int i = owners.index[ii];
+					bool skip_s2 = groups && ( groups[i] & 1 );
+
+					for( int k = 0; k < n_near; ++k ){
+						int jb = targets.cell_start[ near[k].cell ];
+						int je = targets.cell_start[ near[k].cell + 1 ];
+						if( jb == je ) continue;
+
+						double sx = near[k].shift[0] - owners.x[ii];
+						double sy = near[k].shift[1] - owners.y[ii];
+						double sz = near[k].shift[2] - owners.z[ii];
+						if( r2.size() < static_cast<std::size_t>( je - jb ) ){
+							r2.resize( je - jb );
+						}
+						double *r2_out = r2.data();
+
+						// No branches in here, so this vectorises.
+						for( int m = jb; m < je; ++m ){
+							double dx = cx[m] + sx;
+							double dy = cy[m] + sy;
+							double dz = cz[m] + sz;
+							r2_out[m - jb] = dx*dx + dy*dy + dz*dz;
+						}
+
+						for( int m = jb; m < je; ++m ){
+							double rij2 = r2_out[m - jb];
+							if( rij2 > rc2 ) continue;
+							int j = cidx[m];
+							if( i == j ) continue;
+							if( skip_s2 && ( groups[j] & 2 ) ) continue;
+
+							visit( i, j, rij2, cx[m] + sx,
+							       cy[m] + sy, cz[m] + sz );
+						}
+					}
+				}
+			}
+		}
+	};
+	util::run_on_threads( n_threads, work );
+}
+
+
+/**
+   \brief Visits all pairs of atoms of s1 and s2 within rc.
+
+   Every pair is visited once from each side, so that visitors only
+   need to store things for the owner i.
+
+   \param b          The block_data the atoms are in.
+   \param s1         Indices of atoms to find the neighbours of.
+   \param s2         Indices of atoms that can be neighbours.
+   \param dims       Dimensionality, in 2D the z-coordinate is ignored.
+   \param rc         Largest distance between neighbours.
+   \param visitors   One visitor per thread that can be used.
+*/
+template <typename pair_visitor>
+void visit_pairs( const block_data &b,
+                  const std::vector<int> &s1, const std::vector<int> &s2,
+                  int dims, double rc, std::vector<pair_visitor> &visitors )
+{
+	int n_threads = std::max<int>( visitors.size(), 1 );
+	cell_list cells2( b, s2, dims, rc, n_threads );
+	if( s1 == s2 ){
+		visit_cell_pairs( cells2, cells2, rc, nullptr, visitors );
+		return;
+	}
+
+	// Instead of adding i to neighs[j], which would need locking,
+	// the atoms of s2 look for their neighbours in s1 themselves.
+	// Pairs of two atoms that are in both groups are found in the
+	// first pass already.
+	cell_list cells1( b, s1, dims, rc, n_threads );
+	std::vector<unsigned char> groups = group_flags( b.N, s1, s2 );
+	visit_cell_pairs( cells1, cells2, rc, nullptr, visitors );
+	visit_cell_pairs( cells2, cells1, rc, groups.data(), visitors );
+}
+
+
+/**
+   \brief Pair visitor that appends accepted pairs to a neigh_list.
+
+   If unique is set, j is not added to neighs[i] if it is already in
+   there, which can happen if more than one image of j is within rc.
+*/
+template <typename pair_policy>
+struct neigh_list_appender
+{
+	neigh_list_appender( neigh_list &neighs, const pair_policy &accept,
+	                     bool unique = false )
+		: neighs( &neighs ), accept( &accept ), unique( unique ),
+		  n_added( 0 ) {}
+
+	void operator()( int i, int j, double r2, double, double, double )
+	{
+		if( !( *accept )( i, j, r2 ) ) return;
+		std::vector<int> &ni = ( *neighs )[i];
+		if( unique && std::find( ni.begin(), ni.end(), j ) != ni.end() ){
+			return;
+		}
+		ni.push_back( j );
+		++n_added;
+	}
+
+	neigh_list *neighs;
+	const pair_policy *accept;
+	bool unique;
+	int n_added;
+};
+
+
+/**
+   \brief Checks if a periodic direction of the box is less than 2 rc
+          wide.
+
+   The cell list then has a single cell along it, and several images of
+   an atom can be within rc of another.
+*/
+inline bool has_narrow_periodic_axis( const block_data &b, int dims,
+                                      double rc )
+{
+	double width[3];
+	b.dom.face_widths( width, dims );
+	for( int d = 0; d < dims; ++d ){
+		if( ( b.dom.periodic & ( 1 << d ) ) && width[d] < 2.0*rc ){
+			return true;
+		}
+	}
+	return false;
+}
+
+
+/// Returns n_threads, or the number of cores if n_threads is 0 or less.
+inline int resolve_threads( int n_threads )
+{
+	if( n_threads > 0 ) return n_threads;
+	return std::max( 1u, std::thread::hardware_concurrency() );
+}
+
+
+/**
+   \brief Builds a neighbour list with a cell list.
+
+   For all atoms in s1 this finds the atoms in s2 within rc that
+   accept agrees on, and adds j to neighs[i] and i to neighs[j].
+   No pair ends up in a list twice, also not if several periodic
+   images of j are within rc of i in a box less than 2 rc wide.
+
+   Every list is filled by one thread only, so the result does not
+   depend on the number of threads.
+
+   \param[out] neighs     Neighbour lists, should have b.N empty lists.
+   \param[in]  b          The block_data to neighborize.
+   \param[in]  s1         Indices of atoms to find the neighbours of.
+   \param[in]  s2         Indices of atoms that can be neighbours.
+   \param[in]  dims       Dimensionality, in 2D the z-coordinate is ignored.
+   \param[in]  rc         Largest distance between neighbours.
+   \param[in]  accept     Pair policy, see within_cutoff.
+   \param[in]  n_threads  Number of threads to use, 0 for all cores.
+
+   \returns the number of entries added to neighs.
+*/
+template <typename pair_policy>
+int build_cell_list( neigh_list &neighs, const block_data &b,
+                     const std::vector<int> &s1, const std::vector<int> &s2,
+                     int dims, double rc, const pair_policy &accept,
+                     int n_threads = 1 )
+{
+	// Lists are only searched for repeats if an atom can be within rc
+	// of another more than once.
+	bool unique = has_narrow_periodic_axis( b, dims, rc );
+	std::vector<neigh_list_appender<pair_policy> > visitors(
+		resolve_threads( n_threads ),
+		neigh_list_appender<pair_policy>( neighs, accept, unique ) );
+	visit_pairs( b, s1, s2, dims, rc, visitors );
+
+	int n_neighs = 0;
+	for( const neigh_list_appender<pair_policy> &v : visitors ){
+		n_neighs += v.n_added;
+	}
+	return n_neighs;
+}
+
+
+} // namespace neighborize
+
+} // namespace lammps_tools
+
+#endif // NEIGHBORIZE_CELL_HPP
@@ -0,0 +1,322 @@
+#include "neighborize_csr.hpp"
+#include "neighborize_cell.hpp"
+#include "block_data_access.hpp"
+#include "my_assert.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+
+namespace lammps_tools {
+
+namespace neighborize {
+
+csr_neigh_list::csr_neigh_list()
+	: kind( FULL ), stored( NO_DATA ), offsets( 1, 0 ), indices(), r(), dr()
+{ }
+
+
+csr_neigh_list::csr_neigh_list( const neigh_list &neighs )
+	: kind( FULL ), stored( NO_DATA ), offsets( neighs.size() + 1, 0 ),
+	  indices(), r(), dr()
+{
+	for( std::size_t i = 0; i < neighs.size(); ++i ){
+		offsets[i+1] = offsets[i] + neighs[i].size();
+	}
+	indices.reserve( offsets.back() );
+	for( const std::vector<int> &ni : neighs ){
+		indices.insert( indices.end(), ni.begin(), ni.end() );
+	}
+}
+
+
+double csr_neigh_list::dist_2( const block_data &b, int i,
+                               std::size_t k ) const
+{
+	if( stored & DISTANCES ){
+		return r[k]*r[k];
+	}else if( stored & DISPLACEMENTS ){
+		const double *d = dr.data() + 3*k;
+		return d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+	}
+
+	const std::vector<double> &x = get_x( b );
+	const std::vector<double> &y = get_y( b );
+	const std::vector<double> &z = get_z( b );
+	int j = indices[k];
+	double xi[3] = { x[i], y[i], z[i] };
+	double xj[3] = { x[j], y[j], z[j] };
+	double rij[3];
+	return b.dom.dist_2( xi, xj, rij );
+}
+
+
+neigh_list csr_neigh_list::to_neigh_list() const
+{
+	neigh_list neighs( size() );
+	for( int i = 0; i < size(); ++i ){
+		neighs[i].assign( (*this)[i].begin(), (*this)[i].end() );
+	}
+	if( is_half() ){
+		for( int i = 0; i < size(); ++i ){
+			for( int j : (*this)[i] ){
+				neighs[j].push_back( i );
+			}
+		}
+		remove_doubles( neighs );
+	}
+	return neighs;
+}
+
+
+std::size_t csr_neigh_list::memory() const
+{
+	return offsets.capacity() * sizeof( std::size_t )
+		+ indices.capacity() * sizeof( int )
+		+ ( r.capacity() + dr.capacity() ) * sizeof( double );
+}
+
+
+namespace {
+
+// Collects the pairs of the owners one thread visits. All entries of
+// an owner are contiguous, so only where each owner starts is stored.
+template <typename pair_policy>
+struct csr_collector
+{
+	csr_collector( bool half, int stored, const pair_policy &accept )
+		: half( half ), stored( stored ), last( -1 ), accept( accept ),
+		  owners(), starts(), dest(), js(), r(), dr()
+	{ }
+
+	void operator()( int i, int j, double r2, double dx, double dy, double dz )
+	{
+		if( half && j < i ) return;
+		if( !accept( i, j, r2 ) ) return;
+		if( i != last ){
+			owners.push_back( i );
+			starts.push_back( js.size() );
+			last = i;
+		}
+		js.push_back( j );
+		if( stored & csr_neigh_list::DISTANCES ){
+			r.push_back( std::sqrt( r2 ) );
+		}
+		if( stored & csr_neigh_list::DISPLACEMENTS ){
+			dr.push_back( dx );
+			dr.push_back( dy );
+			dr.push_back( dz );
+		}
+	}
+
+	std::size_t owner_end( std::size_t k ) const
+	{ return k + 1 < owners.size() ? starts[k+1] : js.size(); }
+
+	bool half;
+	int stored;
+	int last;
+	pair_policy accept;
+
+	std::vector<int> owners;
+	std::vector<std::size_t> starts;
+	std::vector<std::size_t> dest; ///< Where the entries go in the list.
+	std::vector<int> js;
+	std::vector<double> r, dr;
+};
+
+
+// Sorts the entries of atom i by index, along with their data.
+void sort_entries( csr_neigh_list &nl, int i, std::vector<std::size_t> &perm,
+                   std::vector<int> &js, std::vector<double> &data )
+{
+	std::size_t begin = nl.offsets[i];
+	std::size_t n = nl.offsets[i+1] - begin;
+	int *idx = nl.indices.data() + begin;
+	if( nl.stored == csr_neigh_list::NO_DATA ){
+		std::sort( idx, idx + n );
+		return;
+	}
+	if( std::is_sorted( idx, idx + n ) ) return;
+
+	perm.resize( n );
+	std::iota( perm.begin(), perm.end(), 0 );
+	std::sort( perm.begin(), perm.end(),
+	           [idx]( std::size_t a, std::size_t b ){
+		           return idx[a] < idx[b]; } );
+
+	js.assign( idx, idx + n );
+	for( std::size_t m = 0; m < n; ++m ) idx[m] = js[ perm[m] ];
+
+	if( nl.stored & csr_neigh_list::DISTANCES ){
+		double *r = nl.r.data() + begin;
+		data.assign( r, r + n );
+		for( std::size_t m = 0; m < n; ++m ) r[m] = data[ perm[m] ];
+	}
+	if( nl.stored & csr_neigh_list::DISPLACEMENTS ){
+		double *d = nl.dr.data() + 3*begin;
+		data.assign( d, d + 3*n );
+		for( std::size_t m = 0; m < n; ++m ){
+			for( int c = 0; c < 3; ++c ){
+				d[3*m+c] = data[ 3*perm[m] + c ];
+			}
+		}
+	}
+}
+
+// Builds the list of the pairs within rc that accept agrees on.
+template <typename pair_policy>
+double build_csr_list( csr_neigh_list &nl, const block_data &b,
+                       const std::vector<int> &ilist,
+                       const std::vector<int> &jlist,
+                       int dims, double rc, int kind, int stored,
+                       int n_threads, const pair_policy &accept )
+{
+	typedef csr_collector<pair_policy> collector;
+	my_assert( __FILE__, __LINE__,
+	           kind == csr_neigh_list::FULL || kind == csr_neigh_list::HALF,
+	           "Unknown kind of neighbour list!" );
+	n_threads = resolve_threads( n_threads );
+
+	std::vector<collector> visitors(
+		n_threads, collector( kind == csr_neigh_list::HALF, stored, accept ) );
+	visit_pairs( b, ilist, jlist, dims, rc, visitors );
+
+	nl.kind = kind;
+	nl.stored = stored;
+	nl.offsets.assign( b.N + 1, 0 );
+	for( const collector &c : visitors ){
+		for( std::size_t k = 0; k < c.owners.size(); ++k ){
+			nl.offsets[ c.owners[k] + 1 ] += c.owner_end( k ) - c.starts[k];
+		}
+	}
+	for( int i = 0; i < b.N; ++i ){
+		nl.offsets[i+1] += nl.offsets[i];
+	}
+
+	std::size_t n_entries = nl.offsets.back();
+	nl.indices.resize( n_entries );
+	nl.r.resize( stored & csr_neigh_list::DISTANCES ? n_entries : 0 );
+	nl.dr.resize( stored & csr_neigh_list::DISPLACEMENTS ? 3*n_entries : 0 );
+
+	// An atom in both groups can have entries with two visitors, so
+	// first find where each run of entries goes, then copy in parallel.
+	std::vector<std::size_t> fill( nl.offsets.begin(), nl.offsets.end() - 1 );
+	for( collector &c : visitors ){
+		c.dest.resize( c.owners.size() );
+		for( std::size_t k = 0; k < c.owners.size(); ++k ){
+			c.dest[k] = fill[ c.owners[k] ];
+			fill[ c.owners[k] ] += c.owner_end( k ) - c.starts[k];
+		}
+	}
+
+	int n_copy = std::min<bigint>( n_threads,
+	                               1 + b.N / cell_list::min_thread_atoms );
+	util::run_on_threads( n_copy, [&]( int t ){
+		for( std::size_t v = t; v < visitors.size(); v += n_copy ){
+			const collector &c = visitors[v];
+			for( std::size_t k = 0; k < c.owners.size(); ++k ){
+				std::size_t begin = c.starts[k];
+				std::size_t n = c.owner_end( k ) - begin;
+				std::size_t to = c.dest[k];
+
+				std::copy( c.js.begin() + begin, c.js.begin() + begin + n,
+				           nl.indices.begin() + to );
+				if( stored & csr_neigh_list::DISTANCES ){
+					std::copy( c.r.begin() + begin, c.r.begin() + begin + n,
+					           nl.r.begin() + to );
+				}
+				if( stored & csr_neigh_list::DISPLACEMENTS ){
+					std::copy( c.dr.begin() + 3*begin,
+					           c.dr.begin() + 3*( begin + n ),
+					           nl.dr.begin() + 3*to );
+				}
+			}
+		}
+	} );
+	visitors.clear();
+
+	util::run_on_threads( n_copy, [&]( int t ){
+		std::vector<std::size_t> perm;
+		std::vector<int> js;
+		std::vector<double> data;
+		for( int i = t; i < b.N; i += n_copy ){
+			sort_entries( nl, i, perm, js, data );
+		}
+	} );
+
+	double avg = n_entries;
+	if( kind == csr_neigh_list::HALF ) avg *= 2;
+	return b.N > 0 ? avg / b.N : 0.0;
+}
+
+} // namespace
+
+
+double make_csr_list_dist_indexed( csr_neigh_list &nl, const block_data &b,
+                                   const std::vector<int> &ilist,
+                                   const std::vector<int> &jlist,
+                                   int dims, double rc, int kind,
+                                   int stored, int n_threads )
+{
+	return build_csr_list( nl, b, ilist, jlist, dims, rc, kind, stored,
+	                       n_threads, within_cutoff() );
+}
+
+
+double make_csr_list_dist( csr_neigh_list &nl, const block_data &b,
+                           int itype, int jtype, int dims, double rc,
+                           int kind, int stored, int n_threads )
+{
+	const std::vector<int> &type = get_type( b );
+	std::vector<int> s1, s2;
+	for( int i = 0; i < b.N; ++i ){
+		if( !itype || type[i] == itype ) s1.push_back( i );
+		if( !jtype || type[i] == jtype ) s2.push_back( i );
+	}
+	return make_csr_list_dist_indexed( nl, b, s1, s2, dims, rc, kind,
+	                                   stored, n_threads );
+}
+
+
+double make_csr_list_dist_types( csr_neigh_list &nl, const block_data &b,
+                                 const std::vector<std::vector<double> > &rc,
+                                 int dims, int kind, int stored,
+                                 int n_threads )
+{
+	type_cutoff_criterion crit( rc, dims );
+	crit.check_types( b );
+	std::vector<int> all_atoms = all( b );
+	return build_csr_list( nl, b, all_atoms, all_atoms, dims, crit.rc_max,
+	                       kind, stored, n_threads,
+	                       type_pair_cutoff( get_type( b ), crit ) );
+}
+
+
+std::vector<bond> neigh_list_to_bonds( const block_data &b,
+                                       const csr_neigh_list &neighs,
+                                       int btype )
+{
+	std::vector<bond> bonds;
+	const std::vector<int> &id = get_id( b );
+	for( int i = 0; i < neighs.size(); ++i ){
+		for( int j : neighs[i] ){
+			// Half lists have each pair once, but not per id.
+			if( !neighs.is_half() && id[i] >= id[j] ) continue;
+
+			bond bb;
+			bb.id = bonds.size() + 1;
+			bb.type = btype;
+			bb.particle1 = id[i] < id[j] ? i : j;
+			bb.particle2 = id[i] < id[j] ? j : i;
+			bonds.push_back( bb );
+		}
+	}
+	return bonds;
+}
+
+
+} // namespace neighborize
+
+} // namespace lammps_tools
@@ -0,0 +1,190 @@
+#ifndef NEIGHBORIZE_CSR_HPP
+#define NEIGHBORIZE_CSR_HPP
+
+/**
+   \file neighborize_csr.hpp
+
+   Neighbour lists stored as one array of offsets and one of indices.
+*/
+
+#include <cstddef>
+#include <vector>
+
+#include "block_data.hpp"
+#include "neighborize.hpp"
+#include "topology.hpp"
+
+
+namespace lammps_tools {
+
+namespace neighborize {
+
+/**
+   \brief A neighbour list in compressed sparse row format.
+
+   The neighbours of atom i are indices[offsets[i]] up to
+   indices[offsets[i+1]], sorted. Compared to a neigh_list, this
+   needs no allocation per atom and keeps all lists in one block of
+   memory. A half list stores every pair only once, in the list of the
+   atom with the lowest index, which halves the memory again.
+
+   Per entry, the list can also store the distance and the
+   displacement from i to j, so that analyses need not compute them
+   again.
+*/
+class csr_neigh_list
+{
+public:
+	/// Whether each pair is stored once or from both sides.
+	enum list_kinds {
+		FULL = 0, ///< j is in the list of i and i in the list of j.
+		HALF = 1  ///< Only j in the list of i, for i < j.
+	};
+
+	/// What to store per entry, can be or'ed together.
+	enum pair_data {
+		NO_DATA       = 0, ///< Only the indices.
+		DISTANCES     = 1, ///< The distance between i and j.
+		DISPLACEMENTS = 2  ///< The displacement from i to j.
+	};
+
+	/// The neighbours of one atom, which can be looped over.
+	class neighbours
+	{
+	public:
+		neighbours( const int *first, const int *last )
+			: first( first ), last( last ) {}
+
+		const int *begin() const { return first; }
+		const int *end()   const { return last; }
+		std::size_t size() const { return last - first; }
+		bool empty()       const { return first == last; }
+		int operator[]( std::size_t m ) const { return first[m]; }
+
+	private:
+		const int *first, *last;
+	};
+
+	/// Constructs an empty full list without data.
+	csr_neigh_list();
+
+	/// Copies neighs into a full list without data.
+	explicit csr_neigh_list( const neigh_list &neighs );
+
+	/// Returns the number of atoms.
+	int size() const { return offsets.size() - 1; }
+
+	/// Returns the neighbours of atom i.
+	neighbours operator[]( int i ) const
+	{
+		return neighbours( indices.data() + offsets[i],
+		                   indices.data() + offsets[i+1] );
+	}
+
+	/// Returns the number of stored entries.
+	std::size_t n_entries() const { return indices.size(); }
+
+	/// Returns true if this is a half list.
+	bool is_half() const { return kind == HALF; }
+
+	/**
+	   \brief Returns the squared distance of an entry.
+
+	   Uses the stored distances or displacements if there are any,
+	   and computes it otherwise.
+
+	   \param b  The block_data the list is of.
+	   \param i  The atom the entry belongs to.
+	   \param k  The index of the entry, between offsets[i] and
+	             offsets[i+1].
+	*/
+	double dist_2( const block_data &b, int i, std::size_t k ) const;
+
+	/// Converts to a neigh_list, which is always full.
+	neigh_list to_neigh_list() const;
+
+	/// Returns the memory used by the list, in bytes.
+	std::size_t memory() const;
+
+	int kind;   ///< See list_kinds.
+	int stored; ///< See pair_data.
+
+	std::vector<std::size_t> offsets; ///< Start of the list of each atom.
+	std::vector<int> indices;         ///< Neighbours of all atoms.
+	std::vector<double> r;            ///< Distance of each entry.
+	std::vector<double> dr;           ///< Three displacements per entry.
+};
+
+
+/**
+   \brief Builds a CSR neighbour list with a cell list.
+
+   Like make_list_dist_indexed with DIST_BIN, but without a neigh_list
+   in between. Molecule and bond policies are not supported.
+
+   \param[out] nl         Will contain the neighbour list.
+   \param[in]  b          block_data to neighborize.
+   \param[in]  ilist      Indices of atoms to find the neighbours of.
+   \param[in]  jlist      Indices of atoms that can be neighbours.
+   \param[in]  dims       Dimensions of the system (2 or 3)
+   \param[in]  rc         Consider atoms less than this apart as neighbour
+   \param[in]  kind       FULL or HALF, see csr_neigh_list::list_kinds.
+   \param[in]  stored     What to store per entry, see
+                          csr_neigh_list::pair_data.
+   \param[in]  n_threads  Number of threads to use, 0 for all cores.
+
+   \returns The average number of neighbours per particle.
+*/
+double make_csr_list_dist_indexed( csr_neigh_list &nl, const block_data &b,
+                                   const std::vector<int> &ilist,
+                                   const std::vector<int> &jlist,
+                                   int dims, double rc,
+                                   int kind = csr_neigh_list::FULL,
+                                   int stored = csr_neigh_list::NO_DATA,
+                                   int n_threads = 1 );
+
+/**
+   \brief Builds a CSR neighbour list for atoms of given types.
+
+   \param itype  Type of particle i to consider, 0 for all.
+   \param jtype  Type of particle j to consider, 0 for all.
+
+   For the other parameters see make_csr_list_dist_indexed.
+*/
+double make_csr_list_dist( csr_neigh_list &nl, const block_data &b,
+                           int itype, int jtype, int dims, double rc,
+                           int kind = csr_neigh_list::FULL,
+                           int stored = csr_neigh_list::NO_DATA,
+                           int n_threads = 1 );
+
+/**
+   \brief Builds a CSR neighbour list with a cut-off per pair of types.
+
+   \param rc  Symmetric matrix of cut-offs, b.N_types by b.N_types,
+              see type_cutoff_criterion.
+
+   For the other parameters see make_csr_list_dist_indexed.
+*/
+double make_csr_list_dist_types( csr_neigh_list &nl, const block_data &b,
+                                 const std::vector<std::vector<double> > &rc,
+                                 int dims,
+                                 int kind = csr_neigh_list::FULL,
+                                 int stored = csr_neigh_list::NO_DATA,
+                                 int n_threads = 1 );
+
+
+/**
+   \brief Converts a CSR neighbour list into a list of bonds.
+
+   \overload neigh_list_to_bonds
+*/
+std::vector<bond> neigh_list_to_bonds( const block_data &b,
+                                       const csr_neigh_list &neighs,
+                                       int btype = 1 );
+
+
+} // namespace neighborize
+
+} // namespace lammps_tools
+
+#endif // NEIGHBORIZE_CSR_HPP
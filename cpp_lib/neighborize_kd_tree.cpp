@@ -0,0 +1,335 @@
+#include "neighborize_kd_tree.hpp"
+#include "block_data_access.hpp"
+#include "my_assert.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+
+namespace lammps_tools {
+
+namespace neighborize {
+
+namespace {
+
+std::vector<int> all_atoms( const block_data &b )
+{
+	std::vector<int> all( b.N );
+	for( int i = 0; i < b.N; ++i ) all[i] = i;
+	return all;
+}
+
+} // namespace
+
+
+kd_tree::kd_tree( const block_data &b, const std::vector<int> &atoms,
+                  int dims )
+	: dims( dims ), periodic( 0 ), fold( 0 ), triclinic( false ), nodes(),
+	  index(), px(), py(), pz()
+{
+	set_box( b.dom );
+
+	const std::vector<double> &x = get_x( b );
+	const std::vector<double> &y = get_y( b );
+	const std::vector<double> &z = get_z( b );
+	std::vector<point> points( atoms.size() );
+	for( std::size_t k = 0; k < atoms.size(); ++k ){
+		int i = atoms[k];
+		point &p = points[k];
+		p.x[0] = x[i];
+		p.x[1] = y[i];
+		p.x[2] = dims == 3 ? z[i] : 0.0;
+		p.idx = i;
+		wrap( p.x );
+	}
+	build( points );
+}
+
+
+kd_tree::kd_tree( const block_data &b, int dims )
+	: kd_tree( b, all_atoms( b ), dims )
+{ }
+
+
+kd_tree::kd_tree( const std::vector<double> &x, const std::vector<double> &y,
+                  const std::vector<double> &z, int dims )
+	: dims( dims ), periodic( 0 ), fold( 0 ), triclinic( false ), nodes(),
+	  index(), px(), py(), pz()
+{
+	my_assert( __FILE__, __LINE__,
+	           x.size() == y.size() && ( dims == 2 || x.size() == z.size() ),
+	           "Coordinate arrays differ in size!" );
+	for( int k = 0; k < 3; ++k ){
+		lo[k] = 0.0;
+		L[k] = 0.0;
+		tilt[k] = 0.0;
+	}
+
+	std::vector<point> points( x.size() );
+	for( std::size_t i = 0; i < x.size(); ++i ){
+		point &p = points[i];
+		p.x[0] = x[i];
+		p.x[1] = y[i];
+		p.x[2] = dims == 3 ? z[i] : 0.0;
+		p.idx = i;
+	}
+	build( points );
+}
+
+
+void kd_tree::set_box( const domain &dom )
+{
+	periodic = dom.periodic;
+	if( dims == 2 ) periodic &= ~domain::BIT_Z;
+	for( int k = 0; k < 3; ++k ){
+		lo[k] = dom.xlo[k];
+		L[k] = dom.xhi[k] - dom.xlo[k];
+		if( L[k] <= 0 ) periodic &= ~( 1 << k );
+	}
+	tilt[0] = dom.xy;
+	tilt[1] = dims == 3 ? dom.xz : 0.0;
+	tilt[2] = dims == 3 ? dom.yz : 0.0;
+	triclinic = tilt[0] != 0 || tilt[1] != 0 || tilt[2] != 0;
+
+	// The bounding boxes of the nodes cannot be folded along tilted box
+	// vectors, so then the images of the query are searched instead.
+	fold = triclinic ? 0 : periodic;
+}
+
+
+void kd_tree::wrap( double x[3] ) const
+{
+	if( triclinic ){
+		domain dom;
+		for( int k = 0; k < 3; ++k ){
+			dom.xlo[k] = lo[k];
+			dom.xhi[k] = lo[k] + L[k];
+		}
+		dom.periodic = periodic;
+		dom.xy = tilt[0];
+		dom.xz = tilt[1];
+		dom.yz = tilt[2];
+		dom.rewrap_position( x );
+		return;
+	}
+	for( int k = 0; k < 3; ++k ){
+		if( !( periodic & ( 1 << k ) ) ) continue;
+		if( x[k] < lo[k] || x[k] >= lo[k] + L[k] ){
+			x[k] -= L[k] * std::floor( ( x[k] - lo[k] ) / L[k] );
+		}
+	}
+}
+
+
+int kd_tree::query_images( const double q[3], double images[][3] ) const
+{
+	std::copy( q, q + 3, images[0] );
+	if( !triclinic ) return 1;
+
+	int n_images = 1;
+	int reach[3];
+	for( int k = 0; k < 3; ++k ){
+		reach[k] = periodic & ( 1 << k ) ? 1 : 0;
+	}
+	for( int c = -reach[2]; c <= reach[2]; ++c ){
+		for( int b = -reach[1]; b <= reach[1]; ++b ){
+			for( int a = -reach[0]; a <= reach[0]; ++a ){
+				if( !a && !b && !c ) continue;
+				double *qi = images[n_images++];
+				qi[0] = q[0] + a*L[0] + b*tilt[0] + c*tilt[1];
+				qi[1] = q[1] + b*L[1] + c*tilt[2];
+				qi[2] = q[2] + c*L[2];
+			}
+		}
+	}
+	return n_images;
+}
+
+
+void kd_tree::build( std::vector<point> &points )
+{
+	nodes.clear();
+	if( points.empty() ) return;
+
+	nodes.reserve( 2 * ( points.size() / leaf_size + 1 ) );
+	build_node( points, 0, points.size() );
+
+	index.resize( points.size() );
+	px.resize( points.size() );
+	py.resize( points.size() );
+	pz.resize( points.size() );
+	for( std::size_t p = 0; p < points.size(); ++p ){
+		index[p] = points[p].idx;
+		px[p] = points[p].x[0];
+		py[p] = points[p].x[1];
+		pz[p] = points[p].x[2];
+	}
+}
+
+
+int kd_tree::build_node( std::vector<point> &points, int begin, int end )
+{
+	int self = nodes.size();
+	nodes.push_back( node() );
+
+	node n;
+	n.begin = begin;
+	n.end = end;
+	n.left = n.right = -1;
+	for( int k = 0; k < 3; ++k ){
+		n.lo[k] = n.hi[k] = points[begin].x[k];
+	}
+	for( int p = begin + 1; p < end; ++p ){
+		for( int k = 0; k < 3; ++k ){
+			n.lo[k] = std::min( n.lo[k], points[p].x[k] );
+			n.hi[k] = std::max( n.hi[k], points[p].x[k] );
+		}
+	}
+
+	if( end - begin > leaf_size ){
+		// Split the widest direction at the median.
+		int axis = 0;
+		for( int k = 1; k < dims; ++k ){
+			if( n.hi[k] - n.lo[k] > n.hi[axis] - n.lo[axis] ) axis = k;
+		}
+		int mid = begin + ( end - begin ) / 2;
+		std::nth_element( points.begin() + begin, points.begin() + mid,
+		                  points.begin() + end,
+		                  [axis]( const point &a, const point &b ){
+			                  return a.x[axis] < b.x[axis]; } );
+		n.left = build_node( points, begin, mid );
+		n.right = build_node( points, mid, end );
+	}
+
+	nodes[self] = n;
+	return self;
+}
+
+
+int kd_tree::nearest( const double x[3], double &r2 ) const
+{
+	return nearest_if( x, []( int ){ return true; }, r2 );
+}
+
+
+void kd_tree::k_nearest( const double x[3], int k, std::vector<int> &idx,
+                         std::vector<double> &r2 ) const
+{
+	idx.clear();
+	r2.clear();
+	if( nodes.empty() || k <= 0 ) return;
+
+	double q[3] = { x[0], x[1], dims == 3 ? x[2] : 0.0 };
+	wrap( q );
+
+	// The k nearest so far, as a heap with the farthest on top. Ties go
+	// to the lowest index.
+	typedef std::pair<double, int> candidate;
+	std::vector<candidate> found;
+	found.reserve( k + 1 );
+	auto worst = [&found, k](){
+		return static_cast<int>( found.size() ) < k
+			? std::numeric_limits<double>::infinity() : found.front().first;
+	};
+
+	double images[max_images][3];
+	int n_images = query_images( q, images );
+	for( int im = 0; im < n_images; ++im ){
+		const double *qi = images[im];
+
+		int stack[max_depth + 1];
+		double bound[max_depth + 1];
+		int top = 0;
+		stack[0] = 0;
+		bound[0] = 0.0;
+		while( top >= 0 ){
+			const node &n = nodes[ stack[top] ];
+			double nb = bound[top];
+			--top;
+			if( nb > worst() ) continue;
+
+			if( n.left < 0 ){
+				for( int p = n.begin; p < n.end; ++p ){
+					candidate c( point_dist_2( q, p ), index[p] );
+					bool full = static_cast<int>( found.size() ) == k;
+					if( full && !( c < found.front() ) ) continue;
+					// Another image of q can have found it already.
+					if( n_images > 1 && std::find( found.begin(), found.end(),
+					                               c ) != found.end() ){
+						continue;
+					}
+					if( full ){
+						std::pop_heap( found.begin(), found.end() );
+						found.pop_back();
+					}
+					found.push_back( c );
+					std::push_heap( found.begin(), found.end() );
+				}
+				continue;
+			}
+
+			double dl = box_dist_2( qi, nodes[n.left] );
+			double dr = box_dist_2( qi, nodes[n.right] );
+			int near_child = dl <= dr ? n.left : n.right;
+			int far_child  = dl <= dr ? n.right : n.left;
+			stack[++top] = far_child;
+			bound[top] = std::max( dl, dr );
+			stack[++top] = near_child;
+			bound[top] = std::min( dl, dr );
+		}
+	}
+
+	std::sort_heap( found.begin(), found.end() );
+	idx.resize( found.size() );
+	r2.resize( found.size() );
+	for( std::size_t m = 0; m < found.size(); ++m ){
+		r2[m] = found[m].first;
+		idx[m] = found[m].second;
+	}
+}
+
+
+void kd_tree::within( const double x[3], double r, std::vector<int> &idx ) const
+{
+	idx.clear();
+	if( nodes.empty() ) return;
+
+	double q[3] = { x[0], x[1], dims == 3 ? x[2] : 0.0 };
+	wrap( q );
+	double rc2 = r*r;
+
+	double images[max_images][3];
+	int n_images = query_images( q, images );
+	for( int im = 0; im < n_images; ++im ){
+		const double *qi = images[im];
+
+		int stack[max_depth + 1];
+		int top = 0;
+		stack[0] = 0;
+		while( top >= 0 ){
+			const node &n = nodes[ stack[top] ];
+			--top;
+			if( box_dist_2( qi, n ) > rc2 ) continue;
+
+			if( n.left < 0 ){
+				for( int p = n.begin; p < n.end; ++p ){
+					if( point_dist_2( q, p ) <= rc2 ) idx.push_back( index[p] );
+				}
+				continue;
+			}
+			stack[++top] = n.right;
+			stack[++top] = n.left;
+		}
+	}
+	if( n_images > 1 ){
+		std::sort( idx.begin(), idx.end() );
+		idx.erase( std::unique( idx.begin(), idx.end() ), idx.end() );
+	}
+}
+
+
+} // namespace neighborize
+
+} // namespace lammps_tools
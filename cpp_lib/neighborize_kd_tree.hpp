@@ -0,0 +1,280 @@
+#ifndef NEIGHBORIZE_KD_TREE_HPP
+#define NEIGHBORIZE_KD_TREE_HPP
+
+/**
+   \file neighborize_kd_tree.hpp
+
+   k-d tree for nearest neighbour and radius queries.
+*/
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "block_data.hpp"
+#include "domain.hpp"
+
+
+namespace lammps_tools {
+
+namespace neighborize {
+
+/**
+   \brief A k-d tree of positions, aware of periodic boundaries.
+
+   Unlike cell lists, the tree needs no cut-off up front, so it finds
+   the nearest atoms at any distance and copes with large differences
+   in density. It is built once and then answers queries for arbitrary
+   points, which need not be atoms. Queries do not change the tree, so
+   several threads can query at once.
+
+   Distances follow the minimum image convention along the periodic
+   directions of the box. In 2D the z-coordinate is ignored. In a
+   triclinic box the tree is searched from each periodic image of the
+   query next to the box, which costs more per query.
+*/
+class kd_tree
+{
+public:
+	/// At most this many points are in a leaf.
+	static const int leaf_size = 8;
+
+	/**
+	   \brief Builds the tree of given atoms.
+
+	   \param b      The block_data the atoms are in.
+	   \param atoms  Indices of the atoms to put in the tree.
+	   \param dims   Dimensions of the system (2 or 3).
+	*/
+	kd_tree( const block_data &b, const std::vector<int> &atoms, int dims );
+
+	/// Builds the tree of all atoms in b. \overload
+	kd_tree( const block_data &b, int dims );
+
+	/**
+	   \brief Builds the tree of points in open space.
+
+	   Queries return indices into x, y and z.
+	*/
+	kd_tree( const std::vector<double> &x, const std::vector<double> &y,
+	         const std::vector<double> &z, int dims );
+
+	/// Returns the number of points in the tree.
+	int size() const { return index.size(); }
+
+	/**
+	   \brief Finds the point nearest to x.
+
+	   \param[in]  x   The point to query.
+	   \param[out] r2  Squared distance to the nearest point.
+
+	   \returns the index of the nearest point, -1 if the tree is empty.
+	            Of points at the same distance, the lowest index wins.
+	*/
+	int nearest( const double x[3], double &r2 ) const;
+
+	/**
+	   \brief Finds the nearest point that accept agrees on.
+
+	   This gives the nearest atom of another group, for example, with
+	   accept( j ) checking that j is not in the group of the query.
+
+	   \param[in]  x       The point to query.
+	   \param[in]  accept  Called with indices of candidates as
+	                       accept( j ), returns false to skip j.
+	   \param[out] r2      Squared distance to the point found.
+
+	   \returns the index of the point, -1 if no point is accepted.
+	*/
+	template <typename filter>
+	int nearest_if( const double x[3], const filter &accept,
+	                double &r2 ) const;
+
+	/**
+	   \brief Finds the k points nearest to x.
+
+	   \param[in]  x    The point to query.
+	   \param[in]  k    Number of points to find.
+	   \param[out] idx  The indices of the points, nearest first.
+	   \param[out] r2   Their squared distances.
+	*/
+	void k_nearest( const double x[3], int k, std::vector<int> &idx,
+	                std::vector<double> &r2 ) const;
+
+	/**
+	   \brief Finds all points within distance r of x.
+
+	   \param[in]  x    The point to query.
+	   \param[in]  r    The largest distance to include.
+	   \param[out] idx  The indices of the points, in no particular order.
+	*/
+	void within( const double x[3], double r, std::vector<int> &idx ) const;
+
+private:
+	struct node
+	{
+		double lo[3], hi[3]; ///< Bounding box of the points in the node.
+		int begin, end;      ///< Range of points in the node.
+		int left, right;     ///< Children, -1 for leaves.
+	};
+
+	struct point
+	{
+		double x[3];
+		int idx;
+	};
+
+	/// Deepest possible tree, as nodes are split in half.
+	static const int max_depth = 64;
+
+	/// Most images of a query that are searched from.
+	static const int max_images = 27;
+
+	void build( std::vector<point> &points );
+	int build_node( std::vector<point> &points, int begin, int end );
+	void set_box( const domain &dom );
+	void wrap( double x[3] ) const;
+	int query_images( const double q[3], double images[][3] ) const;
+
+	double point_dist_2( const double q[3], int p ) const;
+	double box_dist_2( const double q[3], const node &n ) const;
+
+	int dims;
+	int periodic; ///< See domain::periodic_bits, bit k is direction k.
+	int fold;     ///< Directions box_dist_2 folds, 0 if triclinic.
+	bool triclinic;
+	double lo[3]; ///< Lower bounds of the box.
+	double L[3];  ///< Box lengths.
+	double tilt[3]; ///< Tilt factors xy, xz and yz.
+
+	std::vector<node> nodes;
+	std::vector<int> index;            ///< Index of each point.
+	std::vector<double> px, py, pz;    ///< Positions, in tree order.
+};
+
+
+inline
+double kd_tree::point_dist_2( const double q[3], int p ) const
+{
+	double d[3] = { px[p] - q[0], py[p] - q[1], pz[p] - q[2] };
+	if( triclinic ){
+		// As in domain::rewrap_vector, c down to a.
+		if( periodic & domain::BIT_Z ){
+			double m = std::round( d[2] / L[2] );
+			d[2] -= m*L[2];
+			d[1] -= m*tilt[2];
+			d[0] -= m*tilt[1];
+		}
+		if( periodic & domain::BIT_Y ){
+			double m = std::round( d[1] / L[1] );
+			d[1] -= m*L[1];
+			d[0] -= m*tilt[0];
+		}
+		if( periodic & domain::BIT_X ){
+			d[0] -= std::round( d[0] / L[0] )*L[0];
+		}
+		return d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+	}
+	for( int k = 0; k < 3; ++k ){
+		if( !( periodic & ( 1 << k ) ) ) continue;
+		if( d[k] > 0.5*L[k] ){
+			d[k] -= L[k];
+		}else if( d[k] < -0.5*L[k] ){
+			d[k] += L[k];
+		}
+	}
+	return d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+}
+
+
+inline
+double kd_tree::box_dist_2( const double q[3], const node &n ) const
+{
+	double r2 = 0.0;
+	for( int k = 0; k < 3; ++k ){
+		double gap = 0.0;
+		if( q[k] < n.lo[k] ){
+			gap = n.lo[k] - q[k];
+			// The image of q one box up can be closer.
+			if( fold & ( 1 << k ) ){
+				gap = std::min( gap, q[k] + L[k] - n.hi[k] );
+			}
+		}else if( q[k] > n.hi[k] ){
+			gap = q[k] - n.hi[k];
+			if( fold & ( 1 << k ) ){
+				gap = std::min( gap, n.lo[k] - q[k] + L[k] );
+			}
+		}
+		r2 += gap*gap;
+	}
+	return r2;
+}
+
+
+template <typename filter>
+int kd_tree::nearest_if( const double x[3], const filter &accept,
+                         double &r2 ) const
+{
+	double q[3] = { x[0], x[1], dims == 3 ? x[2] : 0.0 };
+	wrap( q );
+
+	int best = -1;
+	double best_r2 = std::numeric_limits<double>::infinity();
+	if( nodes.empty() ){
+		r2 = best_r2;
+		return best;
+	}
+
+	// Points are compared with q itself, so all images of q give the
+	// same distance for a point.
+	double images[max_images][3];
+	int n_images = query_images( q, images );
+	for( int im = 0; im < n_images; ++im ){
+		const double *qi = images[im];
+
+		// Nodes to visit, with a lower bound on their distance to qi.
+		int stack[max_depth + 1];
+		double bound[max_depth + 1];
+		int top = 0;
+		stack[0] = 0;
+		bound[0] = 0.0;
+		while( top >= 0 ){
+			const node &n = nodes[ stack[top] ];
+			double nb = bound[top];
+			--top;
+			if( nb > best_r2 ) continue;
+
+			if( n.left < 0 ){
+				for( int p = n.begin; p < n.end; ++p ){
+					double d2 = point_dist_2( q, p );
+					if( d2 > best_r2 ) continue;
+					if( d2 == best_r2 && index[p] > best ) continue;
+					if( !accept( index[p] ) ) continue;
+					best = index[p];
+					best_r2 = d2;
+				}
+				continue;
+			}
+
+			// Visit the nearer child first, so it is on top.
+			double dl = box_dist_2( qi, nodes[n.left] );
+			double dr = box_dist_2( qi, nodes[n.right] );
+			int near_child = dl <= dr ? n.left : n.right;
+			int far_child  = dl <= dr ? n.right : n.left;
+			stack[++top] = far_child;
+			bound[top] = std::max( dl, dr );
+			stack[++top] = near_child;
+			bound[top] = std::min( dl, dr );
+		}
+	}
+
+	r2 = best_r2;
+	return best;
+}
+
+
+} // namespace neighborize
+
+} // namespace lammps_tools
+
+#endif // NEIGHBORIZE_KD_TREE_HPP
@@ -0,0 +1,185 @@
+#include "neighborize_verlet.hpp"
+#include "neighborize_cell.hpp"
+#include "block_data_access.hpp"
+#include "my_assert.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace lammps_tools {
+
+namespace neighborize {
+
+verlet_list::verlet_list( double rc, double skin, int dims, int itype,
+                          int jtype, int kind, int stored, int n_threads )
+	: rc( rc ), skin( skin ), dims( dims ), itype( itype ), jtype( jtype ),
+	  kind( kind ), stored( stored ),
+	  n_threads( resolve_threads( n_threads ) ), skin_list(), current(),
+	  ref_id(), ref_type(), ref_x(), ref_y(), ref_z(),
+	  ref_xlo{ 0.0, 0.0, 0.0 }, ref_xhi{ 0.0, 0.0, 0.0 },
+	  ref_tilt{ 0.0, 0.0, 0.0 }, ref_periodic( 0 ),
+	  last_rebuilt( false ), builds( 0 ), updates( 0 )
+{
+	my_assert( __FILE__, __LINE__, rc > 0, "Cut-off must be positive!" );
+	my_assert( __FILE__, __LINE__, skin >= 0, "Skin cannot be negative!" );
+}
+
+
+const csr_neigh_list &verlet_list::update( const block_data &b )
+{
+	last_rebuilt = needs_rebuild( b );
+	if( last_rebuilt ) build( b );
+	filter( b );
+	++updates;
+	return current;
+}
+
+
+bool verlet_list::needs_rebuild( const block_data &b ) const
+{
+	if( builds == 0 ) return true;
+	if( b.N != static_cast<bigint>( ref_id.size() ) ) return true;
+	if( b.dom.periodic != ref_periodic ) return true;
+	for( int d = 0; d < 3; ++d ){
+		if( b.dom.xlo[d] != ref_xlo[d] ) return true;
+		if( b.dom.xhi[d] != ref_xhi[d] ) return true;
+	}
+	if( b.dom.xy != ref_tilt[0] || b.dom.xz != ref_tilt[1]
+	    || b.dom.yz != ref_tilt[2] ){
+		return true;
+	}
+	if( get_id( b ) != ref_id ) return true;
+	if( ( itype || jtype ) && get_type( b ) != ref_type ) return true;
+
+	const std::vector<double> &x = get_x( b );
+	const std::vector<double> &y = get_y( b );
+	const std::vector<double> &z = get_z( b );
+
+	// Two atoms that both moved half the skin towards each other can
+	// just have come within rc.
+	double max_move2 = 0.25*skin*skin;
+	for( int i = 0; i < b.N; ++i ){
+		double xi[3]  = { x[i], y[i], dims == 3 ? z[i] : 0.0 };
+		double xi0[3] = { ref_x[i], ref_y[i], ref_z[i] };
+		double r[3];
+		if( b.dom.dist_2( xi, xi0, r ) > max_move2 ) return true;
+	}
+	return false;
+}
+
+
+void verlet_list::build( const block_data &b )
+{
+	make_csr_list_dist( skin_list, b, itype, jtype, dims, rc + skin, kind,
+	                    csr_neigh_list::NO_DATA, n_threads );
+
+	ref_id = get_id( b );
+	if( itype || jtype ) ref_type = get_type( b );
+	const std::vector<double> &x = get_x( b );
+	const std::vector<double> &y = get_y( b );
+	const std::vector<double> &z = get_z( b );
+	ref_x = x;
+	ref_y = y;
+	if( dims == 3 ){
+		ref_z = z;
+	}else{
+		ref_z.assign( b.N, 0.0 );
+	}
+	for( int d = 0; d < 3; ++d ){
+		ref_xlo[d] = b.dom.xlo[d];
+		ref_xhi[d] = b.dom.xhi[d];
+	}
+	ref_tilt[0] = b.dom.xy;
+	ref_tilt[1] = b.dom.xz;
+	ref_tilt[2] = b.dom.yz;
+	ref_periodic = b.dom.periodic;
+	++builds;
+}
+
+
+void verlet_list::filter( const block_data &b )
+{
+	const std::vector<double> &x = get_x( b );
+	const std::vector<double> &y = get_y( b );
+	const std::vector<double> &z = get_z( b );
+	const double rc2 = rc*rc;
+	const int N = b.N;
+
+	// Keep the squared distance of every pair in the skin list, or -1
+	// for the ones that are too far apart now.
+	std::vector<double> r2( skin_list.n_entries() );
+	std::vector<double> dr( stored & csr_neigh_list::DISPLACEMENTS
+	                        ? 3*r2.size() : 0 );
+	current.kind = kind;
+	current.stored = stored;
+	current.offsets.assign( N + 1, 0 );
+
+	int n_run = std::min<bigint>( n_threads,
+	                              1 + b.N / cell_list::min_thread_atoms );
+	auto atom_range = [N, n_run]( int t, int &begin, int &end ){
+		begin = static_cast<long long>( N ) * t / n_run;
+		end = static_cast<long long>( N ) * ( t + 1 ) / n_run;
+	};
+
+	util::run_on_threads( n_run, [&]( int t ){
+		int begin, end;
+		atom_range( t, begin, end );
+		for( int i = begin; i < end; ++i ){
+			double xi[3] = { x[i], y[i], dims == 3 ? z[i] : 0.0 };
+			std::size_t kept = 0;
+			for( std::size_t k = skin_list.offsets[i];
+			     k < skin_list.offsets[i+1]; ++k ){
+				int j = skin_list.indices[k];
+				double xj[3] = { x[j], y[j], dims == 3 ? z[j] : 0.0 };
+				double rij[3];
+				double rij2 = b.dom.dist_2( xj, xi, rij );
+				if( rij2 > rc2 ){
+					r2[k] = -1.0;
+					continue;
+				}
+				r2[k] = rij2;
+				if( !dr.empty() ){
+					std::copy( rij, rij + 3, dr.begin() + 3*k );
+				}
+				++kept;
+			}
+			current.offsets[i+1] = kept;
+		}
+	} );
+	for( int i = 0; i < N; ++i ){
+		current.offsets[i+1] += current.offsets[i];
+	}
+
+	std::size_t n_entries = current.offsets.back();
+	current.indices.resize( n_entries );
+	current.r.resize( stored & csr_neigh_list::DISTANCES ? n_entries : 0 );
+	current.dr.resize( dr.empty() ? 0 : 3*n_entries );
+
+	util::run_on_threads( n_run, [&]( int t ){
+		int begin, end;
+		atom_range( t, begin, end );
+		for( int i = begin; i < end; ++i ){
+			std::size_t to = current.offsets[i];
+			for( std::size_t k = skin_list.offsets[i];
+			     k < skin_list.offsets[i+1]; ++k ){
+				if( r2[k] < 0 ) continue;
+				current.indices[to] = skin_list.indices[k];
+				if( !current.r.empty() ){
+					current.r[to] = std::sqrt( r2[k] );
+				}
+				if( !current.dr.empty() ){
+					std::copy( dr.begin() + 3*k, dr.begin() + 3*k + 3,
+					           current.dr.begin() + 3*to );
+				}
+				++to;
+			}
+		}
+	} );
+}
+
+
+} // namespace neighborize
+
+} // namespace lammps_tools
@@ -0,0 +1,100 @@
+#ifndef NEIGHBORIZE_VERLET_HPP
+#define NEIGHBORIZE_VERLET_HPP
+
+/**
+   \file neighborize_verlet.hpp
+
+   Neighbour lists that are reused over consecutive frames.
+*/
+
+#include <vector>
+
+#include "block_data.hpp"
+#include "neighborize_csr.hpp"
+
+
+namespace lammps_tools {
+
+namespace neighborize {
+
+/**
+   \brief A neighbour list with a skin, that is kept between frames.
+
+   The list is built with a cut-off of rc + skin. As long as no atom
+   moved more than half the skin since then, every pair that is within
+   rc now was within rc + skin at the build, so the list for a new
+   frame follows from checking the distances of the pairs in it.
+
+   A rebuild also happens if the atoms are in a different order, if
+   their types changed or if the box changed. Dumps that are not sorted
+   by id (see dump_modify sort) are therefore rebuilt every frame.
+*/
+class verlet_list
+{
+public:
+	/**
+	   \param rc         Consider atoms less than this apart as neighbour.
+	   \param skin       Extra distance to build the list with.
+	   \param dims       Dimensions of the system (2 or 3).
+	   \param itype      Type of particle i to consider, 0 for all.
+	   \param jtype      Type of particle j to consider, 0 for all.
+	   \param kind       FULL or HALF, see csr_neigh_list::list_kinds.
+	   \param stored     What to store per entry, see
+	                     csr_neigh_list::pair_data.
+	   \param n_threads  Number of threads to use, 0 for all cores.
+	*/
+	verlet_list( double rc, double skin, int dims,
+	             int itype = 0, int jtype = 0,
+	             int kind = csr_neigh_list::FULL,
+	             int stored = csr_neigh_list::NO_DATA,
+	             int n_threads = 1 );
+
+	/**
+	   \brief Gets the neighbour list for a new frame.
+
+	   \param b  The block_data of the frame.
+
+	   \returns the pairs within rc in b. The reference stays valid
+	            until the next call.
+	*/
+	const csr_neigh_list &update( const block_data &b );
+
+	/// Returns the list of the last frame passed to update.
+	const csr_neigh_list &neighs() const { return current; }
+
+	/// Returns true if the last update rebuilt the list.
+	bool rebuilt() const { return last_rebuilt; }
+
+	/// Returns the number of times the list was built.
+	int n_builds() const { return builds; }
+
+	/// Returns the number of frames the list was updated for.
+	int n_updates() const { return updates; }
+
+private:
+	bool needs_rebuild( const block_data &b ) const;
+	void build( const block_data &b );
+	void filter( const block_data &b );
+
+	double rc, skin;
+	int dims, itype, jtype, kind, stored, n_threads;
+
+	csr_neigh_list skin_list; ///< Pairs within rc + skin at the build.
+	csr_neigh_list current;   ///< Pairs within rc in the last frame.
+
+	// State of the atoms at the build.
+	std::vector<int> ref_id, ref_type;
+	std::vector<double> ref_x, ref_y, ref_z;
+	double ref_xlo[3], ref_xhi[3], ref_tilt[3];
+	int ref_periodic;
+
+	bool last_rebuilt;
+	int builds, updates;
+};
+
+
+} // namespace neighborize
+
+} // namespace lammps_tools
+
+#endif // NEIGHBORIZE_VERLET_HPP
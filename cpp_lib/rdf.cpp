@@ -1,7 +1,10 @@
+#include <algorithm>
 #include <cmath>
 
 #include "block_data_access.hpp"
 #include "constants.hpp"
+#include "my_assert.hpp"
+#include "neighborize_cell.hpp"
 #include "rdf.hpp"
 
 
@@ -11,65 +14,20 @@ namespace neighborize {
 
 using lammps_tools::constants::pi;
 
-void compute_rdf( const block_data &b, int Nbins, double r0, double r1,
-                  int dims, int itype, int jtype,
-                  std::vector<double> &rdf, std::vector<double> &coord )
-{
-	neigh_list neighs;
-	make_list_dist( neighs, b, itype, jtype, DIST_BIN, dims, r1 );
-	compute_rdf_with_neighs( b, Nbins, r0, r1, dims, neighs, rdf, coord );
-}
-
 void test_indentation( double x )
 {
 	std::cerr << "poop!\n";
 }
 
-void compute_rdf_with_neighs( const block_data &b, int Nbins,
-                              double r0, double r1, int dims,
-                              const neigh_list &neighs,
-                              std::vector<double> &rdf,
-                              std::vector<double> &coord )
+namespace {
+
+// Normalises the histogram in rdf, with adds pairs in total, and
+// integrates it into coord.
+void normalise_rdf( const block_data &b, int Nbins, double r0, double r1,
+                    int dims, double adds, std::vector<double> &rdf,
+                    std::vector<double> &coord )
 {
-	rdf.resize( Nbins );
-	coord.resize( Nbins );
 	double dr = ( r1 - r0 ) / ( Nbins - 1 );
-	for( int i = 0; i < Nbins; ++i ){
-		rdf[i] = coord[i] = 0.0;
-	}
-
-	// TODO: Think of normalisation.
-	double total_neighs = 0.0;
-	for( std::size_t i = 0; i < neighs.size(); ++i ){
-		total_neighs += neighs[i].size();
-	}
-	// double avg_neighs = total_neighs / b.N;
-
-	const std::vector<double> &x = get_x( b );
-	const std::vector<double> &y = get_y( b );
-	const std::vector<double> &z = get_z( b );
-
-	double rc2 = r1*r1;
-	int adds = 0;
-
-	for( std::size_t i = 0; i < neighs.size(); ++i ){
-		const std::vector<int> &ni = neighs[i];
-		for( int j : ni ){
-			double xi[3] = { x[i], y[i], z[i] };
-			double xj[3] = { x[j], y[j], z[j] };
-
-			double r[3];
-			double r2 = b.dom.dist_2( xi, xj, r );
-			if( r2 > rc2 ) continue;
-
-			double rr = std::sqrt( r2 );
-			int bini = ( rr - r0 ) / dr;
-			if( bini < 0 || bini >= Nbins ) continue;
-
-			rdf[bini] += 1.0;
-			++adds;
-		}
-	}
 
 	double Lx = b.dom.xhi[0] - b.dom.xlo[0];
 	double Ly = b.dom.xhi[1] - b.dom.xlo[1];
@@ -103,59 +61,177 @@ void compute_rdf_with_neighs( const block_data &b, int Nbins,
 		}
 		rdf[bin] /= adds;
 	}
+}
 
-	std::ofstream out("rdf_test.dat");
-	for( int bin = 0; bin < Nbins; ++bin ){
-		out << bin << " " << r0 + dr*bin << " " << rdf[bin]
-		    << " " << coord[bin] << "\n";
+
+// Histograms the pairs in neighs, each counted w times. The squared
+// distance of the m-th neighbour j of atom i is dist_2( i, m, j ).
+template <typename list_type, typename dist_func>
+void rdf_from_list( const block_data &b, int Nbins, double r0, double r1,
+                    int dims, const list_type &neighs, double w,
+                    const dist_func &dist_2,
+                    std::vector<double> &rdf, std::vector<double> &coord )
+{
+	rdf.assign( Nbins, 0.0 );
+	coord.assign( Nbins, 0.0 );
+	double dr = ( r1 - r0 ) / ( Nbins - 1 );
+
+	// TODO: Think of normalisation.
+	double rc2 = r1*r1;
+	double adds = 0;
+
+	for( int i = 0; i < static_cast<int>( neighs.size() ); ++i ){
+		std::size_t m = 0;
+		for( int j : neighs[i] ){
+			double r2 = dist_2( i, m++, j );
+			if( r2 > rc2 ) continue;
+
+			double rr = std::sqrt( r2 );
+			if( rr < r0 ) continue;
+			int bini = ( rr - r0 ) / dr;
+			if( bini >= Nbins ) continue;
+
+			rdf[bini] += w;
+			adds += w;
+		}
 	}
+	normalise_rdf( b, Nbins, r0, r1, dims, adds, rdf, coord );
 }
 
 
-std::vector<double> rdf( const block_data &b, int Nbins, double r0, double r1,
-                         int dims, int itype, int jtype )
+// Pair visitor that histograms the distances, per pair of types if
+// type is set. Pairs closer than r0 or in no bin are dropped.
+struct pair_histogram
 {
-	std::vector<double> rrdf( Nbins );
+	pair_histogram( int Nbins, double r0, double dr, const int *type,
+	                int stride, int n_pairs )
+		: Nbins( Nbins ), r0( r0 ), dr( dr ), type( type ),
+		  stride( stride ), counts( n_pairs*Nbins, 0.0 )
+	{}
+
+	void operator()( int i, int j, double r2, double, double, double )
+	{
+		double rr = std::sqrt( r2 );
+		if( rr < r0 ) return;
+		int bini = ( rr - r0 ) / dr;
+		if( bini >= Nbins ) return;
+		int pair = type ? type[i]*stride + type[j] : 0;
+		counts[ pair*Nbins + bini ] += 1.0;
+	}
 
-	double dr = ( r1 - r0 ) / ( Nbins - 1 );
-	for( int i = 0; i < Nbins; ++i ){
-		rrdf[i] = 0.0;
+	int Nbins;
+	double r0, dr;
+	const int *type;
+	int stride;
+	std::vector<double> counts;
+};
+
+
+// Histograms the pairs of s1 and s2 within r1 in one pass over a cell
+// list, and sums the histograms of all threads.
+std::vector<double> histogram_pairs( const block_data &b,
+                                     const std::vector<int> &s1,
+                                     const std::vector<int> &s2, int dims,
+                                     double r1, const pair_histogram &proto,
+                                     int n_threads )
+{
+	std::vector<pair_histogram> visitors( resolve_threads( n_threads ),
+	                                      proto );
+	if( !s1.empty() && !s2.empty() ){
+		visit_pairs( b, s1, s2, dims, r1, visitors );
 	}
 
-	neigh_list neighs;
-	make_list_dist( neighs, b, itype, jtype, DIST_BIN, dims, r1 );
+	std::vector<double> counts( proto.counts.size(), 0.0 );
+	for( const pair_histogram &h : visitors ){
+		for( std::size_t k = 0; k < counts.size(); ++k ){
+			counts[k] += h.counts[k];
+		}
+	}
+	return counts;
+}
 
-	// TODO: Think of normalisation.
-	double total_neighs = 0.0;
-	for( std::size_t i = 0; i < neighs.size(); ++i ){
-		total_neighs += neighs[i].size();
+
+// Indices of the atoms of type t, or all if t is 0.
+std::vector<int> atoms_of_type( const block_data &b, int t )
+{
+	const std::vector<int> &type = get_type( b );
+	std::vector<int> atoms;
+	atoms.reserve( t ? 0 : b.N );
+	for( int i = 0; i < b.N; ++i ){
+		if( !t || type[i] == t ) atoms.push_back( i );
 	}
+	return atoms;
+}
+
+} // namespace
+
+
+void compute_rdf( const block_data &b, int Nbins, double r0, double r1,
+                  int dims, int itype, int jtype,
+                  std::vector<double> &rdf, std::vector<double> &coord,
+                  int n_threads )
+{
+	double dr = ( r1 - r0 ) / ( Nbins - 1 );
+	pair_histogram proto( Nbins, r0, dr, nullptr, 0, 1 );
+	rdf = histogram_pairs( b, atoms_of_type( b, itype ),
+	                       atoms_of_type( b, jtype ), dims, r1, proto,
+	                       n_threads );
+	coord.assign( Nbins, 0.0 );
+
+	double adds = 0.0;
+	for( double c : rdf ) adds += c;
+	normalise_rdf( b, Nbins, r0, r1, dims, adds, rdf, coord );
+}
+
 
+void compute_rdf_with_neighs( const block_data &b, int Nbins,
+                              double r0, double r1, int dims,
+                              const neigh_list &neighs,
+                              std::vector<double> &rdf,
+                              std::vector<double> &coord )
+{
 	const std::vector<double> &x = get_x( b );
 	const std::vector<double> &y = get_y( b );
 	const std::vector<double> &z = get_z( b );
 
-	double rc2 = r1*r1;
-	int adds = 0;
+	auto dist_2 = [&]( int i, std::size_t m, int j ){
+		double xi[3] = { x[i], y[i], z[i] };
+		double xj[3] = { x[j], y[j], z[j] };
+		double r[3];
+		return b.dom.dist_2( xi, xj, r );
+	};
+	rdf_from_list( b, Nbins, r0, r1, dims, neighs, 1.0, dist_2, rdf, coord );
+}
 
-	for( std::size_t i = 0; i < neighs.size(); ++i ){
-		const std::vector<int> &ni = neighs[i];
-		for( int j : ni ){
-			double xi[3] = { x[i], y[i], z[i] };
-			double xj[3] = { x[j], y[j], z[j] };
 
-			double r[3];
-			double r2 = b.dom.dist_2( xi, xj, r );
-			if( r2 > rc2 ) continue;
+void compute_rdf_with_neighs( const block_data &b, int Nbins,
+                              double r0, double r1, int dims,
+                              const csr_neigh_list &neighs,
+                              std::vector<double> &rdf,
+                              std::vector<double> &coord )
+{
+	// Half lists have each pair once, full lists twice.
+	double w = neighs.is_half() ? 2.0 : 1.0;
+	auto dist_2 = [&]( int i, std::size_t m, int j ){
+		return neighs.dist_2( b, i, neighs.offsets[i] + m );
+	};
+	rdf_from_list( b, Nbins, r0, r1, dims, neighs, w, dist_2, rdf, coord );
+}
 
-			double rr = std::sqrt( r2 );
-			int bini = ( rr - r0 ) / dr;
-			if( bini < 0 || bini >= Nbins ) continue;
 
-			rrdf[bini] += 1.0;
-			++adds;
-		}
-	}
+std::vector<double> rdf( const block_data &b, int Nbins, double r0, double r1,
+                         int dims, int itype, int jtype )
+{
+	std::vector<double> rrdf;
+	double dr = ( r1 - r0 ) / ( Nbins - 1 );
+
+	pair_histogram proto( Nbins, r0, dr, nullptr, 0, 1 );
+	rrdf = histogram_pairs( b, atoms_of_type( b, itype ),
+	                        atoms_of_type( b, jtype ), dims, r1, proto, 1 );
+
+	// TODO: Think of normalisation.
+	double adds = 0;
+	for( double c : rrdf ) adds += c;
 
 	double Lx = b.dom.xhi[0] - b.dom.xlo[0];
 	double Ly = b.dom.xhi[1] - b.dom.xlo[1];
@@ -230,6 +306,151 @@ std::vector<double> coord( const block_data &b, double r0, double r1, int dims,
 }
 
 
+rdf_accumulator::rdf_accumulator( int Nbins, double r0, double r1, int dims,
+                                  int n_threads )
+	: Nbins( Nbins ), r0( r0 ), r1( r1 ), dr( ( r1 - r0 ) / Nbins ),
+	  dims( dims ), n_threads( n_threads ), frames( 0 ), max_type( 0 ),
+	  counts(), pair_density(), n_centres()
+{
+	my_assert( __FILE__, __LINE__, Nbins > 0, "Need at least one bin!" );
+	my_assert( __FILE__, __LINE__, r1 > r0 && r0 >= 0,
+	           "Need 0 <= r0 < r1!" );
+}
+
+
+void rdf_accumulator::clear()
+{
+	frames = 0;
+	max_type = 0;
+	counts.clear();
+	pair_density.clear();
+	n_centres.clear();
+}
+
+
+void rdf_accumulator::grow_types( int n )
+{
+	if( n <= max_type ) return;
+
+	// Move the sums to their place in the bigger table.
+	int old_stride = max_type + 1;
+	int stride = n + 1;
+	std::vector<std::vector<double> > new_counts( stride*stride );
+	std::vector<double> new_density( stride*stride, 0.0 );
+	for( int a = 1; a <= n; ++a ){
+		for( int c = 1; c <= n; ++c ){
+			int p = a*stride + c;
+			if( a <= max_type && c <= max_type ){
+				int q = a*old_stride + c;
+				new_counts[p].swap( counts[q] );
+				new_density[p] = pair_density[q];
+			}else{
+				new_counts[p].assign( Nbins, 0.0 );
+			}
+		}
+	}
+	counts.swap( new_counts );
+	pair_density.swap( new_density );
+	n_centres.resize( stride, 0.0 );
+	max_type = n;
+}
+
+
+void rdf_accumulator::add_frame( const block_data &b )
+{
+	const std::vector<int> &type = get_type( b );
+	int n_types = 0;
+	for( int t : type ) n_types = std::max( n_types, t );
+	grow_types( n_types );
+	int stride = max_type + 1;
+
+	std::vector<int> all_atoms( b.N );
+	std::vector<double> n_of_type( stride, 0.0 );
+	for( int i = 0; i < b.N; ++i ){
+		all_atoms[i] = i;
+		my_assert( __FILE__, __LINE__, type[i] > 0,
+		           "Atom types should be positive!" );
+		n_of_type[ type[i] ] += 1.0;
+	}
+
+	pair_histogram proto( Nbins, r0, dr, type.data(), stride,
+	                      stride*stride );
+	std::vector<double> frame = histogram_pairs( b, all_atoms, all_atoms,
+	                                             dims, r1, proto, n_threads );
+
+	double V = 1.0;
+	for( int d = 0; d < dims; ++d ) V *= b.dom.xhi[d] - b.dom.xlo[d];
+	for( int a = 1; a < stride; ++a ){
+		n_centres[a] += n_of_type[a];
+		for( int c = 1; c < stride; ++c ){
+			int p = a*stride + c;
+			const double *h = frame.data() + p*Nbins;
+			for( int k = 0; k < Nbins; ++k ) counts[p][k] += h[k];
+			double n_pairs = n_of_type[a]*( n_of_type[c] - ( a == c ) );
+			pair_density[p] += n_pairs / V;
+		}
+	}
+	++frames;
+}
+
+
+double rdf_accumulator::shell_volume( int k ) const
+{
+	double ra = r0 + k*dr;
+	double rb = ra + dr;
+	if( dims == 2 ) return pi*( rb*rb - ra*ra );
+	return 4.0*pi/3.0*( rb*rb*rb - ra*ra*ra );
+}
+
+
+std::vector<double> rdf_accumulator::rdf( int itype, int jtype ) const
+{
+	my_assert( __FILE__, __LINE__, itype >= 0 && itype <= max_type &&
+	           jtype >= 0 && jtype <= max_type, "Type out of range!" );
+	int stride = max_type + 1;
+	std::vector<double> g( Nbins, 0.0 );
+	double density = 0.0;
+	for( int a = 1; a <= max_type; ++a ){
+		if( itype && a != itype ) continue;
+		for( int c = 1; c <= max_type; ++c ){
+			if( jtype && c != jtype ) continue;
+			int p = a*stride + c;
+			for( int k = 0; k < Nbins; ++k ) g[k] += counts[p][k];
+			density += pair_density[p];
+		}
+	}
+	if( density <= 0 ) return g;
+	for( int k = 0; k < Nbins; ++k ){
+		g[k] /= density*shell_volume( k );
+	}
+	return g;
+}
+
+
+std::vector<double> rdf_accumulator::coord( int itype, int jtype ) const
+{
+	my_assert( __FILE__, __LINE__, itype >= 0 && itype <= max_type &&
+	           jtype >= 0 && jtype <= max_type, "Type out of range!" );
+	int stride = max_type + 1;
+	std::vector<double> n( Nbins, 0.0 );
+	double centres = 0.0;
+	for( int a = 1; a <= max_type; ++a ){
+		if( itype && a != itype ) continue;
+		centres += n_centres[a];
+		for( int c = 1; c <= max_type; ++c ){
+			if( jtype && c != jtype ) continue;
+			int p = a*stride + c;
+			for( int k = 0; k < Nbins; ++k ) n[k] += counts[p][k];
+		}
+	}
+	for( int k = 1; k < Nbins; ++k ) n[k] += n[k-1];
+	if( centres > 0 ){
+		for( double &nk : n ) nk /= centres;
+	}
+	return n;
+}
+
+
 } // namespace lammps_tools
 
 } // namespace neighborize
@@ -11,6 +11,7 @@
 
 #include "block_data.hpp"
 #include "neighborize.hpp"
+#include "neighborize_csr.hpp"
 
 namespace lammps_tools {
 
@@ -29,13 +30,21 @@ namespace neighborize {
    \param[out] rdf    Will contain the rdf
    \param[out] coord  Will contain the coordination (integral of rdf)
 
-   \note This function constructs an internal neighbour list. If a
-   neighbour list that ranges to at least r1 is available, consider
-   calling compute_rdf_with_neighs for efficiency.
+   \param[in]  n_threads  Number of threads to use, 0 for all cores.
+
+   \note The distances are histogrammed straight from a cell list,
+   without building a neighbour list. For many frames, rdf_accumulator
+   gets all type pairs in one go.
+
+   \warning Bin k starts at r0 + k*dr with dr = (r1 - r0)/(Nbins - 1),
+   so the last bin starts at r1 and stays empty. This differs
+   from rdf_accumulator, which uses dr = (r1 - r0)/Nbins. Compare the
+   two with their own bin positions, not by index.
 */
 void compute_rdf( const block_data &b, int Nbins, double r0, double r1,
                   int dims, int itype, int jtype,
-                  std::vector<double> &rdf, std::vector<double> &coord );
+                  std::vector<double> &rdf, std::vector<double> &coord,
+                  int n_threads = 1 );
 
 /**
    \brief Calculate g(r) for itype with respect to jtype.
@@ -55,6 +64,24 @@ void compute_rdf_with_neighs( const block_data &b, int Nbins,
                               std::vector<double> &rdf,
                               std::vector<double> &coord );
 
+/**
+   \brief Calculate g(r) from a CSR neighbour list.
+
+   Stored distances are used if the list has them.
+
+   \overload compute_rdf_with_neighs
+*/
+void compute_rdf_with_neighs( const block_data &b, int Nbins,
+                              double r0, double r1, int dims,
+                              const csr_neigh_list &neighs,
+                              std::vector<double> &rdf,
+                              std::vector<double> &coord );
+
+/**
+   \brief Returns g(r) of jtype around itype.
+
+   Bins as compute_rdf does, with dr = (r1 - r0)/(Nbins - 1).
+*/
 std::vector<double> rdf( const block_data &b, int Nbins, double r0, double r1,
                          int dims, int itype, int jtype );
 
@@ -62,6 +89,84 @@ std::vector<double> coord( const block_data &b, double r0, double r1, int dims,
                            const std::vector<double> &rrdf );
 
 
+/**
+   \brief Accumulates the partial pair distribution functions g_ab(r) of
+          all type pairs over many frames.
+
+   Each frame is histogrammed in one pass over a cell list, with one
+   histogram per thread, and no neighbour list is built. The counts and
+   the pair densities of all frames are summed, so the result is the
+   average over frames even if the number of atoms or the box changes.
+
+   Bin k covers [ r0 + k*dr, r0 + (k+1)*dr ) with dr = (r1 - r0)/Nbins,
+   so the bins end exactly at r1. Note that compute_rdf and rdf use
+   dr = (r1 - r0)/(Nbins - 1) instead; use r( k ) for the bin positions.
+*/
+class rdf_accumulator
+{
+public:
+	/**
+	   \param Nbins      Number of bins.
+	   \param r0         Lower cutoff for distance.
+	   \param r1         Upper cutoff for distance.
+	   \param dims       Dimensions of the system (2 or 3).
+	   \param n_threads  Number of threads to use, 0 for all cores.
+	*/
+	rdf_accumulator( int Nbins, double r0, double r1, int dims,
+	                 int n_threads = 1 );
+
+	/// Adds the pairs of frame b to the histograms.
+	void add_frame( const block_data &b );
+
+	/// Forgets all frames added so far.
+	void clear();
+
+	/// Returns the number of frames added.
+	int n_frames() const { return frames; }
+
+	/// Returns the highest atom type seen.
+	int n_types() const { return max_type; }
+
+	/// Returns the distance of the centre of bin k.
+	double r( int k ) const { return r0 + ( k + 0.5 )*dr; }
+
+	/**
+	   \brief Gets the average g(r) of jtype around itype.
+
+	   \param itype  Type of the central atoms, 0 for all.
+	   \param jtype  Type of the atoms around them, 0 for all.
+	*/
+	std::vector<double> rdf( int itype, int jtype ) const;
+
+	/**
+	   \brief Gets the average number of jtype atoms within r of an
+	          itype atom, at the upper edge of each bin.
+
+	   \param itype  Type of the central atoms, 0 for all.
+	   \param jtype  Type of the atoms around them, 0 for all.
+	*/
+	std::vector<double> coord( int itype, int jtype ) const;
+
+private:
+	void grow_types( int n );
+	double shell_volume( int k ) const;
+
+	int Nbins;
+	double r0, r1, dr;
+	int dims, n_threads;
+
+	int frames;
+	int max_type;
+	/// Pair counts of types a and b, as counts[ a*(max_type+1) + b ],
+	/// where type 0 counts all atoms.
+	std::vector<std::vector<double> > counts;
+	/// Sum over frames of N_a*N_b/V, the pairs per volume.
+	std::vector<double> pair_density;
+	/// Sum over frames of N_a, to normalise coord.
+	std::vector<double> n_centres;
+};
+
+
 
 
 
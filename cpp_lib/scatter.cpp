@@ -3,46 +3,46 @@
 #include "id_map.hpp"
 #include "scatter.hpp"
 #include "fast_math.hpp"
+#include "my_assert.hpp"
+#include "neighborize_cell.hpp"
+#include "util.hpp"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <string>
 #include <vector>
 
 namespace lammps_tools {
 
 namespace scatter {
 
-constexpr const bool use_lut = true;
-//constexpr const bool use_lut = false;
+namespace {
+
+// Atoms done together, so their projections stay in cache over all q.
+const std::size_t block_atoms = 1024;
 
 
 inline double bessel_j1( double x )
 {
 	double inv_x  = 1.0/x;
-	if( use_lut ){
-		double s, c;
-		// sincos.sincos( x, s, c );
-		fast_math::sincos( x, s, c );
-		return inv_x * ( s * inv_x - c );
-	}else{
-		double s = std::sin(x);
-		double c = std::cos(x);
-		return inv_x * ( s * inv_x - c );
-	}
+	double s = std::sin(x);
+	double c = std::cos(x);
+	return inv_x * ( s * inv_x - c );
 }
 
 
-void get_position( const block_data &b, int idx, double ri[3], double scale )
+// Form factor of a sphere, R^3 j1( qR ) / qR, which is R^3 / 3 at q = 0.
+double sphere_form_factor( double q, double R )
 {
-	double xx = get_x(b)[idx];
-	double yy = get_y(b)[idx];
-	double zz = get_z(b)[idx];
-
-	ri[0] = xx*scale;
-	ri[1] = yy*scale;
-	ri[2] = zz*scale;
+	double R3 = R*R*R;
+	double qR = q*R;
+	if( std::fabs( qR ) < 1e-4 ) return R3 * ( 1.0/3.0 - qR*qR/30.0 );
+	return R3 * bessel_j1( qR ) / qR;
 }
 
+} // namespace
+
 
 std::vector<double> rayleigh_gans( const class block_data &b,
                                    const std::vector<double> &qs,
@@ -59,60 +59,140 @@ std::vector<double> rayleigh_gans( const class block_data &b,
                                    double position_scale, double d_epsilon0,
                                    const std::vector<int> &ids )
 {
-	// In units of micrometers:
-	id_map im( get_id( b ) );
+	// Assume detector is far away, and at 90 degrees from box.
+	std::vector<double> n = { 0.0, 1.0, 0.0 };
+	return rayleigh_gans( b, qs, radius, position_scale, d_epsilon0, ids, n );
+}
 
-	double d_epsilon_02 = d_epsilon0 * d_epsilon0;
+
+std::vector<double> rayleigh_gans( const class block_data &b,
+                                   const std::vector<double> &qs,
+                                   const std::vector<double> &radius,
+                                   double position_scale, double d_epsilon0,
+                                   const std::vector<int> &ids,
+                                   const std::vector<double> &detectors,
+                                   int n_threads )
+{
+	my_assert( __FILE__, __LINE__,
+	           !detectors.empty() && detectors.size() % 3 == 0,
+	           "Need three components per detector!" );
+	my_assert( __FILE__, __LINE__,
+	           radius.size() >= static_cast<std::size_t>( b.N ),
+	           "Need a radius for each atom!" );
+	n_threads = neighborize::resolve_threads( n_threads );
 
 	std::size_t Nqs = qs.size();
-	std::vector<double> FXre( Nqs, 0.0 );
-	std::vector<double> FXim( Nqs, 0.0 );
-	std::vector<double> Iq  ( Nqs, 0.0 );
+	std::size_t n_det = detectors.size() / 3;
+	std::size_t N = ids.size();
 
-	// Assume detector is far away, and at 90 degrees from box.
-	double n [3] = { 0.0, 1.0, 0.0 };
+	// Directions of the scattering vectors, with the light along x.
+	std::vector<double> qdir( 3*n_det );
 	double n0[3] = { 1.0, 0.0, 0.0 };
-	// Wave vector for 500nm in 1 / micrometers
-	double qdir[3] = { n[0] - n0[0], n[1] - n0[1], n[2] - n0[2] };
-	double inv_n = 1.0 / std::sqrt( util::norm2<3>( qdir ) );
-	qdir[0] *= inv_n;
-	qdir[1] *= inv_n;
-	qdir[2] *= inv_n;
-
-
-	for( int idi : ids ){
-		int idx = im[ idi ];
-		double Ri = radius[idx];
-		double Ri2 = Ri*Ri;
-		double Ri3 = Ri2*Ri;
-		// You need to convert the positions somewhow!
-		double ri[3];
-		get_position( b, idx, ri, position_scale );
-
-		std::size_t bin = 0;
-		for( double q : qs ){
-			double qq[3] = { q*qdir[0], q*qdir[1], q*qdir[2] };
-			double qRi = q * Ri;
-			double FFq = Ri3 * bessel_j1( qRi ) / qRi;
-			double qdotr = util::dot<3>( qq, ri );
-			double exp_part_real, exp_part_imag;
-			if( use_lut ){
-				fast_math::sincos( -qdotr,
-				                   exp_part_imag,
-				                   exp_part_real );
-			}else{
-				exp_part_real = std::cos( -qdotr );
-				exp_part_imag = std::sin( -qdotr );
-			}
+	for( std::size_t k = 0; k < n_det; ++k ){
+		const double *n = detectors.data() + 3*k;
+		double inv_n = 1.0 / std::sqrt( util::norm2<3>( n ) );
+		double *qd = qdir.data() + 3*k;
+		for( int d = 0; d < 3; ++d ) qd[d] = n[d]*inv_n - n0[d];
+		double norm = std::sqrt( util::norm2<3>( qd ) );
+		my_assert( __FILE__, __LINE__, norm > 1e-12,
+		           "Detector cannot be in the direction of the light!" );
+		for( int d = 0; d < 3; ++d ) qd[d] /= norm;
+	}
 
-			FXre[bin] += FFq * exp_part_real;
-			FXim[bin] += FFq * exp_part_imag;
-			++bin;
+	// Sort the atoms on radius, so that runs of them share a form factor.
+	const std::vector<int> &id = get_id( b );
+	id_map im( id );
+	std::vector<int> idx( N );
+	for( std::size_t s = 0; s < N; ++s ){
+		std::size_t idi = ids[s];
+		int i = idi < im.size() ? im[idi] : -1;
+		if( i < 0 || id[i] != ids[s] ){
+			my_runtime_error( __FILE__, __LINE__,
+			                  "Atom with id " + std::to_string( idi )
+			                  + " is not in block!" );
 		}
+		idx[s] = i;
+	}
+	std::stable_sort( idx.begin(), idx.end(),
+	                  [&radius]( int i, int j ){ return radius[i] < radius[j]; } );
+
+	std::vector<std::size_t> run_start;
+	for( std::size_t s = 0; s < N; ++s ){
+		if( s > 0 && radius[ idx[s] ] == radius[ idx[s-1] ] ) continue;
+		run_start.push_back( s );
 	}
+	run_start.push_back( N );
+
+	// Positions projected on the scattering directions, per detector.
+	const std::vector<double> &x = get_x(b);
+	const std::vector<double> &y = get_y(b);
+	const std::vector<double> &z = get_z(b);
+	std::vector<double> proj( n_det * N );
+	for( std::size_t s = 0; s < N; ++s ){
+		int i = idx[s];
+		double ri[3] = { x[i]*position_scale, y[i]*position_scale,
+		                 z[i]*position_scale };
+		for( std::size_t k = 0; k < n_det; ++k ){
+			proj[k*N + s] = util::dot<3>( qdir.data() + 3*k, ri );
+		}
+	}
+
+	// Sums of F(q) exp( -i q.r ) per thread, real and imaginary part
+	// after each other.
+	int n_run = std::max<std::size_t>( 1, std::min<std::size_t>( n_threads,
+	                                                             N / 32 ) );
+	std::vector<std::vector<double> > sums(
+		n_run, std::vector<double>( 2 * n_det * Nqs, 0.0 ) );
+
+	util::run_on_threads( n_run, [&]( int t ){
+		std::vector<double> &acc = sums[t];
+		std::size_t begin = N * t / n_run, end = N * ( t + 1 ) / n_run;
+		if( begin == end ) return;
+
+		// Form factors of the current run, so only Nqs per thread are kept
+		// even if every atom has its own radius.
+		std::vector<double> ff( Nqs );
+		std::size_t r = std::upper_bound( run_start.begin(), run_start.end(),
+		                                  begin ) - run_start.begin() - 1;
+		for( ; run_start[r] < end; ++r ){
+			std::size_t r0 = std::max( begin, run_start[r] );
+			std::size_t r1 = std::min( end, run_start[r+1] );
+			double R = radius[ idx[r0] ];
+			for( std::size_t iq = 0; iq < Nqs; ++iq ){
+				ff[iq] = sphere_form_factor( qs[iq], R );
+			}
+			for( std::size_t b0 = r0; b0 < r1; b0 += block_atoms ){
+				std::size_t b1 = std::min( b0 + block_atoms, r1 );
+				for( std::size_t k = 0; k < n_det; ++k ){
+					const double *p = proj.data() + k*N;
+					double *re = acc.data() + 2*k*Nqs;
+					for( std::size_t iq = 0; iq < Nqs; ++iq ){
+						double q = qs[iq];
+						double sum_c = 0.0, sum_s = 0.0;
+						for( std::size_t s = b0; s < b1; ++s ){
+							double sn, cs;
+							fast_math::sincos_poly( q*p[s], sn, cs );
+							sum_c += cs;
+							sum_s += sn;
+						}
+						re[2*iq]     += ff[iq] * sum_c;
+						re[2*iq + 1] -= ff[iq] * sum_s;
+					}
+				}
+			}
+		}
+	} );
+
 	// Determine intensity:
+	double d_epsilon_02 = d_epsilon0 * d_epsilon0;
+	std::vector<double> Iq( n_det * Nqs, 0.0 );
 	for( std::size_t i = 0; i < Iq.size(); ++i ){
-		double abs_val_square = FXre[i]*FXre[i] + FXim[i]*FXim[i];
+		double FXre = 0.0, FXim = 0.0;
+		for( const std::vector<double> &acc : sums ){
+			FXre += acc[2*i];
+			FXim += acc[2*i + 1];
+		}
+		double abs_val_square = FXre*FXre + FXim*FXim;
 		Iq[i] = d_epsilon_02 * abs_val_square;
 	}
 	return Iq;
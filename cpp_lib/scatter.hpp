@@ -28,6 +28,36 @@ std::vector<double> rayleigh_gans( const block_data &b,
                                    double position_scale, double d_epsilon0,
                                    const std::vector<int> &ids );
 
+/**
+   \brief Calculates Raygleigh-Gans scattering data for several detectors.
+
+   The incoming light travels along x, and the detectors are far away,
+   so for a detector in direction n the scattering vectors point along
+   n - (1,0,0). The versions above use one detector along y.
+
+   The form factor of a sphere only depends on q and its radius, so it
+   is computed once for each distinct radius. The atoms are divided
+   over the threads, which each keep their own sums.
+
+   \param b               The block_data to scatter off.
+   \param qs              Lengths of the scattering vectors.
+   \param radius          Radius of each atom, by index.
+   \param position_scale  Factor to convert positions to units of 1/q.
+   \param d_epsilon0      Contrast of the dielectric constant.
+   \param ids             Ids of the atoms that scatter.
+   \param detectors       Directions of the detectors, three per detector.
+   \param n_threads       Number of threads to use, 0 for all cores.
+
+   \returns the intensity at q index iq for detector k at k*qs.size() + iq.
+*/
+std::vector<double> rayleigh_gans( const block_data &b,
+                                   const std::vector<double> &qs,
+                                   const std::vector<double> &radius,
+                                   double position_scale, double d_epsilon0,
+                                   const std::vector<int> &ids,
+                                   const std::vector<double> &detectors,
+                                   int n_threads = 1 );
+
 // Ugly crap for pybind11:
 inline
 std::vector<double> rayleigh_gans_( const block_data &b,
@@ -37,6 +67,18 @@ std::vector<double> rayleigh_gans_( const block_data &b,
                                     const std::vector<int> &ids )
 { return rayleigh_gans( b, qs, radius, position_scale, d_epsilon0, ids); }
 
+inline
+std::vector<double> rayleigh_gans_detectors_( const block_data &b,
+                                              const std::vector<double> &qs,
+                                              const std::vector<double> &radius,
+                                              double position_scale,
+                                              double d_epsilon0,
+                                              const std::vector<int> &ids,
+                                              const std::vector<double> &detectors,
+                                              int n_threads )
+{ return rayleigh_gans( b, qs, radius, position_scale, d_epsilon0, ids,
+                        detectors, n_threads ); }
+
 
 
 } // namespace scatter
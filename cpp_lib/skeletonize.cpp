@@ -2,6 +2,9 @@
 #include "skeletonize.hpp"
 #include "triangulate.hpp"
 #include "neighborize.hpp"
+#include "neighborize_csr.hpp"
+#include "neighborize_kd_tree.hpp"
+#include "my_assert.hpp"
 #include <cmath>
 #include <array>
 
@@ -64,8 +67,9 @@ double sphere_dist( const double *xi, const double *xj, double R )
 
 
 
-std::vector<double> get_insideness( const class block_data &b,
-                                    const neighborize::neigh_list &neighs )
+template <typename list_type>
+std::vector<double> insideness_of( const block_data &b,
+                                   const list_type &neighs )
 {
 
 	std::vector<double> insideness( b.N );
@@ -96,9 +100,8 @@ std::vector<double> get_insideness( const class block_data &b,
 				continue;
 			}
 
-			const std::vector<int> &ni = neighs[i];
 			bool has_current_val = false;
-			for( int idx : ni ){
+			for( int idx : neighs[i] ){
 				if( insideness[idx] == current_val ){
 					has_current_val = true;
 					break;
@@ -120,6 +123,22 @@ std::vector<double> get_insideness( const class block_data &b,
 }
 
 
+std::vector<double> get_insideness( const class block_data &b,
+                                    const neighborize::neigh_list &neighs )
+{
+	return insideness_of( b, neighs );
+}
+
+
+std::vector<double> get_insideness( const class block_data &b,
+                                    const neighborize::csr_neigh_list &neighs )
+{
+	my_assert( __FILE__, __LINE__, !neighs.is_half(),
+	           "Insideness needs a full neighbour list!" );
+	return insideness_of( b, neighs );
+}
+
+
 void get_edge( const block_data &b, const std::vector<double> &insideness,
                std::list<int> &edge )
 {
@@ -146,6 +165,16 @@ std::vector<double> euclidian_distance_transform( const class block_data &b,
 	const std::vector<double> &z = data_as<double>(
 		b.get_special_field( block_data::Z ) );
 
+	// The points are on a sphere of radius R, so the closest edge point
+	// along the sphere is also the closest one in space.
+	std::vector<double> ex, ey, ez;
+	for( int j : edge ){
+		ex.push_back( x[j] );
+		ey.push_back( y[j] );
+		ez.push_back( z[j] );
+	}
+	neighborize::kd_tree edge_tree( ex, ey, ez, 3 );
+
 	for( int i = 0; i < b.N; ++i ){
 		if( insideness[i] == 0 ){
 			edt[i] = 0.0;
@@ -159,12 +188,10 @@ std::vector<double> euclidian_distance_transform( const class block_data &b,
 			double min_dist = 16*R;
 
 			// Find the closest edge:
-			for( int j : edge ){
-				double xx[3];
-				xx[0] = x[j];
-				xx[1] = y[j];
-				xx[2] = z[j];
-				double dot = xi[0]*xx[0] + xi[1]*xx[1] + xi[2]*xx[2];
+			double r2;
+			int j = edge_tree.nearest( xi, r2 );
+			if( j >= 0 ){
+				double dot = xi[0]*ex[j] + xi[1]*ey[j] + xi[2]*ez[j];
 				double theta = std::acos( dot / R2 );
 				min_dist = std::min( min_dist, theta*R );
 			}
@@ -177,13 +204,14 @@ std::vector<double> euclidian_distance_transform( const class block_data &b,
 
 
 
-void get_local_maxima( const std::vector<std::vector<int> > & neighs,
-                       const std::vector<double> &field,
-                       std::vector<int> &max_indices,
-                       std::function< double(double) > f )
+template <typename list_type>
+void local_maxima_of( const list_type &neighs,
+                      const std::vector<double> &field,
+                      std::vector<int> &max_indices,
+                      const std::function< double(double) > &f )
 {
 	// d_out << "Indices of maxima:";
-	for( std::size_t idx = 0; idx < neighs.size(); ++idx ){
+	for( int idx = 0; idx < static_cast<int>( neighs.size() ); ++idx ){
 		double vi = f( field[idx] );
 		bool largest = true;
 		for( std::size_t idj : neighs[idx] ){
@@ -203,6 +231,14 @@ void get_local_maxima( const std::vector<std::vector<int> > & neighs,
 	// d_out << "\n";
 }
 
+void get_local_maxima( const std::vector<std::vector<int> > & neighs,
+                       const std::vector<double> &field,
+                       std::vector<int> &max_indices,
+                       std::function< double(double) > f )
+{
+	local_maxima_of( neighs, field, max_indices, f );
+}
+
 void get_local_maxima( const std::vector<std::vector<int> > &neighs,
                        const std::vector<double> &field,
                        std::vector<int> &max_indices )
@@ -211,6 +247,24 @@ void get_local_maxima( const std::vector<std::vector<int> > &neighs,
 	get_local_maxima( neighs, field, max_indices, unit_operator );
 }
 
+void get_local_maxima( const neighborize::csr_neigh_list &neighs,
+                       const std::vector<double> &field,
+                       std::vector<int> &max_indices,
+                       std::function< double(double) > f )
+{
+	my_assert( __FILE__, __LINE__, !neighs.is_half(),
+	           "Local maxima need a full neighbour list!" );
+	local_maxima_of( neighs, field, max_indices, f );
+}
+
+void get_local_maxima( const neighborize::csr_neigh_list &neighs,
+                       const std::vector<double> &field,
+                       std::vector<int> &max_indices )
+{
+	auto unit_operator = []( double x ){ return x; };
+	get_local_maxima( neighs, field, max_indices, unit_operator );
+}
+
 
 
 void get_stats( const std::vector<double> &values,
@@ -333,10 +387,11 @@ void skeletonize( const block_data &b, std::vector<int> &skeleton,
 }
 
 
-std::vector<double> get_ribbon_widths( const block_data &b,
-                                       const neighborize::neigh_list &neighs,
-                                       const std::vector<double> &edt,
-                                       const std::vector<double> &insideness )
+template <typename list_type>
+std::vector<double> ribbon_widths_of( const block_data &b,
+                                      const list_type &neighs,
+                                      const std::vector<double> &edt,
+                                      const std::vector<double> &insideness )
 {
 	std::vector<int> maxima;
 	std::vector<double> widths;
@@ -378,6 +433,24 @@ std::vector<double> get_ribbon_widths( const block_data &b,
 }
 
 
+std::vector<double> get_ribbon_widths( const block_data &b,
+                                       const neighborize::neigh_list &neighs,
+                                       const std::vector<double> &edt,
+                                       const std::vector<double> &insideness )
+{
+	return ribbon_widths_of( b, neighs, edt, insideness );
+}
+
+
+std::vector<double> get_ribbon_widths( const block_data &b,
+                                       const neighborize::csr_neigh_list &neighs,
+                                       const std::vector<double> &edt,
+                                       const std::vector<double> &insideness )
+{
+	return ribbon_widths_of( b, neighs, edt, insideness );
+}
+
+
 std::vector<double> neighbor_strain( block_data &b, double r0,
                                      int itype, int jtype, int method,
                                      int dims, double rc )
@@ -12,6 +12,7 @@
 #include <functional>
 
 #include "neighborize.hpp"
+#include "neighborize_csr.hpp"
 
 namespace lammps_tools {
 
@@ -30,6 +31,10 @@ struct ribbon_data
 std::vector<double> get_insideness( const class block_data &b,
                                     const neighborize::neigh_list &neighs );
 
+/// \overload get_insideness, needs a full list.
+std::vector<double> get_insideness( const class block_data &b,
+                                    const neighborize::csr_neigh_list &neighs );
+
 
 std::vector<double> euclidian_distance_transform( const class block_data &b,
                                                   const std::vector<double> &insideness,
@@ -40,6 +45,12 @@ std::vector<double> get_ribbon_widths( const block_data &b,
                                        const std::vector<double> &edt,
                                        const std::vector<double> &insideness );
 
+/// \overload get_ribbon_widths, needs a full list.
+std::vector<double> get_ribbon_widths( const block_data &b,
+                                       const neighborize::csr_neigh_list &neighs,
+                                       const std::vector<double> &edt,
+                                       const std::vector<double> &insideness );
+
 void get_edge( const block_data &b, const std::vector<double> &insideness,
                const std::list<int> &edges );
 
@@ -60,6 +71,17 @@ void get_local_maxima( const std::vector<std::vector<int> > & neighs,
                        std::vector<int> &max_indices,
                        std::function< double(double) > );
 
+/// \overload get_local_maxima, needs a full list.
+void get_local_maxima( const neighborize::csr_neigh_list &neighs,
+                       const std::vector<double> &field,
+                       std::vector<int> &max_indices );
+
+/// \overload get_local_maxima, needs a full list.
+void get_local_maxima( const neighborize::csr_neigh_list &neighs,
+                       const std::vector<double> &field,
+                       std::vector<int> &max_indices,
+                       std::function< double(double) > );
+
 void get_ribbon_data( class block_data &b, ribbon_data &r_data );
 
 std::vector<double> neighbor_strain( class block_data &b, double r0,
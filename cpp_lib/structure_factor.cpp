@@ -0,0 +1,491 @@
+#include "structure_factor.hpp"
+#include "block_data_access.hpp"
+#include "constants.hpp"
+#include "fast_math.hpp"
+#include "fft.hpp"
+#include "my_assert.hpp"
+#include "neighborize_cell.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace lammps_tools {
+
+namespace fourier {
+
+namespace {
+
+// Atoms of one type of which the phases are built up together.
+const int block_atoms = 64;
+
+
+// The vectors q = 2 pi H^-T ( h, k, l ) of the reciprocal lattice with
+// 0 < |q| < q_max, where H has the box vectors as columns. Only the
+// half with h > 0, or h = 0 and k > 0, or h = k = 0 and l > 0 is kept.
+// For fixed h and k, the l of the vectors follow each other.
+struct lattice
+{
+	struct column { int h, k, l0, first, count; };
+
+	int hmax[3];                  // Largest |h|, |k| and |l|.
+	std::vector<column> columns;
+	std::vector<int> bin;         // Bin of |q| of each vector.
+
+	std::size_t size() const { return bin.size(); }
+};
+
+
+lattice make_lattice( const domain &dom, int dims, double q_max, double dq,
+                      int Nbins )
+{
+	// The box vectors are a = ( Lx, 0, 0 ), b = ( xy, Ly, 0 ) and
+	// c = ( xz, yz, Lz ), and h = q.a / 2 pi can be at most |q||a| / 2 pi.
+	double L[3];
+	for( int d = 0; d < 3; ++d ) L[d] = dom.xhi[d] - dom.xlo[d];
+	double len[3] = { L[0], std::sqrt( dom.xy*dom.xy + L[1]*L[1] ),
+	                  std::sqrt( dom.xz*dom.xz + dom.yz*dom.yz + L[2]*L[2] ) };
+
+	lattice lat;
+	for( int d = 0; d < 3; ++d ){
+		lat.hmax[d] = d < dims ? q_max * len[d] / constants::pi2 : 0;
+	}
+
+	double q2_max = q_max*q_max / ( constants::pi2*constants::pi2 );
+	for( int h = 0; h <= lat.hmax[0]; ++h ){
+		for( int k = -lat.hmax[1]; k <= lat.hmax[1]; ++k ){
+			if( h == 0 && k < 0 ) continue;
+			lattice::column col = { h, k, 0, static_cast<int>( lat.size() ), 0 };
+			for( int l = -lat.hmax[2]; l <= lat.hmax[2]; ++l ){
+				if( h == 0 && k == 0 && l <= 0 ) continue;
+				// Solve H^T q = ( h, k, l ), in units of 2 pi.
+				double qx = h / L[0];
+				double qy = ( k - dom.xy*qx ) / L[1];
+				double qz = dims == 3 ? ( l - dom.xz*qx - dom.yz*qy ) / L[2] : 0.0;
+				double q2 = qx*qx + qy*qy + qz*qz;
+				if( q2 >= q2_max ) continue;
+
+				if( col.count == 0 ) col.l0 = l;
+				++col.count;
+				int bin = constants::pi2 * std::sqrt( q2 ) / dq;
+				lat.bin.push_back( std::min( bin, Nbins - 1 ) );
+			}
+			if( col.count > 0 ) lat.columns.push_back( col );
+		}
+	}
+	return lat;
+}
+
+
+// The positions of a frame in fractional coordinates.
+struct fractional
+{
+	fractional( const block_data &b, int dims )
+		: dom( b.dom ), dims( dims ), x( get_x( b ) ), y( get_y( b ) ),
+		  z( get_z( b ) ) {}
+
+	// Gets the position of atom i, wrapped into [0,1).
+	void operator()( int i, double s[3] ) const;
+
+	const domain &dom;
+	int dims;
+	const std::vector<double> &x, &y, &z;
+};
+
+
+void fractional::operator()( int i, double s[3] ) const
+{
+	double xi[3] = { x[i], y[i], dims == 3 ? z[i] : dom.xlo[2] };
+	dom.to_fractional( xi, s );
+	for( int d = 0; d < 3; ++d ) s[d] -= std::floor( s[d] );
+	if( dims == 2 ) s[2] = 0.0;
+}
+
+
+// Points of the grid along each axis, four per period of the largest q.
+void grid_points( const lattice &lat, int dims, int n[3] )
+{
+	for( int d = 0; d < 3; ++d ){
+		n[d] = d < dims
+			? std::max<std::size_t>( 2, fft_size( 4*lat.hmax[d] ) ) : 1;
+	}
+}
+
+
+// Sums exp( -i q.r ) over the atoms, for each type and vector. The
+// atoms in order are sorted by type. The densities of type t are at
+// t*lat.size() in re and im.
+void direct_densities( const block_data &b, int dims, const lattice &lat,
+                       const std::vector<int> &order, int n_types,
+                       int n_threads,
+                       std::vector<double> &re, std::vector<double> &im )
+{
+	const std::vector<int> &type = get_type( b );
+	const std::size_t n_vec = lat.size();
+	const std::size_t N = order.size();
+	const std::size_t entries = ( n_types + 1 ) * n_vec;
+	const int B = block_atoms;
+	fractional position( b, dims );
+
+	int n_run = std::max<std::size_t>( 1, std::min<std::size_t>( n_threads,
+	                                                             N / B ) );
+	std::vector<std::vector<double> > rho( n_run );
+
+	util::run_on_threads( n_run, [&]( int t ){
+		std::vector<double> &r = rho[t];
+		r.assign( 2*entries, 0.0 );
+
+		// exp( -2 pi i h s ) for each axis, h and atom in the block.
+		std::vector<double> tab_re[3], tab_im[3];
+		for( int d = 0; d < 3; ++d ){
+			tab_re[d].resize( ( lat.hmax[d] + 1 ) * B );
+			tab_im[d].resize( ( lat.hmax[d] + 1 ) * B );
+		}
+		std::vector<double> xy_re( B ), xy_im( B );
+
+		std::size_t s0 = N * t / n_run, end = N * ( t + 1 ) / n_run;
+		while( s0 < end ){
+			int ty = type[ order[s0] ];
+			std::size_t s1 = s0 + 1;
+			while( s1 < end && s1 - s0 < static_cast<std::size_t>( B )
+			       && type[ order[s1] ] == ty ){
+				++s1;
+			}
+			int nb = s1 - s0;
+
+			for( int j = 0; j < nb; ++j ){
+				double s[3];
+				position( order[s0 + j], s );
+				for( int d = 0; d < 3; ++d ){
+					double *tr = tab_re[d].data();
+					double *ti = tab_im[d].data();
+					tr[j] = 1.0;
+					ti[j] = 0.0;
+					if( lat.hmax[d] == 0 ) continue;
+					double sn, cs;
+					fast_math::sincos_poly( -constants::pi2 * s[d], sn, cs );
+					for( int h = 1; h <= lat.hmax[d]; ++h ){
+						double p_re = tr[ ( h - 1 )*B + j ];
+						double p_im = ti[ ( h - 1 )*B + j ];
+						tr[ h*B + j ] = p_re*cs - p_im*sn;
+						ti[ h*B + j ] = p_re*sn + p_im*cs;
+					}
+				}
+			}
+
+			double *out_re = r.data() + ty*n_vec;
+			double *out_im = r.data() + entries + ty*n_vec;
+			for( const lattice::column &col : lat.columns ){
+				// Negative indices are the complex conjugate.
+				const double *xr = tab_re[0].data() + col.h*B;
+				const double *xi = tab_im[0].data() + col.h*B;
+				const double *yr = tab_re[1].data() + std::abs( col.k )*B;
+				const double *yi = tab_im[1].data() + std::abs( col.k )*B;
+				double sk = col.k < 0 ? -1.0 : 1.0;
+				for( int j = 0; j < nb; ++j ){
+					double yim = sk*yi[j];
+					xy_re[j] = xr[j]*yr[j] - xi[j]*yim;
+					xy_im[j] = xr[j]*yim + xi[j]*yr[j];
+				}
+				for( int c = 0; c < col.count; ++c ){
+					int l = col.l0 + c;
+					const double *zr = tab_re[2].data() + std::abs( l )*B;
+					const double *zi = tab_im[2].data() + std::abs( l )*B;
+					double sl = l < 0 ? -1.0 : 1.0;
+					double sum_re = 0.0, sum_im = 0.0;
+					for( int j = 0; j < nb; ++j ){
+						double zim = sl*zi[j];
+						sum_re += xy_re[j]*zr[j] - xy_im[j]*zim;
+						sum_im += xy_re[j]*zim + xy_im[j]*zr[j];
+					}
+					out_re[ col.first + c ] += sum_re;
+					out_im[ col.first + c ] += sum_im;
+				}
+			}
+			s0 = s1;
+		}
+	} );
+
+	re.assign( entries, 0.0 );
+	im.assign( entries, 0.0 );
+	for( const std::vector<double> &r : rho ){
+		for( std::size_t e = 0; e < entries; ++e ){
+			re[e] += r[e];
+			im[e] += r[entries + e];
+		}
+	}
+}
+
+
+// Same as direct_densities, but from FFTs of the types spread on a
+// grid with cloud-in-cell weights. Two types share one complex grid.
+// shot gets the aliased shot noise per atom of each vector, relative
+// to the deconvolved density.
+void grid_densities( const block_data &b, int dims, const lattice &lat,
+                     const std::vector<int> &order,
+                     const std::vector<bigint> &type_start, int n_types,
+                     int n_threads,
+                     std::vector<double> &re, std::vector<double> &im,
+                     std::vector<double> &shot )
+{
+	int n[3];
+	grid_points( lat, dims, n );
+	const std::size_t n_vec = lat.size();
+	re.assign( ( n_types + 1 ) * n_vec, 0.0 );
+	im.assign( ( n_types + 1 ) * n_vec, 0.0 );
+
+	// The transform of the weights along an axis is sinc^2( pi h / n ),
+	// and its aliases add up to 1 - 2/3 sin^2( pi h / n ).
+	std::vector<double> inv_w( n_vec );
+	std::vector<std::size_t> at( n_vec ), at_minus( n_vec );
+	shot.resize( n_vec );
+	for( const lattice::column &col : lat.columns ){
+		for( int c = 0; c < col.count; ++c ){
+			int hkl[3] = { col.h, col.k, col.l0 + c };
+			double W = 1.0, C1 = 1.0;
+			for( int d = 0; d < dims; ++d ){
+				double x = constants::pi * hkl[d] / n[d];
+				double sn = std::sin( x );
+				double sinc = hkl[d] == 0 ? 1.0 : sn / x;
+				W  *= sinc*sinc;
+				C1 *= 1.0 - 2.0 / 3.0 * sn*sn;
+			}
+			int m = col.first + c;
+			inv_w[m] = 1.0 / W;
+			shot[m] = ( C1 - W*W ) / ( W*W );
+			at[m] = ( static_cast<std::size_t>( hkl[0] & ( n[0] - 1 ) )*n[1]
+			          + ( hkl[1] & ( n[1] - 1 ) ) )*n[2] + ( hkl[2] & ( n[2] - 1 ) );
+			at_minus[m] = ( static_cast<std::size_t>( -hkl[0] & ( n[0] - 1 ) )*n[1]
+			                + ( -hkl[1] & ( n[1] - 1 ) ) )*n[2]
+				+ ( -hkl[2] & ( n[2] - 1 ) );
+		}
+	}
+
+	fractional position( b, dims );
+	std::vector<cx_double> grid( static_cast<std::size_t>( n[0] ) * n[1] * n[2] );
+	for( int t = 1; t <= n_types; t += 2 ){
+		std::fill( grid.begin(), grid.end(), cx_double( 0.0, 0.0 ) );
+		for( int u = t; u <= std::min( t + 1, n_types ); ++u ){
+			cx_double unit = u == t ? cx_double( 1.0, 0.0 ) : cx_double( 0.0, 1.0 );
+			for( bigint s = type_start[u]; s < type_start[u+1]; ++s ){
+				double sf[3];
+				position( order[s], sf );
+				int i0[3];
+				double w[3][2];
+				for( int d = 0; d < 3; ++d ){
+					double x = sf[d] * n[d];
+					i0[d] = x;
+					w[d][1] = x - i0[d];
+					w[d][0] = 1.0 - w[d][1];
+				}
+				for( int a = 0; a < 2; ++a ){
+					int ix = ( i0[0] + a ) & ( n[0] - 1 );
+					for( int c = 0; c < 2; ++c ){
+						int iy = ( i0[1] + c ) & ( n[1] - 1 );
+						double wxy = w[0][a] * w[1][c];
+						for( int e = 0; e < 2; ++e ){
+							int iz = ( i0[2] + e ) & ( n[2] - 1 );
+							grid[ ( static_cast<std::size_t>( ix )*n[1] + iy )*n[2] + iz ]
+								+= wxy * w[2][e] * unit;
+						}
+					}
+				}
+			}
+		}
+
+		fft_3d( grid.data(), n[0], n[1], n[2], false, n_threads );
+
+		// Z = A + iB for the real grids A and B of the two types, so
+		// A(q) = ( Z(q) + Z*(-q) )/2 and B(q) = ( Z(q) - Z*(-q) )/2i.
+		for( std::size_t m = 0; m < n_vec; ++m ){
+			cx_double z  = grid[ at[m] ];
+			cx_double zm = std::conj( grid[ at_minus[m] ] );
+			cx_double A = 0.5 * ( z + zm );
+			cx_double Bq = cx_double( 0.0, -0.5 ) * ( z - zm );
+			re[ t*n_vec + m ] = A.real() * inv_w[m];
+			im[ t*n_vec + m ] = A.imag() * inv_w[m];
+			if( t < n_types ){
+				re[ ( t + 1 )*n_vec + m ] = Bq.real() * inv_w[m];
+				im[ ( t + 1 )*n_vec + m ] = Bq.imag() * inv_w[m];
+			}
+		}
+	}
+}
+
+} // namespace
+
+
+structure_factor::structure_factor( int Nbins, double q_max, int dims,
+                                    int method, int n_threads )
+	: Nbins( Nbins ), q_max( q_max ), dq( q_max / Nbins ), dims( dims ),
+	  method( method ), n_threads( neighborize::resolve_threads( n_threads ) ),
+	  frames( 0 ), max_type( 0 ), sums(), norm(),
+	  modes_per_bin( Nbins, 0.0 )
+{
+	my_assert( __FILE__, __LINE__, Nbins > 0, "Need at least one bin!" );
+	my_assert( __FILE__, __LINE__, q_max > 0, "Need a positive q_max!" );
+	my_assert( __FILE__, __LINE__, dims == 2 || dims == 3,
+	           "Dimensions have to be 2 or 3!" );
+	my_assert( __FILE__, __LINE__, method >= AUTO && method <= GRID,
+	           "Unknown method for the structure factor!" );
+}
+
+
+void structure_factor::clear()
+{
+	frames = 0;
+	max_type = 0;
+	sums.clear();
+	norm.clear();
+	modes_per_bin.assign( Nbins, 0.0 );
+}
+
+
+void structure_factor::grow_types( int n )
+{
+	if( n <= max_type ) return;
+
+	// Move the sums to their place in the bigger table.
+	int old_stride = max_type + 1;
+	int stride = n + 1;
+	std::vector<std::vector<double> > new_sums( stride*stride );
+	std::vector<std::vector<double> > new_norm( stride*stride );
+	for( int a = 0; a <= n; ++a ){
+		for( int c = 0; c <= n; ++c ){
+			int p = a*stride + c;
+			bool had = frames > 0 && a <= max_type && c <= max_type;
+			if( had ){
+				int q = a*old_stride + c;
+				new_sums[p].swap( sums[q] );
+				new_norm[p].swap( norm[q] );
+			}else{
+				new_sums[p].assign( Nbins, 0.0 );
+				new_norm[p].assign( Nbins, 0.0 );
+			}
+		}
+	}
+	sums.swap( new_sums );
+	norm.swap( new_norm );
+	max_type = n;
+}
+
+
+void structure_factor::add_frame( const block_data &b )
+{
+	my_assert( __FILE__, __LINE__,
+	           ( b.dom.periodic & ( ( 1 << dims ) - 1 ) ) == ( 1 << dims ) - 1,
+	           "The structure factor needs a periodic box!" );
+
+	const std::vector<int> &type = get_type( b );
+	int n_types = 0;
+	for( int t : type ){
+		my_assert( __FILE__, __LINE__, t > 0, "Atom types should be positive!" );
+		n_types = std::max( n_types, t );
+	}
+	grow_types( n_types );
+	int stride = max_type + 1;
+
+	// Sort the atoms on type.
+	std::vector<bigint> type_start( stride + 1, 0 );
+	for( int t : type ) ++type_start[t + 1];
+	for( int t = 1; t <= stride; ++t ) type_start[t] += type_start[t-1];
+	std::vector<double> n_of_type( stride, 0.0 );
+	n_of_type[0] = b.N;
+	for( int t = 1; t < stride; ++t ){
+		n_of_type[t] = type_start[t+1] - type_start[t];
+	}
+	std::vector<int> order( b.N );
+	std::vector<bigint> next( type_start );
+	for( bigint i = 0; i < b.N; ++i ) order[ next[ type[i] ]++ ] = i;
+
+	lattice lat = make_lattice( b.dom, dims, q_max, dq, Nbins );
+	const std::size_t n_vec = lat.size();
+
+	int use = method;
+	if( use == AUTO ){
+		// Rough operation counts of both.
+		int n[3];
+		grid_points( lat, dims, n );
+		double M = double( n[0] ) * n[1] * n[2];
+		double direct_cost = double( b.N ) * n_vec;
+		double grid_cost = ( max_type + 1 ) / 2
+			* ( M * ( 4.0*std::log2( M ) + 1.0 ) + 8.0*b.N );
+		use = grid_cost < direct_cost ? GRID : DIRECT;
+	}
+
+	std::vector<double> re, im, shot;
+	if( use == GRID ){
+		grid_densities( b, dims, lat, order, type_start, max_type,
+		                n_threads, re, im, shot );
+	}else{
+		direct_densities( b, dims, lat, order, max_type, n_threads, re, im );
+	}
+
+	std::vector<double> in_bin( Nbins, 0.0 );
+	for( std::size_t m = 0; m < n_vec; ++m ){
+		int k = lat.bin[m];
+		in_bin[k] += 1.0;
+		for( int a = 1; a < stride; ++a ){
+			double ra = re[ a*n_vec + m ], ia = im[ a*n_vec + m ];
+			for( int c = a; c < stride; ++c ){
+				double val = ra * re[ c*n_vec + m ] + ia * im[ c*n_vec + m ];
+				if( c == a && use == GRID ) val -= n_of_type[a] * shot[m];
+				sums[ a*stride + c ][k] += val;
+				if( c != a ) sums[ c*stride + a ][k] += val;
+			}
+		}
+	}
+
+	for( int k = 0; k < Nbins; ++k ) modes_per_bin[k] += in_bin[k];
+	for( int a = 0; a < stride; ++a ){
+		for( int c = 0; c < stride; ++c ){
+			double n_ac = std::sqrt( n_of_type[a] * n_of_type[c] );
+			std::vector<double> &nn = norm[ a*stride + c ];
+			for( int k = 0; k < Nbins; ++k ) nn[k] += in_bin[k] * n_ac;
+		}
+	}
+	++frames;
+}
+
+
+std::vector<double> structure_factor::sq( int itype, int jtype ) const
+{
+	my_assert( __FILE__, __LINE__, itype >= 0 && itype <= max_type &&
+	           jtype >= 0 && jtype <= max_type, "Type out of range!" );
+	int stride = max_type + 1;
+	std::vector<double> S( Nbins, 0.0 );
+	if( frames == 0 ) return S;
+
+	for( int a = 1; a <= max_type; ++a ){
+		if( itype && a != itype ) continue;
+		for( int c = 1; c <= max_type; ++c ){
+			if( jtype && c != jtype ) continue;
+			const std::vector<double> &s = sums[ a*stride + c ];
+			for( int k = 0; k < Nbins; ++k ) S[k] += s[k];
+		}
+	}
+	const std::vector<double> &nn = norm[ itype*stride + jtype ];
+	for( int k = 0; k < Nbins; ++k ){
+		S[k] = nn[k] > 0 ? S[k] / nn[k] : 0.0;
+	}
+	return S;
+}
+
+
+bigint compute_structure_factor( readers::dump_reader *reader,
+                                 structure_factor &sf )
+{
+	block_data b;
+	bigint frames = 0;
+	while( reader->next_block( b ) == 0 ){
+		sf.add_frame( b );
+		++frames;
+	}
+	return frames;
+}
+
+
+} // namespace fourier
+
+} // namespace lammps_tools
@@ -0,0 +1,128 @@
+#ifndef STRUCTURE_FACTOR_HPP
+#define STRUCTURE_FACTOR_HPP
+
+/**
+   \file structure_factor.hpp
+
+   The static structure factor S(q) on the reciprocal lattice of a
+   periodic box.
+*/
+
+#include <vector>
+
+#include "block_data.hpp"
+#include "dump_reader.hpp"
+#include "types.hpp"
+
+
+namespace lammps_tools {
+
+namespace fourier {
+
+/**
+   \brief Accumulates the partial structure factors S_ab(q) of all type
+          pairs over many frames.
+
+   For each frame, the densities rho_a(q) = sum_{j in a} exp( -i q.r_j )
+   are computed for every vector q of the reciprocal lattice of the box
+   with 0 < |q| < q_max. The partial structure factors are
+
+     S_ab(q) = Re rho_a(q) rho_b(-q) / sqrt( N_a N_b ),
+
+   averaged over shells of |q|. Type 0 stands for all atoms, so S_00 is
+   the usual S(q) = |rho(q)|^2 / N. Only half of the lattice is visited,
+   because rho(-q) is the complex conjugate of rho(q).
+
+   There are two ways to get the densities:
+   - DIRECT sums over the atoms for each q. This is exact. The phases
+     along each axis are built up by complex multiplication, in blocks
+     of atoms of the same type so the sums vectorise, and the atoms are
+     divided over threads.
+   - GRID spreads each type on a grid with cloud-in-cell weights and
+     uses FFTs. The result is divided by the transform of the weights,
+     and the aliased shot noise of each type is subtracted, as in
+     Jing (2005). The grid has at least four points per period of the
+     largest q, so the remaining error is small except for strongly
+     ordered systems.
+
+   Bin k covers [ k*dq, (k+1)*dq ) with dq = q_max / Nbins.
+*/
+class structure_factor
+{
+public:
+	/// Ways to compute the densities.
+	enum methods {
+		AUTO   = 0,  ///< Pick whichever is cheaper for the frame.
+		DIRECT = 1,  ///< Sum over atoms for each q.
+		GRID   = 2   ///< Spread on a grid and transform it.
+	};
+
+	/**
+	   \param Nbins      Number of bins in |q|.
+	   \param q_max      Largest |q| to include.
+	   \param dims       Dimensions of the system (2 or 3).
+	   \param method     The way to compute the densities, see methods.
+	   \param n_threads  Number of threads to use, 0 for all cores.
+	*/
+	structure_factor( int Nbins, double q_max, int dims = 3,
+	                  int method = AUTO, int n_threads = 1 );
+
+	/// Adds the densities of frame b to the sums.
+	void add_frame( const block_data &b );
+
+	/// Forgets all frames added so far.
+	void clear();
+
+	/// Returns the number of frames added.
+	int n_frames() const { return frames; }
+
+	/// Returns the highest atom type seen.
+	int n_types() const { return max_type; }
+
+	/// Returns the |q| of the centre of bin k.
+	double q( int k ) const { return ( k + 0.5 )*dq; }
+
+	/// Returns the number of lattice vectors summed into each bin.
+	const std::vector<double> &n_vectors() const { return modes_per_bin; }
+
+	/**
+	   \brief Gets the average S_ab(q) per bin.
+
+	   Bins without any lattice vectors are 0.
+
+	   \param itype  Type a, 0 for all atoms.
+	   \param jtype  Type b, 0 for all atoms.
+	*/
+	std::vector<double> sq( int itype = 0, int jtype = 0 ) const;
+
+private:
+	void grow_types( int n );
+
+	int Nbins;
+	double q_max, dq;
+	int dims, method, n_threads;
+
+	int frames;
+	int max_type;
+	/// Sums of Re rho_a rho_b^* for types a, b > 0, at a*(max_type+1) + b.
+	std::vector<std::vector<double> > sums;
+	/// Sums of sqrt( N_a N_b ) over frames and vectors, for a, b >= 0.
+	std::vector<std::vector<double> > norm;
+	std::vector<double> modes_per_bin;
+};
+
+
+/**
+   \brief Feeds all frames of a dump reader to a structure_factor.
+
+   \returns the number of frames read.
+*/
+bigint compute_structure_factor( readers::dump_reader *reader,
+                                 structure_factor &sf );
+
+
+} // namespace fourier
+
+} // namespace lammps_tools
+
+#endif // STRUCTURE_FACTOR_HPP
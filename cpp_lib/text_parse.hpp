@@ -0,0 +1,221 @@
+#ifndef TEXT_PARSE_HPP
+#define TEXT_PARSE_HPP
+
+/**
+   \file text_parse.hpp
+
+   Allocation-free parsers for numbers in plain text buffers.
+
+   These work on [begin, end) character ranges that need not be
+   null-terminated, so they can parse directly from a read buffer.
+*/
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace lammps_tools {
+
+namespace util {
+
+/// Returns true for the characters that separate columns.
+inline bool is_blank( char c )
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+/// Returns true if c is a decimal digit.
+inline bool is_digit( char c )
+{
+	return static_cast<unsigned>( c - '0' ) < 10u;
+}
+
+/// Returns pointer to first non-blank character in [p, end).
+inline const char *skip_blanks( const char *p, const char *end )
+{
+	while( p < end && is_blank( *p ) ) ++p;
+	return p;
+}
+
+
+/**
+   \brief Parses a double with strtod.
+
+   Slow path of parse_double for input the fast path cannot handle
+   exactly, like very long mantissas, huge exponents, inf and nan.
+
+   \returns pointer past the parsed number, or nullptr on failure.
+*/
+inline const char *parse_double_strtod( const char *p, const char *end,
+                                        double &val )
+{
+	const char *q = p;
+	while( q < end && !is_blank( *q ) && *q != '\n' ) ++q;
+
+	// strtod needs a terminated string. Numbers fit on the stack,
+	// only absurdly long tokens need the heap.
+	char buf[64];
+	std::string long_token;
+	const char *token = buf;
+	std::size_t len = q - p;
+	if( len < sizeof(buf) ){
+		std::memcpy( buf, p, len );
+		buf[len] = '\0';
+	}else{
+		long_token.assign( p, q );
+		token = long_token.c_str();
+	}
+
+	char *stop = nullptr;
+	val = std::strtod( token, &stop );
+	if( stop == token ) return nullptr;
+	return p + ( stop - token );
+}
+
+
+/**
+   \brief Parses a double from [p, end), skipping leading blanks.
+
+   Mantissas of up to 2^53 with decimal exponents of at most 22 are
+   computed with a single multiplication or division by an exact power
+   of ten, which covers everything LAMMPS writes with its default
+   formats. Anything else is passed on to strtod.
+
+   \param p    Start of the text to parse.
+   \param end  End of the text to parse.
+   \param val  Will contain the parsed value.
+
+   \returns pointer past the parsed number, or nullptr on failure.
+*/
+inline const char *parse_double( const char *p, const char *end, double &val )
+{
+	static const double exact_pow10[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+		1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+		1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+	p = skip_blanks( p, end );
+	const char *start = p;
+
+	bool negative = false;
+	if( p < end && ( *p == '-' || *p == '+' ) ){
+		negative = *p == '-';
+		++p;
+	}
+
+	// Keep at most 19 significant digits so mant cannot overflow.
+	uint64_t mant = 0;
+	int n_digits = 0;
+	int exp10 = 0;
+	const char *digits = p;
+	while( p < end && is_digit( *p ) ){
+		if( n_digits < 19 ){
+			mant = 10*mant + ( *p - '0' );
+			if( mant ) ++n_digits;
+		}else{
+			++exp10;
+		}
+		++p;
+	}
+	bool have_digits = p != digits;
+
+	if( p < end && *p == '.' ){
+		++p;
+		const char *frac = p;
+		while( p < end && is_digit( *p ) ){
+			if( n_digits < 19 ){
+				mant = 10*mant + ( *p - '0' );
+				if( mant ) ++n_digits;
+				--exp10;
+			}
+			++p;
+		}
+		have_digits = have_digits || p != frac;
+	}
+	if( !have_digits ){
+		return parse_double_strtod( start, end, val );
+	}
+
+	if( p < end && ( *p == 'e' || *p == 'E' ) ){
+		const char *q = p + 1;
+		bool neg_exp = false;
+		if( q < end && ( *q == '-' || *q == '+' ) ){
+			neg_exp = *q == '-';
+			++q;
+		}
+		const char *exp_digits = q;
+		int e = 0;
+		while( q < end && is_digit( *q ) ){
+			if( e < 100000 ) e = 10*e + ( *q - '0' );
+			++q;
+		}
+		if( q != exp_digits ){
+			exp10 += neg_exp ? -e : e;
+			p = q;
+		}
+	}
+
+	if( mant > ( uint64_t(1) << 53 ) || exp10 < -22 || exp10 > 22 ){
+		return parse_double_strtod( start, end, val );
+	}
+
+	double d = static_cast<double>( mant );
+	if( exp10 < 0 ){
+		d /= exact_pow10[-exp10];
+	}else{
+		d *= exact_pow10[exp10];
+	}
+	val = negative ? -d : d;
+	return p;
+}
+
+
+/**
+   \brief Parses an int from [p, end), skipping leading blanks.
+
+   Values with a fraction or exponent are parsed as double and then
+   truncated, so that float columns can be read as ints.
+
+   \param p    Start of the text to parse.
+   \param end  End of the text to parse.
+   \param val  Will contain the parsed value.
+
+   \returns pointer past the parsed number, or nullptr on failure.
+*/
+inline const char *parse_int( const char *p, const char *end, int &val )
+{
+	p = skip_blanks( p, end );
+	const char *start = p;
+
+	bool negative = false;
+	if( p < end && ( *p == '-' || *p == '+' ) ){
+		negative = *p == '-';
+		++p;
+	}
+
+	int64_t v = 0;
+	const char *digits = p;
+	while( p < end && is_digit( *p ) ){
+		v = 10*v + ( *p - '0' );
+		++p;
+	}
+
+	if( p < end && ( *p == '.' || *p == 'e' || *p == 'E' ) ){
+		double d;
+		p = parse_double( start, end, d );
+		val = static_cast<int>( d );
+		return p;
+	}
+	if( p == digits ) return nullptr;
+
+	val = static_cast<int>( negative ? -v : v );
+	return p;
+}
+
+
+} // namespace util
+
+} // namespace lammps_tools
+
+#endif // TEXT_PARSE_HPP
@@ -0,0 +1,304 @@
+#include "time_correlation.hpp"
+#include "block_data_access.hpp"
+#include "constants.hpp"
+#include "fast_math.hpp"
+#include "my_assert.hpp"
+#include "neighborize_cell.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace lammps_tools {
+
+namespace correlate {
+
+self_correlator::self_correlator( int which, int dims, int n_threads,
+                                  int p, int m )
+	: which( which ), dims( dims ),
+	  n_threads( neighborize::resolve_threads( n_threads ) ), p( p ), m( m ),
+	  atoms( dims ), width( 0 ), v_offset( 0 ), frame(), buffer( 0, p, m ),
+	  slot_type(), max_type( 0 ), q(), Nbins( 0 ), dr( 0.0 ),
+	  n_channels( 0 ), per_thread()
+{
+	my_assert( __FILE__, __LINE__, which > 0 && which < 8,
+	           "Unknown quantities to correlate!" );
+}
+
+
+void self_correlator::set_wave_numbers( const std::vector<double> &qs )
+{
+	my_assert( __FILE__, __LINE__, n_frames() == 0,
+	           "Wave numbers have to be set before the first frame!" );
+	q = qs;
+}
+
+
+void self_correlator::set_van_hove_bins( int N, double r_max )
+{
+	my_assert( __FILE__, __LINE__, n_frames() == 0,
+	           "Bins have to be set before the first frame!" );
+	my_assert( __FILE__, __LINE__, N > 0 && r_max > 0,
+	           "Need a positive number of bins and range!" );
+	Nbins = N;
+	dr = r_max / N;
+}
+
+
+void self_correlator::setup( const block_data &b )
+{
+	my_assert( __FILE__, __LINE__, !( which & SELF_ISF ) || !q.empty(),
+	           "No wave numbers set for the self-ISF!" );
+	my_assert( __FILE__, __LINE__, !( which & VAN_HOVE ) || Nbins > 0,
+	           "No bins set for the van Hove function!" );
+
+	const std::vector<int> &type = get_type( b );
+	const std::vector<int> &index = atoms.index();
+	slot_type.resize( atoms.size() );
+	max_type = 0;
+	for( int s = 0; s < atoms.size(); ++s ){
+		slot_type[s] = type[ index[s] ];
+		my_assert( __FILE__, __LINE__, slot_type[s] > 0,
+		           "Atom types have to be positive!" );
+		max_type = std::max( max_type, slot_type[s] );
+	}
+
+	bool positions = which & ( SELF_ISF | VAN_HOVE );
+	v_offset = positions ? dims : 0;
+	width = v_offset + ( which & VACF ? dims : 0 );
+	frame.resize( atoms.size() * width );
+	buffer = multi_tau( frame.size(), p, m );
+
+	int n_run = std::min<bigint>( n_threads,
+	                              1 + atoms.size()
+	                              / neighborize::cell_list::min_thread_atoms );
+	per_thread.assign( n_run, sums() );
+	n_channels = 0;
+}
+
+
+void self_correlator::grow_channels( int n )
+{
+	if( n <= n_channels ) return;
+	std::size_t entries = n * ( max_type + 1 );
+	for( sums &acc : per_thread ){
+		acc.counts.resize( entries, 0.0 );
+		if( which & VACF ) acc.vacf.resize( entries, 0.0 );
+		if( which & SELF_ISF ) acc.isf.resize( entries * q.size(), 0.0 );
+		if( which & VAN_HOVE ) acc.van_hove.resize( entries * Nbins, 0.0 );
+	}
+	n_channels = n;
+}
+
+
+void self_correlator::add_frame( const block_data &b )
+{
+	atoms.add_frame( b );
+	if( n_frames() == 1 ) setup( b );
+
+	const std::vector<double> &u = atoms.unwrapped();
+	const std::vector<int> &index = atoms.index();
+	std::size_t N = atoms.size();
+	if( which & ( SELF_ISF | VAN_HOVE ) ){
+		for( std::size_t s = 0; s < N; ++s ){
+			std::copy( u.begin() + s*dims, u.begin() + ( s + 1 )*dims,
+			           frame.begin() + s*width );
+		}
+	}
+	if( which & VACF ){
+		my_assert( __FILE__, __LINE__,
+		           b.get_special_field( block_data::VX )
+		           && b.get_special_field( block_data::VY )
+		           && ( dims == 2 || b.get_special_field( block_data::VZ ) ),
+		           "Velocity autocorrelation needs velocities!" );
+		const std::vector<double> &vx = get_vx( b );
+		const std::vector<double> &vy = get_vy( b );
+		const std::vector<double> *vz = dims == 3 ? &get_vz( b ) : nullptr;
+		for( std::size_t s = 0; s < N; ++s ){
+			double *v = frame.data() + s*width + v_offset;
+			int i = index[s];
+			v[0] = vx[i];
+			v[1] = vy[i];
+			if( vz ) v[2] = (*vz)[i];
+		}
+	}
+
+	const std::vector<multi_tau::partner> &partners =
+		buffer.add( frame.data() );
+	int needed = 0;
+	for( const multi_tau::partner &pp : partners ){
+		needed = std::max( needed, pp.channel + 1 );
+	}
+	grow_channels( needed );
+
+	int n_run = per_thread.size();
+	util::run_on_threads( n_run, [&]( int t ){
+		correlate_slots( per_thread[t], N * t / n_run, N * ( t + 1 ) / n_run,
+		                 partners );
+	} );
+}
+
+
+void self_correlator::correlate_slots(
+	sums &acc, std::size_t begin, std::size_t end,
+	const std::vector<multi_tau::partner> &partners ) const
+{
+	const std::size_t n_q = q.size();
+	const int n_t = max_type + 1;
+	const double *now = frame.data();
+	for( const multi_tau::partner &pp : partners ){
+		const double *then = pp.frame;
+		std::size_t base = pp.channel * n_t;
+		for( std::size_t s = begin; s < end; ++s ){
+			std::size_t e = base + slot_type[s];
+			const double *a = now + s*width;
+			const double *b = then + s*width;
+			acc.counts[e] += 1.0;
+
+			if( which & VACF ){
+				double vv = 0.0;
+				for( int d = 0; d < dims; ++d ){
+					vv += a[v_offset + d] * b[v_offset + d];
+				}
+				acc.vacf[e] += vv;
+			}
+			if( !( which & ( SELF_ISF | VAN_HOVE ) ) ) continue;
+
+			double r2 = 0.0;
+			for( int d = 0; d < dims; ++d ){
+				double dd = a[d] - b[d];
+				r2 += dd*dd;
+			}
+			double r = std::sqrt( r2 );
+			if( which & SELF_ISF ){
+				double *isf = acc.isf.data() + e * n_q;
+				for( std::size_t iq = 0; iq < n_q; ++iq ){
+					double qr = q[iq] * r;
+					if( dims == 2 ){
+						isf[iq] += fast_math::bessel_j0( qr );
+					}else{
+						isf[iq] += qr > 0 ? std::sin( qr ) / qr : 1.0;
+					}
+				}
+			}
+			if( which & VAN_HOVE ){
+				int k = r / dr;
+				if( k < Nbins ) acc.van_hove[ e * Nbins + k ] += 1.0;
+			}
+		}
+	}
+}
+
+
+double self_correlator::total( const std::vector<double> sums::*field,
+                               int channel, int type, std::size_t per,
+                               std::size_t k ) const
+{
+	std::size_t entry = channel * ( max_type + 1 );
+	int t0 = type == 0 ? 1 : type;
+	int t1 = type == 0 ? max_type : type;
+	double sum = 0.0;
+	for( const sums &acc : per_thread ){
+		const std::vector<double> &v = acc.*field;
+		for( int t = t0; t <= t1; ++t ){
+			sum += v[ ( entry + t ) * per + k ];
+		}
+	}
+	return sum;
+}
+
+
+std::vector<bigint> self_correlator::lag_frames() const
+{
+	std::vector<bigint> lags( n_channels );
+	for( int c = 0; c < n_channels; ++c ) lags[c] = buffer.lag( c );
+	return lags;
+}
+
+
+std::vector<bigint> self_correlator::lag_times() const
+{
+	std::vector<bigint> lags = lag_frames();
+	for( bigint &l : lags ) l *= atoms.time_step();
+	return lags;
+}
+
+
+std::vector<double> self_correlator::vacf( int type ) const
+{
+	my_assert( __FILE__, __LINE__, which & VACF,
+	           "Velocity autocorrelation was not computed!" );
+	my_assert( __FILE__, __LINE__, type >= 0 && type <= max_type,
+	           "Type out of range!" );
+	std::vector<double> res( n_channels, 0.0 );
+	for( int c = 0; c < n_channels; ++c ){
+		double n = total( &sums::counts, c, type );
+		if( n > 0 ) res[c] = total( &sums::vacf, c, type ) / n;
+	}
+	return res;
+}
+
+
+std::vector<double> self_correlator::self_isf( int iq, int type ) const
+{
+	my_assert( __FILE__, __LINE__, which & SELF_ISF,
+	           "Self-ISF was not computed!" );
+	my_assert( __FILE__, __LINE__, iq >= 0 && iq < static_cast<int>( q.size() ),
+	           "Wave number out of range!" );
+	my_assert( __FILE__, __LINE__, type >= 0 && type <= max_type,
+	           "Type out of range!" );
+	std::vector<double> res( n_channels, 0.0 );
+	for( int c = 0; c < n_channels; ++c ){
+		double n = total( &sums::counts, c, type );
+		if( n > 0 ) res[c] = total( &sums::isf, c, type, q.size(), iq ) / n;
+	}
+	return res;
+}
+
+
+std::vector<double> self_correlator::van_hove( int channel, int type ) const
+{
+	my_assert( __FILE__, __LINE__, which & VAN_HOVE,
+	           "Van Hove function was not computed!" );
+	my_assert( __FILE__, __LINE__, channel >= 0 && channel < n_channels,
+	           "Lag out of range!" );
+	my_assert( __FILE__, __LINE__, type >= 0 && type <= max_type,
+	           "Type out of range!" );
+
+	std::vector<double> res( Nbins, 0.0 );
+	double n = total( &sums::counts, channel, type );
+	if( n <= 0 ) return res;
+
+	for( int k = 0; k < Nbins; ++k ){
+		double r0 = k*dr, r1 = ( k + 1 )*dr;
+		double vol = dims == 3
+			? 4.0 / 3.0 * constants::pi * ( r1*r1*r1 - r0*r0*r0 )
+			: constants::pi * ( r1*r1 - r0*r0 );
+		res[k] = total( &sums::van_hove, channel, type, Nbins, k ) / ( n * vol );
+	}
+	return res;
+}
+
+
+std::size_t self_correlator::memory() const
+{
+	return buffer.memory() + atoms.memory();
+}
+
+
+bigint correlate_frames( readers::dump_reader *reader, self_correlator &corr )
+{
+	block_data b;
+	bigint frames = 0;
+	while( reader->next_block( b ) == 0 ){
+		corr.add_frame( b );
+		++frames;
+	}
+	return frames;
+}
+
+
+} // namespace correlate
+
+} // namespace lammps_tools
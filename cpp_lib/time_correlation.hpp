@@ -0,0 +1,165 @@
+#ifndef TIME_CORRELATION_HPP
+#define TIME_CORRELATION_HPP
+
+/**
+   \file time_correlation.hpp
+
+   Time correlations of single atoms, over many time origins.
+*/
+
+#include <vector>
+
+#include "atom_tracker.hpp"
+#include "block_data.hpp"
+#include "dump_reader.hpp"
+#include "multi_tau.hpp"
+#include "types.hpp"
+
+
+namespace lammps_tools {
+
+namespace correlate {
+
+/**
+   \brief Correlates each atom with itself at earlier times.
+
+   Frames are fed one at a time and kept in a multi_tau buffer, so the
+   memory grows as O( N log T ) and every stored frame serves as a time
+   origin. The correlations are averaged over atoms and origins, per
+   atom type. The atoms are followed with an atom_tracker.
+
+   The quantities are:
+   - VACF, the velocity autocorrelation < v(0) . v(t) >, which needs
+     velocities in the frames.
+   - SELF_ISF, the self-intermediate scattering function
+     F_s( q, t ) = < exp( i q . dr ) >, averaged over the directions of
+     q, so < sin( q dr ) / ( q dr ) > in 3D and < J_0( q dr ) > in 2D.
+   - VAN_HOVE, the self part of the van Hove function G_s( r, t ), the
+     distribution of the displacements dr, normalised to integrate to
+     one over space.
+*/
+class self_correlator
+{
+public:
+	/// The quantities to correlate, to be or-ed together.
+	enum quantities {
+		VACF     = 1,  ///< Velocity autocorrelation.
+		SELF_ISF = 2,  ///< Self-intermediate scattering function.
+		VAN_HOVE = 4   ///< Self part of the van Hove function.
+	};
+
+	/**
+	   \param which      The quantities to compute, see quantities.
+	   \param dims       Dimensions of the system (2 or 3).
+	   \param n_threads  Number of threads to use, 0 for all cores.
+	   \param p          Frames per level of the multi_tau buffer.
+	   \param m          Spacing between levels of the buffer.
+	*/
+	explicit self_correlator( int which, int dims = 3, int n_threads = 1,
+	                          int p = 16, int m = 2 );
+
+	/// Sets the wave numbers for SELF_ISF, before the first frame.
+	void set_wave_numbers( const std::vector<double> &q );
+
+	/**
+	   \brief Sets the bins of VAN_HOVE, before the first frame.
+
+	   \param Nbins  Number of bins.
+	   \param r_max  Largest displacement to bin.
+	*/
+	void set_van_hove_bins( int Nbins, double r_max );
+
+	/// Correlates the next frame with the stored ones.
+	void add_frame( const block_data &b );
+
+	/// Returns the number of frames added.
+	bigint n_frames() const { return atoms.n_frames(); }
+
+	/// Returns the highest atom type.
+	int n_types() const { return max_type; }
+
+	/// Returns the lags that results are for, in frames.
+	std::vector<bigint> lag_frames() const;
+
+	/// Returns the lags that results are for, in time steps.
+	std::vector<bigint> lag_times() const;
+
+	/**
+	   \brief Gets the velocity autocorrelation at each lag.
+
+	   \param type  The atom type to average over, 0 for all.
+	*/
+	std::vector<double> vacf( int type = 0 ) const;
+
+	/**
+	   \brief Gets F_s( q, t ) at each lag.
+
+	   \param iq    Index of the wave number in set_wave_numbers.
+	   \param type  The atom type to average over, 0 for all.
+	*/
+	std::vector<double> self_isf( int iq, int type = 0 ) const;
+
+	/// Returns the distance of the centre of van Hove bin k.
+	double van_hove_r( int k ) const { return ( k + 0.5 )*dr; }
+
+	/**
+	   \brief Gets G_s( r, t ) at one lag.
+
+	   \param channel  Index of the lag, see lag_frames.
+	   \param type     The atom type to average over, 0 for all.
+	*/
+	std::vector<double> van_hove( int channel, int type = 0 ) const;
+
+	/// Returns the number of bytes used for stored frames.
+	std::size_t memory() const;
+
+private:
+	/// Sums of one thread, per channel c and type t at c*(max_type+1)+t.
+	struct sums
+	{
+		std::vector<double> counts;
+		std::vector<double> vacf;
+		std::vector<double> isf;       ///< n_q entries per c and t.
+		std::vector<double> van_hove;  ///< Nbins entries per c and t.
+	};
+
+	void setup( const block_data &b );
+	void grow_channels( int n );
+	void correlate_slots( sums &acc, std::size_t begin, std::size_t end,
+	                      const std::vector<multi_tau::partner> &partners ) const;
+	double total( const std::vector<double> sums::*field, int channel,
+	              int type, std::size_t per = 1, std::size_t k = 0 ) const;
+
+	int which, dims, n_threads, p, m;
+	atom_tracker atoms;
+
+	int width;     ///< Values per atom in a frame.
+	int v_offset;  ///< Where the velocities start in those.
+	std::vector<double> frame;
+	multi_tau buffer;
+
+	std::vector<int> slot_type;
+	int max_type;
+
+	std::vector<double> q;
+	int Nbins;
+	double dr;
+
+	int n_channels;
+	std::vector<sums> per_thread;
+};
+
+
+/**
+   \brief Feeds all frames of a dump reader to a self_correlator.
+
+   \returns the number of frames read.
+*/
+bigint correlate_frames( readers::dump_reader *reader, self_correlator &corr );
+
+
+} // namespace correlate
+
+} // namespace lammps_tools
+
+#endif // TIME_CORRELATION_HPP
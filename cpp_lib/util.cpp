@@ -7,6 +7,8 @@
 #include <sstream>
 #include <vector>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 
 
 using namespace lammps_tools;
@@ -27,6 +29,17 @@ std::vector<std::string> split( std::string line )
 }
 
 
+bool file_stamp( const std::string &fname,
+                 std::uint64_t &size, std::int64_t &mtime )
+{
+	struct stat st;
+	if( stat( fname.c_str(), &st ) != 0 ) return false;
+	size  = st.st_size;
+	mtime = st.st_mtime;
+	return true;
+}
+
+
 
 
 } // namespace util
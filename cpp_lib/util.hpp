@@ -8,11 +8,13 @@
 */
 
 #include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <memory>
 #include <numeric>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 #include "types.hpp"
@@ -40,6 +42,17 @@ inline bool starts_with( const std::string &s, const std::string &begin )
 	return s.compare(0, begin.length(), begin ) == 0;
 }
 
+/**
+   Checks if string starts with substring.
+   \overloads starts_with
+
+   Saves making a string out of begin if it is a literal.
+*/
+inline bool starts_with( const std::string &s, const char *begin )
+{
+	return s.compare( 0, std::strlen( begin ), begin ) == 0;
+}
+
 /**
    Checks if string ends with substring.
 
@@ -265,6 +278,20 @@ inline bool file_exists( const std::string &fname )
 	return std::ifstream(fname).good();
 }
 
+/**
+   Gets the size and modification time of a file.
+
+   Used to check if cached information about a file is still valid.
+
+   \param[in]  fname  File name to check.
+   \param[out] size   Size of the file in bytes.
+   \param[out] mtime  Time of last modification, in seconds.
+
+   \returns True if the file exists, false otherwise.
+*/
+bool file_stamp( const std::string &fname,
+                 std::uint64_t &size, std::int64_t &mtime );
+
 /**
    Checks if entry is unique in container.
 
@@ -335,6 +362,27 @@ void apply_permutation( std::vector<T>& vec, const std::vector<std::size_t>& p )
 	}
 }
 
+/**
+   Puts the entries of a vector that was reordered with apply_permutation
+   back in their original order, so per-atom results computed on a
+   reordered block_data can be scattered back.
+
+   \param vec  The reordered vector.
+   \param p    The permutation vec was reordered with.
+
+   \returns vec in the order from before the permutation.
+*/
+template <typename T>
+std::vector<T> undo_permutation( const std::vector<T> &vec,
+                                 const std::vector<std::size_t> &p )
+{
+	std::vector<T> orig( vec.size() );
+	for( std::size_t k = 0; k < p.size(); ++k ){
+		orig[ p[k] ] = vec[k];
+	}
+	return orig;
+}
+
 /**
    Removes double entries from given container in O(n log(n)) complexity.
 
@@ -623,6 +671,26 @@ typename container::const_iterator arg_min( const container &c )
 	return min_it;
 }
 
+
+/**
+   \brief Calls f(t) for t in [0, n), each on its own thread.
+
+   f(0) runs on the calling thread. Returns once all calls are done.
+*/
+template <typename F> inline
+void run_on_threads( int n, F f )
+{
+	std::vector<std::thread> workers;
+	workers.reserve( n > 1 ? n - 1 : 0 );
+	for( int t = 1; t < n; ++t ){
+		workers.emplace_back( f, t );
+	}
+	f( 0 );
+	for( std::thread &w : workers ){
+		w.join();
+	}
+}
+
 } // namespace util
 
 } // namespace lammps_tools
@@ -221,12 +221,15 @@ int block_to_hoomd_gsd( gsd_handle *gh, const block_data &b, uint props )
 	L[0] = b.dom.xhi[0] - b.dom.xlo[0];
 	L[1] = b.dom.xhi[1] - b.dom.xlo[1];
 	L[2] = b.dom.xhi[2] - b.dom.xlo[2];
-	box[3] = box[4] = box[5] = 0.0;
-
 	box[0] = L[0];
 	box[1] = L[1];
 	box[2] = L[2];
 
+	// HOOMD has tilt factors relative to the box lengths.
+	box[3] = L[1] > 0 ? b.dom.xy / L[1] : 0.0;
+	box[4] = L[2] > 0 ? b.dom.xz / L[2] : 0.0;
+	box[5] = L[2] > 0 ? b.dom.yz / L[2] : 0.0;
+
 	my_assert(__FILE__, __LINE__, N > 0, "N <= 0 does not make sense!");
 
 	if( props & TIME_STEP ){
@@ -293,40 +296,32 @@ int block_to_hoomd_gsd( gsd_handle *gh, const block_data &b, uint props )
 			continue;
 		}
 
-		// Remap the positions to -0.5L and 0.5L.
-		double xi[3];
+		// Remap the positions to -0.5L and 0.5L along each box vector,
+		// which centres the box on the origin.
+		double xi[3] = { x[i], y[i], z[i] };
+		double s[3];
+		b.dom.to_fractional( xi, s );
 		for( int d = 0; d < 3; ++d ){
-			double xd = 0;
-			switch(d){
-				case 0:
-					xd = x[i];
-					break;
-				case 1:
-					xd = y[i];
-					break;
-				case 2:
-					xd = z[i];
-					break;
-			}
-			xi[d] = xd - b.dom.xlo[d];
-			xi[d] -= 0.5*L[d];
+			s[d] -= 0.5;
 
 			constexpr const double tol = 1e-8;
 
 			// Check box bounds:
-			if( xi[d] > (0.5 + tol)*L[d] || xi[d] < -(0.5 + tol)*L[d] ){
+			if( s[d] > 0.5 + tol || s[d] < -( 0.5 + tol ) ){
 				std::cerr << "Particle " << id[i]
 				          << " is out of box bound in "
 				          << "dim " << d << " ( "
 				          << -0.5*L[d] << ", "
 				          << 0.5*L[d] << " ) with x = "
-				          << xi[d] << ".\n";
+				          << s[d]*L[d] << ".\n";
 				const char *msg = "Invalid particle position";
 				my_runtime_error( __FILE__, __LINE__,
 				                  msg );
 			}
-			xx[3*j+d] = xi[d];
 		}
+		xx[3*j+0] = s[0]*L[0] + s[1]*b.dom.xy + s[2]*b.dom.xz;
+		xx[3*j+1] = s[1]*L[1] + s[2]*b.dom.yz;
+		xx[3*j+2] = s[2]*L[2];
 	}
 
 
@@ -105,6 +105,10 @@ void block_to_lammps_data( std::ostream &out, const block_data &b )
 		out << b.dom.xlo[dim] << " " << b.dom.xhi[dim]
 		  << " " << words[dim][0] << " " << words[dim][1] << "\n";
 	}
+	if( b.dom.is_triclinic() ){
+		out << b.dom.xy << " " << b.dom.xz << " " << b.dom.yz
+		    << " xy xz yz\n";
+	}
 	out << "\n";
 
 	out << "Masses\n\n";
@@ -264,7 +268,9 @@ void output_atom_line( const block_data &b, std::ostream &out, int i )
 void block_to_lammps_dump_text( std::ostream &out, const block_data &b,
                                 bool is_local )
 {
+	bool triclinic = b.dom.is_triclinic();
 	std::string boxline = "ITEM: BOX BOUNDS";
+	if( triclinic ) boxline += " xy xz yz";
 	if( b.dom.periodic & domain::BIT_X ) boxline += " pp";
 	else                                 boxline += " ff";
 	if( b.dom.periodic & domain::BIT_Y ) boxline += " pp";
@@ -280,9 +286,19 @@ void block_to_lammps_dump_text( std::ostream &out, const block_data &b,
 		out << "ITEM: NUMBER OF ATOMS\n";
 	}
 	out << b.N << "\n" << boxline << "\n";
-	out << b.dom.xlo[0] << " " << b.dom.xhi[0] << "\n";
-	out << b.dom.xlo[1] << " " << b.dom.xhi[1] << "\n";
-	out << b.dom.xlo[2] << " " << b.dom.xhi[2] << "\n";
+	if( triclinic ){
+		// LAMMPS writes the bounding box, with the tilt factors.
+		double lo[3], hi[3];
+		double tilt[3] = { b.dom.xy, b.dom.xz, b.dom.yz };
+		b.dom.bounding_box( lo, hi );
+		for( int d = 0; d < 3; ++d ){
+			out << lo[d] << " " << hi[d] << " " << tilt[d] << "\n";
+		}
+	}else{
+		out << b.dom.xlo[0] << " " << b.dom.xhi[0] << "\n";
+		out << b.dom.xlo[1] << " " << b.dom.xhi[1] << "\n";
+		out << b.dom.xlo[2] << " " << b.dom.xhi[2] << "\n";
+	}
 
 	std::string header_line = "ITEM: ATOMS";
 	if( is_local ){
@@ -321,11 +337,10 @@ void write_bin( std::ostream &out, const T &val )
 // void block_to_lammps_dump_bin( std::ostream &out, const block_data &b )
 void block_to_lammps_dump_bin( std::ostream &out, const block_data &b )
 {
-	// Some defaults we don't use yet:
-	int triclinic = 0;
-	int xy = 0;
-	int xz = 0;
-	int yz = 0;
+	int triclinic = b.dom.is_triclinic() ? 1 : 0;
+	double xy = b.dom.xy;
+	double xz = b.dom.xz;
+	double yz = b.dom.yz;
 	int boundary[3][2];
 	int size_one = b.n_data_fields();
 
@@ -348,12 +363,16 @@ void block_to_lammps_dump_bin( std::ostream &out, const block_data &b )
 	write_bin( out, b.N );
 	write_bin( out, triclinic );
 	write_bin( out, boundary[0][0], 6*sizeof(int) );
-	write_bin( out, b.dom.xlo[0] );
-	write_bin( out, b.dom.xhi[0] );
-	write_bin( out, b.dom.xlo[1] );
-	write_bin( out, b.dom.xhi[1] );
-	write_bin( out, b.dom.xlo[2] );
-	write_bin( out, b.dom.xhi[2] );
+
+	// Triclinic boxes have the bounding box here, like text dumps.
+	double lo[3], hi[3];
+	b.dom.bounding_box( lo, hi );
+	write_bin( out, lo[0] );
+	write_bin( out, hi[0] );
+	write_bin( out, lo[1] );
+	write_bin( out, hi[1] );
+	write_bin( out, lo[2] );
+	write_bin( out, hi[2] );
 
 	if( triclinic ){
 		write_bin( out, xy );
@@ -0,0 +1,118 @@
+/*
+  Benchmarks reading of large plain text LAMMPS dump files.
+
+  The first frame of test/small_hex.dump is tiled n x n times in the
+  xy-plane and written out a few times to get a file with the same
+  formatting as LAMMPS writes, but with millions of atoms. The time
+  it takes to read the file back in is then reported.
+
+  Compile as
+  $CC -O3 -std=c++11 read_bench.cpp -I../../cpp_lib -llammpstools -o read_bench
+
+  Run as
+  ./read_bench [tiles per dimension (default 350)] [frames (default 3)]
+               [parse threads (default 1)]
+*/
+
+#include "block_data.hpp"
+#include "dump_reader_lammps.hpp"
+#include "my_timer.hpp"
+#include "util.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+using namespace lammps_tools;
+
+// Writes the tiled hexagonal lattice to fname.
+void write_tiled_dump( const std::string &fname, int tiles, int frames )
+{
+	std::ifstream in( "../../test/small_hex.dump" );
+	if( !in ){
+		std::cerr << "Run this from examples/dump_reader!\n";
+		std::exit( -1 );
+	}
+
+	std::vector<std::string> headers = { "id", "type", "x", "y", "z" };
+	std::unique_ptr<readers::dump_reader> d(
+		readers::make_dump_reader_lammps( in, headers ) );
+	d->quiet = true;
+	block_data b;
+	d->next_block( b );
+
+	const std::vector<int> &type  = data_as<int>( b.get_data( "type" ) );
+	const std::vector<double> &x  = data_as<double>( b.get_data( "x" ) );
+	const std::vector<double> &y  = data_as<double>( b.get_data( "y" ) );
+	const std::vector<double> &z  = data_as<double>( b.get_data( "z" ) );
+	double Lx = b.dom.xhi[0] - b.dom.xlo[0];
+	double Ly = b.dom.xhi[1] - b.dom.xlo[1];
+
+	std::FILE *out = std::fopen( fname.c_str(), "w" );
+	for( int frame = 0; frame < frames; ++frame ){
+		std::fprintf( out, "ITEM: TIMESTEP\n%d\n", 1000*frame );
+		std::fprintf( out, "ITEM: NUMBER OF ATOMS\n%ld\n",
+		              static_cast<long>( b.N ) * tiles * tiles );
+		std::fprintf( out, "ITEM: BOX BOUNDS pp pp pp\n" );
+		std::fprintf( out, "%.16e %.16e\n", b.dom.xlo[0],
+		              b.dom.xlo[0] + tiles*Lx );
+		std::fprintf( out, "%.16e %.16e\n", b.dom.xlo[1],
+		              b.dom.xlo[1] + tiles*Ly );
+		std::fprintf( out, "%.16e %.16e\n", b.dom.xlo[2], b.dom.xhi[2] );
+		std::fprintf( out, "ITEM: ATOMS id type x y z \n" );
+
+		long id = 1;
+		for( int i = 0; i < tiles; ++i ){
+			for( int j = 0; j < tiles; ++j ){
+				for( int k = 0; k < b.N; ++k ){
+					std::fprintf( out, "%ld %d %g %g %g \n",
+					              id++, type[k],
+					              x[k] + i*Lx, y[k] + j*Ly,
+					              z[k] );
+				}
+			}
+		}
+	}
+	std::fclose( out );
+}
+
+
+int main( int argc, char **argv )
+{
+	int tiles  = argc > 1 ? std::atoi( argv[1] ) : 350;
+	int frames = argc > 2 ? std::atoi( argv[2] ) : 3;
+	int threads = argc > 3 ? std::atoi( argv[3] ) : 1;
+
+	std::string fname = "small_hex_tiled.dump";
+	if( !util::file_exists( fname ) ){
+		std::cerr << "Writing " << fname << "...\n";
+		write_tiled_dump( fname, tiles, frames );
+	}
+
+	std::unique_ptr<readers::dump_reader_lammps> d(
+		readers::make_dump_reader_lammps( fname, FILE_FORMAT_PLAIN ) );
+	d->quiet = true;
+	d->set_parse_threads( threads );
+
+	my_timer timer;
+	block_data b;
+	double atoms = 0.0;
+	int n_frames = 0;
+
+	timer.tic();
+	while( d->next_block( b ) == 0 ){
+		atoms += b.N;
+		++n_frames;
+	}
+	double ms = timer.toc( "" );
+
+	std::cout << "Read " << n_frames << " frames, " << atoms
+	          << " atoms in " << ms << " ms ("
+	          << atoms / ms * 1e-3 << " M atoms/s).\n";
+
+	return 0;
+}
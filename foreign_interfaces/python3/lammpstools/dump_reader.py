@@ -122,6 +122,23 @@ class dump_reader:
             return None
 
 
+    def number_of_frames(self):
+        """ Returns the number of frames in the dump file, or -1 if the
+        dump file cannot be indexed. Does not change the current frame. """
+        return dump_reader_.number_of_frames( self.handle )
+
+    def seek_to_frame(self, k):
+        """ Makes frame k (counting from 0) the next block to be read. """
+        status = dump_reader_.seek_to_frame( self.handle, k )
+        if status != 0:
+            raise IndexError( "Cannot seek to frame " + str(k) + "!" )
+
+    def seek_to_timestep(self, tstep):
+        """ Makes the frame at given time step the next block to be read. """
+        status = dump_reader_.seek_to_timestep( self.handle, tstep )
+        if status != 0:
+            raise IndexError( "Cannot seek to time step " + str(tstep) + "!" )
+
     def set_column_headers(self, headers):
         """ Sets the column headers for the dump file. """
         if self.local:
@@ -22,6 +22,9 @@ PYBIND11_PLUGIN(dump_reader_) {
 	m.def("status", &lt_dump_reader_status);
 	m.def("get_next_block", &lt_get_next_block);
 	m.def("number_of_blocks", &lt_number_of_blocks);
+	m.def("number_of_frames", &lt_number_of_frames);
+	m.def("seek_to_frame", &lt_seek_to_frame);
+	m.def("seek_to_timestep", &lt_seek_to_timestep);
 	m.def("set_column_header", &lt_set_col_header);
 	m.def("set_special_column", &lt_set_column_header_as_special);
 	m.def("set_column_type", &lt_set_column_type);
@@ -3,8 +3,12 @@ import conversions_
 import numpy as np
 
 def rayleigh_gans( b, qs, ids = None, radius = None, d_epsilon = 1e-2,
-                   position_scale = 1.0 ):
-    """ Calculates Rayleigh-Gans scattering data for all atoms or given ids. """
+                   position_scale = 1.0, detectors = None, n_threads = 1 ):
+    """ Calculates Rayleigh-Gans scattering data for all atoms or given ids.
+
+    detectors is an optional array of detector directions, one row of
+    three per detector. If it is given, the result has one row of
+    intensities per detector. Otherwise the detector is along y. """
     if ids is None:
         ids = b.ids
     else:
@@ -17,5 +21,13 @@ def rayleigh_gans( b, qs, ids = None, radius = None, d_epsilon = 1e-2,
     rradius = conversions_.list_to_double_vector(radius.tolist())
     qqs  = conversions_.list_to_double_vector(qs.tolist())
 
-    return scatter_.rayleigh_gans_( b.get_ref_(), qqs, rradius, position_scale,
-                                    d_epsilon, ids )
+    if detectors is None:
+        return scatter_.rayleigh_gans_( b.get_ref_(), qqs, rradius,
+                                        position_scale, d_epsilon, ids )
+
+    dirs = np.asarray( detectors, dtype = float ).reshape( -1, 3 )
+    ddirs = conversions_.list_to_double_vector( dirs.ravel().tolist() )
+    I = scatter_.rayleigh_gans_detectors_( b.get_ref_(), qqs, rradius,
+                                           position_scale, d_epsilon, ids,
+                                           ddirs, n_threads )
+    return np.array( list(I) ).reshape( dirs.shape[0], len(qs) )
@@ -13,6 +13,8 @@ PYBIND11_PLUGIN(scatter_) {
 
 	m.def("rayleigh_gans_", &scatter::rayleigh_gans_,
 	      "Calculates Rayleigh-Gans scattering data for specific ids.");
+	m.def("rayleigh_gans_detectors_", &scatter::rayleigh_gans_detectors_,
+	      "Calculates Rayleigh-Gans scattering data for several detectors.");
 
 	return m.ptr();
 }
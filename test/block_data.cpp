@@ -2,10 +2,14 @@
 #include "block_data_access.hpp"
 #include "data_field.hpp"
 #include "dump_reader_lammps.hpp"
+#include "util.hpp"
 
 #include <catch.hpp>
 
+#include <cmath>
 #include <memory>
+#include <random>
+#include <utility>
 
 TEST_CASE ( "block_data constructor works correctly.", "[block_data_constructor]" ) {
 
@@ -113,6 +117,128 @@ TEST_CASE ( "block_data assignment works correctly.", "[block_data_assignment]"
 
 
 
+TEST_CASE ( "block_data takes over moved data fields.", "[block_data_add_moved]" ) {
+
+	using namespace lammps_tools;
+
+	data_field_double d( "data", 3 );
+	data_field_int id( "id", 3 );
+	d[0] = 1.337;
+	d[1] = d[0]*2;
+	d[2] = d[1]*2;
+	id[0] = 1;
+	id[1] = 3;
+	id[2] = 2;
+	const double *d_ptr = d.get_data_ptr();
+	const int *id_ptr = id.get_data_ptr();
+
+	block_data b1( d.size() );
+	b1.add_field( std::move( d ) );
+	b1.add_field( std::move( id ), block_data::ID );
+	REQUIRE( b1.n_data_fields() == 2 );
+	REQUIRE( d.size() == 0 );
+	REQUIRE( id.size() == 0 );
+
+	// The block should hold the very same storage.
+	const data_field_double *d1 = static_cast<const data_field_double*>(
+		b1.get_data( "data" ) );
+	const data_field_int *id1 = static_cast<const data_field_int*>(
+		b1.get_special_field( block_data::ID ) );
+	REQUIRE( d1 != nullptr );
+	REQUIRE( id1 != nullptr );
+	REQUIRE( id1->name == "id" );
+	REQUIRE( d1->get_data_ptr() == d_ptr );
+	REQUIRE( id1->get_data_ptr() == id_ptr );
+	REQUIRE( (*d1)[2] == Approx(5.348) );
+	REQUIRE( (*id1)[1] == 3 );
+
+	// Assigning over an existing block still copies.
+	block_data b2( 1 );
+	b2.add_field( data_field_int( "other", 1 ) );
+	b2 = b1;
+	REQUIRE( b2.n_data_fields() == 2 );
+	REQUIRE( b2.get_data( "other" ) == nullptr );
+	REQUIRE( b2.get_special_field( block_data::ID ) != nullptr );
+	REQUIRE( b2.get_data( "data" ) != b1.get_data( "data" ) );
+	REQUIRE( data_as<int>( b2.get_special_field( block_data::ID ) ) ==
+	         id1->get_data() );
+
+	// Swapping hands over the fields without copying them.
+	block_data b3;
+	swap( b3, b1 );
+	REQUIRE( b1.n_data_fields() == 0 );
+	REQUIRE( b3.get_data( "data" ) == d1 );
+	REQUIRE( b3.get_special_field( block_data::ID ) == id1 );
+}
+
+
+
+TEST_CASE ( "block_data emplaces, takes and moves data fields.", "[block_data_emplace_take]" ) {
+
+	using namespace lammps_tools;
+
+	block_data b1( 3 );
+	data_field_int &id = b1.emplace_field<int>( "id", block_data::ID );
+	id[0] = 3;
+	id[1] = 1;
+	id[2] = 2;
+	std::vector<double> xs = { 0.5, 1.5, 2.5 };
+	const double *x_ptr = xs.data();
+	b1.emplace_field( "x", std::move( xs ), block_data::X );
+	b1.emplace_field<double>( "charge" );
+	b1.emplace_field<double>( "y", block_data::Y );
+
+	REQUIRE( b1.n_data_fields() == 4 );
+	REQUIRE( b1.get_special_field( block_data::ID ) == &id );
+	REQUIRE( data_as<double>( b1.get_special_field( block_data::X ) ).data()
+	         == x_ptr );
+	REQUIRE( b1.get_data( "charge" )->size() == 3 );
+
+	// Taking out a plain field shifts the special fields after it.
+	int special_field = block_data::X;
+	std::unique_ptr<data_field> charge = b1.take_field( "charge",
+	                                                   special_field );
+	REQUIRE( charge );
+	REQUIRE( charge->name == "charge" );
+	REQUIRE( special_field == block_data::UNKNOWN );
+	REQUIRE( b1.n_data_fields() == 3 );
+	REQUIRE( b1.get_special_field( block_data::Y )->name == "y" );
+	REQUIRE( b1.get_special_field_type( 2 ) == block_data::Y );
+	REQUIRE( !b1.take_field( "charge", special_field ) );
+
+	// A taken field moves into another block without copying.
+	std::unique_ptr<data_field> x = b1.take_field( "x", special_field );
+	REQUIRE( special_field == block_data::X );
+	REQUIRE( b1.get_special_field( block_data::X ) == nullptr );
+	REQUIRE( b1.get_special_field( block_data::Y )->name == "y" );
+
+	block_data b2( 3 );
+	b2.add_field( std::move( *x ), special_field );
+	REQUIRE( data_as<double>( b2.get_special_field( block_data::X ) ).data()
+	         == x_ptr );
+
+	// Moving a block leaves the source empty.
+	block_data b3( std::move( b2 ) );
+	REQUIRE( b2.n_data_fields() == 0 );
+	REQUIRE( b3.N == 3 );
+	REQUIRE( data_as<double>( b3.get_special_field( block_data::X ) ).data()
+	         == x_ptr );
+
+	b2 = std::move( b3 );
+	REQUIRE( b3.n_data_fields() == 0 );
+	REQUIRE( b2.get_special_field( block_data::X )->name == "x" );
+
+	// Filtering copies the requested atoms into new fields.
+	block_data f = filter_by_id( b1, { 2, 3 } );
+	REQUIRE( f.N == 2 );
+	REQUIRE( f.n_data_fields() == b1.n_data_fields() );
+	REQUIRE( data_as<int>( f.get_special_field( block_data::ID ) ) ==
+	         std::vector<int>( { 2, 3 } ) );
+	REQUIRE( f.get_special_field( block_data::Y ) != nullptr );
+}
+
+
+
 TEST_CASE ( "block_data remove_field works correctly.", "[block_data_add_remove]" ) {
 
 	using namespace lammps_tools;
@@ -248,3 +374,84 @@ TEST_CASE ( "Convenience accessors work.", "[block_data_convenience]" ) {
 	REQUIRE( y_ro[3] == Approx(y[3]) );
 
 }
+
+TEST_CASE ( "Spatial sort reorders all fields consistently.", "[block_data_sort_spatially]" ) {
+	using namespace lammps_tools;
+
+	const int N = 4000;
+	const double L = 20.0;
+	std::mt19937 gen( 7 );
+	std::uniform_real_distribution<double> pos( 0.0, L );
+	std::vector<int> id( N ), type( N );
+	std::vector<double> x( N ), y( N ), z( N ), q( N );
+	for( int i = 0; i < N; ++i ){
+		id[i] = i + 1;
+		type[i] = 1 + i % 3;
+		x[i] = pos( gen );
+		y[i] = pos( gen );
+		z[i] = pos( gen );
+		q[i] = 0.5*i;
+	}
+
+	block_data b( N );
+	b.set_ntypes( 3 );
+	for( int d = 0; d < 3; ++d ){
+		b.dom.xlo[d] = 0.0;
+		b.dom.xhi[d] = L;
+	}
+	b.dom.periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	b.add_field( data_field_int(   "id", id ), block_data::ID );
+	b.add_field( data_field_int( "type", type ), block_data::TYPE );
+	b.add_field( data_field_double( "x", x ), block_data::X );
+	b.add_field( data_field_double( "y", y ), block_data::Y );
+	b.add_field( data_field_double( "z", z ), block_data::Z );
+	b.add_field( data_field_double( "q", q ) );
+
+	auto mean_step = []( const std::vector<double> &xs,
+	                     const std::vector<double> &ys,
+	                     const std::vector<double> &zs ){
+		double sum = 0.0;
+		for( std::size_t i = 1; i < xs.size(); ++i ){
+			double dx = xs[i] - xs[i-1];
+			double dy = ys[i] - ys[i-1];
+			double dz = zs[i] - zs[i-1];
+			sum += std::sqrt( dx*dx + dy*dy + dz*dz );
+		}
+		return sum / ( xs.size() - 1 );
+	};
+	double step_before = mean_step( x, y, z );
+
+	std::vector<std::size_t> p = b.sort_spatially( 3 );
+	REQUIRE( p.size() == static_cast<std::size_t>( N ) );
+
+	const std::vector<int> &new_id = get_id( b );
+	const std::vector<int> &new_type = get_type( b );
+	const std::vector<double> &new_x = get_x( b );
+	const std::vector<double> &new_y = get_y( b );
+	const std::vector<double> &new_z = get_z( b );
+	const std::vector<double> &new_q = data_as<double>( b.get_data( "q" ) );
+
+	std::vector<bool> seen( N, false );
+	for( int k = 0; k < N; ++k ){
+		std::size_t i = p[k];
+		REQUIRE( i < static_cast<std::size_t>( N ) );
+		REQUIRE( !seen[i] );
+		seen[i] = true;
+
+		REQUIRE( new_id[k] == id[i] );
+		REQUIRE( new_type[k] == type[i] );
+		REQUIRE( new_x[k] == x[i] );
+		REQUIRE( new_y[k] == y[i] );
+		REQUIRE( new_z[k] == z[i] );
+		REQUIRE( new_q[k] == q[i] );
+	}
+
+	SECTION( "undo_permutation restores the original order" ){
+		REQUIRE( util::undo_permutation( new_x, p ) == x );
+		REQUIRE( util::undo_permutation( new_id, p ) == id );
+	}
+
+	SECTION( "consecutive atoms are closer together" ){
+		REQUIRE( mean_step( new_x, new_y, new_z ) < 0.25*step_before );
+	}
+}
@@ -0,0 +1,130 @@
+#include <catch.hpp>
+
+#include "block_data.hpp"
+#include "block_data_access.hpp"
+#include "constants.hpp"
+#include "correlation.hpp"
+#include "fast_math.hpp"
+#include "random_block.hpp"
+
+#include <cmath>
+#include <vector>
+
+
+TEST_CASE( "Grid and pair loop agree on spatial correlations", "[correlation]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::correlate;
+
+	const double L = 10.0, x1 = 4.5, dx = 0.5;
+	const double k = constants::pi2 / L;
+	const double no_tilt[3] = { 0.0, 0.0, 0.0 };
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+
+	for( int dims : { 2, 3 } ){
+		int N = dims == 3 ? 4000 : 1500;
+		double Ls[3] = { L, L, dims == 3 ? L : 1.0 };
+		block_data b = random_block( N, Ls, no_tilt, dims, all_periodic, 1,
+		                             17 + dims );
+
+		// A plane wave along x. Averaged over a shell of pairs at
+		// distance r, cos( k x_i ) cos( k x_j ) gives J_0( kr ) / 2 in
+		// 2D and sin( kr ) / ( 2 kr ) in 3D.
+		const std::vector<double> &x = data_as<double>(
+			b.get_special_field( block_data::X ) );
+		std::vector<double> f( N );
+		for( int i = 0; i < N; ++i ) f[i] = std::cos( k * x[i] );
+
+		std::vector<double> pairs, grid;
+		correlate_double( b, f, pairs, 0.0, x1, dx, dims, PAIR_LOOP, 2 );
+		correlate_double( b, f, grid, 0.0, x1, dx, dims, GRID_FFT, 2, 0.1 );
+		REQUIRE( pairs.size() == 9 );
+		REQUIRE( grid.size() == 9 );
+
+		for( std::size_t bin = 1; bin < pairs.size(); ++bin ){
+			double r = ( bin + 0.5 ) * dx;
+			double kr = k * r;
+			double expect = dims == 3 ? 0.5 * std::sin( kr ) / kr
+				: 0.5 * fast_math::bessel_j0( kr );
+			REQUIRE( pairs[bin] == Approx( expect ).margin( 0.05 ) );
+			REQUIRE( grid[bin] == Approx( pairs[bin] ).margin( 0.02 ) );
+		}
+
+		// Threads do not change the result.
+		std::vector<double> serial;
+		correlate_double( b, f, serial, 0.0, x1, dx, dims, GRID_FFT, 1, 0.1 );
+		for( std::size_t bin = 0; bin < grid.size(); ++bin ){
+			REQUIRE( serial[bin] == Approx( grid[bin] ).margin( 1e-9 ) );
+		}
+	}
+}
+
+
+// Compares the grid with the pair loop for a plane wave along the first
+// box vector plus a ramp along the third, in a box that need not be
+// cubic or periodic. The boxes are several x1 wide, so the pair loop
+// only visits nearby bins.
+static void compare_grid_and_pairs( const lammps_tools::block_data &b,
+                                    double x1, double dx )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::correlate;
+
+	const std::vector<double> &x = get_x( b );
+	const std::vector<double> &y = get_y( b );
+	const std::vector<double> &z = get_z( b );
+	std::vector<double> f( b.N );
+	for( int i = 0; i < b.N; ++i ){
+		double xi[3] = { x[i], y[i], z[i] };
+		double s[3];
+		b.dom.to_fractional( xi, s );
+		f[i] = std::cos( constants::pi2 * s[0] ) + s[2];
+	}
+
+	std::vector<double> pairs, grid;
+	correlate_double( b, f, pairs, 0.0, x1, dx, 3, PAIR_LOOP, 2 );
+	correlate_double( b, f, grid, 0.0, x1, dx, 3, GRID_FFT, 2, 0.1 );
+	REQUIRE( pairs.size() == grid.size() );
+	for( std::size_t bin = 1; bin < pairs.size(); ++bin ){
+		REQUIRE( grid[bin] == Approx( pairs[bin] ).margin( 0.02 ) );
+	}
+}
+
+
+TEST_CASE( "Grid and pair loop agree in a box with an open side",
+           "[correlation]" )
+{
+	using namespace lammps_tools;
+
+	// Along z the grid is padded with zeros instead of wrapping.
+	const double L[3] = { 16.0, 16.0, 20.0 };
+	const double no_tilt[3] = { 0.0, 0.0, 0.0 };
+	block_data b = random_block( 8000, L, no_tilt, 3,
+	                             domain::BIT_X | domain::BIT_Y, 1, 29 );
+	compare_grid_and_pairs( b, 4.5, 0.5 );
+}
+
+
+TEST_CASE( "Grid and pair loop agree in a tilted box", "[correlation]" )
+{
+	using namespace lammps_tools;
+
+	const double L[3] = { 18.0, 18.0, 18.0 };
+	const double tilt[3] = { 4.0, 2.0, -3.0 };
+	block_data b = random_block( 8000, L, tilt, 3,
+	                             domain::BIT_X | domain::BIT_Y | domain::BIT_Z,
+	                             1, 31 );
+	compare_grid_and_pairs( b, 4.0, 0.5 );
+}
+
+
+TEST_CASE( "Spatial correlation picks the cheaper method", "[correlation]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::correlate;
+
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	block_data b = random_block( 2000, 10.0, 3, all_periodic, 1, 5 );
+	REQUIRE( choose_method( b, 0.5, 0.5, 3 ) == PAIR_LOOP );
+	REQUIRE( choose_method( b, 4.5, 1.0, 3 ) == GRID_FFT );
+}
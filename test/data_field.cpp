@@ -103,3 +103,33 @@ TEST_CASE ( "Data field's data_as works as expected.", "[data_field_data_as]" )
 		REQUIRE( d_data[i] == d[i] );
 	}
 }
+
+
+TEST_CASE ( "Data fields are moved without copying.", "[data_field_move]" ) {
+	std::vector<int> vals = { 1, 2, 4, 8, 16 };
+	const int *vals_ptr = vals.data();
+
+	data_field_int d( "d", std::move( vals ) );
+	REQUIRE( d.size() == 5 );
+	REQUIRE( d.get_data_ptr() == vals_ptr );
+
+	data_field_int e( std::move( d ) );
+	REQUIRE( e.name == "d" );
+	REQUIRE( e.size() == 5 );
+	REQUIRE( e.get_data_ptr() == vals_ptr );
+	REQUIRE( d.size() == 0 );
+
+	data_field_int f( "f", 2 );
+	f = std::move( e );
+	REQUIRE( f.name == "d" );
+	REQUIRE( f.get_data_ptr() == vals_ptr );
+	REQUIRE( f[4] == 16 );
+
+	// Moving through the base class keeps the type:
+	data_field *g = move_field( std::move( f ) );
+	REQUIRE( g->type() == data_field::INT );
+	REQUIRE( g->name == "d" );
+	REQUIRE( data_as<int>( g ).data() == vals_ptr );
+	REQUIRE( f.size() == 0 );
+	delete g;
+}
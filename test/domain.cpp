@@ -2,6 +2,8 @@
 
 #include "domain.hpp"
 
+#include <cmath>
+
 TEST_CASE( "Tests if periodic boundaries work as expected.", "[domain_pbc]" ){
 	using lammps_tools::domain;
 	domain dom;
@@ -95,3 +97,103 @@ TEST_CASE( "Tests if periodic boundaries work as expected.", "[domain_pbc]" ){
 	REQUIRE( r[2] == Approx( -1.0 ) );
 	
 }
+
+
+TEST_CASE( "Triclinic boxes shift periodic images along the box vectors.", "[domain_triclinic]" ){
+	using lammps_tools::domain;
+	domain dom;
+	dom.xlo[0] = dom.xlo[1] = dom.xlo[2] = 0.0;
+	dom.xhi[0] = dom.xhi[1] = dom.xhi[2] = 4.0;
+	dom.xy = 1.0;
+	dom.xz = 0.5;
+	dom.yz = -1.0;
+	dom.periodic = domain::BIT_X + domain::BIT_Y + domain::BIT_Z;
+	REQUIRE( dom.is_triclinic() );
+
+	// Box vectors are a = (4,0,0), b = (1,4,0) and c = (0.5,-1,4).
+	double s[3] = { 0.25, 0.5, 0.75 };
+	double x[3];
+	dom.from_fractional( s, x );
+	REQUIRE( x[0] == Approx( 1.0 + 0.5 + 0.375 ) );
+	REQUIRE( x[1] == Approx( 2.0 - 0.75 ) );
+	REQUIRE( x[2] == Approx( 3.0 ) );
+	double s2[3];
+	dom.to_fractional( x, s2 );
+	REQUIRE( s2[0] == Approx( s[0] ) );
+	REQUIRE( s2[1] == Approx( s[1] ) );
+	REQUIRE( s2[2] == Approx( s[2] ) );
+
+	// A point one b and one c away is the same point.
+	double x1[3] = { 1.0, 1.0, 1.0 };
+	double x2[3] = { 1.0 + 1.0 + 0.5, 1.0 + 4.0 - 1.0, 1.0 + 4.0 };
+	double r[3];
+	REQUIRE( dom.dist_2( x1, x2, r ) == Approx( 0.0 ).margin( 1e-12 ) );
+
+	// Close through the tilted face, but not along the axes.
+	double x3[3] = { 0.2, 0.2, 0.2 };
+	double x4[3] = { 0.2 + 1.0 - 0.3, 0.2 + 4.0 - 0.3, 0.2 };
+	REQUIRE( dom.dist_2( x3, x4, r ) == Approx( 0.18 ) );
+	REQUIRE( r[0] == Approx( 0.3 ) );
+	REQUIRE( r[1] == Approx( 0.3 ) );
+
+	// Wrapping moves the point into the box, the image flags back out.
+	double x5[3] = { x2[0], x2[1], x2[2] };
+	int ix[3] = { 0, 0, 0 };
+	dom.rewrap_position( x5, ix );
+	REQUIRE( x5[0] == Approx( x1[0] ) );
+	REQUIRE( x5[1] == Approx( x1[1] ) );
+	REQUIRE( x5[2] == Approx( x1[2] ) );
+	REQUIRE( ix[0] == 0 );
+	REQUIRE( ix[1] == 1 );
+	REQUIRE( ix[2] == 1 );
+	dom.unwrap_image( x5, ix );
+	REQUIRE( x5[0] == Approx( x2[0] ) );
+	REQUIRE( x5[1] == Approx( x2[1] ) );
+	REQUIRE( x5[2] == Approx( x2[2] ) );
+
+	// The faces are closer together than the box lengths.
+	double w[3];
+	dom.face_widths( w );
+	REQUIRE( w[0] < 4.0 );
+	REQUIRE( w[1] < 4.0 );
+	REQUIRE( w[2] == Approx( 4.0 ) );
+	REQUIRE( w[1] == Approx( 16.0 / std::sqrt( 17.0 ) ) );
+
+	// Dump files have the bounding box instead.
+	double lo[3], hi[3];
+	dom.bounding_box( lo, hi );
+	REQUIRE( lo[0] == Approx( 0.0 ) );
+	REQUIRE( hi[0] == Approx( 5.5 ) );
+	REQUIRE( lo[1] == Approx( -1.0 ) );
+	REQUIRE( hi[1] == Approx( 4.0 ) );
+	domain dom2;
+	dom2.set_from_bounding_box( lo, hi, dom.xy, dom.xz, dom.yz );
+	for( int d = 0; d < 3; ++d ){
+		REQUIRE( dom2.xlo[d] == Approx( dom.xlo[d] ) );
+		REQUIRE( dom2.xhi[d] == Approx( dom.xhi[d] ) );
+	}
+}
+
+
+TEST_CASE( "Fractional coordinates stay finite in a flat 2D box.", "[domain_triclinic]" ){
+	using lammps_tools::domain;
+	domain dom;
+	dom.xlo[0] = dom.xlo[1] = dom.xlo[2] = 0.0;
+	dom.xhi[0] = dom.xhi[1] = 4.0;
+	dom.xhi[2] = 0.0;
+	dom.xy = 1.0;
+	dom.periodic = domain::BIT_X + domain::BIT_Y;
+
+	double x[3] = { 2.5, 2.0, 0.0 };
+	double s[3];
+	dom.to_fractional( x, s );
+	REQUIRE( s[0] == Approx( 0.5 ) );
+	REQUIRE( s[1] == Approx( 0.5 ) );
+	REQUIRE( s[2] == 0.0 );
+
+	double x2[3];
+	dom.from_fractional( s, x2 );
+	REQUIRE( x2[0] == Approx( x[0] ) );
+	REQUIRE( x2[1] == Approx( x[1] ) );
+	REQUIRE( x2[2] == 0.0 );
+}
@@ -1,9 +1,12 @@
+#include "constants.hpp"
+#include "fft.hpp"
 #include "fourier.hpp"
 #include "random_generator.hpp"
 #include "util.hpp"
 
 #include <algorithm>
 #include <catch2/catch.hpp>
+#include <cmath>
 #include <fstream>
 
 
@@ -18,3 +21,87 @@ TEST_CASE ( "Fourier in two dimensions", "[fourier2D]" )
 {
 
 }
+
+
+TEST_CASE ( "Radix-2 FFT matches the direct transform", "[fft_plan]" )
+{
+	using namespace lammps_tools;
+	using fourier::cx_double;
+
+	REQUIRE( fourier::fft_size( 1 ) == 1 );
+	REQUIRE( fourier::fft_size( 5 ) == 8 );
+	REQUIRE( fourier::fft_size( 64 ) == 64 );
+
+	for( std::size_t n : { 1, 2, 8, 64 } ){
+		fourier::fft_plan plan( n );
+		REQUIRE( plan.size() == n );
+
+		// Every other entry, to check the stride too.
+		std::vector<cx_double> x( n ), data( 2*n );
+		for( std::size_t j = 0; j < n; ++j ){
+			x[j] = cx_double( std::cos( 0.3*j*j ), std::sin( 1.7*j ) - 0.2 );
+			data[2*j] = x[j];
+		}
+		plan.forward( data.data(), 2 );
+		for( std::size_t k = 0; k < n; ++k ){
+			cx_double X = 0.0;
+			for( std::size_t j = 0; j < n; ++j ){
+				X += x[j] * std::polar( 1.0, -constants::pi2 * j * k / n );
+			}
+			REQUIRE( std::real( data[2*k] ) == Approx( std::real( X ) ).margin( 1e-9 ) );
+			REQUIRE( std::imag( data[2*k] ) == Approx( std::imag( X ) ).margin( 1e-9 ) );
+		}
+
+		plan.inverse( data.data(), 2 );
+		for( std::size_t j = 0; j < n; ++j ){
+			REQUIRE( std::real( data[2*j] ) / n == Approx( std::real( x[j] ) ).margin( 1e-12 ) );
+			REQUIRE( std::imag( data[2*j] ) / n == Approx( std::imag( x[j] ) ).margin( 1e-12 ) );
+		}
+	}
+}
+
+
+TEST_CASE ( "FFT of a grid matches the direct transform", "[fft_3d]" )
+{
+	using namespace lammps_tools;
+	using fourier::cx_double;
+
+	const int n[3] = { 4, 8, 2 };
+	const std::size_t M = n[0]*n[1]*n[2];
+	std::vector<cx_double> x( M );
+	for( std::size_t j = 0; j < M; ++j ){
+		x[j] = cx_double( std::cos( 0.7*j*j ), std::sin( 1.3*j ) + 0.1 );
+	}
+
+	for( int n_threads : { 1, 3 } ){
+		std::vector<cx_double> data( x );
+		fourier::fft_3d( data.data(), n[0], n[1], n[2], false, n_threads );
+		for( int kx = 0; kx < n[0]; ++kx ){
+			for( int ky = 0; ky < n[1]; ++ky ){
+				for( int kz = 0; kz < n[2]; ++kz ){
+					cx_double X = 0.0;
+					for( int jx = 0; jx < n[0]; ++jx ){
+						for( int jy = 0; jy < n[1]; ++jy ){
+							for( int jz = 0; jz < n[2]; ++jz ){
+								double phase = double( jx*kx ) / n[0]
+									+ double( jy*ky ) / n[1]
+									+ double( jz*kz ) / n[2];
+								X += x[ ( jx*n[1] + jy )*n[2] + jz ]
+									* std::polar( 1.0, -constants::pi2 * phase );
+							}
+						}
+					}
+					const cx_double &Y = data[ ( kx*n[1] + ky )*n[2] + kz ];
+					REQUIRE( std::real( Y ) == Approx( std::real( X ) ).margin( 1e-9 ) );
+					REQUIRE( std::imag( Y ) == Approx( std::imag( X ) ).margin( 1e-9 ) );
+				}
+			}
+		}
+
+		fourier::fft_3d( data.data(), n[0], n[1], n[2], true, n_threads );
+		for( std::size_t j = 0; j < M; ++j ){
+			REQUIRE( std::real( data[j] ) / M == Approx( std::real( x[j] ) ).margin( 1e-12 ) );
+			REQUIRE( std::imag( data[j] ) / M == Approx( std::imag( x[j] ) ).margin( 1e-12 ) );
+		}
+	}
+}
@@ -0,0 +1,107 @@
+#include "dump_reader.hpp"
+#include "enums.hpp"
+#include "frame_parallel.hpp"
+
+#include <catch.hpp>
+#include <cstdio>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+TEST_CASE ( "Frame-parallel analysis emits results in frame order.", "[map_frames]" )
+{
+	using namespace lammps_tools;
+	using namespace readers;
+
+	// Work on a copy so the sidecar does not end up in the tree.
+	std::string fname = "map_frames_test.dump";
+	{
+		std::ifstream in( "small_hex.dump" );
+		std::ofstream out( fname );
+		out << in.rdbuf();
+	}
+	std::string idx_file = frame_index_file_name( fname );
+	std::remove( idx_file.c_str() );
+
+	auto open = [&fname]() -> dump_reader* {
+		return make_dump_reader( fname, FILE_FORMAT_PLAIN,
+		                         DUMP_FORMAT_LAMMPS );
+	};
+	auto analyse = []( const block_data &b ){
+		const std::vector<double> &x = data_as<double>( b.get_data( "x" ) );
+		double sum = 0.0;
+		for( double xi : x ) sum += xi;
+		return std::make_pair( b.tstep, sum );
+	};
+
+	std::vector<std::pair<bigint, double> > serial;
+	{
+		std::unique_ptr<dump_reader> d( open() );
+		block_data b;
+		while( d->next_block( b ) == 0 ) serial.push_back( analyse( b ) );
+	}
+	REQUIRE( serial.size() == 6 );
+
+	for( int n_threads : { 1, 2, 3, 8 } ){
+		for( std::size_t chunk : { 0, 1, 4 } ){
+			std::vector<std::pair<bigint, double> > results;
+			int status = map_frames(
+				open, analyse,
+				[&results]( const std::pair<bigint, double> &r ){
+					results.push_back( r ); },
+				n_threads, 0, std::numeric_limits<std::size_t>::max(),
+				chunk );
+			REQUIRE( status == 0 );
+			REQUIRE( results == serial );
+		}
+	}
+
+	// Ranges of frames, also past the end.
+	std::vector<bigint> tsteps;
+	auto emit_tstep = [&tsteps]( const std::pair<bigint, double> &r ){
+		tsteps.push_back( r.first );
+	};
+	REQUIRE( map_frames( open, analyse, emit_tstep, 3, 2, 5 ) == 0 );
+	REQUIRE( tsteps.size() == 3 );
+	REQUIRE( tsteps[0] == serial[2].first );
+	REQUIRE( tsteps[2] == serial[4].first );
+
+	tsteps.clear();
+	REQUIRE( map_frames( open, analyse, emit_tstep, 1, 4, 100 ) == 0 );
+	REQUIRE( tsteps.size() == 2 );
+	REQUIRE( tsteps[1] == serial[5].first );
+
+	tsteps.clear();
+	REQUIRE( map_frames( open, analyse, emit_tstep, 2, 6 ) == 0 );
+	REQUIRE( tsteps.empty() );
+
+	// Exceptions in the analysis end up on the calling thread.
+	auto throw_on_third = [&serial]( const block_data &b ){
+		if( b.tstep == serial[3].first ){
+			throw std::runtime_error( "bad frame" );
+		}
+		return b.tstep;
+	};
+	std::vector<bigint> before;
+	REQUIRE_THROWS_AS( map_frames( open, throw_on_third,
+	                               [&before]( bigint t ){
+		                               before.push_back( t ); },
+	                               3, 0,
+	                               std::numeric_limits<std::size_t>::max(),
+	                               1 ),
+	                   std::runtime_error );
+	REQUIRE( before.size() <= 3 );
+	for( std::size_t k = 0; k < before.size(); ++k ){
+		REQUIRE( before[k] == serial[k].first );
+	}
+
+	// A reader that cannot be opened is reported.
+	auto no_reader = []() -> dump_reader* { return nullptr; };
+	REQUIRE( map_frames( no_reader, analyse, emit_tstep, 2 ) < 0 );
+
+	std::remove( idx_file.c_str() );
+	std::remove( fname.c_str() );
+}
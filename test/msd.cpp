@@ -0,0 +1,340 @@
+#include <catch.hpp>
+
+#include "atom_tracker.hpp"
+#include "block_data.hpp"
+#include "block_data_access.hpp"
+#include "msd.hpp"
+#include "multi_tau.hpp"
+#include "random_block.hpp"
+#include "time_correlation.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+
+// Random walk of N atoms in a periodic box, as unwrapped positions
+// per frame, three per atom.
+static std::vector<std::vector<double> > random_walk( int N, int T, double L,
+                                                      double step, int seed )
+{
+	std::mt19937 gen( seed );
+	std::uniform_real_distribution<double> pos( 0.0, L );
+	std::normal_distribution<double> kick( 0.0, step );
+
+	std::vector<std::vector<double> > walk( T, std::vector<double>( 3*N ) );
+	for( int v = 0; v < 3*N; ++v ) walk[0][v] = pos( gen );
+	for( int t = 1; t < T; ++t ){
+		for( int v = 0; v < 3*N; ++v ){
+			walk[t][v] = walk[t-1][v] + kick( gen );
+		}
+	}
+	return walk;
+}
+
+
+// Makes the frame of walk at time t, wrapped into the box, with the
+// atoms in a shuffled order. Velocities are added if v is given.
+static lammps_tools::block_data walk_frame( const std::vector<double> &u,
+                                            double L, bool images,
+                                            lammps_tools::bigint tstep,
+                                            int seed,
+                                            const std::vector<double> *v = nullptr )
+{
+	using namespace lammps_tools;
+
+	int N = u.size() / 3;
+	std::vector<int> order( N );
+	for( int i = 0; i < N; ++i ) order[i] = i;
+	std::mt19937 gen( seed );
+	std::shuffle( order.begin(), order.end(), gen );
+
+	std::vector<int> id( N ), type( N ), ix( N ), iy( N ), iz( N );
+	std::vector<double> x( N ), y( N ), z( N ), vx( N ), vy( N ), vz( N );
+	for( int k = 0; k < N; ++k ){
+		int a = order[k];
+		id[k] = a + 1;
+		type[k] = 1 + a % 2;
+		if( v ){
+			vx[k] = (*v)[3*a];
+			vy[k] = (*v)[3*a+1];
+			vz[k] = (*v)[3*a+2];
+		}
+		int *img[3] = { &ix[k], &iy[k], &iz[k] };
+		double *xk[3] = { &x[k], &y[k], &z[k] };
+		for( int d = 0; d < 3; ++d ){
+			double w = std::floor( u[3*a+d] / L );
+			*img[d] = w;
+			*xk[d] = u[3*a+d] - w*L;
+		}
+	}
+
+	double Ls[3] = { L, L, L };
+	double no_tilt[3] = { 0.0, 0.0, 0.0 };
+	block_data b = make_block( id, type, x, y, z, Ls, no_tilt,
+	                           domain::BIT_X | domain::BIT_Y | domain::BIT_Z );
+	b.tstep = tstep;
+	if( v ){
+		b.add_field( data_field_double( "vx", vx ), block_data::VX );
+		b.add_field( data_field_double( "vy", vy ), block_data::VY );
+		b.add_field( data_field_double( "vz", vz ), block_data::VZ );
+	}
+	if( images ){
+		b.add_field( data_field_int( "ix", ix ), block_data::IX );
+		b.add_field( data_field_int( "iy", iy ), block_data::IY );
+		b.add_field( data_field_int( "iz", iz ), block_data::IZ );
+	}
+	return b;
+}
+
+
+// Averages over time origins that are a multiple of stride.
+static double brute_msd( const std::vector<std::vector<double> > &walk,
+                         int lag, int stride = 1 )
+{
+	double sum = 0.0;
+	int origins = 0;
+	int N = walk[0].size() / 3;
+	for( int t = 0; t + lag < static_cast<int>( walk.size() ); t += stride ){
+		++origins;
+		for( int v = 0; v < 3*N; ++v ){
+			double d = walk[t+lag][v] - walk[t][v];
+			sum += d*d;
+		}
+	}
+	return sum / ( origins * double( N ) );
+}
+
+
+TEST_CASE( "Multi-tau buffers pair frames on a logarithmic grid", "[multi_tau]" )
+{
+	using namespace lammps_tools::correlate;
+
+	const int p = 8, m = 2, T = 200;
+	multi_tau buffer( 1, p, m );
+	std::vector<int> counts;
+	for( int t = 0; t < T; ++t ){
+		double frame = t;
+		for( const multi_tau::partner &pp : buffer.add( &frame ) ){
+			// Frames hold their own time, so the lag is visible.
+			REQUIRE( frame - *pp.frame == buffer.lag( pp.channel ) );
+			if( pp.channel >= static_cast<int>( counts.size() ) ){
+				counts.resize( pp.channel + 1, 0 );
+			}
+			++counts[pp.channel];
+		}
+	}
+	REQUIRE( buffer.n_frames() == T );
+	REQUIRE( buffer.n_channels() == static_cast<int>( counts.size() ) );
+
+	// Lags increase, evenly up to p and then by a factor m per level.
+	for( int c = 1; c < buffer.n_channels(); ++c ){
+		REQUIRE( buffer.lag( c ) > buffer.lag( c - 1 ) );
+	}
+	REQUIRE( buffer.lag( p - 1 ) == p - 1 );
+	REQUIRE( buffer.lag( p ) == p );
+	REQUIRE( buffer.lag( p + p/2 ) == 2*p );
+	REQUIRE( buffer.lag( buffer.n_channels() - 1 ) < T );
+
+	// Level 0 sees every origin, coarser levels every m^l-th.
+	for( int c = 0; c < p; ++c ){
+		REQUIRE( counts[c] == T - c );
+	}
+	REQUIRE( counts[p] == ( T - 1 ) / 2 - p / 2 + 1 );
+}
+
+
+TEST_CASE( "MSD of a random walk", "[msd]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::fluctuations;
+
+	const int N = 40, T = 120;
+	const double L = 5.0;
+	std::vector<std::vector<double> > walk = random_walk( N, T, L, 0.3, 3 );
+
+	std::vector<double> ref( T );
+	for( int lag = 0; lag < T; ++lag ) ref[lag] = brute_msd( walk, lag );
+
+	for( bool images : { true, false } ){
+		for( int n_threads : { 1, 3 } ){
+			msd_accumulator fft( 3, msd_accumulator::FFT,
+			                     std::vector<int>(), n_threads );
+			msd_accumulator tau( 3, msd_accumulator::MULTI_TAU,
+			                     std::vector<int>(), n_threads, 8, 2 );
+			for( int t = 0; t < T; ++t ){
+				block_data b = walk_frame( walk[t], L, images, 100 + 50*t, t );
+				fft.add_frame( b );
+				tau.add_frame( b );
+			}
+			REQUIRE( fft.n_frames() == T );
+			REQUIRE( fft.n_atoms() == N );
+
+			std::vector<double> msd = fft.msd();
+			std::vector<bigint> lags = fft.lag_frames();
+			std::vector<bigint> times = fft.lag_times();
+			REQUIRE( msd.size() == static_cast<std::size_t>( T ) );
+			for( int lag = 0; lag < T; ++lag ){
+				REQUIRE( lags[lag] == lag );
+				REQUIRE( times[lag] == 50*lag );
+				REQUIRE( msd[lag] == Approx( ref[lag] ).epsilon( 1e-8 )
+				         .margin( 1e-9 ) );
+			}
+
+			// Coarser levels of the multi-tau buffer have fewer origins.
+			msd = tau.msd();
+			lags = tau.lag_frames();
+			REQUIRE( msd.size() == lags.size() );
+			REQUIRE( lags.back() > T / 2 );
+			int stride = 1;
+			for( std::size_t c = 0; c < lags.size(); ++c ){
+				if( c >= 8 && ( c - 8 ) % 4 == 0 ) stride *= 2;
+				REQUIRE( msd[c] == Approx( brute_msd( walk, lags[c], stride ) )
+				         .epsilon( 1e-8 ).margin( 1e-9 ) );
+			}
+			REQUIRE( tau.memory() < fft.memory() );
+		}
+	}
+
+	SECTION( "Only given atoms are followed" ){
+		std::vector<int> ids = { 3, 7, 11 };
+		msd_accumulator sub( 3, msd_accumulator::FFT, ids );
+		for( int t = 0; t < T; ++t ){
+			sub.add_frame( walk_frame( walk[t], L, true, 50*t, t ) );
+		}
+		std::vector<std::vector<double> > sub_walk( T );
+		for( int t = 0; t < T; ++t ){
+			for( int i : ids ){
+				for( int d = 0; d < 3; ++d ){
+					sub_walk[t].push_back( walk[t][3*(i-1)+d] );
+				}
+			}
+		}
+		std::vector<double> msd = sub.msd();
+		REQUIRE( sub.n_atoms() == 3 );
+		for( int lag = 0; lag < T; lag += 7 ){
+			REQUIRE( msd[lag] == Approx( brute_msd( sub_walk, lag ) )
+			         .epsilon( 1e-8 ).margin( 1e-9 ) );
+		}
+	}
+}
+
+
+TEST_CASE( "Atom tracker continues when frames gain image flags",
+           "[atom_tracker]" )
+{
+	using namespace lammps_tools;
+
+	const int N = 30, T = 60;
+	const double L = 5.0;
+	std::vector<std::vector<double> > walk = random_walk( N, T, L, 0.3, 8 );
+
+	// Start the atoms in images -1, 0 and 1.
+	for( int t = 0; t < T; ++t ){
+		for( int v = 0; v < 3*N; ++v ) walk[t][v] += L * ( v / 3 % 3 - 1 );
+	}
+
+	// No flags at first, then with flags, and then mixed.
+	for( int first_flags : { 0, 20 } ){
+		atom_tracker tracker;
+		std::vector<double> u0;
+		for( int t = 0; t < T; ++t ){
+			bool images = t >= first_flags && ( t < 40 || t % 3 == 0 );
+			tracker.add_frame( walk_frame( walk[t], L, images, 10*t, t ) );
+			const std::vector<double> &u = tracker.unwrapped();
+			if( t == 0 ) u0 = u;
+			for( int s = 0; s < N; ++s ){
+				int a = tracker.ids()[s] - 1;
+				for( int d = 0; d < 3; ++d ){
+					double moved = walk[t][3*a+d] - walk[0][3*a+d];
+					REQUIRE( u[3*s+d] - u0[3*s+d]
+					         == Approx( moved ).margin( 1e-9 ) );
+				}
+			}
+		}
+	}
+}
+
+
+TEST_CASE( "Self correlations over multi-tau time origins", "[self_correlator]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::correlate;
+
+	const int N = 30, T = 90, p = 8, m = 2;
+	const double L = 5.0;
+	std::vector<std::vector<double> > walk = random_walk( N, T, L, 0.3, 5 );
+	std::vector<std::vector<double> > vel = random_walk( N, T, 1.0, 0.5, 6 );
+	const std::vector<double> q = { 0.5, 2.0, 6.0 };
+	const int Nbins = 20;
+	const double r_max = 4.0;
+
+	int all = self_correlator::VACF | self_correlator::SELF_ISF
+		| self_correlator::VAN_HOVE;
+	for( int n_threads : { 1, 4 } ){
+		self_correlator corr( all, 3, n_threads, p, m );
+		corr.set_wave_numbers( q );
+		corr.set_van_hove_bins( Nbins, r_max );
+		for( int t = 0; t < T; ++t ){
+			corr.add_frame( walk_frame( walk[t], L, t % 2, 10*t, t, &vel[t] ) );
+		}
+		REQUIRE( corr.n_frames() == T );
+		REQUIRE( corr.n_types() == 2 );
+
+		std::vector<bigint> lags = corr.lag_frames();
+		std::vector<bigint> times = corr.lag_times();
+		std::vector<double> vacf = corr.vacf();
+		std::vector<double> vacf_2 = corr.vacf( 2 );
+		REQUIRE( lags.size() == vacf.size() );
+
+		int stride = 1;
+		for( std::size_t c = 0; c < lags.size(); ++c ){
+			if( c >= p && ( c - p ) % ( p - p/m ) == 0 ) stride *= m;
+			int lag = lags[c];
+			REQUIRE( times[c] == 10*lag );
+
+			// Brute force over the same origins.
+			double n = 0, n_2 = 0, vv = 0, vv_2 = 0;
+			std::vector<double> isf( q.size(), 0.0 );
+			std::vector<double> hist( Nbins, 0.0 );
+			for( int t = 0; t + lag < T; t += stride ){
+				for( int a = 0; a < N; ++a ){
+					double dot = 0.0, r2 = 0.0;
+					for( int d = 0; d < 3; ++d ){
+						dot += vel[t][3*a+d] * vel[t+lag][3*a+d];
+						double dd = walk[t+lag][3*a+d] - walk[t][3*a+d];
+						r2 += dd*dd;
+					}
+					double r = std::sqrt( r2 );
+					n += 1;
+					vv += dot;
+					if( a % 2 == 1 ){
+						n_2 += 1;
+						vv_2 += dot;
+					}
+					for( std::size_t iq = 0; iq < q.size(); ++iq ){
+						isf[iq] += r > 0 ? std::sin( q[iq]*r ) / ( q[iq]*r ) : 1.0;
+					}
+					int k = r / ( r_max / Nbins );
+					if( k < Nbins ) hist[k] += 1;
+				}
+			}
+			REQUIRE( vacf[c] == Approx( vv / n ) );
+			REQUIRE( vacf_2[c] == Approx( vv_2 / n_2 ) );
+			for( std::size_t iq = 0; iq < q.size(); ++iq ){
+				REQUIRE( corr.self_isf( iq )[c] == Approx( isf[iq] / n ) );
+			}
+
+			std::vector<double> G = corr.van_hove( c );
+			double dr = r_max / Nbins;
+			for( int k = 0; k < Nbins; ++k ){
+				double r0 = k*dr, r1 = ( k + 1 )*dr;
+				double vol = 4.0 / 3.0 * 3.14159265358979 * ( r1*r1*r1 - r0*r0*r0 );
+				REQUIRE( G[k] * vol == Approx( hist[k] / n ) );
+			}
+		}
+		REQUIRE( corr.self_isf( 1 )[0] == Approx( 1.0 ) );
+		REQUIRE( lags.back() > T / 2 );
+	}
+}
@@ -4,9 +4,19 @@
 #include "dump_reader_lammps.hpp"
 #include "my_timer.hpp"
 #include "neighborize.hpp"
+#include "neighborize_bin.hpp"
+#include "neighborize_cell.hpp"
+#include "neighborize_csr.hpp"
+#include "neighborize_kd_tree.hpp"
+#include "neighborize_verlet.hpp"
+#include "cluster_finder.hpp"
+#include "random_block.hpp"
+#include "rdf.hpp"
 #include "util.hpp"
 #include "writers.hpp"
 
+#include <algorithm>
+#include <random>
 #include <string>
 
 TEST_CASE( "Neighbour list works as expected", "[neigh_list_dist]" ) {
@@ -453,3 +463,669 @@ TEST_CASE( "Two-dimensional neigh list works without hiccups", "[neigh_list_dist
 
 
 }
+
+
+
+static void sort_lists( lammps_tools::neighborize::neigh_list &neighs )
+{
+	for( std::vector<int> &ni : neighs ){
+		std::sort( ni.begin(), ni.end() );
+	}
+}
+
+
+TEST_CASE( "Cell list finds the same neighbours as the N^2 search", "[neigh_list_cell]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::neighborize;
+
+	// Box sizes that give many cells, two cells and one cell.
+	double L[3]  = { 10.0, 2.5, 1.8 };
+	int periodic[3] = { domain::BIT_X | domain::BIT_Y | domain::BIT_Z,
+	                    domain::BIT_X | domain::BIT_Y,
+	                    0 };
+	double rc = 1.2;
+
+	for( int dims = 2; dims <= 3; ++dims ){
+		for( int k = 0; k < 3; ++k ){
+			for( int p = 0; p < 3; ++p ){
+				block_data b = random_block( 300, L[k], 3, periodic[p], 2,
+				                             10*k + p );
+				neigh_list nsq, bin;
+				make_list_dist( nsq, b, 0, 0, DIST_NSQ, dims, rc );
+				make_list_dist( bin, b, 0, 0, DIST_BIN, dims, rc );
+				sort_lists( nsq );
+				sort_lists( bin );
+				REQUIRE( nsq == bin );
+
+				make_list_dist( nsq, b, 1, 2, DIST_NSQ, dims, rc );
+				make_list_dist( bin, b, 1, 2, DIST_BIN, dims, rc );
+				sort_lists( nsq );
+				sort_lists( bin );
+				REQUIRE( nsq == bin );
+			}
+		}
+	}
+}
+
+
+// Only accepts pairs of atoms of the same type.
+struct same_type
+{
+	explicit same_type( const std::vector<int> &type ) : type( type ) {}
+	bool operator()( int i, int j, double r2 ) const
+	{ return type[i] == type[j]; }
+
+	const std::vector<int> &type;
+};
+
+
+TEST_CASE( "Cell list applies the pair policy", "[neigh_list_cell]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::neighborize;
+
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	block_data b = random_block( 400, 8.0, 3, all_periodic, 2, 42 );
+	const std::vector<int> &type = get_type( b );
+	double rc = 1.5;
+
+	neigh_list nsq;
+	make_list_dist( nsq, b, 0, 0, DIST_NSQ, 3, rc );
+	for( int i = 0; i < b.N; ++i ){
+		std::vector<int> same;
+		for( int j : nsq[i] ){
+			if( type[i] == type[j] ) same.push_back( j );
+		}
+		nsq[i].swap( same );
+	}
+
+	std::vector<int> all( b.N );
+	for( int i = 0; i < b.N; ++i ) all[i] = i;
+	neigh_list cell( b.N );
+	int n_neighs = build_cell_list( cell, b, all, all, 3, rc,
+	                                same_type( type ) );
+	sort_lists( nsq );
+	sort_lists( cell );
+	REQUIRE( nsq == cell );
+
+	int n_nsq = 0;
+	for( const std::vector<int> &ni : nsq ) n_nsq += ni.size();
+	REQUIRE( n_neighs == n_nsq );
+}
+
+
+TEST_CASE( "Cell list lists each neighbour once in a narrow box", "[neigh_list_cell]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::neighborize;
+
+	// Less than 2 rc wide, so two images of an atom can be within rc.
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	const double L[3] = { 1.8, 6.0, 6.0 };
+	const double tilt[3] = { 0.4, 0.0, 0.0 };
+	block_data b = random_block( 300, L, tilt, 3, all_periodic, 2, 17 );
+	double rc = 1.2;
+
+	std::vector<int> all( b.N );
+	for( int i = 0; i < b.N; ++i ) all[i] = i;
+	neigh_list nsq, cell( b.N );
+	make_list_dist( nsq, b, 0, 0, DIST_NSQ, 3, rc );
+	int n_neighs = build_cell_list( cell, b, all, all, 3, rc,
+	                                within_cutoff() );
+	sort_lists( nsq );
+	sort_lists( cell );
+	REQUIRE( nsq == cell );
+
+	int n_nsq = 0;
+	for( const std::vector<int> &ni : nsq ) n_nsq += ni.size();
+	REQUIRE( n_neighs == n_nsq );
+}
+
+
+// Same type and within rc, through the general criterion interface.
+struct close_same_type : public lammps_tools::neighborize::are_neighbours
+{
+	close_same_type( double rc ) : dist( rc, 3 ) {}
+	virtual bool operator()( const lammps_tools::block_data &b,
+	                         int i, int j ) const
+	{
+		const std::vector<int> &type = lammps_tools::get_type( b );
+		return type[i] == type[j] && dist( b, i, j );
+	}
+
+	lammps_tools::neighborize::dist_criterion dist;
+};
+
+
+TEST_CASE( "Dilute systems in big boxes use a sparse cell grid", "[neigh_list_sparse]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::neighborize;
+
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	double L = 1000.0;
+	double rc = 1.5;
+
+	for( int periodic : { 0, all_periodic } ){
+		// Three small clusters, one of them across the box edge if
+		// periodic, and a few atoms far outside of the box if not.
+		block_data b = random_block( 600, 4.0, 3, periodic, 2, 9 );
+		std::vector<double> &x = get_x_rw( b );
+		std::vector<double> &y = get_y_rw( b );
+		std::vector<double> &z = get_z_rw( b );
+		double centres[3][3] = { { 10.0, 10.0, 10.0 },
+		                         { 500.0, 20.0, 700.0 },
+		                         { 0.5, 999.0, 300.0 } };
+		for( int i = 0; i < b.N; ++i ){
+			double xi[3] = { x[i] + centres[i % 3][0],
+			                 y[i] + centres[i % 3][1],
+			                 z[i] + centres[i % 3][2] };
+			b.dom.rewrap_position( xi );
+			x[i] = xi[0];
+			y[i] = xi[1];
+			z[i] = xi[2];
+		}
+		for( int d = 0; d < 3; ++d ){
+			b.dom.xlo[d] = 0.0;
+			b.dom.xhi[d] = L;
+		}
+		if( !periodic ){
+			for( int i = 0; i < 10; ++i ){
+				x[i] = -50.0 - 0.5*i;
+				z[i] = 5e6;
+			}
+		}
+
+		std::vector<int> all( b.N );
+		for( int i = 0; i < b.N; ++i ) all[i] = i;
+		cell_list cells( b, all, 3, rc );
+		REQUIRE( cells.is_sparse() );
+		REQUIRE( cells.n_cells() <= b.N );
+
+		neigh_list nsq, bin;
+		make_list_dist( nsq, b, 0, 0, DIST_NSQ, 3, rc );
+		make_list_dist( bin, b, 0, 0, DIST_BIN, 3, rc );
+		sort_lists( nsq );
+		sort_lists( bin );
+		REQUIRE( nsq == bin );
+
+		// A general criterion would need a dense grid of 10^8 bins.
+		const std::vector<int> &type = get_type( b );
+		for( int i = 0; i < b.N; ++i ){
+			std::vector<int> same;
+			for( int j : nsq[i] ){
+				if( type[i] == type[j] ) same.push_back( j );
+			}
+			nsq[i].swap( same );
+		}
+		neighborizer_bin nb( b, all, all, 3, rc );
+		nb.quiet = true;
+		REQUIRE( nb.too_many_bins() );
+		neigh_list custom( b.N );
+		nb.build_list( custom, close_same_type( rc ) );
+		sort_lists( custom );
+		REQUIRE( nsq == custom );
+	}
+}
+
+
+TEST_CASE( "Threaded cell list gives the same lists for any thread count", "[neigh_list_threads]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::neighborize;
+
+	// About 0.8 atoms per unit volume, like a dense liquid, and enough
+	// atoms that four threads get some each.
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	int N = 10000;
+	block_data b = random_block( N, 23.2, 3, all_periodic, 2, 1 );
+	double rc = 2.5;
+
+	neigh_list ref, ref_12;
+	for( int nt : { 1, 2, 3, 4 } ){
+		neigh_list neighs, neighs_12;
+		make_list_dist( neighs, b, 0, 0, DIST_BIN, 3, rc,
+		                0, 0, true, nt );
+		make_list_dist( neighs_12, b, 1, 2, DIST_BIN, 3, rc,
+		                0, 0, true, nt );
+		if( nt == 1 ){
+			ref.swap( neighs );
+			ref_12.swap( neighs_12 );
+		}else{
+			REQUIRE( neighs == ref );
+			REQUIRE( neighs_12 == ref_12 );
+		}
+	}
+
+	// Compare with the N^2 search on a part of the atoms.
+	std::vector<int> some;
+	for( int i = 0; i < N; i += 97 ) some.push_back( i );
+	std::vector<int> all_atoms = all( b );
+	neigh_list nsq;
+	make_list_dist_indexed( nsq, b, some, all_atoms, DIST_NSQ, 3, rc );
+	for( int i : some ){
+		std::vector<int> expect;
+		for( int j : nsq[i] ){
+			expect.push_back( j );
+		}
+		REQUIRE( expect == ref[i] );
+	}
+}
+
+
+// Hidden, run it with the [benchmark] tag.
+TEST_CASE( "Threaded cell list scaling", "[.][benchmark][neigh_list_scaling]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::neighborize;
+
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	int N = 100000;
+	block_data b = random_block( N, 50.0, 3, all_periodic, 2, 1 );
+	double rc = 2.5;
+
+	std::vector<int> n_threads = { 1, 2, 4, 8, 16, 32, 64 };
+	neigh_list ref;
+	my_timer timer;
+	std::cerr << "  threads    all (ms)   1-2 (ms)\n";
+	for( int nt : n_threads ){
+		neigh_list neighs, neighs_12;
+		timer.tic();
+		make_list_dist( neighs, b, 0, 0, DIST_BIN, 3, rc,
+		                0, 0, true, nt );
+		double t_all = timer.get_toc_time();
+		timer.tic();
+		make_list_dist( neighs_12, b, 1, 2, DIST_BIN, 3, rc,
+		                0, 0, true, nt );
+		double t_12 = timer.get_toc_time();
+		std::cerr << "  " << nt << "    " << t_all
+		          << "    " << t_12 << "\n";
+
+		if( nt == 1 ){
+			ref.swap( neighs );
+		}else{
+			REQUIRE( neighs == ref );
+		}
+	}
+}
+
+
+
+TEST_CASE( "CSR neighbour lists match the vector ones", "[neigh_list_csr]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::neighborize;
+
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	block_data b = random_block( 3000, 15.0, 3, all_periodic, 2, 7 );
+	double rc = 1.6;
+	int both = csr_neigh_list::DISTANCES | csr_neigh_list::DISPLACEMENTS;
+
+	for( int types = 0; types < 2; ++types ){
+		int itype = types;
+		int jtype = 2*types;
+		neigh_list ref;
+		make_list_dist( ref, b, itype, jtype, DIST_BIN, 3, rc );
+
+		csr_neigh_list full, half;
+		make_csr_list_dist( full, b, itype, jtype, 3, rc,
+		                    csr_neigh_list::FULL, both );
+		make_csr_list_dist( half, b, itype, jtype, 3, rc,
+		                    csr_neigh_list::HALF );
+		REQUIRE( full.size() == b.N );
+		REQUIRE( full.to_neigh_list() == ref );
+		REQUIRE( half.to_neigh_list() == ref );
+		REQUIRE( 2*half.n_entries() == full.n_entries() );
+
+		for( int i = 0; i < b.N; ++i ){
+			for( int j : half[i] ){
+				REQUIRE( i < j );
+			}
+			for( std::size_t k = full.offsets[i]; k < full.offsets[i+1]; ++k ){
+				const double *d = full.dr.data() + 3*k;
+				double r2 = d[0]*d[0] + d[1]*d[1] + d[2]*d[2];
+				REQUIRE( full.r[k]*full.r[k] == Approx( r2 ) );
+			}
+			for( std::size_t k = half.offsets[i]; k < half.offsets[i+1]; ++k ){
+				REQUIRE( half.dist_2( b, i, k ) <= rc*rc );
+			}
+		}
+
+		// Same list for any number of threads.
+		csr_neigh_list threaded;
+		make_csr_list_dist( threaded, b, itype, jtype, 3, rc,
+		                    csr_neigh_list::FULL, both, 4 );
+		REQUIRE( threaded.offsets == full.offsets );
+		REQUIRE( threaded.indices == full.indices );
+		REQUIRE( threaded.r == full.r );
+		REQUIRE( threaded.dr == full.dr );
+	}
+
+	neigh_list ref;
+	make_list_dist( ref, b, 0, 0, DIST_BIN, 3, rc );
+	csr_neigh_list copy( ref );
+	REQUIRE( copy.to_neigh_list() == ref );
+}
+
+
+TEST_CASE( "Analyses take CSR neighbour lists", "[neigh_list_csr]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::neighborize;
+
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	block_data b = random_block( 2000, 12.0, 3, all_periodic, 2, 3 );
+	std::vector<int> mol( b.N );
+	for( int i = 0; i < b.N; ++i ) mol[i] = 1 + i / 10;
+	b.add_field( data_field_int( "mol", mol ), block_data::MOL );
+	double rc = 1.5;
+
+	neigh_list ref;
+	make_list_dist( ref, b, 0, 0, DIST_BIN, 3, rc );
+	csr_neigh_list full, half;
+	make_csr_list_dist( full, b, 0, 0, 3, rc, csr_neigh_list::FULL,
+	                    csr_neigh_list::DISTANCES );
+	make_csr_list_dist( half, b, 0, 0, 3, rc, csr_neigh_list::HALF );
+
+	std::vector<double> rdf_ref, coord_ref, rdf, coord;
+	compute_rdf_with_neighs( b, 20, 0.0, rc, 3, ref, rdf_ref, coord_ref );
+	compute_rdf_with_neighs( b, 20, 0.0, rc, 3, full, rdf, coord );
+	for( int k = 0; k < 20; ++k ){
+		REQUIRE( rdf[k] == Approx( rdf_ref[k] ) );
+		REQUIRE( coord[k] == Approx( coord_ref[k] ) );
+	}
+	compute_rdf_with_neighs( b, 20, 0.0, rc, 3, half, rdf, coord );
+	for( int k = 0; k < 20; ++k ){
+		REQUIRE( rdf[k] == Approx( rdf_ref[k] ) );
+	}
+
+	neigh_list conns = get_molecular_connections( b, ref );
+	neigh_list conns_half = get_molecular_connections( b, half );
+	REQUIRE( conns.size() == conns_half.size() );
+	for( std::size_t m = 0; m < conns.size(); ++m ){
+		std::sort( conns[m].begin(), conns[m].end() );
+		std::sort( conns_half[m].begin(), conns_half[m].end() );
+		REQUIRE( conns[m] == conns_half[m] );
+	}
+
+	std::vector<bond> bonds = neigh_list_to_bonds( b, ref );
+	std::vector<bond> bonds_half = neigh_list_to_bonds( b, half );
+	REQUIRE( bonds.size() == bonds_half.size() );
+}
+
+
+TEST_CASE( "Verlet lists match lists built every frame", "[neigh_list_verlet]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::neighborize;
+
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	double L = 12.0;
+	block_data b = random_block( 2000, L, 3, all_periodic, 2, 5 );
+	double rc = 1.5;
+	int both = csr_neigh_list::DISTANCES | csr_neigh_list::DISPLACEMENTS;
+
+	std::mt19937 gen( 11 );
+	std::uniform_real_distribution<double> step( -0.02, 0.02 );
+
+	for( int kind = 0; kind < 2; ++kind ){
+		verlet_list verlet( rc, 0.3, 3, 0, 0, kind, both );
+		block_data frame = b;
+		int n_frames = 20;
+		for( int t = 0; t < n_frames; ++t ){
+			std::vector<double> &x = get_x_rw( frame );
+			std::vector<double> &y = get_y_rw( frame );
+			std::vector<double> &z = get_z_rw( frame );
+			for( int i = 0; i < frame.N; ++i ){
+				double xi[3] = { x[i] + step( gen ), y[i] + step( gen ),
+				                 z[i] + step( gen ) };
+				frame.dom.rewrap_position( xi );
+				x[i] = xi[0];
+				y[i] = xi[1];
+				z[i] = xi[2];
+			}
+
+			const csr_neigh_list &nl = verlet.update( frame );
+			csr_neigh_list ref;
+			make_csr_list_dist( ref, frame, 0, 0, 3, rc, kind, both );
+			REQUIRE( nl.is_half() == ref.is_half() );
+			REQUIRE( nl.offsets == ref.offsets );
+			REQUIRE( nl.indices == ref.indices );
+			for( std::size_t k = 0; k < ref.n_entries(); ++k ){
+				REQUIRE( nl.r[k] == Approx( ref.r[k] ) );
+				REQUIRE( nl.dr[3*k] == Approx( ref.dr[3*k] ) );
+			}
+		}
+		REQUIRE( verlet.n_updates() == n_frames );
+		REQUIRE( verlet.n_builds() > 1 );
+		REQUIRE( verlet.n_builds() < n_frames / 2 );
+
+		// A different order of atoms means the list cannot be reused.
+		std::vector<int> &id = get_id_rw( frame );
+		std::swap( id[0], id[1] );
+		verlet.update( frame );
+		REQUIRE( verlet.rebuilt() );
+	}
+}
+
+
+TEST_CASE( "k-d tree queries match brute force", "[kd_tree]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::neighborize;
+
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	double L = 10.0;
+	std::mt19937 gen( 17 );
+	std::uniform_real_distribution<double> pos( -0.2*L, 1.2*L );
+	std::vector<int> periodics = { 0, domain::BIT_X, all_periodic };
+
+	for( int periodic : periodics ){
+		for( int dims : { 2, 3 } ){
+			block_data b = random_block( 1500, L, 3, periodic, 2, 23 );
+			const std::vector<double> &x = get_x( b );
+			const std::vector<double> &y = get_y( b );
+			const std::vector<double> &z = get_z( b );
+
+			// Only the even atoms go in the tree.
+			std::vector<int> even;
+			for( int i = 0; i < b.N; i += 2 ) even.push_back( i );
+			kd_tree tree( b, even, dims );
+			REQUIRE( tree.size() == static_cast<int>( even.size() ) );
+
+			for( int q = 0; q < 50; ++q ){
+				double xq[3] = { pos( gen ), pos( gen ), pos( gen ) };
+				double zq = dims == 3 ? xq[2] : 0.0;
+				domain dom = b.dom;
+				if( dims == 2 ) dom.periodic &= ~domain::BIT_Z;
+
+				std::vector<std::pair<double, int> > ref;
+				for( int j : even ){
+					double xj[3] = { x[j], y[j], dims == 3 ? z[j] : 0.0 };
+					double xi[3] = { xq[0], xq[1], zq };
+					double r[3];
+					// Queries can be out of the box, so wrap them first.
+					dom.rewrap_position( xi );
+					ref.push_back( std::make_pair( dom.dist_2( xj, xi, r ), j ) );
+				}
+				std::sort( ref.begin(), ref.end() );
+
+				double r2;
+				REQUIRE( tree.nearest( xq, r2 ) == ref[0].second );
+				REQUIRE( r2 == Approx( ref[0].first ) );
+
+				// Nearest atom whose index is a multiple of four.
+				auto by_four = []( int j ){ return j % 4 == 0; };
+				int j4 = tree.nearest_if( xq, by_four, r2 );
+				for( const std::pair<double, int> &p : ref ){
+					if( p.second % 4 ) continue;
+					REQUIRE( j4 == p.second );
+					break;
+				}
+
+				std::vector<int> idx;
+				std::vector<double> r2s;
+				tree.k_nearest( xq, 7, idx, r2s );
+				REQUIRE( idx.size() == 7 );
+				for( int m = 0; m < 7; ++m ){
+					REQUIRE( idx[m] == ref[m].second );
+					REQUIRE( r2s[m] == Approx( ref[m].first ) );
+				}
+
+				double rc = 1.7;
+				tree.within( xq, rc, idx );
+				std::sort( idx.begin(), idx.end() );
+				std::vector<int> in_range;
+				for( const std::pair<double, int> &p : ref ){
+					if( p.first <= rc*rc ) in_range.push_back( p.second );
+				}
+				std::sort( in_range.begin(), in_range.end() );
+				REQUIRE( idx == in_range );
+			}
+		}
+	}
+
+	// Points in open space, indices are into the arrays.
+	std::vector<double> px = { 0.0, 5.0, -3.0 }, py = { 0.0, 0.0, 1.0 },
+		pz = { 0.0, 0.0, 0.0 };
+	kd_tree points( px, py, pz, 3 );
+	double xq[3] = { -2.0, 1.0, 0.0 };
+	double r2;
+	REQUIRE( points.nearest( xq, r2 ) == 2 );
+	REQUIRE( r2 == Approx( 1.0 ) );
+}
+
+
+TEST_CASE( "Neighbour lists with a cut-off per type pair", "[neigh_list_type_cutoffs]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::neighborize;
+
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	block_data b = random_block( 3000, 14.0, 3, all_periodic, 2, 31 );
+	const std::vector<int> &type = get_type( b );
+
+	std::vector<std::vector<std::vector<double> > > cutoffs = {
+		{ { 1.2, 1.6 }, { 1.6, 2.0 } },
+		{ { 1.5, 0.0 }, { 0.0, 1.1 } } };
+
+	for( const std::vector<std::vector<double> > &rc : cutoffs ){
+		// All pairs within the largest cut-off, filtered per type.
+		neigh_list ref;
+		make_list_dist( ref, b, 0, 0, DIST_NSQ, 3, 2.0 );
+		for( int i = 0; i < b.N; ++i ){
+			std::vector<int> kept;
+			for( int j : ref[i] ){
+				double rc_ij = rc[ type[i]-1 ][ type[j]-1 ];
+				if( rc_ij <= 0 ) continue;
+				const std::vector<double> &x = get_x( b );
+				const std::vector<double> &y = get_y( b );
+				const std::vector<double> &z = get_z( b );
+				double xi[3] = { x[i], y[i], z[i] };
+				double xj[3] = { x[j], y[j], z[j] };
+				double r[3];
+				if( b.dom.dist_2( xi, xj, r ) <= rc_ij*rc_ij ){
+					kept.push_back( j );
+				}
+			}
+			ref[i].swap( kept );
+		}
+
+		neigh_list nsq, bin;
+		make_list_dist_types( nsq, b, rc, DIST_NSQ, 3 );
+		make_list_dist_types( bin, b, rc, DIST_BIN, 3,
+		                      neighborizer::IGNORE, neighborizer::IGNORE,
+		                      true, 2 );
+		REQUIRE( nsq == ref );
+		REQUIRE( bin == ref );
+
+		csr_neigh_list full, half;
+		make_csr_list_dist_types( full, b, rc, 3 );
+		make_csr_list_dist_types( half, b, rc, 3, csr_neigh_list::HALF,
+		                          csr_neigh_list::DISTANCES, 2 );
+		REQUIRE( full.to_neigh_list() == ref );
+		REQUIRE( half.to_neigh_list() == ref );
+	}
+
+	// Types without cut-offs are an error.
+	std::vector<std::vector<double> > one_type = { { 1.5 } };
+	neigh_list neighs;
+	REQUIRE_THROWS( make_list_dist_types( neighs, b, one_type, DIST_BIN, 3 ) );
+}
+
+
+TEST_CASE( "Neighbour lists in triclinic boxes", "[neigh_list_triclinic]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::neighborize;
+
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	const double L[3] = { 12.0, 12.0, 12.0 };
+	const double tilt[3] = { 3.0, -2.5, 4.0 };
+	block_data b = random_block( 2000, L, tilt, 3, all_periodic, 2, 41 );
+	const double rc = 2.0;
+	const std::vector<double> &x = get_x( b );
+	const std::vector<double> &y = get_y( b );
+	const std::vector<double> &z = get_z( b );
+
+	// Brute force over enough images that the nearest is among them.
+	neigh_list ref( b.N );
+	for( int i = 0; i < b.N; ++i ){
+		for( int j = 0; j < b.N; ++j ){
+			if( i == j ) continue;
+			double best = 1e300;
+			for( int c = -2; c <= 2; ++c ){
+				for( int bb = -2; bb <= 2; ++bb ){
+					for( int a = -2; a <= 2; ++a ){
+						double xj[3] = { x[j], y[j], z[j] };
+						int img[3] = { a, bb, c };
+						b.dom.unwrap_image( xj, img );
+						double dx = xj[0] - x[i];
+						double dy = xj[1] - y[i];
+						double dz = xj[2] - z[i];
+						best = std::min( best, dx*dx + dy*dy + dz*dz );
+					}
+				}
+			}
+			if( best <= rc*rc ) ref[i].push_back( j );
+		}
+	}
+
+	neigh_list nsq, bin;
+	make_list_dist( nsq, b, 0, 0, DIST_NSQ, 3, rc );
+	make_list_dist( bin, b, 0, 0, DIST_BIN, 3, rc );
+	sort_lists( nsq );
+	sort_lists( bin );
+	REQUIRE( nsq == ref );
+	REQUIRE( bin == ref );
+
+	csr_neigh_list half;
+	make_csr_list_dist( half, b, 0, 0, 3, rc, csr_neigh_list::HALF,
+	                    csr_neigh_list::NO_DATA, 2 );
+	REQUIRE( half.to_neigh_list() == ref );
+
+	kd_tree tree( b, 3 );
+	for( int i = 0; i < b.N; i += 97 ){
+		double xi[3] = { x[i], y[i], z[i] };
+		std::vector<int> idx;
+		tree.within( xi, rc, idx );
+		std::sort( idx.begin(), idx.end() );
+		idx.erase( std::remove( idx.begin(), idx.end(), i ), idx.end() );
+		REQUIRE( idx == ref[i] );
+	}
+
+	// Ghost atoms make the box non-periodic with the same neighbours.
+	block_data g = b;
+	g.add_ghost_atoms( rc, 3 );
+	g.dom.periodic = 0;
+	neigh_list ghost_neighs;
+	make_list_dist( ghost_neighs, g, 0, 0, DIST_BIN, 3, rc );
+	const std::vector<int> &gid = get_id( g );
+	for( int i = 0; i < b.N; ++i ){
+		std::vector<int> ids;
+		for( int j : ghost_neighs[i] ) ids.push_back( gid[j] - 1 );
+		std::sort( ids.begin(), ids.end() );
+		REQUIRE( ids == ref[i] );
+	}
+}
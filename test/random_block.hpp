@@ -0,0 +1,108 @@
+#ifndef TEST_RANDOM_BLOCK_HPP
+#define TEST_RANDOM_BLOCK_HPP
+
+/**
+   \file random_block.hpp
+
+   Builds blocks of atoms for the tests.
+*/
+
+#include "block_data.hpp"
+#include "domain.hpp"
+
+#include <random>
+#include <vector>
+
+
+/**
+   \brief Makes a block of the given atoms, in a box from 0 to L.
+
+   \param L         Box lengths.
+   \param tilt      Tilt factors xy, xz and yz.
+   \param periodic  Periodic bits of the domain.
+*/
+inline lammps_tools::block_data make_block( const std::vector<int> &id,
+                                            const std::vector<int> &type,
+                                            const std::vector<double> &x,
+                                            const std::vector<double> &y,
+                                            const std::vector<double> &z,
+                                            const double L[3],
+                                            const double tilt[3],
+                                            int periodic )
+{
+	using namespace lammps_tools;
+
+	block_data b( id.size() );
+	for( int d = 0; d < 3; ++d ){
+		b.dom.xlo[d] = 0.0;
+		b.dom.xhi[d] = L[d];
+	}
+	b.dom.xy = tilt[0];
+	b.dom.xz = tilt[1];
+	b.dom.yz = tilt[2];
+	b.dom.periodic = periodic;
+	b.add_field( data_field_int(   "id", id ), block_data::ID );
+	b.add_field( data_field_int( "type", type ), block_data::TYPE );
+	b.add_field( data_field_double( "x", x ), block_data::X );
+	b.add_field( data_field_double( "y", y ), block_data::Y );
+	b.add_field( data_field_double( "z", z ), block_data::Z );
+	return b;
+}
+
+
+/**
+   \brief Places N atoms at random in a box from 0 to L with the given
+          tilt factors.
+
+   Atom i has id i+1 and type 1 + i % n_types. In 2D all atoms are in
+   the plane halfway up the box in z.
+
+   \param L         Box lengths.
+   \param tilt      Tilt factors xy, xz and yz.
+   \param dims      Dimensions of the system (2 or 3).
+   \param periodic  Periodic bits of the domain.
+   \param n_types   Number of atom types.
+   \param seed      Seed of the random number generator.
+*/
+inline lammps_tools::block_data random_block( int N, const double L[3],
+                                              const double tilt[3], int dims,
+                                              int periodic, int n_types,
+                                              int seed )
+{
+	using namespace lammps_tools;
+
+	std::mt19937 gen( seed );
+	std::uniform_real_distribution<double> u( 0.0, 1.0 );
+	std::vector<int> id( N ), type( N );
+	std::vector<double> x( N ), y( N ), z( N );
+	for( int i = 0; i < N; ++i ){
+		id[i] = i + 1;
+		type[i] = 1 + i % n_types;
+		double s0 = u( gen );
+		double s1 = u( gen );
+		double s2 = dims == 3 ? u( gen ) : 0.5;
+		x[i] = s0*L[0] + s1*tilt[0] + s2*tilt[1];
+		y[i] = s1*L[1] + s2*tilt[2];
+		z[i] = s2*L[2];
+	}
+
+	block_data b = make_block( id, type, x, y, z, L, tilt, periodic );
+	b.set_ntypes( n_types );
+	return b;
+}
+
+
+/**
+   \brief Places N atoms at random in a cubic box of size L.
+*/
+inline lammps_tools::block_data random_block( int N, double L, int dims,
+                                              int periodic, int n_types,
+                                              int seed )
+{
+	double Ls[3] = { L, L, L };
+	double tilt[3] = { 0.0, 0.0, 0.0 };
+	return random_block( N, Ls, tilt, dims, periodic, n_types, seed );
+}
+
+
+#endif // TEST_RANDOM_BLOCK_HPP
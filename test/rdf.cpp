@@ -1,13 +1,16 @@
 #include <catch.hpp>
 
 #include "block_data.hpp"
+#include "block_data_access.hpp"
 #include "dump_reader_lammps.hpp"
 #include "my_timer.hpp"
 #include "neighborize.hpp"
+#include "random_block.hpp"
 #include "rdf.hpp"
 #include "util.hpp"
 #include "writers.hpp"
 
+#include <cmath>
 #include <string>
 
 TEST_CASE( "Calculating RDF works", "[neigh_rdf]" )
@@ -42,3 +45,100 @@ TEST_CASE( "Calculating RDF works", "[neigh_rdf]" )
 	lammps_tools::neighborize::compute_rdf( b, 251, 0.0, 4.0, 3, 0, 0, rdf, coords );
 
 }
+
+
+TEST_CASE( "RDF is histogrammed without a neighbour list", "[neigh_rdf_fused]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::neighborize;
+
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	block_data b = random_block( 3000, 15.0, 3, all_periodic, 2, 51 );
+	const double rc = 3.0;
+	const int Nbins = 30;
+
+	// The same as from a neighbour list, for any group and thread count.
+	for( int itype = 0; itype <= 2; ++itype ){
+		neigh_list ref;
+		make_list_dist( ref, b, itype, 2, DIST_BIN, 3, rc );
+		std::vector<double> rdf_ref, coord_ref, rdf, coord;
+		compute_rdf_with_neighs( b, Nbins, 0.0, rc, 3, ref, rdf_ref,
+		                         coord_ref );
+		for( int n_threads : { 1, 3 } ){
+			compute_rdf( b, Nbins, 0.0, rc, 3, itype, 2, rdf, coord,
+			             n_threads );
+			for( int k = 0; k < Nbins; ++k ){
+				REQUIRE( rdf[k] == Approx( rdf_ref[k] ) );
+				REQUIRE( coord[k] == Approx( coord_ref[k] ) );
+			}
+		}
+	}
+}
+
+
+TEST_CASE( "RDF accumulator averages partial g(r) over frames", "[rdf_accumulator]" )
+{
+	using namespace lammps_tools;
+	using namespace lammps_tools::neighborize;
+
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	const double rc = 3.0;
+	const int Nbins = 30;
+
+	// Brute force partial g(r) over two frames with different boxes.
+	block_data b = random_block( 3000, 15.0, 3, all_periodic, 2, 51 );
+	block_data b2 = random_block( 2000, 13.0, 3, all_periodic, 2, 52 );
+	rdf_accumulator acc( Nbins, 0.5, rc, 3, 2 );
+	acc.add_frame( b );
+	acc.add_frame( b2 );
+	REQUIRE( acc.n_frames() == 2 );
+	REQUIRE( acc.n_types() == 2 );
+
+	std::vector<double> hist( Nbins, 0.0 );
+	double density = 0.0, centres = 0.0;
+	for( const block_data *f : { &b, &b2 } ){
+		const std::vector<double> &x = get_x( *f );
+		const std::vector<double> &y = get_y( *f );
+		const std::vector<double> &z = get_z( *f );
+		const std::vector<int> &type = get_type( *f );
+		double n1 = 0, n2 = 0;
+		for( int i = 0; i < f->N; ++i ){
+			if( type[i] == 1 ) ++n1;
+			else ++n2;
+			if( type[i] != 1 ) continue;
+			for( int j = 0; j < f->N; ++j ){
+				if( type[j] != 2 ) continue;
+				double xi[3] = { x[i], y[i], z[i] };
+				double xj[3] = { x[j], y[j], z[j] };
+				double r[3];
+				double rr = std::sqrt( f->dom.dist_2( xi, xj, r ) );
+				if( rr < 0.5 || rr > rc ) continue;
+				int k = ( rr - 0.5 ) / ( ( rc - 0.5 ) / Nbins );
+				if( k < Nbins ) hist[k] += 1.0;
+			}
+		}
+		double L = f->dom.xhi[0] - f->dom.xlo[0];
+		density += n1*n2 / ( L*L*L );
+		centres += n1;
+	}
+
+	std::vector<double> g12 = acc.rdf( 1, 2 );
+	std::vector<double> n12 = acc.coord( 1, 2 );
+	std::vector<double> g21 = acc.rdf( 2, 1 );
+	double running = 0.0;
+	for( int k = 0; k < Nbins; ++k ){
+		double ra = 0.5 + k*( rc - 0.5 ) / Nbins;
+		double rb = 0.5 + ( k + 1 )*( rc - 0.5 ) / Nbins;
+		double shell = 4.0*3.14159265358979323846/3.0*( rb*rb*rb - ra*ra*ra );
+		REQUIRE( g12[k] == Approx( hist[k] / ( density*shell ) ) );
+		REQUIRE( g21[k] == Approx( g12[k] ) );
+		running += hist[k];
+		REQUIRE( n12[k] == Approx( running / centres ) );
+	}
+
+	// An ideal gas has g(r) close to 1 for all pairs.
+	std::vector<double> g = acc.rdf( 0, 0 );
+	for( int k = Nbins / 2; k < Nbins; ++k ){
+		REQUIRE( g[k] == Approx( 1.0 ).epsilon( 0.1 ) );
+	}
+}
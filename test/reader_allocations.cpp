@@ -0,0 +1,128 @@
+#include "dump_reader.hpp"
+#include "dump_reader_lammps.hpp"
+#include "enums.hpp"
+
+#include <atomic>
+#include <catch.hpp>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <vector>
+
+
+// Counts heap allocations while counting is switched on, so that reading
+// blocks can be checked to not allocate at all. The operators are global
+// to the test program, so counting is off by default and only switched
+// on around the reads that are measured.
+static std::atomic<bool> counting( false );
+static std::atomic<std::size_t> n_allocations( 0 );
+
+void *operator new( std::size_t size )
+{
+	if( counting ) ++n_allocations;
+	if( void *p = std::malloc( size ? size : 1 ) ) return p;
+	throw std::bad_alloc();
+}
+
+void operator delete( void *p ) noexcept
+{
+	std::free( p );
+}
+
+
+// Counts allocations for as long as it lives.
+struct count_allocations
+{
+	count_allocations() : before( n_allocations ) { counting = true; }
+	~count_allocations() { counting = false; }
+
+	std::size_t count() const { return n_allocations - before; }
+
+	std::size_t before;
+};
+
+
+TEST_CASE ( "Reading blocks reuses the fields of the previous ones.", "[block_recycling]" )
+{
+	using namespace lammps_tools;
+	using namespace readers;
+
+	auto open = []() -> dump_reader_lammps* {
+		return make_dump_reader_lammps( "small_hex.dump",
+		                                FILE_FORMAT_PLAIN );
+	};
+
+	// Reference blocks, each read into a new block_data.
+	std::vector<block_data> fresh;
+	{
+		std::unique_ptr<dump_reader_lammps> d( open() );
+		while( true ){
+			block_data b;
+			if( d->next_block( b ) != 0 ) break;
+			fresh.push_back( b );
+		}
+	}
+	REQUIRE( fresh.size() == 6 );
+
+	// Blocks read ahead would be counted with the block they follow, so
+	// the counts below need serial reads, also with THREADED_READ_BLOCKS.
+	std::unique_ptr<dump_reader_lammps> d( open() );
+	d->set_prefetch( 0 );
+	block_data b;
+	std::vector<std::size_t> columns, heap;
+	for( const block_data &ref : fresh ){
+		int status;
+		std::size_t allocated;
+		{
+			count_allocations counter;
+			status = d->next_block( b );
+			allocated = counter.count();
+		}
+		REQUIRE( status == 0 );
+		heap.push_back( allocated );
+		columns.push_back( d->get_column_allocations() );
+
+		REQUIRE( b.tstep == ref.tstep );
+		REQUIRE( b.N == ref.N );
+		REQUIRE( b.dom.periodic == ref.dom.periodic );
+		REQUIRE( b.dom.xhi[0] == ref.dom.xhi[0] );
+		REQUIRE( b.n_special_fields() == ref.n_special_fields() );
+		REQUIRE( b.ati.type_names == ref.ati.type_names );
+		for( const char *h : { "id", "type" } ){
+			REQUIRE( data_as<int>( b.get_data( h ) ) ==
+			         data_as<int>( ref.get_data( h ) ) );
+		}
+		for( const char *h : { "x", "y", "z" } ){
+			REQUIRE( data_as<double>( b.get_data( h ) ) ==
+			         data_as<double>( ref.get_data( h ) ) );
+		}
+	}
+
+	// The first two blocks need new fields, one for the block
+	// being read and one for the block that is handed back.
+	REQUIRE( columns[0] == 5 );
+	REQUIRE( columns[1] == 10 );
+	for( std::size_t k = 2; k < fresh.size(); ++k ){
+		REQUIRE( columns[k] == columns[1] );
+		REQUIRE( heap[k] == 0 );
+	}
+
+	// Fields the caller added make the block not match the layout
+	// once it comes back, so it gets new fields.
+	std::unique_ptr<dump_reader_lammps> d2( open() );
+	d2->set_prefetch( 0 );
+	block_data b2;
+	REQUIRE( d2->next_block( b2 ) == 0 );
+	REQUIRE( d2->next_block( b2 ) == 0 );
+	b2.emplace_field<double>( "extra" );
+	REQUIRE( d2->next_block( b2 ) == 0 );
+	REQUIRE( d2->get_column_allocations() == 10 );
+	REQUIRE( d2->next_block( b2 ) == 0 );
+	REQUIRE( d2->get_column_allocations() == 15 );
+	REQUIRE( b2.n_data_fields() == 5 );
+	REQUIRE( b2.tstep == fresh[3].tstep );
+	REQUIRE( data_as<double>( b2.get_data( "x" ) ) ==
+	         data_as<double>( fresh[3].get_data( "x" ) ) );
+	REQUIRE( d2->next_block( b2 ) == 0 );
+	REQUIRE( d2->get_column_allocations() == 15 );
+}
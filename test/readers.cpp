@@ -1,12 +1,21 @@
 #include "dump_reader_lammps.hpp"
+#include "dump_reader_lammps_bin.hpp"
 #include "enums.hpp"
+#include "gzip_reader.hpp"
 #include "id_map.hpp"
 #include "readers.hpp"
 #include "util.hpp"
+#include "writers.hpp"
 
 #include <algorithm>
 #include <catch.hpp>
+#include <cstdio>
 #include <fstream>
+#include <sstream>
+
+#ifdef HAVE_ZLIB
+#  include <zlib.h>
+#endif
 
 
 TEST_CASE ( "LAMMPS data file gets read correctly.", "[read_lammps_data]" )
@@ -203,6 +212,375 @@ TEST_CASE ( "LAMMPS binary dump file gets read correctly.", "[read_lammps_dump_b
 
 
 
+// Writes a frame in the layout LAMMPS uses for binary dumps.
+static void write_bin_frame( std::FILE *f, int64_t tstep,
+                             const std::vector<std::vector<double> > &chunks,
+                             int size_one, bool triclinic )
+{
+	int64_t natoms = 0;
+	for( const std::vector<double> &c : chunks ) natoms += c.size() / size_one;
+	int tri = triclinic;
+	int boundary[6] = { 0, 0, 0, 0, 1, 1 };
+	double box[6] = { 0.0, 10.0, -1.0, 9.0, 0.0, 5.0 };
+	double tilt[3] = { 0.5, 0.0, 0.0 };
+	int nchunk = chunks.size();
+
+	std::fwrite( &tstep, sizeof(int64_t), 1, f );
+	std::fwrite( &natoms, sizeof(int64_t), 1, f );
+	std::fwrite( &tri, sizeof(int), 1, f );
+	std::fwrite( boundary, sizeof(int), 6, f );
+	std::fwrite( box, sizeof(double), 6, f );
+	if( triclinic ) std::fwrite( tilt, sizeof(double), 3, f );
+	std::fwrite( &size_one, sizeof(int), 1, f );
+	std::fwrite( &nchunk, sizeof(int), 1, f );
+	for( const std::vector<double> &c : chunks ){
+		int n = c.size();
+		std::fwrite( &n, sizeof(int), 1, f );
+		std::fwrite( c.data(), sizeof(double), n, f );
+	}
+}
+
+
+TEST_CASE ( "Memory-mapped binary dump reader decodes columns.", "[read_lammps_dump_bin_mmap]" )
+{
+	using namespace lammps_tools;
+	using namespace readers;
+
+	std::string fname = "bin_mmap_test.dump.bin";
+	std::FILE *f = std::fopen( fname.c_str(), "wb" );
+	REQUIRE( f );
+	// Two chunks, as if written by two processors, id type x y z.
+	std::vector<std::vector<double> > chunks = {
+		{ 1, 1, 0.5, 1.5, 2.5,   2, 2, 3.25, 4.0, 1.0 },
+		{ 3, 1, 7.0, 8.0, 0.125 } };
+	write_bin_frame( f, 0,   chunks, 5, false );
+	chunks[1][2] = 6.0;
+	write_bin_frame( f, 100, chunks, 5, true );
+	write_bin_frame( f, 200, chunks, 5, false );
+	// A frame LAMMPS did not finish writing:
+	int64_t partial = 300;
+	std::fwrite( &partial, sizeof(int64_t), 1, f );
+	std::fclose( f );
+
+	std::vector<std::string> headers = { "id", "type", "x", "y", "z" };
+	std::shared_ptr<dump_reader_lammps> r(
+		make_dump_reader_lammps( fname, FILE_FORMAT_BIN, headers ) );
+	r->set_column_header_as_special( "id", block_data::ID );
+	r->set_column_header_as_special( "x", block_data::X );
+	r->quiet = true;
+
+	dump_reader_lammps_bin *rb = static_cast<dump_reader_lammps_bin*>( r.get() );
+	REQUIRE( rb->n_frames() == 3 );
+
+	block_data b;
+	REQUIRE( r->next_block( b ) == 0 );
+	REQUIRE( b.tstep == 0 );
+	REQUIRE( b.N == 3 );
+	REQUIRE( b.dom.xlo[1] == Approx( -1.0 ) );
+	REQUIRE( b.dom.xhi[2] == Approx(  5.0 ) );
+	REQUIRE( b.dom.periodic == (domain::BIT_X | domain::BIT_Y) );
+
+	const std::vector<int> &id = data_as<int>( b.get_special_field( block_data::ID ) );
+	const std::vector<int> &type = data_as<int>( b.get_data( "type" ) );
+	const std::vector<double> &x = data_as<double>( b.get_special_field( block_data::X ) );
+	const std::vector<double> &z = data_as<double>( b.get_data( "z" ) );
+	REQUIRE( id[0] == 1 );
+	REQUIRE( id[2] == 3 );
+	REQUIRE( type[1] == 2 );
+	REQUIRE( x[1] == 3.25 );
+	REQUIRE( x[2] == 7.0 );
+	REQUIRE( z[2] == 0.125 );
+
+	// Second frame is triclinic, which shifts the column data:
+	REQUIRE( r->next_block( b ) == 0 );
+	REQUIRE( b.tstep == 100 );
+	REQUIRE( data_as<double>( b.get_data( "x" ) )[2] == 6.0 );
+
+	REQUIRE( rb->skip_n_blocks( 1 ) == 0 );
+	REQUIRE( r->next_block( b ) != 0 );
+	REQUIRE( b.tstep == 100 );
+
+	// The binary reader can go back too:
+	REQUIRE( r->get_frame_index()->size() == 3 );
+	REQUIRE( r->seek_to_timestep( 100 ) == 0 );
+	REQUIRE( r->next_block( b ) == 0 );
+	REQUIRE( data_as<double>( b.get_data( "x" ) )[2] == 6.0 );
+	REQUIRE( r->seek_to_frame( 3 ) > 0 );
+
+	std::remove( fname.c_str() );
+}
+
+
+
+TEST_CASE ( "Prefetching dump reader gives same blocks as serial one.", "[read_lammps_dump_prefetch]" )
+{
+	using namespace lammps_tools;
+	using namespace readers;
+
+	std::string fname = "small_hex.dump";
+	std::unique_ptr<dump_reader> serial(
+		make_dump_reader( fname, FILE_FORMAT_PLAIN, DUMP_FORMAT_LAMMPS ) );
+	std::unique_ptr<dump_reader> ahead(
+		make_dump_reader( fname, FILE_FORMAT_PLAIN, DUMP_FORMAT_LAMMPS ) );
+	serial->set_prefetch( 0 );
+	ahead->set_prefetch( 2 );
+	REQUIRE( ahead->get_prefetch() == 2 );
+
+	block_data b1, b2;
+	int n_blocks = 0;
+	while( true ){
+		int s1 = serial->next_block( b1 );
+		int s2 = ahead->next_block( b2 );
+		REQUIRE( s1 == s2 );
+		if( s1 ) break;
+
+		REQUIRE( b1.tstep == b2.tstep );
+		REQUIRE( b1.N == b2.N );
+		const std::vector<double> &x1 = data_as<double>( b1.get_data( "x" ) );
+		const std::vector<double> &x2 = data_as<double>( b2.get_data( "x" ) );
+		REQUIRE( x1 == x2 );
+		++n_blocks;
+	}
+	REQUIRE( n_blocks == 6 );
+	// Asking again after EOF should give EOF again.
+	REQUIRE( ahead->next_block( b2 ) > 0 );
+
+	// Destroying a reader with a full queue should not hang.
+	std::unique_ptr<dump_reader> busy(
+		make_dump_reader( fname, FILE_FORMAT_PLAIN, DUMP_FORMAT_LAMMPS ) );
+	busy->set_prefetch( 1 );
+	REQUIRE( busy->next_block( b1 ) == 0 );
+	REQUIRE( b1.tstep == 0 );
+	REQUIRE( busy->skip_n_blocks( 2 ) == 0 );
+	REQUIRE( busy->next_block( b1 ) == 0 );
+	REQUIRE( b1.tstep == 150 );
+	busy.reset();
+}
+
+
+TEST_CASE ( "Prefetching dump reader reports errors in order.", "[read_lammps_dump_prefetch_error]" )
+{
+	using namespace lammps_tools;
+	using namespace readers;
+
+	// Second frame ends early:
+	std::string fname = "prefetch_error_test.dump";
+	{
+		std::ifstream in( "small_hex.dump" );
+		std::ofstream out( fname );
+		std::string line;
+		for( int i = 0; i < 50 && std::getline( in, line ); ++i ){
+			out << line << "\n";
+		}
+	}
+	std::unique_ptr<dump_reader> r(
+		make_dump_reader( fname, FILE_FORMAT_PLAIN, DUMP_FORMAT_LAMMPS ) );
+	r->set_prefetch( 4 );
+
+	block_data b;
+	REQUIRE( r->next_block( b ) == 0 );
+	REQUIRE( b.tstep == 0 );
+	REQUIRE( r->next_block( b ) < 0 );
+	// The block is left alone on failure:
+	REQUIRE( b.tstep == 0 );
+	REQUIRE( b.N == 32 );
+
+	std::remove( fname.c_str() );
+}
+
+
+TEST_CASE ( "Prefetched blocks are read again when column types change.", "[read_lammps_dump_prefetch_settings]" )
+{
+	using namespace lammps_tools;
+	using namespace readers;
+
+	// Work on a copy so the sidecar does not end up in the tree.
+	std::string fname = "prefetch_settings_test.dump";
+	{
+		std::ifstream in( "small_hex.dump" );
+		std::ofstream out( fname );
+		out << in.rdbuf();
+	}
+	std::string idx_file = frame_index_file_name( fname );
+	std::remove( idx_file.c_str() );
+
+	std::vector<block_data> blocks;
+	{
+		std::unique_ptr<dump_reader> d(
+			make_dump_reader( fname, FILE_FORMAT_PLAIN, DUMP_FORMAT_LAMMPS ) );
+		d->set_prefetch( 0 );
+		block_data b;
+		while( d->next_block( b ) == 0 ) blocks.push_back( b );
+	}
+	REQUIRE( blocks.size() == 6 );
+
+	std::unique_ptr<dump_reader_lammps> r(
+		make_dump_reader_lammps( fname, FILE_FORMAT_PLAIN ) );
+	r->set_prefetch( 2 );
+	block_data b;
+	REQUIRE( r->next_block( b ) == 0 );
+	REQUIRE( b.get_data( "x" )->type() == data_field::DOUBLE );
+
+	// The thread has read ahead by now, but the next block should
+	// still be the next frame, with the new type.
+	r->set_column_type( "x", data_field::INT );
+	REQUIRE( r->next_block( b ) == 0 );
+	REQUIRE( b.tstep == blocks[1].tstep );
+	REQUIRE( b.get_data( "x" )->type() == data_field::INT );
+
+	int n_blocks = 2;
+	while( r->next_block( b ) == 0 ){
+		REQUIRE( b.tstep == blocks[n_blocks].tstep );
+		REQUIRE( b.get_data( "x" )->type() == data_field::INT );
+		++n_blocks;
+	}
+	REQUIRE( n_blocks == 6 );
+
+	r.reset();
+	std::remove( idx_file.c_str() );
+	std::remove( fname.c_str() );
+}
+
+
+
+TEST_CASE ( "Parallel text parsing gives same blocks as serial one.", "[read_lammps_dump_parallel_parse]" )
+{
+	using namespace lammps_tools;
+	using namespace readers;
+
+	// Frames large enough to be split, with Windows line endings in
+	// the second and no trailing newline at the very end.
+	std::string fname = "parallel_parse_test.dump";
+	{
+		std::ofstream out( fname, std::ios_base::binary );
+		int N = 100000;
+		for( int frame = 0; frame < 3; ++frame ){
+			const char *nl = frame == 1 ? "\r\n" : "\n";
+			out << "ITEM: TIMESTEP" << nl << 10*frame << nl
+			    << "ITEM: NUMBER OF ATOMS" << nl << N << nl
+			    << "ITEM: BOX BOUNDS pp pp pp" << nl
+			    << "0 10" << nl << "0 10" << nl << "0 10" << nl
+			    << "ITEM: ATOMS id type x y z c_pe" << nl;
+			for( int i = 0; i < N; ++i ){
+				out << i+1 << " " << 1 + i % 3 << " " << 1e-3*i
+				    << " " << -0.5*i << " " << i % 7 << " "
+				    << 1.25e-5*frame*i;
+				if( frame < 2 || i < N-1 ) out << nl;
+			}
+		}
+	}
+
+	std::unique_ptr<dump_reader_lammps> serial(
+		make_dump_reader_lammps( fname, FILE_FORMAT_PLAIN ) );
+	std::unique_ptr<dump_reader_lammps> parallel(
+		make_dump_reader_lammps( fname, FILE_FORMAT_PLAIN ) );
+	parallel->set_parse_threads( 4 );
+	REQUIRE( parallel->get_parse_threads() == 4 );
+
+	block_data b_serial, b_parallel;
+	int n_blocks = 0;
+	while( serial->next_block( b_serial ) == 0 ){
+		REQUIRE( parallel->next_block( b_parallel ) == 0 );
+		REQUIRE( b_parallel.tstep == b_serial.tstep );
+		REQUIRE( b_parallel.N == 100000 );
+
+		const std::vector<int> &id_s = data_as<int>( b_serial.get_data( "id" ) );
+		const std::vector<int> &id_p = data_as<int>( b_parallel.get_data( "id" ) );
+		REQUIRE( id_p == id_s );
+		for( const char *col : { "x", "y", "z", "c_pe" } ){
+			const std::vector<double> &s = data_as<double>( b_serial.get_data( col ) );
+			const std::vector<double> &p = data_as<double>( b_parallel.get_data( col ) );
+			REQUIRE( p == s );
+		}
+		++n_blocks;
+	}
+	REQUIRE( n_blocks == 3 );
+	REQUIRE( parallel->next_block( b_parallel ) > 0 );
+
+	std::remove( fname.c_str() );
+}
+
+
+TEST_CASE ( "Dump readers seek to frames through the frame index.", "[dump_reader_seek]" )
+{
+	using namespace lammps_tools;
+	using namespace readers;
+
+	// Work on a copy so the sidecar does not end up in the tree.
+	std::string fname = "seek_test.dump";
+	{
+		std::ifstream in( "small_hex.dump" );
+		std::ofstream out( fname );
+		out << in.rdbuf();
+	}
+	std::string idx_file = frame_index_file_name( fname );
+	std::remove( idx_file.c_str() );
+
+	std::vector<block_data> blocks;
+	{
+		std::unique_ptr<dump_reader> d(
+			make_dump_reader( fname, FILE_FORMAT_PLAIN, DUMP_FORMAT_LAMMPS ) );
+		block_data b;
+		while( d->next_block( b ) == 0 ) blocks.push_back( b );
+	}
+	REQUIRE( blocks.size() == 6 );
+
+	std::unique_ptr<dump_reader> d(
+		make_dump_reader( fname, FILE_FORMAT_PLAIN, DUMP_FORMAT_LAMMPS ) );
+	d->set_prefetch( 2 );
+	block_data b;
+	REQUIRE( d->next_block( b ) == 0 );
+
+	// Indexing does not change what is read next.
+	const frame_index *index = d->get_frame_index();
+	REQUIRE( index );
+	REQUIRE( index->size() == blocks.size() );
+	REQUIRE( (*index)[0].offset == 0 );
+	REQUIRE( (*index)[3].tstep == blocks[3].tstep );
+	REQUIRE( (*index)[3].N == blocks[3].N );
+	REQUIRE( d->next_block( b ) == 0 );
+	REQUIRE( b.tstep == blocks[1].tstep );
+
+	REQUIRE( d->seek_to_frame( 4 ) == 0 );
+	REQUIRE( d->next_block( b ) == 0 );
+	REQUIRE( b.tstep == blocks[4].tstep );
+	REQUIRE( d->seek_to_frame( 0 ) == 0 );
+	REQUIRE( d->next_block( b ) == 0 );
+	REQUIRE( b.tstep == blocks[0].tstep );
+	REQUIRE( data_as<double>( b.get_data( "x" ) ) ==
+	         data_as<double>( blocks[0].get_data( "x" ) ) );
+
+	REQUIRE( d->seek_to_timestep( blocks[5].tstep ) == 0 );
+	REQUIRE( d->next_block( b ) == 0 );
+	REQUIRE( b.tstep == blocks[5].tstep );
+	REQUIRE( d->next_block( b ) > 0 );
+
+	// After EOF seeking still works, and bad targets are rejected.
+	REQUIRE( d->seek_to_frame( 2 ) == 0 );
+	REQUIRE( d->next_block( b ) == 0 );
+	REQUIRE( b.tstep == blocks[2].tstep );
+	REQUIRE( d->seek_to_frame( 6 ) > 0 );
+	REQUIRE( d->seek_to_timestep( -1 ) > 0 );
+
+	// The sidecar is picked up while the dump is unchanged.
+	frame_index cached;
+	REQUIRE( cached.load( fname ) );
+	REQUIRE( cached.size() == blocks.size() );
+	REQUIRE( cached.end == index->end );
+	REQUIRE( cached[5].offset == (*index)[5].offset );
+
+	{
+		std::ofstream out( fname, std::ios_base::app );
+		out << "ITEM: TIMESTEP\n";
+	}
+	REQUIRE( !cached.load( fname ) );
+	REQUIRE( cached.size() == 0 );
+
+	std::remove( idx_file.c_str() );
+	std::remove( fname.c_str() );
+}
+
+
 TEST_CASE ( "LAMMPS gzipped text dump file gets read correctly.", "[read_lammps_dump_gzip]" )
 {
 	using namespace lammps_tools;
@@ -271,6 +649,111 @@ TEST_CASE ( "LAMMPS gzipped text dump file gets read correctly.", "[read_lammps_
 }
 
 
+#ifdef HAVE_ZLIB
+TEST_CASE ( "Gzip reader indexes, seeks and decompresses in parallel.", "[read_lammps_dump_gzip_index]" )
+{
+	using namespace lammps_tools;
+	using namespace readers;
+
+	// Large enough for several access points, written as two gzip
+	// members like after concatenating files.
+	std::string fname = "gzip_index_test.dump";
+	std::string gz_name = fname + ".gz";
+	std::string idx_file = util::gzip_index_file_name( gz_name );
+	std::remove( idx_file.c_str() );
+	{
+		std::ofstream plain( fname );
+		gzFile gz = gzopen( gz_name.c_str(), "wb1" );
+		int N = 200000;
+		for( int frame = 0; frame < 5; ++frame ){
+			if( frame == 3 ){
+				gzclose( gz );
+				gz = gzopen( gz_name.c_str(), "ab1" );
+			}
+			std::stringstream ss;
+			ss << "ITEM: TIMESTEP\n" << 100*frame << "\n"
+			   << "ITEM: NUMBER OF ATOMS\n" << N << "\n"
+			   << "ITEM: BOX BOUNDS pp pp pp\n"
+			   << "0 10\n0 10\n0 10\n"
+			   << "ITEM: ATOMS id type x y z\n";
+			for( int i = 0; i < N; ++i ){
+				ss << i+1 << " " << 1 + (i*7 + frame) % 3 << " "
+				   << 1e-3*i << " " << 0.5*frame << " " << i % 11 << "\n";
+			}
+			std::string text = ss.str();
+			plain << text;
+			gzwrite( gz, text.data(), text.size() );
+		}
+		gzclose( gz );
+	}
+
+	std::vector<block_data> blocks;
+	{
+		std::unique_ptr<dump_reader> d(
+			make_dump_reader( fname, FILE_FORMAT_PLAIN, DUMP_FORMAT_LAMMPS ) );
+		block_data b;
+		while( d->next_block( b ) == 0 ) blocks.push_back( b );
+	}
+	REQUIRE( blocks.size() == 5 );
+
+	auto same_block = []( const block_data &a, const block_data &b ){
+		return a.tstep == b.tstep && a.N == b.N &&
+			data_as<int>( a.get_data( "type" ) ) ==
+			data_as<int>( b.get_data( "type" ) ) &&
+			data_as<double>( a.get_data( "x" ) ) ==
+			data_as<double>( b.get_data( "x" ) ) &&
+			data_as<double>( a.get_data( "y" ) ) ==
+			data_as<double>( b.get_data( "y" ) );
+	};
+
+	{
+		// No index yet, so this decompresses serially and builds it.
+		std::unique_ptr<dump_reader> d(
+			make_dump_reader( gz_name, FILE_FORMAT_GZIP, DUMP_FORMAT_LAMMPS ) );
+		block_data b;
+		REQUIRE( d->next_block( b ) == 0 );
+		REQUIRE( same_block( b, blocks[0] ) );
+		REQUIRE( d->seek_to_frame( 4 ) == 0 );
+		REQUIRE( d->next_block( b ) == 0 );
+		REQUIRE( same_block( b, blocks[4] ) );
+		REQUIRE( d->seek_to_timestep( 100 ) == 0 );
+		REQUIRE( d->next_block( b ) == 0 );
+		REQUIRE( same_block( b, blocks[1] ) );
+	}
+	REQUIRE( util::file_exists( idx_file ) );
+
+	// Now the index comes from the sidecar and pieces are
+	// decompressed on several threads.
+	std::unique_ptr<dump_reader_lammps> d(
+		make_dump_reader_lammps( gz_name, FILE_FORMAT_GZIP ) );
+	d->set_parse_threads( 3 );
+	block_data b;
+	for( std::size_t k = 0; k < blocks.size(); ++k ){
+		REQUIRE( d->next_block( b ) == 0 );
+		REQUIRE( same_block( b, blocks[k] ) );
+	}
+	REQUIRE( d->next_block( b ) > 0 );
+	REQUIRE( d->seek_to_frame( 3 ) == 0 );
+	REQUIRE( d->next_block( b ) == 0 );
+	REQUIRE( same_block( b, blocks[3] ) );
+	REQUIRE( d->seek_to_frame( 2 ) == 0 );
+	REQUIRE( d->next_block( b ) == 0 );
+	REQUIRE( same_block( b, blocks[2] ) );
+
+	// Back to one thread in the middle of the file.
+	d->set_parse_threads( 1 );
+	REQUIRE( d->next_block( b ) == 0 );
+	REQUIRE( same_block( b, blocks[3] ) );
+
+	std::remove( idx_file.c_str() );
+	std::remove( frame_index_file_name( gz_name ).c_str() );
+	std::remove( frame_index_file_name( fname ).c_str() );
+	std::remove( gz_name.c_str() );
+	std::remove( fname.c_str() );
+}
+#endif // HAVE_ZLIB
+
+
 TEST_CASE ( "Dump readers count correct number of blocks.", "[dump_reader_number_of_blocks]" )
 {
 	using namespace lammps_tools;
@@ -378,6 +861,11 @@ TEST_CASE ( "Setting data type explicitly works.", "[read_lammps_dump_explicit_d
 
 	const std::vector<int> &x2 = data_as<int>( b.get_special_field( block_data::X ) );
 	REQUIRE( x2[im2[127]] == 2 );
+
+	// With a prefetch thread, changing the type indexes the file.
+	r.reset();
+	std::remove( frame_index_file_name( fname ).c_str() );
+	std::remove( util::gzip_index_file_name( fname ).c_str() );
 }
 
 
@@ -416,3 +904,82 @@ TEST_CASE ( "HOOMD dump file file gets read correctly.", "[read_hoomd_gsd]" )
 	}
 
 }
+
+
+TEST_CASE ( "Triclinic boxes are read and written by the LAMMPS readers.", "[read_lammps_dump_triclinic]" )
+{
+	using namespace lammps_tools;
+	using namespace readers;
+
+	// Dump files have the bounding box and then the tilt factors.
+	std::string fname = "triclinic_test.dump";
+	{
+		std::ofstream out( fname );
+		out << "ITEM: TIMESTEP\n10\nITEM: NUMBER OF ATOMS\n2\n"
+		    << "ITEM: BOX BOUNDS xy xz yz pp ff pp\n"
+		    << "-1.0 11.0 1.5\n"
+		    << "0.0 12.0 -2.0\n"
+		    << "0.0 8.0 0.0\n"
+		    << "ITEM: ATOMS id type x y z\n"
+		    << "1 1 1.0 1.0 1.0\n2 1 2.0 3.0 4.0\n";
+	}
+	auto check_box = []( const domain &dom ){
+		REQUIRE( dom.is_triclinic() );
+		REQUIRE( dom.periodic == ( domain::BIT_X | domain::BIT_Z ) );
+		REQUIRE( dom.xy == Approx( 1.5 ) );
+		REQUIRE( dom.xz == Approx( -2.0 ) );
+		REQUIRE( dom.yz == Approx( 0.0 ) );
+		REQUIRE( dom.xlo[0] == Approx( 1.0 ) );
+		REQUIRE( dom.xhi[0] == Approx( 9.5 ) );
+		REQUIRE( dom.xlo[1] == Approx( 0.0 ) );
+		REQUIRE( dom.xhi[1] == Approx( 12.0 ) );
+		REQUIRE( dom.xlo[2] == Approx( 0.0 ) );
+		REQUIRE( dom.xhi[2] == Approx( 8.0 ) );
+	};
+
+	block_data b;
+	{
+		std::unique_ptr<dump_reader> d(
+			make_dump_reader( fname, FILE_FORMAT_PLAIN, DUMP_FORMAT_LAMMPS ) );
+		REQUIRE( d->next_block( b ) == 0 );
+	}
+	check_box( b.dom );
+
+	// Writing and reading it again gives the same box, as text...
+	writers::block_to_lammps_dump( fname, b, FILE_FORMAT_PLAIN );
+	{
+		std::unique_ptr<dump_reader> d(
+			make_dump_reader( fname, FILE_FORMAT_PLAIN, DUMP_FORMAT_LAMMPS ) );
+		block_data b2;
+		REQUIRE( d->next_block( b2 ) == 0 );
+		check_box( b2.dom );
+	}
+
+	// ...and as binary.
+	std::string bin_name = "triclinic_test.dump.bin";
+	writers::block_to_lammps_dump( bin_name, b, FILE_FORMAT_BIN );
+	{
+		std::vector<std::string> headers = { "id", "type", "x", "y", "z" };
+		std::unique_ptr<dump_reader> d(
+			make_dump_reader_lammps( bin_name, FILE_FORMAT_BIN, headers ) );
+		block_data b2;
+		REQUIRE( d->next_block( b2 ) == 0 );
+		check_box( b2.dom );
+	}
+	std::remove( fname.c_str() );
+	std::remove( bin_name.c_str() );
+
+	// Data files have the box itself, and a line with the tilt factors.
+	std::stringstream data;
+	data << "LAMMPS data file\n\n"
+	     << "1 atoms\n1 atom types\n\n"
+	     << "1.0 9.5 xlo xhi\n0.0 12.0 ylo yhi\n0.0 8.0 zlo zhi\n"
+	     << "1.5 -2.0 0.0 xy xz yz\n\n"
+	     << "Atoms # atomic\n\n1 1 1.0 1.0 1.0\n";
+	int status = -1;
+	block_data bd = block_data_from_lammps_data( data, status );
+	REQUIRE( bd.dom.xy == Approx( 1.5 ) );
+	REQUIRE( bd.dom.xz == Approx( -2.0 ) );
+	REQUIRE( bd.dom.xlo[0] == Approx( 1.0 ) );
+	REQUIRE( bd.dom.xhi[0] == Approx( 9.5 ) );
+}
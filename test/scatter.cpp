@@ -0,0 +1,189 @@
+#include <catch.hpp>
+
+#include "block_data.hpp"
+#include "block_data_access.hpp"
+#include "fast_math.hpp"
+#include "scatter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+
+TEST_CASE( "Polynomial sincos matches the library", "[sincos_poly]" )
+{
+	using namespace lammps_tools;
+
+	std::mt19937 gen( 3 );
+	std::uniform_real_distribution<double> arg( -1e4, 1e4 );
+	for( int i = 0; i < 10000; ++i ){
+		double x = i < 100 ? ( i - 50 ) * 0.25 * fast_math::pi : arg( gen );
+		double s, c;
+		fast_math::sincos_poly( x, s, c );
+		REQUIRE( s == Approx( std::sin( x ) ).margin( 1e-11 ) );
+		REQUIRE( c == Approx( std::cos( x ) ).margin( 1e-11 ) );
+	}
+}
+
+
+TEST_CASE( "Bessel function J0 matches tabulated values", "[bessel_j0]" )
+{
+	using namespace lammps_tools;
+
+	// Values from the C library j0, both sides of the switch at 13.
+	double x[]  = { 0.0, 0.5, 2.4048255576957729, 5.0, 12.0, 30.0 };
+	double J0[] = { 1.0, 0.93846980724081286, 0.0, -0.17759677131433829,
+	                0.047689310796833542, -0.086367983581040211 };
+	for( int i = 0; i < 6; ++i ){
+		REQUIRE( fast_math::bessel_j0( x[i] ) == Approx( J0[i] ).margin( 1e-11 ) );
+		REQUIRE( fast_math::bessel_j0( -x[i] ) == Approx( J0[i] ).margin( 1e-11 ) );
+	}
+
+	// The two branches meet.
+	REQUIRE( fast_math::bessel_j0( 13.0 - 1e-12 )
+	         == Approx( fast_math::bessel_j0( 13.0 ) ).margin( 1e-11 ) );
+}
+
+
+namespace {
+
+// Builds a block of N atoms at random positions in [0,L)^3, with ids in
+// reverse order.
+lammps_tools::block_data random_scatterers( int N, double L, int seed )
+{
+	using namespace lammps_tools;
+
+	std::mt19937 gen( seed );
+	std::uniform_real_distribution<double> pos( 0.0, L );
+	std::vector<int> id( N ), type( N, 1 );
+	std::vector<double> x( N ), y( N ), z( N );
+	for( int i = 0; i < N; ++i ){
+		id[i] = N - i;
+		x[i] = pos( gen );
+		y[i] = pos( gen );
+		z[i] = pos( gen );
+	}
+	block_data b( N );
+	for( int d = 0; d < 3; ++d ){
+		b.dom.xlo[d] = 0.0;
+		b.dom.xhi[d] = L;
+	}
+	b.add_field( data_field_int(   "id", id ), block_data::ID );
+	b.add_field( data_field_int( "type", type ), block_data::TYPE );
+	b.add_field( data_field_double( "x", x ), block_data::X );
+	b.add_field( data_field_double( "y", y ), block_data::Y );
+	b.add_field( data_field_double( "z", z ), block_data::Z );
+	return b;
+}
+
+
+// Rayleigh-Gans intensity summed atom by atom with the library sin/cos.
+double brute_rayleigh_gans( const lammps_tools::block_data &b, double q,
+                            const std::vector<double> &radius, double scale,
+                            double d_epsilon0, const std::vector<int> &ids,
+                            const double *n )
+{
+	using namespace lammps_tools;
+
+	const std::vector<double> &x = get_x( b );
+	const std::vector<double> &y = get_y( b );
+	const std::vector<double> &z = get_z( b );
+	const std::vector<int> &id = get_id( b );
+
+	double nn = std::sqrt( n[0]*n[0] + n[1]*n[1] + n[2]*n[2] );
+	double qdir[3] = { n[0]/nn - 1.0, n[1]/nn, n[2]/nn };
+	double qn = std::sqrt( qdir[0]*qdir[0] + qdir[1]*qdir[1]
+	                       + qdir[2]*qdir[2] );
+	double re = 0.0, im = 0.0;
+	for( int i = 0; i < b.N; ++i ){
+		if( std::find( ids.begin(), ids.end(), id[i] ) == ids.end() ) continue;
+		double R = radius[i];
+		double qR = q * R;
+		double F = qR > 0
+			? R*R*R * ( std::sin( qR ) / qR - std::cos( qR ) ) / ( qR*qR )
+			: R*R*R / 3.0;
+		double qr = q * scale * ( qdir[0]*x[i] + qdir[1]*y[i]
+		                          + qdir[2]*z[i] ) / qn;
+		re += F * std::cos( qr );
+		im -= F * std::sin( qr );
+	}
+	return d_epsilon0 * d_epsilon0 * ( re*re + im*im );
+}
+
+} // namespace
+
+
+TEST_CASE( "Rayleigh-Gans scattering sums over atoms and detectors",
+           "[rayleigh_gans]" )
+{
+	using namespace lammps_tools;
+
+	const int N = 300;
+	const double scale = 0.05;
+	block_data b = random_scatterers( N, 20.0, 11 );
+	std::vector<double> radius( N );
+	for( int i = 0; i < N; ++i ) radius[i] = 0.2 + 0.1 * ( i % 3 );
+
+	std::vector<double> qs;
+	for( int iq = 0; iq < 40; ++iq ) qs.push_back( 0.5 * iq );
+
+	// Every other atom, by id.
+	std::vector<int> ids;
+	for( int i = 1; i <= N; i += 2 ) ids.push_back( i );
+
+	std::vector<double> detectors = { 0.0, 1.0, 0.0,
+	                                  0.0, 0.0, 2.0,
+	                                  -1.0, 1.0, 1.0 };
+	std::vector<double> I = scatter::rayleigh_gans( b, qs, radius, scale,
+	                                                0.1, ids, detectors, 3 );
+	REQUIRE( I.size() == 3 * qs.size() );
+
+	for( int k = 0; k < 3; ++k ){
+		for( std::size_t iq = 0; iq < qs.size(); ++iq ){
+			double expect = brute_rayleigh_gans( b, qs[iq], radius, scale, 0.1,
+			                                     ids, detectors.data() + 3*k );
+			REQUIRE( I[k*qs.size() + iq] == Approx( expect ).epsilon( 1e-9 ) );
+		}
+	}
+
+	// The old interface is the detector along y on one thread.
+	std::vector<double> I_y = scatter::rayleigh_gans( b, qs, radius, scale,
+	                                                  0.1, ids );
+	for( std::size_t iq = 0; iq < qs.size(); ++iq ){
+		REQUIRE( I_y[iq] == Approx( I[iq] ).epsilon( 1e-9 ) );
+	}
+}
+
+
+TEST_CASE( "Rayleigh-Gans scattering with a different radius for every atom",
+           "[rayleigh_gans]" )
+{
+	using namespace lammps_tools;
+
+	const int N = 500;
+	const double scale = 0.05;
+	block_data b = random_scatterers( N, 20.0, 5 );
+	std::mt19937 gen( 17 );
+	std::uniform_real_distribution<double> rad( 0.1, 0.5 );
+	std::vector<double> radius( N );
+	for( int i = 0; i < N; ++i ) radius[i] = rad( gen );
+
+	std::vector<double> qs;
+	for( int iq = 0; iq < 25; ++iq ) qs.push_back( 0.8 * iq );
+
+	std::vector<int> ids( N );
+	for( int i = 0; i < N; ++i ) ids[i] = i + 1;
+
+	std::vector<double> detectors = { 0.0, 1.0, 0.0, 1.0, 1.0, 0.0 };
+	std::vector<double> I = scatter::rayleigh_gans( b, qs, radius, scale,
+	                                                0.1, ids, detectors, 4 );
+	REQUIRE( I.size() == 2 * qs.size() );
+	for( int k = 0; k < 2; ++k ){
+		for( std::size_t iq = 0; iq < qs.size(); ++iq ){
+			double expect = brute_rayleigh_gans( b, qs[iq], radius, scale, 0.1,
+			                                     ids, detectors.data() + 3*k );
+			REQUIRE( I[k*qs.size() + iq] == Approx( expect ).epsilon( 1e-9 ) );
+		}
+	}
+}
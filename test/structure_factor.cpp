@@ -0,0 +1,143 @@
+#include <catch.hpp>
+
+#include "block_data.hpp"
+#include "constants.hpp"
+#include "random_block.hpp"
+#include "structure_factor.hpp"
+
+#include <cmath>
+#include <complex>
+#include <vector>
+
+
+// S_ab(q) per bin, summed over the full reciprocal lattice.
+static std::vector<double> brute_sq( const lammps_tools::block_data &b,
+                                     int Nbins, double q_max, int dims,
+                                     int itype, int jtype )
+{
+	using namespace lammps_tools;
+	typedef std::complex<double> cx;
+
+	const std::vector<double> &x = data_as<double>( b.get_special_field( block_data::X ) );
+	const std::vector<double> &y = data_as<double>( b.get_special_field( block_data::Y ) );
+	const std::vector<double> &z = data_as<double>( b.get_special_field( block_data::Z ) );
+	const std::vector<int> &type = data_as<int>( b.get_special_field( block_data::TYPE ) );
+
+	// Reciprocal vectors from the cross products of the box vectors.
+	double Lx = b.dom.xhi[0], Ly = b.dom.xhi[1], Lz = b.dom.xhi[2];
+	double a[3] = { Lx, 0, 0 }, bb[3] = { b.dom.xy, Ly, 0 }, c[3] = { 0, 0, Lz };
+	double V = Lx*Ly*Lz;
+	double ra[3] = { ( bb[1]*c[2] - bb[2]*c[1] ) / V,
+	                 ( bb[2]*c[0] - bb[0]*c[2] ) / V,
+	                 ( bb[0]*c[1] - bb[1]*c[0] ) / V };
+	double rb[3] = { ( c[1]*a[2] - c[2]*a[1] ) / V,
+	                 ( c[2]*a[0] - c[0]*a[2] ) / V,
+	                 ( c[0]*a[1] - c[1]*a[0] ) / V };
+	double rc[3] = { 0, 0, 1.0 / Lz };
+
+	double Ni = 0, Nj = 0;
+	for( int t : type ){
+		Ni += !itype || t == itype;
+		Nj += !jtype || t == jtype;
+	}
+
+	double dq = q_max / Nbins;
+	std::vector<double> S( Nbins, 0.0 ), n( Nbins, 0.0 );
+	int hm = 12, lm = dims == 3 ? 12 : 0;
+	for( int h = -hm; h <= hm; ++h ){
+		for( int k = -hm; k <= hm; ++k ){
+			for( int l = -lm; l <= lm; ++l ){
+				double q[3];
+				for( int d = 0; d < 3; ++d ){
+					q[d] = constants::pi2 * ( h*ra[d] + k*rb[d] + l*rc[d] );
+				}
+				double qq = std::sqrt( q[0]*q[0] + q[1]*q[1] + q[2]*q[2] );
+				if( qq == 0 || qq >= q_max ) continue;
+
+				cx rho_i = 0.0, rho_j = 0.0;
+				for( std::size_t m = 0; m < x.size(); ++m ){
+					double qr = q[0]*x[m] + q[1]*y[m] + q[2]*z[m];
+					cx e = std::polar( 1.0, -qr );
+					if( !itype || type[m] == itype ) rho_i += e;
+					if( !jtype || type[m] == jtype ) rho_j += e;
+				}
+				int bin = qq / dq;
+				S[bin] += std::real( rho_i * std::conj( rho_j ) ) / std::sqrt( Ni*Nj );
+				n[bin] += 1.0;
+			}
+		}
+	}
+	for( int bin = 0; bin < Nbins; ++bin ){
+		if( n[bin] > 0 ) S[bin] /= n[bin];
+	}
+	return S;
+}
+
+
+TEST_CASE( "Direct structure factor matches a brute force sum", "[structure_factor]" )
+{
+	using namespace lammps_tools;
+	using fourier::structure_factor;
+
+	const double L[3] = { 6.0, 5.0, 7.0 };
+	const double tilt[3] = { 1.5, 0.0, 0.0 };
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	const int Nbins = 8;
+	const double q_max = 6.0;
+
+	for( int dims : { 2, 3 } ){
+		block_data b = random_block( 150, L, tilt, dims, all_periodic, 2,
+		                             7 + dims );
+		structure_factor sf( Nbins, q_max, dims, structure_factor::DIRECT, 3 );
+		sf.add_frame( b );
+		REQUIRE( sf.n_types() == 2 );
+
+		int pairs[4][2] = { { 0, 0 }, { 1, 1 }, { 1, 2 }, { 0, 2 } };
+		for( auto &p : pairs ){
+			std::vector<double> S = sf.sq( p[0], p[1] );
+			std::vector<double> expect = brute_sq( b, Nbins, q_max, dims,
+			                                       p[0], p[1] );
+			for( int k = 0; k < Nbins; ++k ){
+				REQUIRE( S[k] == Approx( expect[k] ).margin( 1e-9 ) );
+			}
+		}
+
+		// The same frame again does not change the average.
+		std::vector<double> once = sf.sq();
+		sf.add_frame( b );
+		REQUIRE( sf.n_frames() == 2 );
+		std::vector<double> twice = sf.sq();
+		for( int k = 0; k < Nbins; ++k ){
+			REQUIRE( twice[k] == Approx( once[k] ).margin( 1e-12 ) );
+		}
+	}
+}
+
+
+TEST_CASE( "Grid structure factor agrees with the direct sum", "[structure_factor]" )
+{
+	using namespace lammps_tools;
+	using fourier::structure_factor;
+
+	const int Nbins = 6;
+	const double q_max = 6.0;
+	int all_periodic = domain::BIT_X | domain::BIT_Y | domain::BIT_Z;
+	block_data b = random_block( 3000, 10.0, 3, all_periodic, 2, 21 );
+
+	structure_factor direct( Nbins, q_max, 3, structure_factor::DIRECT, 2 );
+	structure_factor grid( Nbins, q_max, 3, structure_factor::GRID, 2 );
+	direct.add_frame( b );
+	grid.add_frame( b );
+	for( int k = 0; k < Nbins; ++k ){
+		REQUIRE( grid.n_vectors()[k] == direct.n_vectors()[k] );
+	}
+
+	int pairs[3][2] = { { 0, 0 }, { 1, 1 }, { 1, 2 } };
+	for( auto &p : pairs ){
+		std::vector<double> S_direct = direct.sq( p[0], p[1] );
+		std::vector<double> S_grid = grid.sq( p[0], p[1] );
+		for( int k = 1; k < Nbins; ++k ){
+			REQUIRE( S_grid[k] == Approx( S_direct[k] ).margin( 0.03 ) );
+		}
+	}
+}
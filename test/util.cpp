@@ -5,6 +5,7 @@
 
 #include "block_data.hpp"
 #include "data_field.hpp"
+#include "text_parse.hpp"
 #include "util.hpp"
 #include "zip.hpp"
 
@@ -252,3 +253,40 @@ TEST_CASE( "Sorted insert works", "[util_insert_sorted]" )
 	print_vec(c);
 
 }
+
+
+
+TEST_CASE( "Text number parsers agree with strtod", "[util_text_parse]" )
+{
+	using namespace lammps_tools;
+
+	std::vector<std::string> doubles = { "0", "-0.5", "1.01284", "+3e2",
+	                                     "5.8476586675610553e-01",
+	                                     "-1.6795961913825074e+01",
+	                                     "1e-300", "123456789012345678901",
+	                                     ".25", "inf" };
+	for( const std::string &s : doubles ){
+		double val = 0.0;
+		const char *end = s.data() + s.size();
+		const char *p = util::parse_double( s.data(), end, val );
+		REQUIRE( p == end );
+		REQUIRE( val == Approx( std::strtod( s.c_str(), nullptr ) ) );
+	}
+
+	std::string line = "  12 -7 2.51939\t3 ";
+	const char *end = line.data() + line.size();
+	int a, b, c;
+	double d;
+	const char *p = util::parse_int( line.data(), end, a );
+	p = util::parse_int( p, end, b );
+	p = util::parse_int( p, end, c );
+	p = util::parse_double( p, end, d );
+	REQUIRE( a == 12 );
+	REQUIRE( b == -7 );
+	REQUIRE( c == 2 );
+	REQUIRE( d == 3.0 );
+	REQUIRE( util::skip_blanks( p, end ) == end );
+
+	std::string junk = "x12";
+	REQUIRE( util::parse_int( junk.data(), junk.data() + junk.size(), a ) == nullptr );
+}